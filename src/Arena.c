@@ -0,0 +1,93 @@
+#include "Arena.h"
+#include "ReportError.h"
+#include <stdlib.h>
+
+#define ARENA_BLOCK_SIZE (1 << 20)
+#define ARENA_ALIGNMENT 16
+
+
+struct ArenaBlock {
+    struct ArenaBlock *previous;
+    size_t capacity;
+    size_t used;
+};
+
+static size_t Align(size_t n) {
+    return (n + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+}
+
+static char *BlockData(struct ArenaBlock *block) {
+    return (char *) block + Align(sizeof(struct ArenaBlock));
+}
+
+static void AddBlock(struct Arena *a, size_t min_capacity) {
+    size_t capacity = (min_capacity > ARENA_BLOCK_SIZE) ? min_capacity : ARENA_BLOCK_SIZE;
+    struct ArenaBlock *block = (struct ArenaBlock *) malloc(Align(sizeof(struct ArenaBlock)) + capacity);
+    if (!block) {
+        ReportInternalError("out of memory");
+    }
+
+    block->previous = a->block;
+    block->capacity = capacity;
+    block->used = 0;
+    a->block = block;
+}
+
+
+//
+// ===
+// == Functions defined in Arena.h
+// ===
+//
+
+
+void *Arena_Alloc(struct Arena *a, size_t size) {
+    size = Align(size);
+    struct ArenaBlock *block = a->block;
+    if (!block || block->capacity - block->used < size) {
+        AddBlock(a, size);
+        block = a->block;
+    }
+
+    void *memory = BlockData(block) + block->used;
+    block->used += size;
+    a->num_allocations += 1;
+    a->bytes_allocated += size;
+    return memory;
+}
+
+void Arena_Free(struct Arena *a) {
+    struct ArenaBlock *block = a->block;
+    while (block) {
+        struct ArenaBlock *previous = block->previous;
+        free(block);
+        block = previous;
+    }
+
+    a->block = NULL;
+}
+
+void Arena_Init(struct Arena *a) {
+    a->block = NULL;
+    a->num_allocations = 0;
+    a->bytes_allocated = 0;
+}
+
+struct ArenaMark Arena_Mark(struct Arena *a) {
+    struct ArenaMark mark;
+    mark.block = a->block;
+    mark.used = a->block ? a->block->used : 0;
+    return mark;
+}
+
+void Arena_Release(struct Arena *a, struct ArenaMark mark) {
+    while (a->block != mark.block) {
+        struct ArenaBlock *previous = a->block->previous;
+        free(a->block);
+        a->block = previous;
+    }
+
+    if (a->block) {
+        a->block->used = mark.used;
+    }
+}
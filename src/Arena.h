@@ -0,0 +1,35 @@
+#ifndef MINIC_ARENA_H
+#define MINIC_ARENA_H
+#include <stddef.h>
+
+#define ARENA_NEW(arena, type) ((struct type *) Arena_Alloc(arena, sizeof(struct type)))
+#define ARENA_NEW_ARRAY(arena, type, count) ((type *) Arena_Alloc(arena, sizeof(type) * (count)))
+
+struct ArenaBlock;
+
+// A bump-pointer allocator. Memory is only given back all at once with Arena_Free,
+// or up to a mark with Arena_Release. The IR code generator uses the latter for the
+// scratch memory of each function: it takes a mark before emitting the function and
+// releases it when the function is done.
+struct Arena {
+    struct ArenaBlock *block;
+    size_t num_allocations;
+    size_t bytes_allocated;
+};
+
+struct ArenaMark {
+    struct ArenaBlock *block;
+    size_t used;
+};
+
+void *Arena_Alloc(struct Arena *a, size_t size);
+
+void Arena_Free(struct Arena *a);
+
+void Arena_Init(struct Arena *a);
+
+struct ArenaMark Arena_Mark(struct Arena *a);
+
+void Arena_Release(struct Arena *a, struct ArenaMark mark);
+
+#endif // MINIC_ARENA_H
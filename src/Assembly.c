@@ -1,101 +1,353 @@
 #include "Assembly.h"
+#include "Peephole.h"
+#include "ReportError.h"
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
+#define OUTPUT_INITIAL_CAPACITY (1 << 16)
+
+// Only for string literals, their length is known at compile time.
+#define EMIT(literal) EmitChars(literal, sizeof(literal) - 1)
+
+
+// All output is collected here and written with a single call in FlushOutput.
+static char *buffer;
+static size_t buffer_length;
+static size_t buffer_capacity;
 static FILE *f;
+static bool use_peephole = true;
+
+static void Reserve(size_t num_chars) {
+    if (buffer_length + num_chars <= buffer_capacity) {
+        return;
+    }
+
+    size_t capacity = (buffer_capacity > 0) ? buffer_capacity : OUTPUT_INITIAL_CAPACITY;
+    while (capacity < buffer_length + num_chars) {
+        capacity *= 2;
+    }
+
+    buffer = (char *) realloc(buffer, capacity);
+    if (!buffer) {
+        ReportInternalError("out of memory");
+    }
+
+    buffer_capacity = capacity;
+}
+
+static void EmitChars(char *chars, size_t length) {
+    Reserve(length);
+    memcpy(buffer + buffer_length, chars, length);
+    buffer_length += length;
+}
+
+
+//
+// ===
+// == Functions defined in Assembly.h
+// ===
+//
+
 
 void Add(char *destination, char *source) {
-    fprintf(f, "  add %s, %s\n", destination, source);
+    EMIT("  add ");
+    EmitString(destination);
+    EMIT(", ");
+    EmitString(source);
+    EmitChar('\n');
+}
+
+void BodyLabel(char *function) {
+    EMIT("body.");
+    EmitString(function);
+    EMIT(":\n");
 }
 
 void Call(char *label) {
-    fprintf(f, "  call %s\n", label);
+    EMIT("  call ");
+    EmitString(label);
+    EmitChar('\n');
 }
 
 void Comment(char *comment) {
-    fprintf(f, "  ; %s\n", comment);
+    EMIT("  ; ");
+    EmitString(comment);
+    EmitChar('\n');
 }
 
 void Compare(char *a, char *b, char *comparison) {
-    fprintf(f,
-        "  cmp %s, %s\n"
-        // Store comparison instruction (e.g. sete, setne, etc.) result in 'al' (Lower 8 bits of rax).
-        "  %s al\n",
-        a, b,
-        comparison
-    );
+    EMIT("  cmp ");
+    EmitString(a);
+    EMIT(", ");
+    EmitString(b);
+    EmitChar('\n');
+    // Store comparison instruction (e.g. sete, setne, etc.) result in 'al' (Lower 8 bits of rax).
+    EMIT("  ");
+    EmitString(comparison);
+    EMIT(" al\n");
 }
 
 void Div(char *operand) {
-    fprintf(f,
-        // Prepares for a signed division (convert quadword to octaword).
-        "  cqo\n"
-        // Divide rdx:rax by operand. Quotient goes to rax, remainder goes to rdx.
-        // rdx:rax means rdx for the most significant bits and rax for the least significant bits.
-        // Together, they form a single 64-bit value.
-        "  idiv %s\n",
-        operand
-    );
+    // Prepares for a signed division (convert quadword to octaword).
+    EMIT("  cqo\n");
+    // Divide rdx:rax by operand. Quotient goes to rax, remainder goes to rdx.
+    // rdx:rax means rdx for the most significant bits and rax for the least significant bits.
+    // Together, they form a single 64-bit value.
+    EMIT("  idiv ");
+    EmitString(operand);
+    EmitChar('\n');
+}
+
+void EmitChar(char c) {
+    Reserve(1);
+    buffer[buffer_length] = c;
+    buffer_length += 1;
+}
+
+void EmitInt(int value) {
+    // Digits are produced backwards, 11 characters fit any int including the sign.
+    char digits[11];
+    int num_digits = 0;
+    unsigned int magnitude = (value < 0) ? 0u - (unsigned int) value : (unsigned int) value;
+    do {
+        digits[num_digits] = (char) ('0' + magnitude % 10);
+        num_digits += 1;
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    Reserve(num_digits + 1);
+    if (value < 0) {
+        buffer[buffer_length] = '-';
+        buffer_length += 1;
+    }
+
+    while (num_digits > 0) {
+        num_digits -= 1;
+        buffer[buffer_length] = digits[num_digits];
+        buffer_length += 1;
+    }
+}
+
+void EmitString(char *str) {
+    EmitChars(str, strlen(str));
+}
+
+void FlushOutput() {
+    if (use_peephole && buffer_length > 0) {
+        size_t length = 0;
+        char *optimized = Peephole_Run(buffer, buffer_length, &length);
+        free(buffer);
+        buffer = optimized;
+        buffer_length = length;
+    }
+
+    // Unbuffered, so the whole output goes to the file (or pipe) in one write.
+    setvbuf(f, NULL, _IONBF, 0);
+    if (buffer_length > 0 && fwrite(buffer, 1, buffer_length, f) != buffer_length) {
+        ReportInternalError("could not write the assembly");
+    }
+
+    free(buffer);
+    buffer = NULL;
+    buffer_length = 0;
+    buffer_capacity = 0;
 }
 
 void Jmp(char *label) {
-    fprintf(f, "  jmp %s\n", label);
+    EMIT("  jmp ");
+    EmitString(label);
+    EmitChar('\n');
+}
+
+void JmpToBody(char *function) {
+    EMIT("  jmp body.");
+    EmitString(function);
+    EmitChar('\n');
+}
+
+void JmpToLabelId(char *label, int label_id) {
+    EMIT("  jmp ");
+    EmitString(label);
+    EmitInt(label_id);
+    EmitChar('\n');
+}
+
+void JmpToReturn(char *function) {
+    EMIT("  jmp return.");
+    EmitString(function);
+    EmitChar('\n');
+}
+
+void JumpIfZero(char *label, int label_id) {
+    EMIT("  cmp rax, 0\n  je ");
+    EmitString(label);
+    EmitInt(label_id);
+    EmitChar('\n');
 }
 
 void Label(char *name) {
-    fprintf(f, "%s:\n", name);
+    EmitString(name);
+    EMIT(":\n");
+}
+
+void LabelId(char *label, int label_id) {
+    EmitString(label);
+    EmitInt(label_id);
+    EMIT(":\n");
 }
 
 void Lea(char *dest, int rbp_offset) {
-    fprintf(f, "  lea %s, [rbp - %d]\n", dest, rbp_offset);
+    EMIT("  lea ");
+    EmitString(dest);
+    EMIT(", [rbp - ");
+    EmitInt(rbp_offset);
+    EMIT("]\n");
 }
 
 void LoadMem(enum PrimitiveType primtype) {
     if (primtype == PRIMTYPE_CHAR) {
-        fprintf(f, "  movzx rax, %s [rax]\n", size[primtype]);
+        EMIT("  movzx rax, ");
     }
     else {
-        fprintf(f, "  mov %s, %s [rax]\n", rax[primtype], size[primtype]);
+        EMIT("  mov ");
+        EmitString(rax[primtype]);
+        EMIT(", ");
     }
+
+    EmitString(size[primtype]);
+    EMIT(" [rax]\n");
 }
 
 void Mov(char *destination, char *source) {
-    fprintf(f, "  mov %s, %s\n", destination, source);
+    EMIT("  mov ");
+    EmitString(destination);
+    EMIT(", ");
+    EmitString(source);
+    EmitChar('\n');
+}
+
+void MovDataField(char *destination, int field_id) {
+    EMIT("  mov ");
+    EmitString(destination);
+    EMIT(", fmt_");
+    EmitInt(field_id);
+    EmitChar('\n');
 }
 
 void MovImm(char *destination, int value) {
-    fprintf(f, "  mov %s, %d\n", destination, value);
+    EMIT("  mov ");
+    EmitString(destination);
+    EMIT(", ");
+    EmitInt(value);
+    EmitChar('\n');
+}
+
+void Movsxd(char *destination, char *source) {
+    EMIT("  movsxd ");
+    EmitString(destination);
+    EMIT(", ");
+    EmitString(source);
+    EmitChar('\n');
+}
+
+void Movzx(char *destination, char *source) {
+    EMIT("  movzx ");
+    EmitString(destination);
+    EMIT(", ");
+    EmitString(source);
+    EmitChar('\n');
 }
 
 void Mul(char *destination, char *source) {
-    fprintf(f, "  imul %s, %s\n", destination, source);
+    EMIT("  imul ");
+    EmitString(destination);
+    EMIT(", ");
+    EmitString(source);
+    EmitChar('\n');
+}
+
+void MulImm(char *destination, int value) {
+    int shift = 0;
+    while (shift < 31 && ((unsigned int) 1 << shift) < (unsigned int) value) {
+        shift += 1;
+    }
+
+    if (value == 1) {
+        return;
+    }
+    else if (value > 0 && (value & (value - 1)) == 0) {
+        EMIT("  shl ");
+        EmitString(destination);
+        EMIT(", ");
+        EmitInt(shift);
+        EmitChar('\n');
+    }
+    else if (value == 3 || value == 5 || value == 9) {
+        EMIT("  lea ");
+        EmitString(destination);
+        EMIT(", [");
+        EmitString(destination);
+        EMIT(" + ");
+        EmitString(destination);
+        EMIT(" * ");
+        EmitInt(value - 1);
+        EMIT("]\n");
+    }
+    else {
+        EMIT("  imul ");
+        EmitString(destination);
+        EMIT(", ");
+        EmitString(destination);
+        EMIT(", ");
+        EmitInt(value);
+        EmitChar('\n');
+    }
 }
 
 void Neg(char *destination) {
-    fprintf(f, "  neg %s\n", destination);
+    EMIT("  neg ");
+    EmitString(destination);
+    EmitChar('\n');
 }
 
 void Pop(char *destination) {
-    fprintf(f, "  pop %s\n", destination);
+    EMIT("  pop ");
+    EmitString(destination);
+    EmitChar('\n');
 }
 
 void Push(char *source) {
-    fprintf(f, "  push %s\n", source);
+    EMIT("  push ");
+    EmitString(source);
+    EmitChar('\n');
 }
 
 void RestoreStackFrame() {
-    fprintf(f,
+    EMIT(
         "  mov rsp, rbp\n"
         "  pop rbp\n"
         "  ret\n"
     );
 }
 
+void ReturnLabel(char *function) {
+    EMIT("return.");
+    EmitString(function);
+    EMIT(":\n");
+}
+
 void SetOutput(FILE *file) {
     f = file;
+    buffer_length = 0;
+}
+
+void SetPeephole(bool is_enabled) {
+    use_peephole = is_enabled;
 }
 
 void SetupAssemblyFile() {
-    fprintf(f,
+    EMIT(
         // Set the assembly to use 64-bit mode.
         "bits 64\n"
         // Set the ddefault operand size to be relative.
@@ -104,28 +356,118 @@ void SetupAssemblyFile() {
     );
 }
 
+void SetupDataSection(struct List *data_fields) {
+    if (data_fields->count == 0) {
+        return;
+    }
+
+    EMIT("section .data\n");
+    for (int i = 0; i < data_fields->count; ++i) {
+        struct Expr *expr = (struct Expr *) List_Get(data_fields, i);
+        char *str = expr->str_value;
+        EMIT("  fmt_");
+        EmitInt(expr->id);
+        EMIT(": db \"");
+        for (int j = 0; str[j] != '\0'; ++j) {
+            if (str[j] == '\\') {
+                j += 1;
+                switch (str[j]) {
+                    case 'n': { EMIT("\", 10, 0"); } break;
+                }
+            }
+            else {
+                EmitChar(str[j]);
+            }
+        }
+
+        EmitChar('\n');
+    }
+}
+
 void SetupStackFrame(int stack_size) {
-    fprintf(f,
+    EMIT(
         "  push rbp\n"
         "  mov rbp, rsp\n"
     );
 
     if (stack_size > 0) {
-        fprintf(f, "  sub rsp, %d\n", stack_size);
+        EMIT("  sub rsp, ");
+        EmitInt(stack_size);
+        EmitChar('\n');
     }
 }
 
+void SetupTextSection() {
+    EMIT(
+        "\n"
+        "section .text\n"
+        "  extern printf\n"
+        // Declare the main function as the entry point of the program.
+        "  global main\n"
+        "\n"
+    );
+}
+
 void Sub(char *destination, char *source) {
-    fprintf(f, "  sub %s, %s\n", destination, source);
+    EMIT("  sub ");
+    EmitString(destination);
+    EMIT(", ");
+    EmitString(source);
+    EmitChar('\n');
+}
+
+void TailCall(char *label) {
+    EMIT(
+        "  mov rsp, rbp\n"
+        "  pop rbp\n"
+        "  jmp "
+    );
+    EmitString(label);
+    EmitChar('\n');
+}
+
+void VectorInstr(char *mnemonic, char *a, char *b, char *c) {
+    EMIT("  ");
+    EmitString(mnemonic);
+    char *operands[3] = {a, b, c};
+    for (int i = 0; i < 3 && operands[i]; ++i) {
+        EmitString((i == 0) ? " " : ", ");
+        EmitString(operands[i]);
+    }
+
+    EmitChar('\n');
+}
+
+void VectorInstrImm(char *mnemonic, char *a, char *b, int value) {
+    EMIT("  ");
+    EmitString(mnemonic);
+    EmitChar(' ');
+    EmitString(a);
+    if (b) {
+        EMIT(", ");
+        EmitString(b);
+    }
+
+    EMIT(", ");
+    EmitInt(value);
+    EmitChar('\n');
 }
 
 void WriteMemOffset(int rbp_offset, int reg_idx, enum PrimitiveType primtype) {
     assert(0 <= reg_idx && reg_idx < 4);
     char **param_reg = param_regs[reg_idx];
     char *reg = param_reg[primtype];
-    fprintf(f, "  mov [rbp - %d], %s\n", rbp_offset, reg);
+    EMIT("  mov [rbp - ");
+    EmitInt(rbp_offset);
+    EMIT("], ");
+    EmitString(reg);
+    EmitChar('\n');
 }
 
 void WriteMemToReg(char *dest, char *src) {
-    fprintf(f, "  mov [%s], %s\n", dest, src);
+    EMIT("  mov [");
+    EmitString(dest);
+    EMIT("], ");
+    EmitString(src);
+    EmitChar('\n');
 }
@@ -1,11 +1,18 @@
 #ifndef MINIC_ASSEMBLY_H
 #define MINIC_ASSEMBLY_H
 #include "Register.h"
+#include <stdbool.h>
 #include <stdio.h>
 
+// The assembly is collected in memory and written to the output set with SetOutput
+// when FlushOutput is called, after the peephole rules of Peephole_Run unless SetPeephole
+// turned them off. Integers are formatted without going through printf.
 
 void Add(char *destination, char *source);
 
+// The label after the prologue of a function, see JmpToBody.
+void BodyLabel(char *function);
+
 void Call(char *label);
 
 void Comment(char *comment);
@@ -14,20 +21,50 @@ void Compare(char *a, char *b, char *comparison);
 
 void Div(char *operand);
 
+void EmitChar(char c);
+
+void EmitInt(int value);
+
+void EmitString(char *str);
+
+void FlushOutput();
+
 void Jmp(char *label);
 
+// Jumps back to the start of the function's body with the current frame, for a call of the
+// function to itself in tail position.
+void JmpToBody(char *function);
+
+void JmpToLabelId(char *label, int label_id);
+
+void JmpToReturn(char *function);
+
+// Jumps to the label if rax is zero.
+void JumpIfZero(char *label, int label_id);
+
 void Label(char *name);
 
+void LabelId(char *label, int label_id);
+
 void Lea(char *dest, int rbp_offset);
 
 void LoadMem(enum PrimitiveType primtype);
 
 void Mov(char *destination, char *source);
 
+void MovDataField(char *destination, int field_id);
+
 void MovImm(char *destination, int value);
 
+void Movsxd(char *destination, char *source);
+
+void Movzx(char *destination, char *source);
+
 void Mul(char *destination, char *source);
 
+// Multiplies a 64-bit register by a constant with shl or lea when the constant allows it.
+void MulImm(char *destination, int value);
+
 void Neg(char *destination);
 
 void Pop(char *destination);
@@ -36,14 +73,34 @@ void Push(char *source);
 
 void RestoreStackFrame();
 
+void ReturnLabel(char *function);
+
 void SetOutput(FILE *file);
 
+void SetPeephole(bool is_enabled);
+
 void SetupAssemblyFile();
 
+// Emits the string literals (struct Expr *) as fmt_<id> data fields.
+void SetupDataSection(struct List *data_fields);
+
 void SetupStackFrame(int stack_size);
 
+void SetupTextSection();
+
 void Sub(char *destination, char *source);
 
+// Tears down the frame and jumps to the function, which returns to the caller of this one.
+// The arguments must be in registers already.
+void TailCall(char *label);
+
+// Emits an SSE or AVX instruction. Operands that are NULL are left out, so the same
+// function serves the two operand SSE forms and the three operand AVX forms.
+void VectorInstr(char *mnemonic, char *a, char *b, char *c);
+
+// Like VectorInstr, with an immediate as the last operand.
+void VectorInstrImm(char *mnemonic, char *a, char *b, int value);
+
 void WriteMemOffset(int rbp_offset, int reg_idx, enum PrimitiveType primtype);
 
 void WriteMemToReg(char *dest, char *src);
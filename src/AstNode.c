@@ -1,11 +1,15 @@
 #include "AstNode.h"
+#include "Arena.h"
 #include "ReportError.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define NEW_TYPE(type) ((struct type *) malloc(sizeof(struct type)))
+#define NEW_TYPE(type) ARENA_NEW(arena, type)
+
+
+static struct Arena *arena;
 
 static struct Expr *NewExpr(enum ExprType type) {
     struct Expr *expr = NEW_TYPE(Expr);
@@ -13,6 +17,8 @@ static struct Expr *NewExpr(enum ExprType type) {
     expr->rhs = NULL;
     expr->int_value = 0;
     expr->id = -1;
+    expr->str_value = NULL;
+    expr->declarator = NULL;
     expr->rbp_offset = 0;
     expr->type = type;
     expr->operand_type = PRIMTYPE_INVALID;
@@ -28,9 +34,13 @@ static struct Expr *NewExpr(enum ExprType type) {
 //
 
 
+void SetAstArena(struct Arena *a) {
+    arena = a;
+}
+
 struct Expr *NewFunctionCallExpr(char *identifier, struct List args) {
     struct Expr *expr = NewExpr(EXPR_FUNC_CALL);
-    strncpy(expr->str_value, identifier, TOKEN_MAX_IDENTIFIER_LENGTH);
+    expr->str_value = identifier;
     expr->args = args;
     return expr;
 }
@@ -50,13 +60,13 @@ struct Expr *NewNumberExpr(int value) {
 
 struct Expr *NewStringExpr(char *value) {
     struct Expr *expr = NewExpr(EXPR_STR);
-    strncpy(expr->str_value, value, TOKEN_MAX_IDENTIFIER_LENGTH);
+    expr->str_value = value;
     return expr;
 }
 
 struct Expr *NewVariableExpr(char *identifier) {
     struct Expr *expr = NewExpr(EXPR_VAR);
-    strncpy(expr->str_value, identifier, TOKEN_MAX_IDENTIFIER_LENGTH);
+    expr->str_value = identifier;
     return expr;
 }
 
@@ -64,6 +74,8 @@ struct Declarator *NewDeclarator() {
     struct Declarator *declarator = NEW_TYPE(Declarator);
     declarator->node.type = AST_DECLARATOR;
     declarator->value = NULL;
+    declarator->identifier = NULL;
+    declarator->type = PRIMTYPE_INVALID;
     declarator->array_dimensions = 0;
     declarator->pointer_inderection = 0;
     return declarator;
@@ -84,7 +96,7 @@ struct FunctionDef *NewFunctionDef(char *identifier, enum PrimitiveType return_t
     function->num_params = 0;
     function->stack_size = 0;
     function->return_type = return_type;
-    strncpy(function->identifier, identifier, TOKEN_MAX_IDENTIFIER_LENGTH);
+    function->identifier = identifier;
     function->body = NewCompoundStmt();
     List_Init(&function->var_decls);
     List_Init(&function->params);
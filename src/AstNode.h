@@ -40,8 +40,9 @@ struct Expr {
     enum PrimitiveType operand_type;
     enum PrimitiveType base_operand_type;
     int int_value;
-    int id; // Temporarily used for string ids
-    char str_value[TOKEN_MAX_IDENTIFIER_LENGTH];
+    int id; // Data field id of EXPR_STR (fmt_<id>), assigned by SemanticAnalysis.
+    char *str_value; // Interned, see Intern.h.
+    struct Declarator *declarator; // Resolved by SemanticAnalysis for EXPR_VAR.
     int rbp_offset;
     enum ExprType {
         EXPR_INVALID,
@@ -83,7 +84,8 @@ struct Declarator {
     int array_sizes[MAX_ARRAY_DIMENSIONS];
     int pointer_inderection;
     int rbp_offset;
-    char identifier[TOKEN_MAX_IDENTIFIER_LENGTH];
+    enum PrimitiveType type;
+    char *identifier; // Interned, see Intern.h.
 };
 
 struct VarDeclaration {
@@ -100,7 +102,7 @@ struct FunctionDef {
     enum PrimitiveType return_type;
     int num_params;
     int stack_size;
-    char identifier[TOKEN_MAX_IDENTIFIER_LENGTH];
+    char *identifier; // Interned, see Intern.h.
 };
 
 struct TranslationUnit {
@@ -154,6 +156,11 @@ struct WhileStmt {
 };
 
 
+struct Arena;
+
+// All nodes are allocated from this arena.
+void SetAstArena(struct Arena *a);
+
 struct Expr *NewFunctionCallExpr(char *identifier, struct List args);
 struct Expr *NewOperationExpr(enum ExprType type, struct Expr *lhs, struct Expr *rhs);
 struct Expr *NewNumberExpr(int value);
@@ -13,7 +13,6 @@ static void GenerateStmt(struct AstNode *stmt);
 
 static struct FunctionDef *current_func;
 static struct TranslationUnit *current_t_unit;
-static FILE *f;
 
 static int Align(int n, int offset) {
     return (n + offset - 1) / offset * offset;
@@ -26,36 +25,6 @@ static int MakeNewLabelId() {
     return label_id;
 }
 
-static struct Declarator *FindDeclarator(struct List *var_declarations, char *identifier) {
-    for (int i = 0; i < var_declarations->count; ++i) {
-        struct VarDeclaration *var_declaration = (struct VarDeclaration *) List_Get(var_declarations, i);
-        struct List *declarators = &var_declaration->declarators;
-        for (int j = 0; j < declarators->count; ++j) {
-            struct Declarator *declarator = (struct Declarator *) List_Get(declarators, j);
-            if (strcmp(declarator->identifier, identifier) == 0) {
-                return declarator;
-            }
-        }
-    }
-
-    return NULL;
-}
-
-static struct VarDeclaration *FindVarDeclaration(struct List *var_declarations, char *identifier) {
-    for (int i = 0; i < var_declarations->count; ++i) {
-        struct VarDeclaration *var_declaration = (struct VarDeclaration *) List_Get(var_declarations, i);
-        struct List *declarators = &var_declaration->declarators;
-        for (int j = 0; j < declarators->count; ++j) {
-            struct Declarator *declarator = (struct Declarator *) List_Get(declarators, j);
-            if (strcmp(declarator->identifier, identifier) == 0) {
-                return var_declaration;
-            }
-        }
-    }
-
-    return NULL;
-}
-
 static bool IsArray(struct Declarator *decl) {
     return decl->array_dimensions > 0;
 }
@@ -64,16 +33,24 @@ static bool IsPointer(struct Declarator *decl) {
     return decl->pointer_inderection > 0;
 }
 
+// Evaluates the arguments of a call into the parameter registers.
+static void GenerateArgs(struct List *args) {
+    for (int i = 0; i < args->count; ++i) {
+        struct Expr *arg = (struct Expr *) List_Get(args, i);
+        GenerateExpr(arg);
+        Push(RAX);
+    }
+
+    for (int i = args->count - 1; i >= 0; --i) {
+        char **param_reg = param_regs[i];
+        Pop(param_reg[PRIMTYPE_PTR]);
+    }
+}
+
 static void LoadAddress(struct Expr *expr) {
     // Literals
     if (expr->type == EXPR_VAR) {
-        struct List *var_decls = &current_func->var_decls;
-        struct Declarator *declarator = FindDeclarator(var_decls, expr->str_value);
-        if (!declarator) {
-            ReportInternalError("variable address of '%s'", declarator->identifier);
-        }
-
-        Lea(RAX, declarator->rbp_offset);
+        Lea(RAX, expr->declarator->rbp_offset);
         return;
     }
 
@@ -91,27 +68,18 @@ static void GenerateExpr(struct Expr *expr) {
             MovImm(RAX, expr->int_value);
         } return;
         case EXPR_STR: {
-            struct List *data_fields = &current_t_unit->data_fields;
-            for (int i = 0; i < data_fields->count; ++i) {
-                struct Expr *data_field = (struct Expr *) List_Get(data_fields, i);
-                if (strcmp(expr->str_value, data_field->str_value) == 0) {
-                    fprintf(f, "  mov rax, fmt_%d\n", data_field->id);
-                    break;
-                }
-            }
+            MovDataField(RAX, expr->id);
         } return;
         case EXPR_VAR: {
             LoadAddress(expr);
 
-            struct List *var_decls = &current_func->var_decls;
-            struct Declarator *declarator = FindDeclarator(var_decls, expr->str_value);
+            struct Declarator *declarator = expr->declarator;
             if (!IsArray(declarator)) {
-                struct VarDeclaration *var_decl = FindVarDeclaration(var_decls, expr->str_value);
                 if (IsPointer(declarator)) {
                     LoadMem(PRIMTYPE_PTR);
                 }
                 else {
-                    LoadMem(var_decl->type);
+                    LoadMem(declarator->type);
                 }
             }
         } return;
@@ -119,18 +87,7 @@ static void GenerateExpr(struct Expr *expr) {
 
     // Other operators
     if (expr->type == EXPR_FUNC_CALL) {
-        struct List *args = &expr->args;
-        for (int i = 0; i < args->count; ++i) {
-            struct Expr *arg = (struct Expr *) List_Get(args, i);
-            GenerateExpr(arg);
-            Push(RAX);
-        }
-
-        for (int i = args->count - 1; i >= 0; --i) {
-            char **param_reg = param_regs[i];
-            Pop(param_reg[PRIMTYPE_PTR]);
-        }
-
+        GenerateArgs(&expr->args);
         Call(expr->str_value);
         return;
     }
@@ -176,6 +133,14 @@ static void GenerateExpr(struct Expr *expr) {
         return;
     }
 
+    // Constant factors, such as the scaling of an array index, need no stack round trip.
+    if (expr->type == EXPR_MUL && (expr->lhs->type == EXPR_NUM || expr->rhs->type == EXPR_NUM)) {
+        struct Expr *factor = (expr->lhs->type == EXPR_NUM) ? expr->lhs : expr->rhs;
+        GenerateExpr((factor == expr->lhs) ? expr->rhs : expr->lhs);
+        MulImm(RAX, factor->int_value);
+        return;
+    }
+
     GenerateExpr(expr->rhs);
     Push(RAX);
     GenerateExpr(expr->lhs);
@@ -219,12 +184,14 @@ static void GenerateFunctionDef(struct FunctionDef *function) {
                 // While x[0] might seem like it should have the same address as x0,
                 // it's actually x[2] that shares the address with x0.
                 // The rbp_offset is calculated after considering the full array size.
+                // Pointer arithmetic steps by 8 bytes whatever the type, so that is the
+                // room every element needs.
                 int total_vars = 1;
                 for (int k = 0; k < declarator->array_dimensions; ++k) {
                     total_vars *= declarator->array_sizes[k];
                 }
 
-                offset += size_in_bytes * total_vars;
+                offset += bytes[PRIMTYPE_PTR] * total_vars;
                 declarator->rbp_offset = offset;
             }
             else if (IsPointer(declarator)) {
@@ -236,7 +203,11 @@ static void GenerateFunctionDef(struct FunctionDef *function) {
                 declarator->rbp_offset = offset;
             }
 
-            fprintf(f, "; %s: %d\n", declarator->identifier, declarator->rbp_offset);
+            EmitString("; ");
+            EmitString(declarator->identifier);
+            EmitString(": ");
+            EmitInt(declarator->rbp_offset);
+            EmitChar('\n');
         }
     }
 
@@ -246,19 +217,22 @@ static void GenerateFunctionDef(struct FunctionDef *function) {
     function->stack_size = Align(offset + shadow_space, 16);
     Label(function->identifier);
     SetupStackFrame(function->stack_size);
+    BodyLabel(function->identifier);
 
     for (int i = 0; i < function->num_params; ++i) {
         struct VarDeclaration *var_decl = (struct VarDeclaration *) List_Get(var_decls, i);
         struct Declarator *decl = (struct Declarator *) List_Get(&var_decl->declarators, 0);
 
-        fprintf(f, "  ; parameter \"%s\"\n", decl->identifier);
+        EmitString("  ; parameter \"");
+        EmitString(decl->identifier);
+        EmitString("\"\n");
         WriteMemOffset(decl->rbp_offset, i, var_decl->type);
     }
 
     GenerateCompoundStmt(function->body);
-    fprintf(f, "return.%s:\n", function->identifier);
+    ReturnLabel(function->identifier);
     RestoreStackFrame();
-    fprintf(f, "\n");
+    EmitChar('\n');
     current_func = NULL;
 }
 
@@ -292,67 +266,62 @@ static void GenerateExpressionStmt(struct ExpressionStmt *expression_stmt) {
 static void GenerateForStmt(struct ForStmt *for_stmt) {
     if (for_stmt->init_expr) GenerateExpr(for_stmt->init_expr);
     int label_id = MakeNewLabelId();
-    fprintf(f, "forstart%d:\n", label_id);
+    LabelId("forstart", label_id);
     if (for_stmt->cond_expr) GenerateExpr(for_stmt->cond_expr);
-    fprintf(f,
-        "  cmp rax, 0\n"
-        "  je forend%d\n",
-        label_id
-    );
+    JumpIfZero("forend", label_id);
 
     GenerateStmt(for_stmt->stmt);
     if (for_stmt->loop_expr) GenerateExpr(for_stmt->loop_expr);
-    fprintf(f,
-        "  jmp forstart%d\n"
-        "forend%d:\n",
-        label_id,
-        label_id
-    );
+    JmpToLabelId("forstart", label_id);
+    LabelId("forend", label_id);
 }
 
 static void GenerateIfStmt(struct IfStmt *if_stmt) {
     GenerateExpr(if_stmt->condition);
     int label_id = MakeNewLabelId();
-    fprintf(f,
-        "  cmp rax, 0\n"
-        "  je ifelse%d\n",
-        label_id
-    );
+    JumpIfZero("ifelse", label_id);
 
     GenerateStmt(if_stmt->stmt);
-    fprintf(f,
-        "  jmp ifend%d\n"
-        "ifelse%d:\n",
-        label_id,
-        label_id
-    );
+    JmpToLabelId("ifend", label_id);
+    LabelId("ifelse", label_id);
 
     if (if_stmt->else_branch) GenerateStmt(if_stmt->else_branch);
-    fprintf(f, "ifend%d:\n", label_id);
+    LabelId("ifend", label_id);
 }
 
 static void GenerateReturnStmt(struct ReturnStmt *return_stmt) {
-    if (return_stmt->expr) GenerateExpr(return_stmt->expr);
-    fprintf(f, "  jmp return.%s\n", current_func->identifier);
+    // A call in tail position reuses the frame. A call to the function itself jumps back to
+    // where the parameters are stored, any other call is jumped to once the frame is gone.
+    struct Expr *expr = return_stmt->expr;
+    if (expr && expr->type == EXPR_FUNC_CALL) {
+        GenerateArgs(&expr->args);
+        if (strcmp(expr->str_value, current_func->identifier) == 0) {
+            JmpToBody(current_func->identifier);
+        }
+        else {
+            TailCall(expr->str_value);
+        }
+
+        return;
+    }
+
+    if (expr) GenerateExpr(expr);
+    // The last statement of the function falls through to the return label.
+    struct List *body = &current_func->body->body;
+    if (body->count == 0 || List_Get(body, body->count - 1) != return_stmt) {
+        JmpToReturn(current_func->identifier);
+    }
 }
 
 static void GenerateWhileStmt(struct WhileStmt *while_stmt) {
     int label_id = MakeNewLabelId();
-    fprintf(f, "whilestart%d:\n", label_id);
+    LabelId("whilestart", label_id);
     GenerateExpr(while_stmt->condition);
-    fprintf(f,
-        "  cmp rax, 0\n"
-        "  je whileend%d\n",
-        label_id
-    );
+    JumpIfZero("whileend", label_id);
 
     GenerateStmt(while_stmt->stmt);
-    fprintf(f,
-        "  jmp whilestart%d\n"
-        "whileend%d:\n",
-        label_id,
-        label_id
-    );
+    JmpToLabelId("whilestart", label_id);
+    LabelId("whileend", label_id);
 }
 
 static void GenerateVarDeclaration(struct VarDeclaration *var_declaration) {
@@ -395,44 +364,12 @@ static void GenerateStmt(struct AstNode *stmt) {
 
 void CodeGeneratorX86_GenerateCode(FILE *asm_file, struct TranslationUnit *t_unit) {
     current_func = NULL;
-    f = asm_file;
 
     SetOutput(asm_file);
     SetupAssemblyFile();
 
-    struct List *data_fields = &t_unit->data_fields;
-    if (data_fields->count > 0) {
-        // TODO: Improve this spaghetti.
-        fprintf(f, "section .data\n");
-        for (int i = 0; i < data_fields->count; ++i) {
-            struct Expr *expr = (struct Expr *) List_Get(data_fields, i);
-            expr->id = i;
-            char *str = expr->str_value;
-            fprintf(f, "  fmt_%d: db \"", i);
-            for (int j = 0; str[j] != '\0'; ++j) {
-                if (str[j] == '\\') {
-                    j += 1;
-                    switch (str[j]) {
-                        case 'n': { fprintf(f, "\", 10, 0"); } break;
-                    }
-                }
-                else {
-                    fprintf(f, "%c", str[j]);
-                }
-            }
-
-            fprintf(f, "\n");
-        }
-    }
-
-    fprintf(f,
-        "\n"
-        "section .text\n"
-        "  extern printf\n"
-        // Declare the main function as the entry point of the program.
-        "  global main\n"
-        "\n"
-    );
-
+    SetupDataSection(&t_unit->data_fields);
+    SetupTextSection();
     GenerateTranslationUnit(t_unit);
+    FlushOutput();
 }
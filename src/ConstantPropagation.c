@@ -0,0 +1,588 @@
+#include "ConstantPropagation.h"
+#include "HashMap.h"
+#include "ReportError.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+
+static struct AstNode *FoldStmt(struct AstNode *stmt);
+static void KillAssignedInStmt(struct AstNode *stmt);
+
+
+struct Variable {
+    int index;
+    enum PrimitiveType type;
+    bool is_tracked; // Scalar whose address is never taken.
+};
+
+// What is known about the tracked variables at one point of the function.
+struct Env {
+    bool is_reachable;
+    bool *is_known;
+    int *values;
+};
+
+// What is known about one variable.
+struct Binding {
+    int index;
+    bool is_known;
+    int value;
+};
+
+static struct HashMap variables; // Declarator -> Variable
+static struct Variable *variable_pool;
+static int num_variables;
+static struct Env env;
+// Every change of env is logged with the binding it replaced, so that a branch or a loop
+// body can be undone in the time it took to fold it instead of copying env.
+static struct Binding *changes;
+static int num_changes;
+static int changes_capacity;
+static int *stamps; // Variable -> when it was last visited, see FoldIfStmt.
+static int stamp;
+
+
+static void SetVariable(int index, bool is_known, int value) {
+    if (num_changes == changes_capacity) {
+        changes_capacity = changes_capacity * 2 + 16;
+        changes = (struct Binding *) realloc(changes, sizeof(struct Binding) * changes_capacity);
+    }
+
+    changes[num_changes] = (struct Binding) {index, env.is_known[index], env.values[index]};
+    num_changes += 1;
+    env.is_known[index] = is_known;
+    env.values[index] = value;
+}
+
+// Restores env to what it was when the log had mark entries.
+static void UndoChanges(int mark) {
+    while (num_changes > mark) {
+        num_changes -= 1;
+        struct Binding *change = &changes[num_changes];
+        env.is_known[change->index] = change->is_known;
+        env.values[change->index] = change->value;
+    }
+}
+
+// Merges a binding that reaches the same join point into env.
+static void MeetVariable(int index, bool is_known, int value) {
+    if (env.is_known[index] && (!is_known || env.values[index] != value)) {
+        SetVariable(index, false, env.values[index]);
+    }
+}
+
+static struct Variable *TrackedVariable(struct Declarator *declarator) {
+    struct Variable *var = (struct Variable *) HashMap_Get(&variables, declarator);
+    return (var && var->is_tracked) ? var : NULL;
+}
+
+static void Kill(struct Declarator *declarator) {
+    struct Variable *var = TrackedVariable(declarator);
+    if (var) {
+        SetVariable(var->index, false, env.values[var->index]);
+    }
+}
+
+static struct Expr *NewConstant(long long value) {
+    struct Expr *num = NewNumberExpr((int) value);
+    num->operand_type = PRIMTYPE_INT;
+    return num;
+}
+
+static bool FitsInt(long long value) {
+    return value >= INT_MIN && value <= INT_MAX;
+}
+
+// Both back ends compute in 64-bit registers, so the result is only replaced when it
+// fits the 32-bit immediate of EXPR_NUM.
+static struct Expr *FoldBinary(struct Expr *expr) {
+    if (expr->lhs->type != EXPR_NUM || expr->rhs->type != EXPR_NUM) {
+        return expr;
+    }
+
+    long long a = expr->lhs->int_value;
+    long long b = expr->rhs->int_value;
+    long long result = 0;
+    switch (expr->type) {
+        case EXPR_EQU: { result = a == b; } break;
+        case EXPR_NEQ: { result = a != b; } break;
+        case EXPR_LT:  { result = a < b; } break;
+        case EXPR_GT:  { result = a > b; } break;
+        case EXPR_LTE: { result = a <= b; } break;
+        case EXPR_GTE: { result = a >= b; } break;
+        case EXPR_ADD: { result = a + b; } break;
+        case EXPR_SUB: { result = a - b; } break;
+        case EXPR_MUL: { result = a * b; } break;
+        case EXPR_DIV: {
+            // Division by zero is left to trap at run time.
+            if (b == 0) {
+                return expr;
+            }
+
+            result = a / b;
+        } break;
+        default: {
+            return expr;
+        }
+    }
+
+    return FitsInt(result) ? NewConstant(result) : expr;
+}
+
+// Division is kept because it traps on zero.
+static bool HasSideEffects(struct Expr *expr) {
+    if (!expr) {
+        return false;
+    }
+
+    switch (expr->type) {
+        case EXPR_FUNC_CALL:
+        case EXPR_ASSIGN:
+        case EXPR_DIV: {
+            return true;
+        }
+    }
+
+    return HasSideEffects(expr->lhs) || HasSideEffects(expr->rhs);
+}
+
+static struct Expr *FoldExpr(struct Expr *expr) {
+    switch (expr->type) {
+        case EXPR_VAR: {
+            struct Variable *var = TrackedVariable(expr->declarator);
+            if (var && env.is_known[var->index]) {
+                return NewConstant(env.values[var->index]);
+            }
+        } return expr;
+        case EXPR_FUNC_CALL: {
+            struct List *args = &expr->args;
+            for (int i = 0; i < args->count; ++i) {
+                args->data[i] = FoldExpr((struct Expr *) List_Get(args, i));
+            }
+        } return expr;
+        case EXPR_PLUS: {
+            expr->lhs = FoldExpr(expr->lhs);
+            if (expr->lhs->type == EXPR_NUM) {
+                return expr->lhs;
+            }
+        } return expr;
+        case EXPR_NEG: {
+            expr->lhs = FoldExpr(expr->lhs);
+            if (expr->lhs->type == EXPR_NUM && expr->lhs->int_value != INT_MIN) {
+                return NewConstant(-(long long) expr->lhs->int_value);
+            }
+        } return expr;
+        case EXPR_DEREF: {
+            expr->lhs = FoldExpr(expr->lhs);
+        } return expr;
+        case EXPR_ADDR: {
+            // The operand is an lvalue, only the address computation of *p can fold.
+            if (expr->lhs->type == EXPR_DEREF) {
+                expr->lhs->lhs = FoldExpr(expr->lhs->lhs);
+            }
+        } return expr;
+        case EXPR_ASSIGN: {
+            expr->rhs = FoldExpr(expr->rhs);
+            struct Expr *lhs = expr->lhs;
+            if (lhs->type == EXPR_DEREF) {
+                lhs->lhs = FoldExpr(lhs->lhs);
+                return expr;
+            }
+
+            struct Variable *var = TrackedVariable(lhs->declarator);
+            if (var) {
+                // The variable keeps only the bytes of its type; char loads zero-extend.
+                bool is_known = expr->rhs->type == EXPR_NUM;
+                long long value = expr->rhs->int_value;
+                if (var->type == PRIMTYPE_CHAR) {
+                    value = (unsigned char) value;
+                }
+
+                SetVariable(var->index, is_known, (int) value);
+            }
+        } return expr;
+        case EXPR_EQU:
+        case EXPR_NEQ:
+        case EXPR_LT:
+        case EXPR_GT:
+        case EXPR_LTE:
+        case EXPR_GTE:
+        case EXPR_ADD:
+        case EXPR_SUB:
+        case EXPR_MUL:
+        case EXPR_DIV: {
+            // Same order as the code generators: rhs first.
+            expr->rhs = FoldExpr(expr->rhs);
+            expr->lhs = FoldExpr(expr->lhs);
+        } return FoldBinary(expr);
+    }
+
+    return expr;
+}
+
+static void KillAssignedInExpr(struct Expr *expr) {
+    if (!expr) {
+        return;
+    }
+
+    if (expr->type == EXPR_ASSIGN && expr->lhs->type == EXPR_VAR) {
+        Kill(expr->lhs->declarator);
+    }
+
+    if (expr->type == EXPR_FUNC_CALL) {
+        for (int i = 0; i < expr->args.count; ++i) {
+            KillAssignedInExpr((struct Expr *) List_Get(&expr->args, i));
+        }
+    }
+
+    KillAssignedInExpr(expr->lhs);
+    KillAssignedInExpr(expr->rhs);
+}
+
+// Forgets every variable that the statement may assign, before entering a loop.
+static void KillAssignedInStmt(struct AstNode *stmt) {
+    switch (stmt->type) {
+        case AST_VAR_DECLARATION: {
+            struct List *declarators = &((struct VarDeclaration *) stmt)->declarators;
+            for (int i = 0; i < declarators->count; ++i) {
+                Kill((struct Declarator *) List_Get(declarators, i));
+            }
+        } break;
+        case AST_COMPOUND_STMT: {
+            struct List *body = &((struct CompoundStmt *) stmt)->body;
+            for (int i = 0; i < body->count; ++i) {
+                KillAssignedInStmt((struct AstNode *) List_Get(body, i));
+            }
+        } break;
+        case AST_EXPRESSION_STMT: {
+            KillAssignedInExpr(((struct ExpressionStmt *) stmt)->expr);
+        } break;
+        case AST_FOR_STMT: {
+            struct ForStmt *for_stmt = (struct ForStmt *) stmt;
+            KillAssignedInExpr(for_stmt->init_expr);
+            KillAssignedInExpr(for_stmt->cond_expr);
+            KillAssignedInExpr(for_stmt->loop_expr);
+            KillAssignedInStmt(for_stmt->stmt);
+        } break;
+        case AST_IF_STMT: {
+            struct IfStmt *if_stmt = (struct IfStmt *) stmt;
+            KillAssignedInExpr(if_stmt->condition);
+            KillAssignedInStmt(if_stmt->stmt);
+            if (if_stmt->else_branch) KillAssignedInStmt(if_stmt->else_branch);
+        } break;
+        case AST_RETURN_STMT: {
+            KillAssignedInExpr(((struct ReturnStmt *) stmt)->expr);
+        } break;
+        case AST_WHILE_STMT: {
+            struct WhileStmt *while_stmt = (struct WhileStmt *) stmt;
+            KillAssignedInExpr(while_stmt->condition);
+            KillAssignedInStmt(while_stmt->stmt);
+        } break;
+    }
+}
+
+static struct AstNode *FoldVarDeclaration(struct VarDeclaration *var_declaration) {
+    struct List *declarators = &var_declaration->declarators;
+    for (int i = 0; i < declarators->count; ++i) {
+        struct Declarator *declarator = (struct Declarator *) List_Get(declarators, i);
+        if (declarator->value) {
+            declarator->value = FoldExpr(declarator->value);
+        }
+        else {
+            Kill(declarator);
+        }
+    }
+
+    return (struct AstNode *) var_declaration;
+}
+
+static struct AstNode *FoldCompoundStmt(struct CompoundStmt *compound_stmt) {
+    struct List *body = &compound_stmt->body;
+    int count = 0;
+    for (int i = 0; i < body->count && env.is_reachable; ++i) {
+        struct AstNode *stmt = FoldStmt((struct AstNode *) List_Get(body, i));
+        if (stmt->type != AST_NULL_STMT) {
+            body->data[count] = stmt;
+            count += 1;
+        }
+    }
+
+    // Everything after a return is dropped. The frame layout comes from var_decls, so
+    // declarations can go too.
+    body->count = count;
+    return (struct AstNode *) compound_stmt;
+}
+
+static struct AstNode *FoldForStmt(struct ForStmt *for_stmt) {
+    if (for_stmt->init_expr) {
+        for_stmt->init_expr = FoldExpr(for_stmt->init_expr);
+    }
+
+    KillAssignedInExpr(for_stmt->cond_expr);
+    KillAssignedInExpr(for_stmt->loop_expr);
+    KillAssignedInStmt(for_stmt->stmt);
+    if (for_stmt->cond_expr) {
+        for_stmt->cond_expr = FoldExpr(for_stmt->cond_expr);
+        if (for_stmt->cond_expr->type == EXPR_NUM && for_stmt->cond_expr->int_value == 0) {
+            return for_stmt->init_expr ? (struct AstNode *) NewExpressionStmt(for_stmt->init_expr) : NewNullStmt();
+        }
+    }
+
+    int mark = num_changes;
+    for_stmt->stmt = FoldStmt(for_stmt->stmt);
+    if (for_stmt->loop_expr && env.is_reachable) {
+        for_stmt->loop_expr = FoldExpr(for_stmt->loop_expr);
+    }
+
+    UndoChanges(mark);
+
+    // Without a condition the loop can only be left through a return.
+    bool is_infinite = !for_stmt->cond_expr || for_stmt->cond_expr->type == EXPR_NUM;
+    env.is_reachable = !is_infinite;
+    return (struct AstNode *) for_stmt;
+}
+
+static struct AstNode *FoldIfStmt(struct IfStmt *if_stmt) {
+    if_stmt->condition = FoldExpr(if_stmt->condition);
+    if (if_stmt->condition->type == EXPR_NUM) {
+        if (if_stmt->condition->int_value != 0) {
+            return FoldStmt(if_stmt->stmt);
+        }
+
+        return if_stmt->else_branch ? FoldStmt(if_stmt->else_branch) : NewNullStmt();
+    }
+
+    int mark = num_changes;
+    bool is_reachable = env.is_reachable;
+    if_stmt->stmt = FoldStmt(if_stmt->stmt);
+
+    // Keep what the then arm left in the variables it changed, walking the log backwards so
+    // that each one is kept once, and undo the arm.
+    bool is_then_reachable = env.is_reachable;
+    struct Binding *then_bindings = (struct Binding *) malloc(sizeof(struct Binding) * (num_changes - mark + 1));
+    int num_then_bindings = 0;
+    stamp += 1;
+    for (int i = num_changes - 1; i >= mark; --i) {
+        int index = changes[i].index;
+        if (stamps[index] != stamp) {
+            stamps[index] = stamp;
+            then_bindings[num_then_bindings] = (struct Binding) {index, env.is_known[index], env.values[index]};
+            num_then_bindings += 1;
+        }
+    }
+
+    UndoChanges(mark);
+    env.is_reachable = is_reachable;
+    if (if_stmt->else_branch) {
+        if_stmt->else_branch = FoldStmt(if_stmt->else_branch);
+    }
+
+    if (!env.is_reachable) {
+        UndoChanges(mark);
+        for (int i = 0; i < num_then_bindings; ++i) {
+            SetVariable(then_bindings[i].index, then_bindings[i].is_known, then_bindings[i].value);
+        }
+
+        env.is_reachable = is_then_reachable;
+    }
+    else if (is_then_reachable) {
+        // The variables only the else arm changed still have their value from before the if
+        // in the then arm, which is the first binding the else arm replaced. The else arm
+        // used the stamps as well, so the then arm's variables are stamped again.
+        stamp += 1;
+        for (int i = 0; i < num_then_bindings; ++i) {
+            stamps[then_bindings[i].index] = stamp;
+        }
+
+        int num_else_changes = num_changes;
+        for (int i = mark; i < num_else_changes; ++i) {
+            int index = changes[i].index;
+            if (stamps[index] != stamp) {
+                stamps[index] = stamp;
+                MeetVariable(index, changes[i].is_known, changes[i].value);
+            }
+        }
+
+        for (int i = 0; i < num_then_bindings; ++i) {
+            MeetVariable(then_bindings[i].index, then_bindings[i].is_known, then_bindings[i].value);
+        }
+    }
+
+    free(then_bindings);
+    return (struct AstNode *) if_stmt;
+}
+
+static struct AstNode *FoldWhileStmt(struct WhileStmt *while_stmt) {
+    KillAssignedInExpr(while_stmt->condition);
+    KillAssignedInStmt(while_stmt->stmt);
+    while_stmt->condition = FoldExpr(while_stmt->condition);
+    if (while_stmt->condition->type == EXPR_NUM && while_stmt->condition->int_value == 0) {
+        return NewNullStmt();
+    }
+
+    int mark = num_changes;
+    while_stmt->stmt = FoldStmt(while_stmt->stmt);
+    UndoChanges(mark);
+    env.is_reachable = while_stmt->condition->type != EXPR_NUM;
+    return (struct AstNode *) while_stmt;
+}
+
+static struct AstNode *FoldStmt(struct AstNode *stmt) {
+    switch (stmt->type) {
+        case AST_VAR_DECLARATION: {
+            return FoldVarDeclaration((struct VarDeclaration *) stmt);
+        }
+        case AST_COMPOUND_STMT: {
+            return FoldCompoundStmt((struct CompoundStmt *) stmt);
+        }
+        case AST_EXPRESSION_STMT: {
+            struct ExpressionStmt *expr_stmt = (struct ExpressionStmt *) stmt;
+            expr_stmt->expr = FoldExpr(expr_stmt->expr);
+            if (!HasSideEffects(expr_stmt->expr)) {
+                return NewNullStmt();
+            }
+        } return stmt;
+        case AST_FOR_STMT: {
+            return FoldForStmt((struct ForStmt *) stmt);
+        }
+        case AST_IF_STMT: {
+            return FoldIfStmt((struct IfStmt *) stmt);
+        }
+        case AST_RETURN_STMT: {
+            struct ReturnStmt *return_stmt = (struct ReturnStmt *) stmt;
+            if (return_stmt->expr) {
+                return_stmt->expr = FoldExpr(return_stmt->expr);
+            }
+
+            env.is_reachable = false;
+        } return stmt;
+        case AST_WHILE_STMT: {
+            return FoldWhileStmt((struct WhileStmt *) stmt);
+        }
+    }
+
+    return stmt;
+}
+
+static void MarkAddressTaken(struct Expr *expr) {
+    if (!expr) {
+        return;
+    }
+
+    if (expr->type == EXPR_ADDR && expr->lhs->type == EXPR_VAR) {
+        struct Variable *var = (struct Variable *) HashMap_Get(&variables, expr->lhs->declarator);
+        if (var) {
+            var->is_tracked = false;
+        }
+    }
+
+    if (expr->type == EXPR_FUNC_CALL) {
+        for (int i = 0; i < expr->args.count; ++i) {
+            MarkAddressTaken((struct Expr *) List_Get(&expr->args, i));
+        }
+    }
+
+    MarkAddressTaken(expr->lhs);
+    MarkAddressTaken(expr->rhs);
+}
+
+static void MarkAddressTakenInStmt(struct AstNode *stmt) {
+    switch (stmt->type) {
+        case AST_VAR_DECLARATION: {
+            struct List *declarators = &((struct VarDeclaration *) stmt)->declarators;
+            for (int i = 0; i < declarators->count; ++i) {
+                MarkAddressTaken(((struct Declarator *) List_Get(declarators, i))->value);
+            }
+        } break;
+        case AST_COMPOUND_STMT: {
+            struct List *body = &((struct CompoundStmt *) stmt)->body;
+            for (int i = 0; i < body->count; ++i) {
+                MarkAddressTakenInStmt((struct AstNode *) List_Get(body, i));
+            }
+        } break;
+        case AST_EXPRESSION_STMT: {
+            MarkAddressTaken(((struct ExpressionStmt *) stmt)->expr);
+        } break;
+        case AST_FOR_STMT: {
+            struct ForStmt *for_stmt = (struct ForStmt *) stmt;
+            MarkAddressTaken(for_stmt->init_expr);
+            MarkAddressTaken(for_stmt->cond_expr);
+            MarkAddressTaken(for_stmt->loop_expr);
+            MarkAddressTakenInStmt(for_stmt->stmt);
+        } break;
+        case AST_IF_STMT: {
+            struct IfStmt *if_stmt = (struct IfStmt *) stmt;
+            MarkAddressTaken(if_stmt->condition);
+            MarkAddressTakenInStmt(if_stmt->stmt);
+            if (if_stmt->else_branch) MarkAddressTakenInStmt(if_stmt->else_branch);
+        } break;
+        case AST_RETURN_STMT: {
+            MarkAddressTaken(((struct ReturnStmt *) stmt)->expr);
+        } break;
+        case AST_WHILE_STMT: {
+            struct WhileStmt *while_stmt = (struct WhileStmt *) stmt;
+            MarkAddressTaken(while_stmt->condition);
+            MarkAddressTakenInStmt(while_stmt->stmt);
+        } break;
+    }
+}
+
+static void FoldFunctionDef(struct FunctionDef *func) {
+    num_variables = 0;
+    for (int i = 0; i < func->var_decls.count; ++i) {
+        struct VarDeclaration *var_decl = (struct VarDeclaration *) List_Get(&func->var_decls, i);
+        num_variables += var_decl->declarators.count;
+    }
+
+    HashMap_Init(&variables);
+    variable_pool = (struct Variable *) malloc(sizeof(struct Variable) * (num_variables + 1));
+    int index = 0;
+    for (int i = 0; i < func->var_decls.count; ++i) {
+        struct VarDeclaration *var_decl = (struct VarDeclaration *) List_Get(&func->var_decls, i);
+        for (int j = 0; j < var_decl->declarators.count; ++j) {
+            struct Declarator *declarator = (struct Declarator *) List_Get(&var_decl->declarators, j);
+            struct Variable *var = &variable_pool[index];
+            var->index = index;
+            var->type = declarator->type;
+            var->is_tracked = declarator->array_dimensions == 0 && declarator->pointer_inderection == 0;
+            HashMap_Put(&variables, declarator, var);
+            index += 1;
+        }
+    }
+
+    MarkAddressTakenInStmt((struct AstNode *) func->body);
+
+    // Parameters and uninitialized variables are unknown.
+    env.is_reachable = true;
+    env.is_known = (bool *) calloc(num_variables + 1, sizeof(bool));
+    env.values = (int *) calloc(num_variables + 1, sizeof(int));
+    stamps = (int *) calloc(num_variables + 1, sizeof(int));
+    stamp = 0;
+    num_changes = 0;
+    FoldCompoundStmt(func->body);
+
+    free(env.is_known);
+    free(env.values);
+    free(stamps);
+    free(variable_pool);
+    HashMap_Free(&variables);
+}
+
+
+//
+// ===
+// == Functions defined in ConstantPropagation.h
+// ===
+//
+
+
+void ConstantPropagation_Run(struct TranslationUnit *t_unit) {
+    for (int i = 0; i < t_unit->functions.count; ++i) {
+        FoldFunctionDef((struct FunctionDef *) List_Get(&t_unit->functions, i));
+    }
+
+    free(changes);
+    changes = NULL;
+    changes_capacity = 0;
+}
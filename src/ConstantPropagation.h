@@ -0,0 +1,11 @@
+#ifndef MINIC_CONSTANT_PROPAGATION_H
+#define MINIC_CONSTANT_PROPAGATION_H
+#include "AstNode.h"
+
+// Conditional constant propagation on the analyzed AST, so that it also runs at -O0.
+// Folds operators whose operands are constant, replaces reads of local variables that
+// hold a known constant, and removes if arms and loops whose condition is constant as
+// well as the statements after a return and expression statements without side effects.
+void ConstantPropagation_Run(struct TranslationUnit *t_unit);
+
+#endif // MINIC_CONSTANT_PROPAGATION_H
@@ -0,0 +1,74 @@
+#include "Dce.h"
+#include "ReportError.h"
+#include <stdlib.h>
+
+
+static void MarkUses(struct IrInstr *instr, bool *is_live, int *worklist, int *num_worklist) {
+    int *uses[64];
+    if (2 + instr->num_args > 64) {
+        ReportInternalError("Dce::MarkUses - too many arguments");
+    }
+
+    int num_uses = Ir_GetUses(instr, uses);
+    for (int i = 0; i < num_uses; ++i) {
+        int reg = *uses[i];
+        if (!is_live[reg]) {
+            is_live[reg] = true;
+            worklist[*num_worklist] = reg;
+            *num_worklist += 1;
+        }
+    }
+}
+
+
+//
+// ===
+// == Functions defined in Dce.h
+// ===
+//
+
+
+void Dce_Run(struct IrFunction *func) {
+    int num_regs = func->num_regs;
+    struct IrInstr **defs = (struct IrInstr **) calloc(num_regs, sizeof(struct IrInstr *));
+    bool *is_live = (bool *) calloc(num_regs, sizeof(bool));
+    int *worklist = (int *) malloc(sizeof(int) * num_regs);
+    int num_worklist = 0;
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->dest != IR_NO_REG) {
+                defs[instr->dest] = instr;
+            }
+
+            if (Ir_HasSideEffects(instr)) {
+                MarkUses(instr, is_live, worklist, &num_worklist);
+            }
+        }
+    }
+
+    while (num_worklist > 0) {
+        num_worklist -= 1;
+        struct IrInstr *def = defs[worklist[num_worklist]];
+        if (def) {
+            MarkUses(def, is_live, worklist, &num_worklist);
+        }
+    }
+
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (!Ir_HasSideEffects(instr) && (instr->dest == IR_NO_REG || !is_live[instr->dest])) {
+                instr->opcode = IR_NOP;
+                instr->num_args = 0;
+            }
+        }
+    }
+
+    Ir_RemoveNops(func);
+    free(defs);
+    free(is_live);
+    free(worklist);
+}
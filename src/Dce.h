@@ -0,0 +1,10 @@
+#ifndef MINIC_DCE_H
+#define MINIC_DCE_H
+#include "Ir.h"
+
+// Dead code elimination: starting from the instructions with side effects, marks every
+// register whose value they can observe, and removes the instructions (phis included)
+// that define an unmarked register. Phi cycles that only feed each other are removed too.
+void Dce_Run(struct IrFunction *func);
+
+#endif // MINIC_DCE_H
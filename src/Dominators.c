@@ -0,0 +1,154 @@
+#include "Dominators.h"
+#include <stdlib.h>
+
+
+static void ComputeReversePostOrder(struct IrFunction *func) {
+    int num_blocks = func->blocks.count;
+    for (int i = 0; i < num_blocks; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        block->rpo_index = -1;
+        block->idom = NULL;
+        block->dom_children.count = 0;
+        block->dom_enter = -1;
+        block->dom_exit = -1;
+    }
+
+    // Iterative depth-first search. next_succ tracks how many successors of each
+    // block on the stack have been visited; rpo_index doubles as the visited mark.
+    struct IrBlock **stack = (struct IrBlock **) malloc(sizeof(struct IrBlock *) * num_blocks);
+    int *next_succ = (int *) malloc(sizeof(int) * num_blocks);
+    struct IrBlock **post_order = (struct IrBlock **) malloc(sizeof(struct IrBlock *) * num_blocks);
+    int num_post_order = 0;
+    int stack_size = 1;
+    stack[0] = (struct IrBlock *) List_Get(&func->blocks, 0);
+    next_succ[0] = 0;
+    stack[0]->rpo_index = 0;
+    while (stack_size > 0) {
+        struct IrBlock *block = stack[stack_size - 1];
+        struct IrBlock *succs[2];
+        int num_succs = Ir_Successors(block, succs);
+        if (next_succ[stack_size - 1] < num_succs) {
+            struct IrBlock *succ = succs[next_succ[stack_size - 1]];
+            next_succ[stack_size - 1] += 1;
+            if (succ->rpo_index == -1) {
+                succ->rpo_index = 0;
+                stack[stack_size] = succ;
+                next_succ[stack_size] = 0;
+                stack_size += 1;
+            }
+        }
+        else {
+            post_order[num_post_order] = block;
+            num_post_order += 1;
+            stack_size -= 1;
+        }
+    }
+
+    func->rpo_blocks.count = 0;
+    for (int i = num_post_order - 1; i >= 0; --i) {
+        post_order[i]->rpo_index = func->rpo_blocks.count;
+        List_Add(&func->rpo_blocks, post_order[i]);
+    }
+
+    free(stack);
+    free(next_succ);
+    free(post_order);
+}
+
+static struct IrBlock *Intersect(struct IrBlock *a, struct IrBlock *b) {
+    while (a != b) {
+        while (a->rpo_index > b->rpo_index) {
+            a = a->idom;
+        }
+
+        while (b->rpo_index > a->rpo_index) {
+            b = b->idom;
+        }
+    }
+
+    return a;
+}
+
+// Numbers the blocks in the order a depth-first walk of the dominator tree enters and leaves
+// them, so that a dominates b exactly when a's numbers enclose b's.
+static void NumberDominatorTree(struct IrFunction *func) {
+    int num_blocks = func->rpo_blocks.count;
+    struct IrBlock **stack = (struct IrBlock **) malloc(sizeof(struct IrBlock *) * num_blocks);
+    int *next_child = (int *) malloc(sizeof(int) * num_blocks);
+    int counter = 0;
+    int stack_size = 1;
+    stack[0] = (struct IrBlock *) List_Get(&func->rpo_blocks, 0);
+    stack[0]->dom_enter = counter;
+    next_child[0] = 0;
+    counter += 1;
+    while (stack_size > 0) {
+        struct IrBlock *block = stack[stack_size - 1];
+        if (next_child[stack_size - 1] < block->dom_children.count) {
+            struct IrBlock *child = (struct IrBlock *) List_Get(&block->dom_children, next_child[stack_size - 1]);
+            next_child[stack_size - 1] += 1;
+            child->dom_enter = counter;
+            counter += 1;
+            stack[stack_size] = child;
+            next_child[stack_size] = 0;
+            stack_size += 1;
+        }
+        else {
+            block->dom_exit = counter;
+            counter += 1;
+            stack_size -= 1;
+        }
+    }
+
+    free(stack);
+    free(next_child);
+}
+
+
+//
+// ===
+// == Functions defined in Dominators.h
+// ===
+//
+
+
+void Dominators_Compute(struct IrFunction *func) {
+    ComputeReversePostOrder(func);
+
+    struct List *rpo_blocks = &func->rpo_blocks;
+    struct IrBlock *entry = (struct IrBlock *) List_Get(rpo_blocks, 0);
+    entry->idom = entry;
+    bool has_changed = true;
+    while (has_changed) {
+        has_changed = false;
+        for (int i = 1; i < rpo_blocks->count; ++i) {
+            struct IrBlock *block = (struct IrBlock *) List_Get(rpo_blocks, i);
+            struct IrBlock *new_idom = NULL;
+            for (int j = 0; j < block->preds.count; ++j) {
+                struct IrBlock *pred = (struct IrBlock *) List_Get(&block->preds, j);
+                if (pred->rpo_index == -1 || !pred->idom) {
+                    continue;
+                }
+
+                new_idom = new_idom ? Intersect(pred, new_idom) : pred;
+            }
+
+            if (block->idom != new_idom) {
+                block->idom = new_idom;
+                has_changed = true;
+            }
+        }
+    }
+
+    for (int i = 1; i < rpo_blocks->count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(rpo_blocks, i);
+        List_Add(&block->idom->dom_children, block);
+    }
+
+    // The entry has no immediate dominator, pointing it to itself was only needed above.
+    entry->idom = NULL;
+    NumberDominatorTree(func);
+}
+
+bool Dominators_Dominates(struct IrBlock *a, struct IrBlock *b) {
+    return a == b || (b->dom_enter != -1 && a->dom_enter <= b->dom_enter && b->dom_exit <= a->dom_exit);
+}
@@ -0,0 +1,15 @@
+#ifndef MINIC_DOMINATORS_H
+#define MINIC_DOMINATORS_H
+#include "Ir.h"
+#include <stdbool.h>
+
+// Computes the reverse post-order of the reachable blocks and the dominator tree, using
+// "A Simple, Fast Dominance Algorithm" by Cooper, Harvey and Kennedy. The predecessor
+// lists must be up to date. Has to be called again after the CFG changes.
+void Dominators_Compute(struct IrFunction *func);
+
+// True if every path from the entry to b goes through a. A block dominates itself.
+// Takes constant time, from the numbering of the dominator tree.
+bool Dominators_Dominates(struct IrBlock *a, struct IrBlock *b);
+
+#endif // MINIC_DOMINATORS_H
@@ -1,14 +1,59 @@
 #include "FileIO.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-void FileIO_FreeFile(struct File *f) {
-    free(f->content);
-    f->content = NULL;
-    f->length = 0;
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define READ_CHUNK_SIZE (1 << 16)
+
+
+static enum FileIOStatus ReadStream(struct File *f, FILE *stream) {
+    int64_t capacity = READ_CHUNK_SIZE;
+    int64_t length = 0;
+    char *content = (char *) malloc(capacity + 1);
+    while (content) {
+        if (capacity - length < READ_CHUNK_SIZE) {
+            capacity *= 2;
+            char *new_content = (char *) realloc(content, capacity + 1);
+            if (!new_content) {
+                break;
+            }
+
+            content = new_content;
+        }
+
+        size_t num_read = fread(content + length, sizeof(char), READ_CHUNK_SIZE, stream);
+        length += num_read;
+        if (num_read < READ_CHUNK_SIZE) {
+            if (ferror(stream)) {
+                break;
+            }
+
+            content[length] = '\0';
+            f->content = content;
+            f->length = length;
+            f->is_mapped = false;
+            return FILE_IO_SUCCESS;
+        }
+    }
+
+    free(content);
+    return FILE_IO_ERROR_UNKNOWN;
 }
 
-enum FileIOStatus FileIO_ReadFile(struct File *f, char *filename) {
+static enum FileIOStatus ReadFileWithStream(struct File *f, char *filename) {
     FILE *stream;
     int error_code = fopen_s(&stream, filename, "rb");
     if (error_code != 0) {
@@ -18,27 +63,147 @@ enum FileIOStatus FileIO_ReadFile(struct File *f, char *filename) {
         }
     }
 
-    fseek(stream, 0, SEEK_END);
-    int file_length = ftell(stream);
-    rewind(stream);
-
-    char *file_content = (char *) malloc((file_length + 1) * sizeof(char));
-    fread((void *) file_content, sizeof(char), file_length, stream);
+    enum FileIOStatus status = ReadStream(f, stream);
     fclose(stream);
+    return status;
+}
+
+#ifdef _WIN32
+
+static enum FileIOStatus MapFile(struct File *f, char *filename) {
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        switch (GetLastError()) {
+            case ERROR_FILE_NOT_FOUND:
+            case ERROR_PATH_NOT_FOUND: return FILE_IO_ERROR_FILE_NOT_FOUND;
+            default: return FILE_IO_ERROR_UNKNOWN;
+        }
+    }
+
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    LARGE_INTEGER file_size;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        return ReadFileWithStream(f, filename);
+    }
+
+    // The bytes between the end of the file and the end of its last page are zero,
+    // which gives us the '\0' sentinel for free. If the file ends exactly on a page
+    // boundary there is no such byte, so we fall back to reading it.
+    int64_t length = file_size.QuadPart;
+    if (length == 0 || length % system_info.dwPageSize == 0) {
+        CloseHandle(file);
+        return ReadFileWithStream(f, filename);
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) {
+        return ReadFileWithStream(f, filename);
+    }
+
+    // The view keeps the mapping alive, so both handles can be closed right away.
+    void *content = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (content == NULL) {
+        return ReadFileWithStream(f, filename);
+    }
+
+    f->content = (char *) content;
+    f->length = length;
+    f->is_mapped = true;
+    return FILE_IO_SUCCESS;
+}
+
+static void UnmapFile(struct File *f) {
+    UnmapViewOfFile(f->content);
+}
+
+static void SetStdinBinary() {
+    _setmode(_fileno(stdin), _O_BINARY);
+}
 
-    file_content[file_length] = '\0';
-    f->content = file_content;
-    f->length = file_length;
+#else
+
+static enum FileIOStatus MapFile(struct File *f, char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return (errno == ENOENT) ? FILE_IO_ERROR_FILE_NOT_FOUND : FILE_IO_ERROR_UNKNOWN;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        close(fd);
+        return ReadFileWithStream(f, filename);
+    }
+
+    // See the Windows version for why files ending on a page boundary are read instead.
+    int64_t length = file_stat.st_size;
+    if (length == 0 || length % sysconf(_SC_PAGESIZE) == 0) {
+        close(fd);
+        return ReadFileWithStream(f, filename);
+    }
+
+    void *content = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (content == MAP_FAILED) {
+        return ReadFileWithStream(f, filename);
+    }
+
+    madvise(content, length, MADV_SEQUENTIAL);
+    f->content = (char *) content;
+    f->length = length;
+    f->is_mapped = true;
     return FILE_IO_SUCCESS;
 }
 
+static void UnmapFile(struct File *f) {
+    munmap(f->content, f->length);
+}
+
+static void SetStdinBinary() {
+}
+
+#endif
+
+
+//
+// ===
+// == Functions defined in FileIO.h
+// ===
+//
+
+
+void FileIO_FreeFile(struct File *f) {
+    if (f->is_mapped) {
+        UnmapFile(f);
+    }
+    else {
+        free(f->content);
+    }
+
+    f->content = NULL;
+    f->length = 0;
+    f->is_mapped = false;
+}
+
+enum FileIOStatus FileIO_ReadFile(struct File *f, char *filename) {
+    if (strcmp(filename, "-") == 0) {
+        SetStdinBinary();
+        return ReadStream(f, stdin);
+    }
+
+    return MapFile(f, filename);
+}
+
 enum FileIOStatus FileIO_SaveFile(struct File *f, char *filename) {
     FILE *stream;
     if (fopen_s(&stream, filename, "wb") != 0) {
         return FILE_IO_ERROR_UNKNOWN;
     }
 
-    fprintf(stream, f->content);
+    fwrite(f->content, sizeof(char), f->length, stream);
     fclose(stream);
     return FILE_IO_SUCCESS;
 }
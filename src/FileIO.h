@@ -1,9 +1,14 @@
 #ifndef MINIC_FILE_IO_H
 #define MINIC_FILE_IO_H
+#include <stdbool.h>
+#include <stdint.h>
 
+// The content of a file read with FileIO_ReadFile is always followed by a '\0'
+// sentinel, so it is safe to peek one character past the end of the file.
 struct File {
     char *content;
-    int length;
+    int64_t length;
+    bool is_mapped;
 };
 
 enum FileIOStatus {
@@ -14,6 +19,8 @@ enum FileIOStatus {
 
 void FileIO_FreeFile(struct File *f);
 
+// Maps the file read-only into memory when possible. Pipes, stdin (filename "-")
+// and files whose size leaves no room for the sentinel are read into a buffer instead.
 enum FileIOStatus FileIO_ReadFile(struct File *f, char *filename);
 
 enum FileIOStatus FileIO_SaveFile(struct File *f, char *filename);
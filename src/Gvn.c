@@ -0,0 +1,263 @@
+#include "Gvn.h"
+#include "ReportError.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct ValueKey {
+    enum IrOpcode opcode;
+    enum PrimitiveType type;
+    int a;
+    int b;
+    int imm;
+    int memory_version; // Only used by loads.
+};
+
+struct ValueEntry {
+    struct ValueKey key;
+    int reg; // IR_NO_REG if the entry is empty.
+};
+
+// An entry as it was before the current scope changed it.
+struct UndoEntry {
+    int index;
+    struct ValueEntry old_entry;
+};
+
+static struct IrFunction *current_func;
+static struct ValueEntry *table;
+static int table_capacity;
+static struct UndoEntry *undo_log;
+static int num_undo_log;
+static int *replacements; // Register -> register it was replaced with
+static int memory_version;
+
+
+static int Resolve(int reg) {
+    while (replacements[reg] != IR_NO_REG) {
+        reg = replacements[reg];
+    }
+
+    return reg;
+}
+
+static bool IsCommutative(enum IrOpcode opcode) {
+    switch (opcode) {
+        case IR_ADD:
+        case IR_MUL:
+        case IR_EQU:
+        case IR_NEQ: {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool IsNumbered(enum IrOpcode opcode) {
+    switch (opcode) {
+        case IR_CONST:
+        case IR_CAST:
+        case IR_NEG:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        // A division can only trap if the same division before it has not.
+        case IR_DIV:
+        case IR_EQU:
+        case IR_NEQ:
+        case IR_LT:
+        case IR_GT:
+        case IR_LTE:
+        case IR_GTE:
+        case IR_SLOT_ADDR:
+        case IR_DATA_ADDR:
+        case IR_LOAD:
+        case IR_LOAD_SLOT: {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool KeysEqual(struct ValueKey *x, struct ValueKey *y) {
+    return x->opcode == y->opcode && x->type == y->type && x->a == y->a && x->b == y->b
+        && x->imm == y->imm && x->memory_version == y->memory_version;
+}
+
+static int IndexOf(struct ValueKey *key) {
+    uint64_t hash = (uint64_t) key->opcode;
+    hash = hash * 31 + (uint64_t) key->type;
+    hash = hash * 31 + (uint64_t) key->a;
+    hash = hash * 31 + (uint64_t) key->b;
+    hash = hash * 31 + (uint64_t) key->imm;
+    hash = hash * 31 + (uint64_t) key->memory_version;
+    hash *= 11400714819323198485ull;
+    int index = (int) (hash >> 32) & (table_capacity - 1);
+    while (table[index].reg != IR_NO_REG && !KeysEqual(&table[index].key, key)) {
+        index = (index + 1) & (table_capacity - 1);
+    }
+
+    return index;
+}
+
+static void Insert(int index, struct ValueKey *key, int reg) {
+    undo_log[num_undo_log].index = index;
+    undo_log[num_undo_log].old_entry = table[index];
+    num_undo_log += 1;
+    table[index].key = *key;
+    table[index].reg = reg;
+}
+
+static void NumberInstr(struct IrInstr *instr) {
+    int *uses[64];
+    if (2 + instr->num_args > 64) {
+        ReportInternalError("Gvn::NumberInstr - too many arguments");
+    }
+
+    int num_uses = Ir_GetUses(instr, uses);
+    for (int i = 0; i < num_uses; ++i) {
+        *uses[i] = Resolve(*uses[i]);
+    }
+
+    if (instr->opcode == IR_STORE || instr->opcode == IR_STORE_SLOT || instr->opcode == IR_VSTORE || instr->opcode == IR_CALL) {
+        memory_version += 1;
+        return;
+    }
+
+    if (instr->opcode == IR_COPY) {
+        replacements[instr->dest] = instr->a;
+        instr->opcode = IR_NOP;
+        return;
+    }
+
+    // A phi that merges one value, apart from itself, is that value.
+    if (instr->opcode == IR_PHI) {
+        int value = IR_NO_REG;
+        for (int i = 0; i < instr->num_args; ++i) {
+            int arg = instr->args[i];
+            if (arg == instr->dest || arg == value) {
+                continue;
+            }
+
+            if (value != IR_NO_REG) {
+                return;
+            }
+
+            value = arg;
+        }
+
+        if (value != IR_NO_REG) {
+            replacements[instr->dest] = value;
+            instr->opcode = IR_NOP;
+            instr->num_args = 0;
+        }
+
+        return;
+    }
+
+    if (!IsNumbered(instr->opcode)) {
+        return;
+    }
+
+    struct ValueKey key;
+    key.opcode = instr->opcode;
+    key.type = instr->type;
+    key.a = instr->a;
+    key.b = instr->b;
+    key.imm = instr->imm;
+    key.memory_version = (instr->opcode == IR_LOAD || instr->opcode == IR_LOAD_SLOT) ? memory_version : 0;
+    if (IsCommutative(instr->opcode) && key.a > key.b) {
+        key.a = instr->b;
+        key.b = instr->a;
+    }
+
+    int index = IndexOf(&key);
+    if (table[index].reg != IR_NO_REG) {
+        replacements[instr->dest] = table[index].reg;
+        instr->opcode = IR_NOP;
+        return;
+    }
+
+    Insert(index, &key, instr->dest);
+}
+
+static void NumberBlock(struct IrBlock *block) {
+    // Memory may have been changed on another path into the block.
+    memory_version += 1;
+    for (int i = 0; i < block->instrs.count; ++i) {
+        NumberInstr((struct IrInstr *) List_Get(&block->instrs, i));
+    }
+}
+
+
+//
+// ===
+// == Functions defined in Gvn.h
+// ===
+//
+
+
+void Gvn_Run(struct IrFunction *func) {
+    current_func = func;
+    int num_instrs = 0;
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        num_instrs += block->instrs.count;
+    }
+
+    table_capacity = 16;
+    while (table_capacity < num_instrs * 2) {
+        table_capacity *= 2;
+    }
+
+    table = (struct ValueEntry *) calloc(table_capacity, sizeof(struct ValueEntry));
+    undo_log = (struct UndoEntry *) malloc(sizeof(struct UndoEntry) * (num_instrs + 1));
+    num_undo_log = 0;
+    replacements = (int *) calloc(func->num_regs, sizeof(int));
+    memory_version = 0;
+
+    // Walks the dominator tree depth first. Each block is on the stack twice: once to
+    // number it and once, after its children, to undo the entries it added.
+    int num_blocks = func->rpo_blocks.count;
+    struct IrBlock **stack = (struct IrBlock **) malloc(sizeof(struct IrBlock *) * num_blocks * 2);
+    int *undo_marks = (int *) malloc(sizeof(int) * num_blocks * 2);
+    int stack_size = 1;
+    stack[0] = (struct IrBlock *) List_Get(&func->rpo_blocks, 0);
+    undo_marks[0] = -1;
+    while (stack_size > 0) {
+        stack_size -= 1;
+        struct IrBlock *block = stack[stack_size];
+        int undo_mark = undo_marks[stack_size];
+        if (undo_mark >= 0) {
+            while (num_undo_log > undo_mark) {
+                num_undo_log -= 1;
+                table[undo_log[num_undo_log].index] = undo_log[num_undo_log].old_entry;
+            }
+
+            continue;
+        }
+
+        stack[stack_size] = block;
+        undo_marks[stack_size] = num_undo_log;
+        stack_size += 1;
+        NumberBlock(block);
+        for (int i = block->dom_children.count - 1; i >= 0; --i) {
+            stack[stack_size] = (struct IrBlock *) List_Get(&block->dom_children, i);
+            undo_marks[stack_size] = -1;
+            stack_size += 1;
+        }
+    }
+
+    // Uses in phis of loop headers can be numbered before their definition was replaced.
+    Ir_ReplaceRegs(func, replacements);
+    Ir_RemoveNops(func);
+    free(stack);
+    free(undo_marks);
+    free(table);
+    free(undo_log);
+    free(replacements);
+    current_func = NULL;
+}
@@ -0,0 +1,13 @@
+#ifndef MINIC_GVN_H
+#define MINIC_GVN_H
+#include "Ir.h"
+
+// Dominator-based value numbering (Briggs, Cooper and Simpson): walks the dominator
+// tree with a scoped hash table, so that an instruction is replaced by an equivalent one
+// in a dominating block. Commutative operands are ordered before hashing. Loads are only
+// reused within a block when no store or call lies between them. Phis whose arguments
+// are all the same value, apart from the phi itself, are replaced by it.
+// Dominators_Compute must have been run.
+void Gvn_Run(struct IrFunction *func);
+
+#endif // MINIC_GVN_H
@@ -0,0 +1,79 @@
+#include "HashMap.h"
+#include "ReportError.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define HASH_MAP_INITIAL_CAPACITY 16
+
+
+static int IndexOf(struct HashMap *m, void *key) {
+    // Fibonacci hashing spreads the aligned, and therefore similar, addresses.
+    uint64_t hash = ((uint64_t) (uintptr_t) key) * 11400714819323198485ull;
+    int index = (int) (hash >> 32) & (m->capacity - 1);
+    while (m->entries[index].key && m->entries[index].key != key) {
+        index = (index + 1) & (m->capacity - 1);
+    }
+
+    return index;
+}
+
+static void Reallocate(struct HashMap *m, int capacity) {
+    struct HashMapEntry *old_entries = m->entries;
+    int old_capacity = m->capacity;
+    m->entries = (struct HashMapEntry *) calloc(capacity, sizeof(struct HashMapEntry));
+    m->capacity = capacity;
+    if (!m->entries) {
+        ReportInternalError("out of memory");
+    }
+
+    for (int i = 0; i < old_capacity; ++i) {
+        if (old_entries[i].key) {
+            m->entries[IndexOf(m, old_entries[i].key)] = old_entries[i];
+        }
+    }
+
+    free(old_entries);
+}
+
+
+//
+// ===
+// == Functions defined in HashMap.h
+// ===
+//
+
+
+void HashMap_Free(struct HashMap *m) {
+    free(m->entries);
+    m->entries = NULL;
+    m->capacity = 0;
+    m->count = 0;
+}
+
+void *HashMap_Get(struct HashMap *m, void *key) {
+    if (m->count == 0) {
+        return NULL;
+    }
+
+    return m->entries[IndexOf(m, key)].value;
+}
+
+void HashMap_Init(struct HashMap *m) {
+    m->entries = NULL;
+    m->capacity = 0;
+    m->count = 0;
+}
+
+void HashMap_Put(struct HashMap *m, void *key, void *value) {
+    if ((m->count + 1) * 2 > m->capacity) {
+        Reallocate(m, m->capacity ? m->capacity * 2 : HASH_MAP_INITIAL_CAPACITY);
+    }
+
+    struct HashMapEntry *entry = &m->entries[IndexOf(m, key)];
+    if (!entry->key) {
+        entry->key = key;
+        m->count += 1;
+    }
+
+    entry->value = value;
+}
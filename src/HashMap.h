@@ -0,0 +1,29 @@
+#ifndef MINIC_HASH_MAP_H
+#define MINIC_HASH_MAP_H
+#include <stdbool.h>
+
+// Maps pointers to pointers. Keys are compared by address, which makes it a good fit
+// for interned strings and AST nodes. NULL is not a valid key.
+
+struct HashMapEntry {
+    void *key;
+    void *value;
+};
+
+struct HashMap {
+    struct HashMapEntry *entries;
+    int capacity;
+    int count;
+};
+
+void HashMap_Free(struct HashMap *m);
+
+// Returns NULL if the key is not in the map.
+void *HashMap_Get(struct HashMap *m, void *key);
+
+void HashMap_Init(struct HashMap *m);
+
+// Inserts the key, or replaces its value if it is already in the map.
+void HashMap_Put(struct HashMap *m, void *key, void *value);
+
+#endif // MINIC_HASH_MAP_H
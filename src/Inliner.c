@@ -0,0 +1,352 @@
+#include "Inliner.h"
+#include <stdlib.h>
+
+// A call costs a call and the prologue and epilogue of the callee, one instruction each,
+// and moving every argument into its register.
+#define CALL_BENEFIT 3
+#define CONSTANT_ARGUMENT_BENEFIT 2
+
+
+struct CallGraphNode {
+    struct IrFunction *func;
+    struct List callees;
+    bool is_visited;
+};
+
+struct InlineContext {
+    struct IrFunction *func;
+    struct IrInstr *call;
+    int *regs; // Callee register -> caller register
+    struct IrBlock **blocks; // Callee block id -> copy in the caller
+    int *slots; // Callee slot -> caller slot
+};
+
+
+static int *CopyArgs(struct InlineContext *context, int *args, int num_args) {
+    int *copy = ARENA_NEW_ARRAY(context->func->arena, int, num_args);
+    for (int i = 0; i < num_args; ++i) {
+        copy[i] = context->regs[args[i]];
+    }
+
+    return copy;
+}
+
+// Counts the instructions that remain when the body is inlined, up to max_cost + 1.
+static int CountCost(struct IrFunction *callee, int max_cost) {
+    int cost = 0;
+    for (int i = 0; i < callee->blocks.count && cost <= max_cost; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&callee->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            switch (instr->opcode) {
+                case IR_NOP:
+                case IR_PARAM:
+                case IR_PHI:
+                case IR_RETURN: {
+                } break;
+                default: {
+                    cost += 1;
+                } break;
+            }
+        }
+    }
+
+    return cost;
+}
+
+static bool *FindConsts(struct IrFunction *func) {
+    bool *is_const = (bool *) calloc(func->num_regs, sizeof(bool));
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            is_const[instr->dest] = instr->opcode == IR_CONST;
+        }
+    }
+
+    return is_const;
+}
+
+static bool ShouldInline(struct IrFunction *func, struct IrInstr *call, struct IrFunction *callee, bool *is_const, int inline_limit) {
+    struct IrBlock *entry = (struct IrBlock *) List_Get(&callee->blocks, 0);
+    if (callee == func || call->num_args != callee->num_params || entry->preds.count != 0) {
+        return false;
+    }
+
+    int benefit = CALL_BENEFIT + call->num_args;
+    for (int i = 0; i < call->num_args; ++i) {
+        if (is_const[call->args[i]]) {
+            benefit += CONSTANT_ARGUMENT_BENEFIT;
+        }
+    }
+
+    int max_cost = inline_limit + benefit;
+    return CountCost(callee, max_cost) <= max_cost;
+}
+
+static void CopyInstr(struct InlineContext *context, struct IrInstr *instr, struct IrBlock *copy) {
+    struct IrInstr *new_instr = Ir_AddInstr(context->func, copy, instr->opcode);
+    *new_instr = *instr;
+    new_instr->dest = context->regs[instr->dest];
+    new_instr->a = context->regs[instr->a];
+    new_instr->b = context->regs[instr->b];
+    if (instr->num_args > 0) {
+        new_instr->args = CopyArgs(context, instr->args, instr->num_args);
+    }
+
+    if (instr->target) {
+        new_instr->target = context->blocks[instr->target->id];
+    }
+
+    if (instr->target2) {
+        new_instr->target2 = context->blocks[instr->target2->id];
+    }
+
+    switch (instr->opcode) {
+        case IR_PARAM: {
+            new_instr->opcode = IR_COPY;
+            new_instr->a = context->call->args[instr->imm];
+            new_instr->imm = 0;
+        } break;
+        case IR_SLOT_ADDR:
+        case IR_LOAD_SLOT:
+        case IR_STORE_SLOT: {
+            new_instr->imm = context->slots[instr->imm];
+        } break;
+    }
+}
+
+// Splits the block after the call, copies the callee's blocks in between and returns the
+// block with the rest of the caller's instructions. The new blocks are added to blocks.
+static struct IrBlock *InlineCall(struct IrFunction *func, struct IrBlock *block, int call_index, struct IrFunction *callee, struct List *blocks) {
+    struct InlineContext context;
+    context.func = func;
+    context.call = (struct IrInstr *) List_Get(&block->instrs, call_index);
+    context.regs = (int *) calloc(callee->num_regs, sizeof(int));
+    context.blocks = (struct IrBlock **) calloc(callee->num_block_ids, sizeof(struct IrBlock *));
+    context.slots = (int *) calloc(callee->slots.count + 1, sizeof(int));
+    for (int i = 0; i < callee->slots.count; ++i) {
+        struct IrSlot *slot = (struct IrSlot *) List_Get(&callee->slots, i);
+        if (!slot->is_promoted) {
+            struct IrSlot *new_slot = Ir_AddSlot(func, slot->name, slot->size, slot->type);
+            new_slot->is_address_taken = slot->is_address_taken;
+            context.slots[i] = new_slot->id;
+        }
+    }
+
+    struct IrBlock *rest = Ir_NewBlock(func);
+    for (int i = call_index + 1; i < block->instrs.count; ++i) {
+        List_Add(&rest->instrs, List_Get(&block->instrs, i));
+    }
+
+    block->instrs.count = call_index;
+    struct IrBlock *succs[2];
+    int num_succs = Ir_Successors(rest, succs);
+    for (int i = 0; i < num_succs; ++i) {
+        struct List *preds = &succs[i]->preds;
+        for (int j = 0; j < preds->count; ++j) {
+            if (List_Get(preds, j) == block) {
+                preds->data[j] = rest;
+            }
+        }
+    }
+
+    for (int i = 0; i < callee->blocks.count; ++i) {
+        struct IrBlock *callee_block = (struct IrBlock *) List_Get(&callee->blocks, i);
+        context.blocks[callee_block->id] = Ir_NewBlock(func);
+        List_Add(blocks, context.blocks[callee_block->id]);
+        for (int j = 0; j < callee_block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&callee_block->instrs, j);
+            if (instr->dest != IR_NO_REG) {
+                context.regs[instr->dest] = Ir_NewReg(func);
+            }
+        }
+    }
+
+    // Returns become jumps to the rest of the block, which picks the returned value.
+    int *return_values = (int *) malloc(sizeof(int) * callee->blocks.count);
+    int num_returns = 0;
+    for (int i = 0; i < callee->blocks.count; ++i) {
+        struct IrBlock *callee_block = (struct IrBlock *) List_Get(&callee->blocks, i);
+        struct IrBlock *copy = context.blocks[callee_block->id];
+        for (int j = 0; j < callee_block->preds.count; ++j) {
+            struct IrBlock *pred = (struct IrBlock *) List_Get(&callee_block->preds, j);
+            List_Add(&copy->preds, context.blocks[pred->id]);
+        }
+
+        for (int j = 0; j < callee_block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&callee_block->instrs, j);
+            if (instr->opcode != IR_RETURN) {
+                CopyInstr(&context, instr, copy);
+                continue;
+            }
+
+            int value = context.regs[instr->a];
+            if (value == IR_NO_REG) {
+                struct IrInstr *zero = Ir_AddInstr(func, copy, IR_CONST);
+                zero->dest = Ir_NewReg(func);
+                value = zero->dest;
+            }
+
+            struct IrInstr *jump = Ir_AddInstr(func, copy, IR_JUMP);
+            jump->target = rest;
+            List_Add(&rest->preds, copy);
+            return_values[num_returns] = value;
+            num_returns += 1;
+        }
+    }
+
+    struct IrBlock *entry_copy = context.blocks[((struct IrBlock *) List_Get(&callee->blocks, 0))->id];
+    List_Add(&entry_copy->preds, block);
+    struct IrInstr *jump = Ir_AddInstr(func, block, IR_JUMP);
+    jump->target = entry_copy;
+
+    // The phi, or the copy when there is a single return, takes the call's place. A callee
+    // that never returns leaves the rest unreachable.
+    struct IrInstr *result = context.call;
+    result->name = NULL;
+    result->num_args = 0;
+    result->args = NULL;
+    if (num_returns == 0) {
+        result->opcode = IR_CONST;
+        result->imm = 0;
+    }
+    else if (num_returns == 1) {
+        result->opcode = IR_COPY;
+        result->a = return_values[0];
+    }
+    else {
+        result->opcode = IR_PHI;
+        result->num_args = num_returns;
+        result->args = ARENA_NEW_ARRAY(func->arena, int, num_returns);
+        for (int i = 0; i < num_returns; ++i) {
+            result->args[i] = return_values[i];
+        }
+    }
+
+    List_Add(&rest->instrs, NULL);
+    for (int i = rest->instrs.count - 1; i > 0; --i) {
+        rest->instrs.data[i] = rest->instrs.data[i - 1];
+    }
+
+    rest->instrs.data[0] = result;
+    List_Add(blocks, rest);
+    free(return_values);
+    free(context.regs);
+    free(context.blocks);
+    free(context.slots);
+    return rest;
+}
+
+
+//
+// ===
+// == Functions defined in Inliner.h
+// ===
+//
+
+
+bool Inliner_Run(struct IrFunction *func, struct HashMap *callees, int inline_limit) {
+    if (inline_limit <= 0) {
+        return false;
+    }
+
+    // Only the caller's own calls are considered, so the registers are all known here.
+    bool *is_const = FindConsts(func);
+    struct List blocks;
+    List_Init(&blocks);
+    bool has_inlined = false;
+    int num_blocks = func->blocks.count;
+    for (int i = 0; i < num_blocks; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        List_Add(&blocks, block);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->opcode != IR_CALL) {
+                continue;
+            }
+
+            struct IrFunction *callee = (struct IrFunction *) HashMap_Get(callees, instr->name);
+            if (callee && ShouldInline(func, instr, callee, is_const, inline_limit)) {
+                // The rest of the block is searched for calls from its start.
+                block = InlineCall(func, block, j, callee, &blocks);
+                j = 0;
+                has_inlined = true;
+            }
+        }
+    }
+
+    List_Free(&func->blocks);
+    func->blocks = blocks;
+    free(is_const);
+    return has_inlined;
+}
+
+void Inliner_SortBottomUp(struct IrProgram *program, struct List *order) {
+    struct List *functions = &program->functions;
+    struct CallGraphNode *nodes = (struct CallGraphNode *) malloc(sizeof(struct CallGraphNode) * (functions->count + 1));
+    struct HashMap node_of_name;
+    HashMap_Init(&node_of_name);
+    for (int i = 0; i < functions->count; ++i) {
+        struct IrFunction *func = (struct IrFunction *) List_Get(functions, i);
+        nodes[i].func = func;
+        nodes[i].is_visited = false;
+        List_Init(&nodes[i].callees);
+        HashMap_Put(&node_of_name, func->name, &nodes[i]);
+    }
+
+    for (int i = 0; i < functions->count; ++i) {
+        struct IrFunction *func = nodes[i].func;
+        for (int j = 0; j < func->blocks.count; ++j) {
+            struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, j);
+            for (int k = 0; k < block->instrs.count; ++k) {
+                struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, k);
+                struct CallGraphNode *callee = (instr->opcode == IR_CALL) ? (struct CallGraphNode *) HashMap_Get(&node_of_name, instr->name) : NULL;
+                if (callee) {
+                    List_Add(&nodes[i].callees, callee);
+                }
+            }
+        }
+    }
+
+    // Iterative depth-first search, a function is added when all its callees are done.
+    struct CallGraphNode **stack = (struct CallGraphNode **) malloc(sizeof(struct CallGraphNode *) * (functions->count + 1));
+    int *next_callee = (int *) malloc(sizeof(int) * (functions->count + 1));
+    for (int i = 0; i < functions->count; ++i) {
+        if (nodes[i].is_visited) {
+            continue;
+        }
+
+        int num_stack = 1;
+        stack[0] = &nodes[i];
+        next_callee[0] = 0;
+        nodes[i].is_visited = true;
+        while (num_stack > 0) {
+            struct CallGraphNode *node = stack[num_stack - 1];
+            int *next = &next_callee[num_stack - 1];
+            if (*next == node->callees.count) {
+                List_Add(order, node->func);
+                num_stack -= 1;
+                continue;
+            }
+
+            struct CallGraphNode *callee = (struct CallGraphNode *) List_Get(&node->callees, *next);
+            *next += 1;
+            if (!callee->is_visited) {
+                callee->is_visited = true;
+                stack[num_stack] = callee;
+                next_callee[num_stack] = 0;
+                num_stack += 1;
+            }
+        }
+    }
+
+    for (int i = 0; i < functions->count; ++i) {
+        List_Free(&nodes[i].callees);
+    }
+
+    HashMap_Free(&node_of_name);
+    free(stack);
+    free(next_callee);
+    free(nodes);
+}
@@ -0,0 +1,22 @@
+#ifndef MINIC_INLINER_H
+#define MINIC_INLINER_H
+#include "HashMap.h"
+#include "Ir.h"
+#include "List.h"
+#include <stdbool.h>
+
+#define INLINER_DEFAULT_LIMIT 20
+
+// Replaces calls to the functions in callees (interned name -> struct IrFunction *) by a
+// copy of their body when it is cheap enough. The cost of a body is the number of its
+// instructions, minus what the call would have cost and a bonus for every constant
+// argument, which the caller's constant propagation folds into the copy. Bodies whose cost
+// is at most inline_limit are inlined, 0 turns inlining off. Calls that come from an
+// inlined body are not inlined again. Returns true if any call was inlined.
+bool Inliner_Run(struct IrFunction *func, struct HashMap *callees, int inline_limit);
+
+// Orders the functions so that callees come before their callers. Within a cycle of
+// recursive functions the order is that of a depth-first search from the first of them.
+void Inliner_SortBottomUp(struct IrProgram *program, struct List *order);
+
+#endif // MINIC_INLINER_H
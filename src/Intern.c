@@ -0,0 +1,100 @@
+#include "Intern.h"
+#include "ReportError.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_INITIAL_CAPACITY 1024
+
+
+struct InternEntry {
+    char *str;
+    uint32_t hash;
+    int length;
+};
+
+static struct Arena *arena;
+static struct InternEntry *entries;
+static int capacity;
+static int count;
+
+static uint32_t Hash(char *str, int length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; ++i) {
+        hash ^= (unsigned char) str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void InitTable(int new_capacity) {
+    entries = (struct InternEntry *) calloc(new_capacity, sizeof(struct InternEntry));
+    if (!entries) {
+        ReportInternalError("out of memory");
+    }
+
+    capacity = new_capacity;
+}
+
+static void Grow() {
+    struct InternEntry *old_entries = entries;
+    int old_capacity = capacity;
+    InitTable(capacity * 2);
+    for (int i = 0; i < old_capacity; ++i) {
+        struct InternEntry entry = old_entries[i];
+        if (entry.str) {
+            int index = entry.hash & (capacity - 1);
+            while (entries[index].str) {
+                index = (index + 1) & (capacity - 1);
+            }
+
+            entries[index] = entry;
+        }
+    }
+
+    free(old_entries);
+}
+
+
+//
+// ===
+// == Functions defined in Intern.h
+// ===
+//
+
+
+void Intern_Init(struct Arena *a) {
+    arena = a;
+    count = 0;
+    free(entries);
+    InitTable(INTERN_INITIAL_CAPACITY);
+}
+
+char *Intern_String(char *str, int length) {
+    uint32_t hash = Hash(str, length);
+    int index = hash & (capacity - 1);
+    while (entries[index].str) {
+        struct InternEntry *entry = &entries[index];
+        if (entry->hash == hash && entry->length == length && memcmp(entry->str, str, length) == 0) {
+            return entry->str;
+        }
+
+        index = (index + 1) & (capacity - 1);
+    }
+
+    char *copy = (char *) Arena_Alloc(arena, length + 1);
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+
+    entries[index].str = copy;
+    entries[index].hash = hash;
+    entries[index].length = length;
+    count += 1;
+    if (count * 2 > capacity) {
+        Grow();
+    }
+
+    return copy;
+}
@@ -0,0 +1,13 @@
+#ifndef MINIC_INTERN_H
+#define MINIC_INTERN_H
+#include "Arena.h"
+
+// Interned strings are unique: two interned strings are equal if and only if
+// their pointers are equal. They are '\0' terminated and live in the arena
+// passed to Intern_Init.
+
+void Intern_Init(struct Arena *arena);
+
+char *Intern_String(char *str, int length);
+
+#endif // MINIC_INTERN_H
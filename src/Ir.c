@@ -0,0 +1,628 @@
+#include "Ir.h"
+#include "ReportError.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+static char *opcode_names[IR_OPCODE_COUNT] = {
+    [IR_NOP]         = "nop",
+    [IR_CONST]       = "const",
+    [IR_COPY]        = "copy",
+    [IR_PARAM]       = "param",
+    [IR_CAST]        = "cast",
+    [IR_NEG]         = "neg",
+    [IR_ADD]         = "add",
+    [IR_SUB]         = "sub",
+    [IR_MUL]         = "mul",
+    [IR_DIV]         = "div",
+    [IR_EQU]         = "equ",
+    [IR_NEQ]         = "neq",
+    [IR_LT]          = "lt",
+    [IR_GT]          = "gt",
+    [IR_LTE]         = "lte",
+    [IR_GTE]         = "gte",
+    [IR_SLOT_ADDR]   = "slotaddr",
+    [IR_DATA_ADDR]   = "dataaddr",
+    [IR_LOAD]        = "load",
+    [IR_LOAD_SLOT]   = "loadslot",
+    [IR_STORE]       = "store",
+    [IR_STORE_SLOT]  = "storeslot",
+    [IR_CALL]        = "call",
+    [IR_PHI]         = "phi",
+    [IR_VBROADCAST]  = "vbroadcast",
+    [IR_VLOAD]       = "vload",
+    [IR_VSTORE]      = "vstore",
+    [IR_VCAST]       = "vcast",
+    [IR_VADD]        = "vadd",
+    [IR_VSUB]        = "vsub",
+    [IR_VMIN]        = "vmin",
+    [IR_VMAX]        = "vmax",
+    [IR_VREDUCE_ADD] = "vreduceadd",
+    [IR_VREDUCE_MIN] = "vreducemin",
+    [IR_VREDUCE_MAX] = "vreducemax",
+    [IR_JUMP]        = "jump",
+    [IR_BRANCH]      = "branch",
+    [IR_RETURN]      = "return",
+};
+
+static char *type_names[PRIMTYPE_COUNT] = {
+    [PRIMTYPE_INVALID]  = "invalid",
+    [PRIMTYPE_CHAR]     = "char",
+    [PRIMTYPE_INT]      = "int",
+    [PRIMTYPE_PTR]      = "ptr",
+};
+
+static bool IsTyped(enum IrOpcode opcode) {
+    switch (opcode) {
+        case IR_CAST:
+        case IR_LOAD:
+        case IR_LOAD_SLOT:
+        case IR_STORE:
+        case IR_STORE_SLOT:
+        case IR_VCAST: {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void AddPredecessor(struct IrBlock *block, struct IrBlock *pred) {
+    // A branch with both targets on the same block is still one edge.
+    for (int i = 0; i < block->preds.count; ++i) {
+        if (List_Get(&block->preds, i) == pred) {
+            return;
+        }
+    }
+
+    List_Add(&block->preds, pred);
+}
+
+static void AddUses(struct IrDefs *defs, struct IrInstr *instr, int delta) {
+    if (instr->a != IR_NO_REG) {
+        defs->num_uses[instr->a] += delta;
+    }
+
+    if (instr->b != IR_NO_REG) {
+        defs->num_uses[instr->b] += delta;
+    }
+
+    for (int i = 0; i < instr->num_args; ++i) {
+        defs->num_uses[instr->args[i]] += delta;
+    }
+}
+
+static void PrintReg(FILE *file, int reg) {
+    fprintf(file, "%%%d", reg);
+}
+
+static void PrintInstr(FILE *file, struct IrInstr *instr) {
+    fprintf(file, "  ");
+    if (instr->dest != IR_NO_REG) {
+        PrintReg(file, instr->dest);
+        fprintf(file, " = ");
+    }
+
+    fprintf(file, "%s", opcode_names[instr->opcode]);
+    if (IsTyped(instr->opcode)) {
+        fprintf(file, ".%s", type_names[instr->type]);
+    }
+
+    if (Ir_IsVector(instr->opcode)) {
+        fprintf(file, ".x%d", instr->imm);
+    }
+
+    switch (instr->opcode) {
+        case IR_CONST:
+        case IR_PARAM: {
+            fprintf(file, " %d", instr->imm);
+        } break;
+        case IR_SLOT_ADDR:
+        case IR_LOAD_SLOT: {
+            fprintf(file, " slot%d", instr->imm);
+        } break;
+        case IR_STORE_SLOT: {
+            fprintf(file, " slot%d, ", instr->imm);
+            PrintReg(file, instr->a);
+        } break;
+        case IR_DATA_ADDR: {
+            fprintf(file, " fmt_%d", instr->imm);
+        } break;
+        case IR_CALL:
+        case IR_PHI: {
+            if (instr->opcode == IR_CALL) {
+                fprintf(file, " %s", instr->name);
+            }
+
+            fprintf(file, "(");
+            for (int i = 0; i < instr->num_args; ++i) {
+                fprintf(file, (i == 0) ? "" : ", ");
+                PrintReg(file, instr->args[i]);
+            }
+
+            fprintf(file, ")");
+        } break;
+        case IR_JUMP: {
+            fprintf(file, " bb%d", instr->target->id);
+        } break;
+        case IR_BRANCH: {
+            fprintf(file, " ");
+            PrintReg(file, instr->a);
+            fprintf(file, ", bb%d, bb%d", instr->target->id, instr->target2->id);
+        } break;
+        default: {
+            if (instr->a != IR_NO_REG) {
+                fprintf(file, " ");
+                PrintReg(file, instr->a);
+            }
+
+            if (instr->b != IR_NO_REG) {
+                fprintf(file, ", ");
+                PrintReg(file, instr->b);
+            }
+        } break;
+    }
+
+    fprintf(file, "\n");
+}
+
+
+//
+// ===
+// == Functions defined in Ir.h
+// ===
+//
+
+
+struct IrInstr *Ir_AddBeforeTerminator(struct IrFunction *func, struct IrBlock *block, enum IrOpcode opcode) {
+    struct IrInstr *instr = Ir_AddInstr(func, block, opcode);
+    int last = block->instrs.count - 1;
+    block->instrs.data[last] = block->instrs.data[last - 1];
+    block->instrs.data[last - 1] = instr;
+    instr->dest = Ir_NewReg(func);
+    return instr;
+}
+
+struct IrBlock *Ir_AddBlock(struct IrFunction *func) {
+    struct IrBlock *block = Ir_NewBlock(func);
+    List_Add(&func->blocks, block);
+    return block;
+}
+
+void Ir_AddDefs(struct IrFunction *func, struct IrDefs *defs, struct IrBlock *block) {
+    if (defs->capacity < func->num_regs) {
+        int capacity = (func->num_regs > 2 * defs->capacity) ? func->num_regs : 2 * defs->capacity;
+        defs->instrs = (struct IrInstr **) realloc(defs->instrs, sizeof(struct IrInstr *) * capacity);
+        defs->blocks = (struct IrBlock **) realloc(defs->blocks, sizeof(struct IrBlock *) * capacity);
+        defs->num_uses = (int *) realloc(defs->num_uses, sizeof(int) * capacity);
+        for (int i = defs->capacity; i < capacity; ++i) {
+            defs->instrs[i] = NULL;
+            defs->blocks[i] = NULL;
+            defs->num_uses[i] = 0;
+        }
+
+        defs->capacity = capacity;
+    }
+
+    for (int i = 0; i < block->instrs.count; ++i) {
+        struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, i);
+        AddUses(defs, instr, 1);
+        if (instr->dest != IR_NO_REG) {
+            defs->instrs[instr->dest] = instr;
+            defs->blocks[instr->dest] = block;
+        }
+    }
+}
+
+struct IrInstr *Ir_AddInstr(struct IrFunction *func, struct IrBlock *block, enum IrOpcode opcode) {
+    struct IrInstr *instr = Ir_NewInstr(func, opcode);
+    List_Add(&block->instrs, instr);
+    return instr;
+}
+
+struct IrSlot *Ir_AddSlot(struct IrFunction *func, char *name, int size, enum PrimitiveType type) {
+    struct IrSlot *slot = ARENA_NEW(func->arena, IrSlot);
+    slot->id = func->slots.count;
+    slot->name = name;
+    slot->size = size;
+    slot->type = type;
+    slot->is_address_taken = false;
+    slot->is_promoted = false;
+    slot->rbp_offset = 0;
+    List_Add(&func->slots, slot);
+    return slot;
+}
+
+bool Ir_Compare(enum IrOpcode opcode, long long a, long long b) {
+    switch (opcode) {
+        case IR_EQU: { return a == b; }
+        case IR_NEQ: { return a != b; }
+        case IR_LT:  { return a < b; }
+        case IR_GT:  { return a > b; }
+        case IR_LTE: { return a <= b; }
+        case IR_GTE: { return a >= b; }
+    }
+
+    return false;
+}
+
+void Ir_ComputeDefs(struct IrFunction *func, struct IrDefs *defs) {
+    defs->instrs = NULL;
+    defs->blocks = NULL;
+    defs->num_uses = NULL;
+    defs->capacity = 0;
+    for (int i = 0; i < func->blocks.count; ++i) {
+        Ir_AddDefs(func, defs, (struct IrBlock *) List_Get(&func->blocks, i));
+    }
+}
+
+void Ir_ComputePredecessors(struct IrFunction *func) {
+    // The old lists are kept to reorder phi arguments, which follow the predecessor order.
+    struct List *old_preds = (struct List *) malloc(sizeof(struct List) * func->blocks.count);
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        old_preds[i] = block->preds;
+        List_Init(&block->preds);
+    }
+
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        struct IrBlock *succs[2];
+        int num_succs = Ir_Successors(block, succs);
+        for (int j = 0; j < num_succs; ++j) {
+            AddPredecessor(succs[j], block);
+        }
+    }
+
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *phi = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (phi->opcode != IR_PHI) {
+                break;
+            }
+
+            int *args = ARENA_NEW_ARRAY(func->arena, int, block->preds.count);
+            for (int k = 0; k < block->preds.count; ++k) {
+                args[k] = IR_NO_REG;
+                for (int m = 0; m < old_preds[i].count; ++m) {
+                    if (List_Get(&old_preds[i], m) == List_Get(&block->preds, k)) {
+                        args[k] = phi->args[m];
+                    }
+                }
+
+                if (args[k] == IR_NO_REG) {
+                    ReportInternalError("Ir::ComputePredecessors - new edge into a block with phis");
+                }
+            }
+
+            phi->args = args;
+            phi->num_args = block->preds.count;
+        }
+
+        List_Free(&old_preds[i]);
+    }
+
+    free(old_preds);
+}
+
+void Ir_FreeDefs(struct IrDefs *defs) {
+    free(defs->instrs);
+    free(defs->blocks);
+    free(defs->num_uses);
+}
+
+int Ir_GetUses(struct IrInstr *instr, int **uses) {
+    int num_uses = 0;
+    if (instr->a != IR_NO_REG) {
+        uses[num_uses] = &instr->a;
+        num_uses += 1;
+    }
+
+    if (instr->b != IR_NO_REG) {
+        uses[num_uses] = &instr->b;
+        num_uses += 1;
+    }
+
+    for (int i = 0; i < instr->num_args; ++i) {
+        uses[num_uses] = &instr->args[i];
+        num_uses += 1;
+    }
+
+    return num_uses;
+}
+
+bool Ir_HasSideEffects(struct IrInstr *instr) {
+    switch (instr->opcode) {
+        case IR_STORE:
+        case IR_STORE_SLOT:
+        case IR_VSTORE:
+        case IR_CALL:
+        case IR_DIV: // Division by zero traps.
+        case IR_JUMP:
+        case IR_BRANCH:
+        case IR_RETURN: {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Ir_InsertBlocks(struct IrFunction *func, struct List *new_blocks, struct List *next_blocks) {
+    // The new blocks are sorted by the id of their next block, the ones for block id i
+    // end up in sorted[starts[i]] to sorted[starts[i + 1] - 1].
+    int *starts = (int *) calloc(func->num_block_ids + 1, sizeof(int));
+    int *ends = (int *) malloc(sizeof(int) * (func->num_block_ids + 1));
+    struct IrBlock **sorted = (struct IrBlock **) malloc(sizeof(struct IrBlock *) * (new_blocks->count + 1));
+    for (int i = 0; i < next_blocks->count; ++i) {
+        starts[((struct IrBlock *) List_Get(next_blocks, i))->id + 1] += 1;
+    }
+
+    for (int i = 0; i < func->num_block_ids; ++i) {
+        starts[i + 1] += starts[i];
+        ends[i] = starts[i];
+    }
+
+    for (int i = 0; i < new_blocks->count; ++i) {
+        int id = ((struct IrBlock *) List_Get(next_blocks, i))->id;
+        sorted[ends[id]] = (struct IrBlock *) List_Get(new_blocks, i);
+        ends[id] += 1;
+    }
+
+    struct List blocks;
+    List_Init(&blocks);
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        for (int j = starts[block->id]; j < starts[block->id + 1]; ++j) {
+            List_Add(&blocks, sorted[j]);
+        }
+
+        List_Add(&blocks, block);
+    }
+
+    List_Free(&func->blocks);
+    func->blocks = blocks;
+    free(starts);
+    free(ends);
+    free(sorted);
+}
+
+bool Ir_IsComparison(enum IrOpcode opcode) {
+    return opcode == IR_EQU || opcode == IR_NEQ || opcode == IR_LT || opcode == IR_GT || opcode == IR_LTE || opcode == IR_GTE;
+}
+
+bool Ir_IsConst(struct IrDefs *defs, int reg) {
+    return defs->instrs[reg] && defs->instrs[reg]->opcode == IR_CONST;
+}
+
+bool Ir_IsTerminator(struct IrInstr *instr) {
+    return instr->opcode == IR_JUMP || instr->opcode == IR_BRANCH || instr->opcode == IR_RETURN;
+}
+
+bool Ir_IsVector(enum IrOpcode opcode) {
+    return IR_VBROADCAST <= opcode && opcode <= IR_VREDUCE_MAX;
+}
+
+enum IrOpcode Ir_NegateComparison(enum IrOpcode opcode) {
+    switch (opcode) {
+        case IR_EQU: { return IR_NEQ; }
+        case IR_NEQ: { return IR_EQU; }
+        case IR_LT:  { return IR_GTE; }
+        case IR_GT:  { return IR_LTE; }
+        case IR_LTE: { return IR_GT; }
+        case IR_GTE: { return IR_LT; }
+    }
+
+    return IR_NOP;
+}
+
+struct IrBlock *Ir_NewBlock(struct IrFunction *func) {
+    struct IrBlock *block = ARENA_NEW(func->arena, IrBlock);
+    block->id = func->num_block_ids;
+    List_Init(&block->instrs);
+    List_Init(&block->preds);
+    block->rpo_index = -1;
+    block->idom = NULL;
+    List_Init(&block->dom_children);
+    block->dom_enter = -1;
+    block->dom_exit = -1;
+    block->loop = NULL;
+    func->num_block_ids += 1;
+    return block;
+}
+
+struct IrInstr *Ir_NewInstr(struct IrFunction *func, enum IrOpcode opcode) {
+    struct IrInstr *instr = ARENA_NEW(func->arena, IrInstr);
+    memset(instr, 0, sizeof(struct IrInstr));
+    instr->opcode = opcode;
+    instr->type = PRIMTYPE_PTR;
+    return instr;
+}
+
+int Ir_NewReg(struct IrFunction *func) {
+    int reg = func->num_regs;
+    func->num_regs += 1;
+    return reg;
+}
+
+void Ir_PrintFunction(FILE *file, struct IrFunction *func) {
+    fprintf(file, "function %s (%d params)\n", func->name, func->num_params);
+    for (int i = 0; i < func->slots.count; ++i) {
+        struct IrSlot *slot = (struct IrSlot *) List_Get(&func->slots, i);
+        if (!slot->is_promoted) {
+            fprintf(file, "  slot%d %s: %d bytes%s\n", i, slot->name, slot->size, slot->is_address_taken ? ", address taken" : "");
+        }
+    }
+
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        fprintf(file, "bb%d:", block->id);
+        if (block->preds.count > 0) {
+            fprintf(file, " ; preds");
+            for (int j = 0; j < block->preds.count; ++j) {
+                struct IrBlock *pred = (struct IrBlock *) List_Get(&block->preds, j);
+                fprintf(file, " bb%d", pred->id);
+            }
+        }
+
+        fprintf(file, "\n");
+        for (int j = 0; j < block->instrs.count; ++j) {
+            PrintInstr(file, (struct IrInstr *) List_Get(&block->instrs, j));
+        }
+    }
+
+    fprintf(file, "\n");
+}
+
+void Ir_PrintProgram(FILE *file, struct IrProgram *program) {
+    for (int i = 0; i < program->functions.count; ++i) {
+        Ir_PrintFunction(file, (struct IrFunction *) List_Get(&program->functions, i));
+    }
+}
+
+void Ir_RemoveNops(struct IrFunction *func) {
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        int count = 0;
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->opcode != IR_NOP) {
+                block->instrs.data[count] = instr;
+                count += 1;
+            }
+        }
+
+        block->instrs.count = count;
+    }
+}
+
+void Ir_RemoveUnreachableBlocks(struct IrFunction *func) {
+    bool *is_reachable = (bool *) calloc(func->num_block_ids, sizeof(bool));
+    struct IrBlock **worklist = (struct IrBlock **) malloc(sizeof(struct IrBlock *) * func->blocks.count);
+    int num_worklist = 1;
+    worklist[0] = (struct IrBlock *) List_Get(&func->blocks, 0);
+    is_reachable[worklist[0]->id] = true;
+    while (num_worklist > 0) {
+        num_worklist -= 1;
+        struct IrBlock *succs[2];
+        int num_succs = Ir_Successors(worklist[num_worklist], succs);
+        for (int i = 0; i < num_succs; ++i) {
+            if (!is_reachable[succs[i]->id]) {
+                is_reachable[succs[i]->id] = true;
+                worklist[num_worklist] = succs[i];
+                num_worklist += 1;
+            }
+        }
+    }
+
+    int count = 0;
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        if (is_reachable[block->id]) {
+            func->blocks.data[count] = block;
+            count += 1;
+        }
+    }
+
+    bool has_removed = count < func->blocks.count;
+    func->blocks.count = count;
+    if (has_removed) {
+        Ir_ComputePredecessors(func);
+    }
+
+    free(is_reachable);
+    free(worklist);
+}
+
+void Ir_RemoveUses(struct IrDefs *defs, struct IrBlock *block) {
+    for (int i = 0; i < block->instrs.count; ++i) {
+        AddUses(defs, (struct IrInstr *) List_Get(&block->instrs, i), -1);
+    }
+}
+
+void Ir_ReplacePredecessor(struct IrBlock *block, struct IrBlock *old_pred, struct IrBlock *new_pred) {
+    for (int i = 0; i < block->preds.count; ++i) {
+        if (List_Get(&block->preds, i) == old_pred) {
+            block->preds.data[i] = new_pred;
+        }
+    }
+}
+
+void Ir_ReplaceRegs(struct IrFunction *func, int *replacements) {
+    int *uses[64];
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (2 + instr->num_args > 64) {
+                ReportInternalError("Ir::ReplaceRegs - too many arguments");
+            }
+
+            int num_uses = Ir_GetUses(instr, uses);
+            for (int k = 0; k < num_uses; ++k) {
+                int reg = *uses[k];
+                while (replacements[reg] != IR_NO_REG) {
+                    reg = replacements[reg];
+                }
+
+                *uses[k] = reg;
+            }
+        }
+    }
+}
+
+void Ir_ReplaceTarget(struct IrInstr *terminator, struct IrBlock *old_target, struct IrBlock *new_target) {
+    if (terminator->target == old_target) {
+        terminator->target = new_target;
+    }
+
+    if (terminator->target2 == old_target) {
+        terminator->target2 = new_target;
+    }
+}
+
+int Ir_Successors(struct IrBlock *block, struct IrBlock **succs) {
+    struct IrInstr *terminator = Ir_Terminator(block);
+    if (!terminator) {
+        return 0;
+    }
+
+    switch (terminator->opcode) {
+        case IR_JUMP: {
+            succs[0] = terminator->target;
+            return 1;
+        }
+        case IR_BRANCH: {
+            succs[0] = terminator->target;
+            if (terminator->target2 == terminator->target) {
+                return 1;
+            }
+
+            succs[1] = terminator->target2;
+            return 2;
+        }
+    }
+
+    return 0;
+}
+
+enum IrOpcode Ir_SwapComparison(enum IrOpcode opcode) {
+    switch (opcode) {
+        case IR_LT:  { return IR_GT; }
+        case IR_GT:  { return IR_LT; }
+        case IR_LTE: { return IR_GTE; }
+        case IR_GTE: { return IR_LTE; }
+    }
+
+    return opcode;
+}
+
+struct IrInstr *Ir_Terminator(struct IrBlock *block) {
+    if (block->instrs.count == 0) {
+        return NULL;
+    }
+
+    struct IrInstr *last = (struct IrInstr *) List_Get(&block->instrs, block->instrs.count - 1);
+    return Ir_IsTerminator(last) ? last : NULL;
+}
@@ -0,0 +1,218 @@
+#ifndef MINIC_IR_H
+#define MINIC_IR_H
+#include "Arena.h"
+#include "AstNode.h"
+#include "List.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// Virtual registers are numbered from 1, so that 0 can mean "no register".
+#define IR_NO_REG 0
+
+
+// A three-address intermediate representation. Each function is a control-flow graph
+// of basic blocks, and each block is a list of instructions that ends with exactly one
+// terminator (jump, branch or return).
+//
+// Every virtual register is assigned by exactly one instruction. Local variables live
+// in stack slots and are read and written with the slot instructions, so the IR is in
+// SSA form for registers from the start. Ssa_PromoteSlots later replaces most slots by
+// registers and phis. Values are 64 bits wide; the type of loads,
+// stores and casts says how many bytes are in memory.
+enum IrOpcode {
+    IR_NOP,
+
+    IR_CONST,       // dest = imm
+    IR_COPY,        // dest = a
+    IR_PARAM,       // dest = parameter number imm
+    IR_CAST,        // dest = a truncated to type and extended back to 64 bits
+    IR_NEG,         // dest = -a
+    IR_ADD,         // dest = a + b
+    IR_SUB,         // dest = a - b
+    IR_MUL,         // dest = a * b
+    IR_DIV,         // dest = a / b
+    IR_EQU,         // dest = a == b
+    IR_NEQ,         // dest = a != b
+    IR_LT,          // dest = a < b
+    IR_GT,          // dest = a > b
+    IR_LTE,         // dest = a <= b
+    IR_GTE,         // dest = a >= b
+    IR_SLOT_ADDR,   // dest = address of slot imm
+    IR_DATA_ADDR,   // dest = address of data field imm (fmt_<imm>)
+    IR_LOAD,        // dest = *(type *) a
+    IR_LOAD_SLOT,   // dest = *(type *) slot imm
+    IR_STORE,       // *(type *) a = b
+    IR_STORE_SLOT,  // *(type *) slot imm = a
+    IR_CALL,        // dest = name(args)
+    IR_PHI,         // dest = args[i] when coming from block->preds[i]
+    // Vector instructions work on imm lanes of 64 bits, see Vectorize.h.
+    IR_VBROADCAST,  // dest = a in every lane
+    IR_VLOAD,       // dest = the lanes at a
+    IR_VSTORE,      // the lanes at a = b
+    IR_VCAST,       // dest = each lane of a truncated to type and extended back to 64 bits
+    IR_VADD,        // dest = a + b in each lane
+    IR_VSUB,        // dest = a - b in each lane
+    IR_VMIN,        // dest = the smaller of a and b in each lane
+    IR_VMAX,        // dest = the larger of a and b in each lane
+    IR_VREDUCE_ADD, // dest = the sum of the lanes of a
+    IR_VREDUCE_MIN, // dest = the smallest lane of a
+    IR_VREDUCE_MAX, // dest = the largest lane of a
+
+    // Terminators
+    IR_JUMP,        // goto target
+    IR_BRANCH,      // if (a != 0) goto target else goto target2
+    IR_RETURN,      // return a, a can be IR_NO_REG
+
+    IR_OPCODE_COUNT,
+};
+
+struct IrInstr {
+    enum IrOpcode opcode;
+    enum PrimitiveType type;
+    int dest;
+    int a;
+    int b;
+    int imm;
+    int num_args;
+    int *args;
+    char *name; // Interned, see Intern.h.
+    struct IrBlock *target;
+    struct IrBlock *target2;
+};
+
+struct IrBlock {
+    int id;
+    struct List instrs;
+    struct List preds;
+
+    // Filled by Dominators_Compute.
+    int rpo_index; // -1 if the block is unreachable.
+    struct IrBlock *idom;
+    struct List dom_children;
+    // When a depth-first walk of the dominator tree enters and leaves the block, -1 if the
+    // block is unreachable.
+    int dom_enter;
+    int dom_exit;
+
+    // Filled by Loops_Find. The innermost loop the block is in, NULL if there is none.
+    struct Loop *loop;
+};
+
+struct IrSlot {
+    int id;
+    char *name;
+    int size;
+    enum PrimitiveType type;
+    // Set when the slot's address is used as a value (&x or an array).
+    bool is_address_taken;
+    bool is_promoted; // Set when mem2reg turned the slot into registers, see Ssa.h.
+    int rbp_offset; // Assigned by the backend.
+};
+
+struct IrFunction {
+    struct Arena *arena;
+    char *name;
+    int num_params;
+    struct List blocks; // The first block is the entry.
+    struct List rpo_blocks; // Reachable blocks in reverse post-order, filled by Dominators_Compute.
+    struct List slots;
+    int num_regs;
+    int num_block_ids;
+};
+
+// Where each register is defined and how many times it is read. Passes that change the
+// instructions keep it up to date with Ir_RemoveUses before and Ir_AddDefs after.
+struct IrDefs {
+    struct IrInstr **instrs; // Register -> instruction that defines it
+    struct IrBlock **blocks; // Register -> block that defines it
+    int *num_uses; // Register -> number of uses
+    int capacity; // Registers the arrays have room for.
+};
+
+struct IrProgram {
+    struct List functions;
+    struct List data_fields; // String literals (struct Expr *), see TranslationUnit.
+};
+
+
+// Adds an instruction right before the block's terminator and gives it a new register.
+struct IrInstr *Ir_AddBeforeTerminator(struct IrFunction *func, struct IrBlock *block, enum IrOpcode opcode);
+
+// Creates a block and appends it to the function's block list.
+struct IrBlock *Ir_AddBlock(struct IrFunction *func);
+
+// Records the definitions and uses of the block's instructions, making room for the
+// registers created since the defs were computed.
+void Ir_AddDefs(struct IrFunction *func, struct IrDefs *defs, struct IrBlock *block);
+
+struct IrInstr *Ir_AddInstr(struct IrFunction *func, struct IrBlock *block, enum IrOpcode opcode);
+
+struct IrSlot *Ir_AddSlot(struct IrFunction *func, char *name, int size, enum PrimitiveType type);
+
+// Evaluates the comparison opcode on a and b.
+bool Ir_Compare(enum IrOpcode opcode, long long a, long long b);
+
+void Ir_ComputeDefs(struct IrFunction *func, struct IrDefs *defs);
+
+// Recomputes the predecessor lists of all blocks from their terminators.
+void Ir_ComputePredecessors(struct IrFunction *func);
+
+void Ir_FreeDefs(struct IrDefs *defs);
+
+// Stores pointers to the registers the instruction reads in uses, so that they can be
+// rewritten, and returns how many there are. uses needs room for 2 + instr->num_args entries.
+int Ir_GetUses(struct IrInstr *instr, int **uses);
+
+// Instructions that must be kept even if their result is unused.
+bool Ir_HasSideEffects(struct IrInstr *instr);
+
+// Places each new block right before the block at the same index of next_blocks, which
+// has to be in the function's block list already. Blocks with the same next block keep
+// their order. Takes one pass over the block list, so passes can collect their new blocks
+// and insert them all at the end.
+void Ir_InsertBlocks(struct IrFunction *func, struct List *new_blocks, struct List *next_blocks);
+
+bool Ir_IsComparison(enum IrOpcode opcode);
+bool Ir_IsConst(struct IrDefs *defs, int reg);
+bool Ir_IsTerminator(struct IrInstr *instr);
+bool Ir_IsVector(enum IrOpcode opcode);
+
+// The comparison that is true when opcode is false, IR_NOP if opcode is not a comparison.
+enum IrOpcode Ir_NegateComparison(enum IrOpcode opcode);
+
+// Creates a block without adding it to the function's block list.
+struct IrBlock *Ir_NewBlock(struct IrFunction *func);
+
+struct IrInstr *Ir_NewInstr(struct IrFunction *func, enum IrOpcode opcode);
+
+int Ir_NewReg(struct IrFunction *func);
+
+void Ir_PrintFunction(FILE *file, struct IrFunction *func);
+
+void Ir_PrintProgram(FILE *file, struct IrProgram *program);
+
+void Ir_RemoveNops(struct IrFunction *func);
+
+// Removes the blocks that cannot be reached from the entry and updates the predecessor lists.
+void Ir_RemoveUnreachableBlocks(struct IrFunction *func);
+
+// Takes the uses of the block's instructions off the counts, the definitions stay.
+void Ir_RemoveUses(struct IrDefs *defs, struct IrBlock *block);
+
+void Ir_ReplacePredecessor(struct IrBlock *block, struct IrBlock *old_pred, struct IrBlock *new_pred);
+
+// Rewrites every use of register r to replacements[r], if that is not IR_NO_REG.
+// Chains of replacements are followed.
+void Ir_ReplaceRegs(struct IrFunction *func, int *replacements);
+
+void Ir_ReplaceTarget(struct IrInstr *terminator, struct IrBlock *old_target, struct IrBlock *new_target);
+
+// Stores the successors of the block in succs and returns how many there are (0 to 2).
+int Ir_Successors(struct IrBlock *block, struct IrBlock **succs);
+
+// The comparison that gives the same result with the operands swapped.
+enum IrOpcode Ir_SwapComparison(enum IrOpcode opcode);
+
+struct IrInstr *Ir_Terminator(struct IrBlock *block);
+
+#endif // MINIC_IR_H
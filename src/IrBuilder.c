@@ -0,0 +1,398 @@
+#include "IrBuilder.h"
+#include "HashMap.h"
+#include "ReportError.h"
+#include <string.h>
+
+
+static void LowerCompoundStmt(struct CompoundStmt *compound_stmt);
+static int LowerExpr(struct Expr *expr);
+static void LowerStmt(struct AstNode *stmt);
+
+static struct Arena *arena;
+static struct IrFunction *current_func;
+static struct IrBlock *current_block;
+static struct HashMap slots; // Declarator -> IrSlot
+
+
+static bool IsArray(struct Declarator *decl) {
+    return decl->array_dimensions > 0;
+}
+
+static bool IsPointer(struct Declarator *decl) {
+    return decl->pointer_inderection > 0;
+}
+
+static struct IrSlot *FindSlot(struct Declarator *declarator) {
+    struct IrSlot *slot = (struct IrSlot *) HashMap_Get(&slots, declarator);
+    if (!slot) {
+        ReportInternalError("IrBuilder::FindSlot - no slot for '%s'", declarator->identifier);
+    }
+
+    return slot;
+}
+
+static bool IsTerminated() {
+    return Ir_Terminator(current_block) != NULL;
+}
+
+static void StartBlock(struct IrBlock *block) {
+    List_Add(&current_func->blocks, block);
+    current_block = block;
+}
+
+static struct IrInstr *AddInstr(enum IrOpcode opcode) {
+    // Code after a return goes to a block that is never reached.
+    if (IsTerminated()) {
+        StartBlock(Ir_NewBlock(current_func));
+    }
+
+    return Ir_AddInstr(current_func, current_block, opcode);
+}
+
+static int AddValue(enum IrOpcode opcode, int a, int b) {
+    struct IrInstr *instr = AddInstr(opcode);
+    instr->dest = Ir_NewReg(current_func);
+    instr->a = a;
+    instr->b = b;
+    return instr->dest;
+}
+
+static int AddConst(int value) {
+    struct IrInstr *instr = AddInstr(IR_CONST);
+    instr->dest = Ir_NewReg(current_func);
+    instr->imm = value;
+    return instr->dest;
+}
+
+static void AddBranch(int condition, struct IrBlock *target, struct IrBlock *target2) {
+    struct IrInstr *instr = AddInstr(IR_BRANCH);
+    instr->a = condition;
+    instr->target = target;
+    instr->target2 = target2;
+}
+
+static void AddJump(struct IrBlock *target) {
+    if (!IsTerminated()) {
+        struct IrInstr *instr = Ir_AddInstr(current_func, current_block, IR_JUMP);
+        instr->target = target;
+    }
+}
+
+static void AddStoreSlot(struct IrSlot *slot, int value) {
+    struct IrInstr *instr = AddInstr(IR_STORE_SLOT);
+    instr->imm = slot->id;
+    instr->a = value;
+    instr->type = slot->type;
+}
+
+static int LowerAddress(struct Expr *expr) {
+    if (expr->type == EXPR_VAR) {
+        struct IrSlot *slot = FindSlot(expr->declarator);
+        slot->is_address_taken = true;
+        struct IrInstr *instr = AddInstr(IR_SLOT_ADDR);
+        instr->dest = Ir_NewReg(current_func);
+        instr->imm = slot->id;
+        return instr->dest;
+    }
+
+    if (expr->type == EXPR_DEREF) {
+        return LowerExpr(expr->lhs);
+    }
+
+    ReportInternalError("IrBuilder::LowerAddress - not an lvalue");
+    return IR_NO_REG;
+}
+
+static int LowerAssignment(struct Expr *expr) {
+    struct Expr *lhs = expr->lhs;
+    if (lhs->operand_type == PRIMTYPE_INVALID) {
+        ReportInternalError("IrBuilder::LowerAssignment - missing operand type");
+    }
+
+    // Plain variables are written through their slot, so that mem2reg can promote them.
+    if (lhs->type == EXPR_VAR && !IsArray(lhs->declarator)) {
+        int value = LowerExpr(expr->rhs);
+        AddStoreSlot(FindSlot(lhs->declarator), value);
+        return value;
+    }
+
+    int address = LowerAddress(lhs);
+    int value = LowerExpr(expr->rhs);
+    struct IrInstr *instr = AddInstr(IR_STORE);
+    instr->a = address;
+    instr->b = value;
+    instr->type = lhs->operand_type;
+    return value;
+}
+
+static int LowerFunctionCall(struct Expr *expr) {
+    struct List *args = &expr->args;
+    int *arg_regs = ARENA_NEW_ARRAY(arena, int, args->count);
+    for (int i = 0; i < args->count; ++i) {
+        arg_regs[i] = LowerExpr((struct Expr *) List_Get(args, i));
+    }
+
+    struct IrInstr *instr = AddInstr(IR_CALL);
+    instr->dest = Ir_NewReg(current_func);
+    instr->name = expr->str_value;
+    instr->num_args = args->count;
+    instr->args = arg_regs;
+    return instr->dest;
+}
+
+static int LowerExpr(struct Expr *expr) {
+    switch (expr->type) {
+        case EXPR_NUM: {
+            return AddConst(expr->int_value);
+        }
+        case EXPR_STR: {
+            struct IrInstr *instr = AddInstr(IR_DATA_ADDR);
+            instr->dest = Ir_NewReg(current_func);
+            instr->imm = expr->id;
+            return instr->dest;
+        }
+        case EXPR_VAR: {
+            // An array evaluates to its address.
+            if (IsArray(expr->declarator)) {
+                return LowerAddress(expr);
+            }
+
+            struct IrSlot *slot = FindSlot(expr->declarator);
+            struct IrInstr *instr = AddInstr(IR_LOAD_SLOT);
+            instr->dest = Ir_NewReg(current_func);
+            instr->imm = slot->id;
+            instr->type = slot->type;
+            return instr->dest;
+        }
+        case EXPR_FUNC_CALL: {
+            return LowerFunctionCall(expr);
+        }
+        case EXPR_PLUS: {
+            return LowerExpr(expr->lhs);
+        }
+        case EXPR_NEG: {
+            return AddValue(IR_NEG, LowerExpr(expr->lhs), IR_NO_REG);
+        }
+        case EXPR_DEREF: {
+            // Dereferences read 8 bytes, like the stack machine code generator does.
+            int address = LowerExpr(expr->lhs);
+            struct IrInstr *instr = AddInstr(IR_LOAD);
+            instr->a = address;
+            instr->dest = Ir_NewReg(current_func);
+            instr->type = PRIMTYPE_PTR;
+            return instr->dest;
+        }
+        case EXPR_ADDR: {
+            return LowerAddress(expr->lhs);
+        }
+        case EXPR_SIZEOF: {
+            ReportInternalError("IrBuilder::LowerExpr - unexpected sizeof");
+        } break;
+        case EXPR_ASSIGN: {
+            return LowerAssignment(expr);
+        }
+    }
+
+    if (!expr->rhs) {
+        ReportInternalError("IrBuilder::LowerExpr - missing rhs");
+    }
+
+    // The right operand is evaluated first, like in the stack machine code generator.
+    int rhs = LowerExpr(expr->rhs);
+    int lhs = LowerExpr(expr->lhs);
+    switch (expr->type) {
+        case EXPR_EQU: { return AddValue(IR_EQU, lhs, rhs); }
+        case EXPR_NEQ: { return AddValue(IR_NEQ, lhs, rhs); }
+        case EXPR_LT:  { return AddValue(IR_LT, lhs, rhs); }
+        case EXPR_GT:  { return AddValue(IR_GT, lhs, rhs); }
+        case EXPR_LTE: { return AddValue(IR_LTE, lhs, rhs); }
+        case EXPR_GTE: { return AddValue(IR_GTE, lhs, rhs); }
+        case EXPR_ADD: { return AddValue(IR_ADD, lhs, rhs); }
+        case EXPR_SUB: { return AddValue(IR_SUB, lhs, rhs); }
+        case EXPR_MUL: { return AddValue(IR_MUL, lhs, rhs); }
+        case EXPR_DIV: { return AddValue(IR_DIV, lhs, rhs); }
+    }
+
+    ReportInternalError("IrBuilder::LowerExpr - not implemented");
+    return IR_NO_REG;
+}
+
+static void LowerForStmt(struct ForStmt *for_stmt) {
+    struct IrBlock *header = Ir_NewBlock(current_func);
+    struct IrBlock *body = Ir_NewBlock(current_func);
+    struct IrBlock *latch = Ir_NewBlock(current_func);
+    struct IrBlock *exit_block = Ir_NewBlock(current_func);
+
+    if (for_stmt->init_expr) LowerExpr(for_stmt->init_expr);
+    AddJump(header);
+    StartBlock(header);
+    if (for_stmt->cond_expr) {
+        AddBranch(LowerExpr(for_stmt->cond_expr), body, exit_block);
+    }
+    else {
+        AddJump(body);
+    }
+
+    StartBlock(body);
+    LowerStmt(for_stmt->stmt);
+    AddJump(latch);
+    StartBlock(latch);
+    if (for_stmt->loop_expr) LowerExpr(for_stmt->loop_expr);
+    AddJump(header);
+    StartBlock(exit_block);
+}
+
+static void LowerIfStmt(struct IfStmt *if_stmt) {
+    struct IrBlock *then_block = Ir_NewBlock(current_func);
+    struct IrBlock *end = Ir_NewBlock(current_func);
+    struct IrBlock *else_block = if_stmt->else_branch ? Ir_NewBlock(current_func) : end;
+
+    AddBranch(LowerExpr(if_stmt->condition), then_block, else_block);
+    StartBlock(then_block);
+    LowerStmt(if_stmt->stmt);
+    AddJump(end);
+    if (if_stmt->else_branch) {
+        StartBlock(else_block);
+        LowerStmt(if_stmt->else_branch);
+        AddJump(end);
+    }
+
+    StartBlock(end);
+}
+
+static void LowerReturnStmt(struct ReturnStmt *return_stmt) {
+    int value = return_stmt->expr ? LowerExpr(return_stmt->expr) : IR_NO_REG;
+    struct IrInstr *instr = AddInstr(IR_RETURN);
+    instr->a = value;
+}
+
+static void LowerWhileStmt(struct WhileStmt *while_stmt) {
+    struct IrBlock *header = Ir_NewBlock(current_func);
+    struct IrBlock *body = Ir_NewBlock(current_func);
+    struct IrBlock *exit_block = Ir_NewBlock(current_func);
+
+    AddJump(header);
+    StartBlock(header);
+    AddBranch(LowerExpr(while_stmt->condition), body, exit_block);
+    StartBlock(body);
+    LowerStmt(while_stmt->stmt);
+    AddJump(header);
+    StartBlock(exit_block);
+}
+
+static void LowerVarDeclaration(struct VarDeclaration *var_declaration) {
+    struct List *declarators = &var_declaration->declarators;
+    for (int i = 0; i < declarators->count; ++i) {
+        struct Declarator *declarator = (struct Declarator *) List_Get(declarators, i);
+        if (declarator->value) {
+            LowerExpr(declarator->value);
+        }
+    }
+}
+
+static void LowerStmt(struct AstNode *stmt) {
+    switch (stmt->type) {
+        case AST_COMPOUND_STMT:     { LowerCompoundStmt((struct CompoundStmt *) stmt); } break;
+        case AST_EXPRESSION_STMT:   { LowerExpr(((struct ExpressionStmt *) stmt)->expr); } break;
+        case AST_FOR_STMT:          { LowerForStmt((struct ForStmt *) stmt); } break;
+        case AST_IF_STMT:           { LowerIfStmt((struct IfStmt *) stmt); } break;
+        case AST_NULL_STMT:         { } break;
+        case AST_RETURN_STMT:       { LowerReturnStmt((struct ReturnStmt *) stmt); } break;
+        case AST_WHILE_STMT:        { LowerWhileStmt((struct WhileStmt *) stmt); } break;
+        default:                    { ReportInternalError("unknown statement"); } break;
+    }
+}
+
+static void LowerCompoundStmt(struct CompoundStmt *compound_stmt) {
+    struct List *body = &compound_stmt->body;
+    for (int i = 0; i < body->count; ++i) {
+        struct AstNode *node = (struct AstNode *) List_Get(body, i);
+        if (node->type == AST_VAR_DECLARATION) {
+            LowerVarDeclaration((struct VarDeclaration *) node);
+        }
+        else {
+            LowerStmt(node);
+        }
+    }
+}
+
+static void AddSlots(struct FunctionDef *function) {
+    struct List *var_decls = &function->var_decls;
+    for (int i = 0; i < var_decls->count; ++i) {
+        struct VarDeclaration *var_declaration = (struct VarDeclaration *) List_Get(var_decls, i);
+        struct List *declarators = &var_declaration->declarators;
+        for (int j = 0; j < declarators->count; ++j) {
+            struct Declarator *declarator = (struct Declarator *) List_Get(declarators, j);
+            int num_elements = 1;
+            for (int k = 0; k < declarator->array_dimensions; ++k) {
+                num_elements *= declarator->array_sizes[k];
+            }
+
+            enum PrimitiveType type = IsPointer(declarator) ? PRIMTYPE_PTR : declarator->type;
+            struct IrSlot *slot = Ir_AddSlot(current_func, declarator->identifier, 8 * num_elements, type);
+            slot->is_address_taken = IsArray(declarator);
+            HashMap_Put(&slots, declarator, slot);
+        }
+    }
+}
+
+static struct IrFunction *LowerFunctionDef(struct FunctionDef *function) {
+    struct IrFunction *func = ARENA_NEW(arena, IrFunction);
+    func->arena = arena;
+    func->name = function->identifier;
+    func->num_params = function->num_params;
+    List_Init(&func->blocks);
+    List_Init(&func->rpo_blocks);
+    List_Init(&func->slots);
+    func->num_regs = 1;
+    func->num_block_ids = 0;
+
+    current_func = func;
+    HashMap_Init(&slots);
+    AddSlots(function);
+
+    StartBlock(Ir_NewBlock(func));
+    for (int i = 0; i < function->num_params; ++i) {
+        struct VarDeclaration *var_decl = (struct VarDeclaration *) List_Get(&function->var_decls, i);
+        struct Declarator *decl = (struct Declarator *) List_Get(&var_decl->declarators, 0);
+        struct IrInstr *param = AddInstr(IR_PARAM);
+        param->dest = Ir_NewReg(func);
+        param->imm = i;
+        AddStoreSlot(FindSlot(decl), param->dest);
+    }
+
+    LowerCompoundStmt(function->body);
+    if (!IsTerminated()) {
+        // Falling off the end of main returns 0.
+        int value = (strcmp(function->identifier, "main") == 0) ? AddConst(0) : IR_NO_REG;
+        struct IrInstr *instr = AddInstr(IR_RETURN);
+        instr->a = value;
+    }
+
+    Ir_ComputePredecessors(func);
+    HashMap_Free(&slots);
+    current_func = NULL;
+    current_block = NULL;
+    return func;
+}
+
+
+//
+// ===
+// == Functions defined in IrBuilder.h
+// ===
+//
+
+
+struct IrProgram *IrBuilder_Build(struct Arena *a, struct TranslationUnit *t_unit) {
+    arena = a;
+    struct IrProgram *program = ARENA_NEW(arena, IrProgram);
+    List_Init(&program->functions);
+    program->data_fields = t_unit->data_fields;
+    for (int i = 0; i < t_unit->functions.count; ++i) {
+        struct FunctionDef *function = (struct FunctionDef *) List_Get(&t_unit->functions, i);
+        List_Add(&program->functions, LowerFunctionDef(function));
+    }
+
+    return program;
+}
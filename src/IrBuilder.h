@@ -0,0 +1,11 @@
+#ifndef MINIC_IR_BUILDER_H
+#define MINIC_IR_BUILDER_H
+#include "Arena.h"
+#include "AstNode.h"
+#include "Ir.h"
+
+// Lowers an analyzed translation unit to IR. Each local variable gets its own slot;
+// arrays get 8 bytes per element, since pointer arithmetic steps in units of 8.
+struct IrProgram *IrBuilder_Build(struct Arena *arena, struct TranslationUnit *t_unit);
+
+#endif // MINIC_IR_BUILDER_H
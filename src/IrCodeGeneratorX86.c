@@ -0,0 +1,604 @@
+#include "IrCodeGeneratorX86.h"
+#include "Arena.h"
+#include "Assembly.h"
+#include "LinearScan.h"
+#include "Register.h"
+#include "ReportError.h"
+#include "Ssa.h"
+#include "Vectorize.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_OPERAND_LENGTH 32
+
+
+static struct IrFunction *current_func;
+static char *block_label; // "<function>.bb", block ids are appended.
+static char **reg_operands; // Virtual register -> its machine register or "qword [rbp - N]"
+static int *reg_assignment; // Virtual register -> index into allocatable_regs, or LINEAR_SCAN_SPILLED
+static char *save_operands[NUM_ALLOCATABLE_REGS]; // Callee-saved register that is used -> where it is saved
+static char **slot_operands[PRIMTYPE_COUNT]; // Slot -> "<size> [rbp - N]"
+static struct IrInstr **const_defs; // Virtual register -> its IR_CONST instruction, if any
+static int *reg_lanes; // Virtual register -> number of 64-bit lanes, 1 for scalars
+// The upper halves of the ymm registers must be cleared before calling or returning to
+// code that uses SSE, or every SSE instruction pays for keeping them.
+static bool uses_ymm;
+
+static int Align(int n, int offset) {
+    return (n + offset - 1) / offset * offset;
+}
+
+static char *MakeString(char *format, char *str, int value) {
+    char *result = ARENA_NEW_ARRAY(current_func->arena, char, MAX_OPERAND_LENGTH + strlen(str));
+    sprintf(result, format, str, value);
+    return result;
+}
+
+static char *Operand(int reg) {
+    return reg_operands[reg];
+}
+
+static char *SlotOperand(int slot, enum PrimitiveType type) {
+    return slot_operands[type][slot];
+}
+
+static int AssignFrameOffsets() {
+    struct Arena *arena = current_func->arena;
+
+    // Start at 8 because we call other functions.
+    int offset = 8;
+    struct List *slots = &current_func->slots;
+    for (int type = PRIMTYPE_CHAR; type < PRIMTYPE_COUNT; ++type) {
+        slot_operands[type] = ARENA_NEW_ARRAY(arena, char *, slots->count);
+    }
+
+    for (int i = 0; i < slots->count; ++i) {
+        struct IrSlot *slot = (struct IrSlot *) List_Get(slots, i);
+        if (slot->is_promoted) {
+            continue;
+        }
+
+        offset += slot->size;
+        slot->rbp_offset = offset;
+        for (int type = PRIMTYPE_CHAR; type < PRIMTYPE_COUNT; ++type) {
+            slot_operands[type][i] = MakeString("%s [rbp - %d]", size[type], offset);
+        }
+    }
+
+    for (int i = NUM_CALLER_SAVED_REGS; i < NUM_ALLOCATABLE_REGS; ++i) {
+        if (save_operands[i]) {
+            offset += 8;
+            save_operands[i] = MakeString("%s [rbp - %d]", QWORD, offset);
+        }
+    }
+
+    reg_operands = ARENA_NEW_ARRAY(arena, char *, current_func->num_regs);
+    for (int reg = 1; reg < current_func->num_regs; ++reg) {
+        if (reg_assignment[reg] != LINEAR_SCAN_SPILLED) {
+            reg_operands[reg] = allocatable_regs[reg_assignment[reg]][PRIMTYPE_PTR];
+            continue;
+        }
+
+        int lanes = reg_lanes[reg];
+        offset += 8 * lanes;
+        reg_operands[reg] = MakeString("%s [rbp - %d]", (lanes == 1) ? QWORD : ((lanes == 2) ? OWORD : YWORD), offset);
+    }
+
+    return offset;
+}
+
+static void FindConsts() {
+    const_defs = ARENA_NEW_ARRAY(current_func->arena, struct IrInstr *, current_func->num_regs);
+    memset(const_defs, 0, sizeof(struct IrInstr *) * current_func->num_regs);
+    for (int i = 0; i < current_func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&current_func->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->opcode == IR_CONST) {
+                const_defs[instr->dest] = instr;
+            }
+        }
+    }
+}
+
+// Finds the registers that hold vectors, Ssa_Destruct has turned their phis into copies.
+static void FindVectorRegs() {
+    reg_lanes = ARENA_NEW_ARRAY(current_func->arena, int, current_func->num_regs);
+    for (int reg = 0; reg < current_func->num_regs; ++reg) {
+        reg_lanes[reg] = 1;
+    }
+
+    uses_ymm = false;
+    bool has_changed = true;
+    while (has_changed) {
+        has_changed = false;
+        for (int i = 0; i < current_func->blocks.count; ++i) {
+            struct IrBlock *block = (struct IrBlock *) List_Get(&current_func->blocks, i);
+            for (int j = 0; j < block->instrs.count; ++j) {
+                struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+                bool is_reduction = instr->opcode >= IR_VREDUCE_ADD && instr->opcode <= IR_VREDUCE_MAX;
+                int lanes = 1;
+                if (Ir_IsVector(instr->opcode) && !is_reduction) {
+                    lanes = instr->imm;
+                }
+                else if (instr->opcode == IR_COPY) {
+                    lanes = reg_lanes[instr->a];
+                }
+
+                if (instr->dest != IR_NO_REG && reg_lanes[instr->dest] != lanes) {
+                    reg_lanes[instr->dest] = lanes;
+                    has_changed = true;
+                }
+
+                uses_ymm = uses_ymm || lanes > VECTORIZE_SSE2_WIDTH;
+            }
+        }
+    }
+}
+
+// Vectors stay in memory.
+static void AllocateRegisters() {
+    int num_regs = current_func->num_regs;
+    bool *is_candidate = ARENA_NEW_ARRAY(current_func->arena, bool, num_regs);
+    for (int reg = 0; reg < num_regs; ++reg) {
+        is_candidate[reg] = reg != IR_NO_REG && reg_lanes[reg] == 1;
+    }
+
+    reg_assignment = ARENA_NEW_ARRAY(current_func->arena, int, num_regs);
+    LinearScan_Allocate(current_func, is_candidate, NUM_ALLOCATABLE_REGS, NUM_CALLER_SAVED_REGS, reg_assignment);
+    memset(save_operands, 0, sizeof(save_operands));
+    for (int reg = 1; reg < num_regs; ++reg) {
+        int index = reg_assignment[reg];
+        if (index >= NUM_CALLER_SAVED_REGS) {
+            // Marks the register as used, AssignFrameOffsets gives it a slot.
+            save_operands[index] = allocatable_regs[index][PRIMTYPE_PTR];
+        }
+    }
+}
+
+static void SaveRegisters() {
+    for (int i = NUM_CALLER_SAVED_REGS; i < NUM_ALLOCATABLE_REGS; ++i) {
+        if (save_operands[i]) {
+            Mov(save_operands[i], allocatable_regs[i][PRIMTYPE_PTR]);
+        }
+    }
+}
+
+static void RestoreRegisters() {
+    for (int i = NUM_CALLER_SAVED_REGS; i < NUM_ALLOCATABLE_REGS; ++i) {
+        if (save_operands[i]) {
+            Mov(allocatable_regs[i][PRIMTYPE_PTR], save_operands[i]);
+        }
+    }
+}
+
+static void Vzeroupper() {
+    if (uses_ymm) {
+        VectorInstr("vzeroupper", NULL, NULL, NULL);
+    }
+}
+
+// More lanes than SSE2 holds take AVX2.
+static bool IsAvx(int lanes) {
+    return lanes > VECTORIZE_SSE2_WIDTH;
+}
+
+static char *VectorReg(int index, int lanes) {
+    return IsAvx(lanes) ? ymm[index] : xmm[index];
+}
+
+static void VectorMov(int lanes, char *destination, char *source) {
+    VectorInstr(IsAvx(lanes) ? "vmovdqu" : "movdqu", destination, source, NULL);
+}
+
+// destination = destination op source, with the SSE instruction op or its AVX form.
+static void VectorOp(bool avx, char *op, char *destination, char *source) {
+    char mnemonic[MAX_OPERAND_LENGTH];
+    if (avx) {
+        sprintf(mnemonic, "v%s", op);
+        VectorInstr(mnemonic, destination, destination, source);
+    }
+    else {
+        VectorInstr(op, destination, source, NULL);
+    }
+}
+
+// destination = source shifted by a constant, with the SSE instruction op or its AVX form.
+static void VectorShift(bool avx, char *op, char *destination, char *source, int amount) {
+    char mnemonic[MAX_OPERAND_LENGTH];
+    if (avx) {
+        sprintf(mnemonic, "v%s", op);
+        VectorInstrImm(mnemonic, destination, source, amount);
+    }
+    else {
+        if (destination != source) {
+            VectorInstr("movdqa", destination, source, NULL);
+        }
+
+        VectorInstrImm(op, destination, NULL, amount);
+    }
+}
+
+// Keeps the larger, or smaller, of destination and source in each lane. Lanes where
+// destination is kept are set in the mask, and destination = source ^ ((destination ^
+// source) & mask). Minimums and maximums are only vectorized for AVX2, so this always
+// uses the AVX forms: the SSE 64-bit compare would need SSE4.2.
+static void GenerateMinMax(bool is_max, char *destination, char *source, char *mask) {
+    char *greater = is_max ? destination : source;
+    char *lesser = is_max ? source : destination;
+    VectorInstr("vpcmpgtq", mask, greater, lesser);
+    VectorOp(true, "pxor", destination, source);
+    VectorOp(true, "pand", destination, mask);
+    VectorOp(true, "pxor", destination, source);
+}
+
+// Truncates each lane of xmm0/ymm0 to the type and extends it back to 64 bits.
+static void GenerateVectorCast(int lanes, enum PrimitiveType type) {
+    bool avx = IsAvx(lanes);
+    char *value = VectorReg(0, lanes);
+    char *temp = VectorReg(1, lanes);
+    if (type == PRIMTYPE_INT) {
+        // Moves the low halves of the lanes next to each other, then interleaves them with
+        // their signs.
+        VectorInstrImm(avx ? "vpshufd" : "pshufd", value, value, 0x88);
+        VectorShift(avx, "psrad", temp, value, 31);
+        VectorOp(avx, "punpckldq", value, temp);
+    }
+    else if (type == PRIMTYPE_CHAR) {
+        VectorOp(avx, "pcmpeqd", temp, temp);
+        VectorShift(avx, "psrlq", temp, temp, 56);
+        VectorOp(avx, "pand", value, temp);
+    }
+}
+
+// Combines the lanes of xmm0/ymm0 into rax.
+static void GenerateVectorReduction(int lanes, enum IrOpcode opcode) {
+    bool avx = IsAvx(lanes);
+    int num_steps = 1;
+    if (avx) {
+        VectorInstrImm("vextracti128", xmm[1], ymm[0], 1);
+        num_steps = 2;
+    }
+
+    for (int i = 0; i < num_steps; ++i) {
+        // After the upper half is folded, the upper lane is swapped into the lower one.
+        if (i == num_steps - 1) {
+            VectorInstrImm(avx ? "vpshufd" : "pshufd", xmm[1], xmm[0], 0x4e);
+        }
+
+        if (opcode == IR_VREDUCE_ADD) {
+            VectorOp(avx, "paddq", xmm[0], xmm[1]);
+        }
+        else {
+            GenerateMinMax(opcode == IR_VREDUCE_MAX, xmm[0], xmm[1], xmm[2]);
+        }
+    }
+
+    VectorInstr(avx ? "vmovq" : "movq", RAX, xmm[0], NULL);
+}
+
+static void GenerateVectorInstr(struct IrInstr *instr) {
+    int lanes = instr->imm;
+    bool avx = IsAvx(lanes);
+    char *r0 = VectorReg(0, lanes);
+    char *r1 = VectorReg(1, lanes);
+    switch (instr->opcode) {
+        case IR_VBROADCAST: {
+            Mov(RAX, Operand(instr->a));
+            VectorInstr(avx ? "vmovq" : "movq", xmm[0], RAX, NULL);
+            if (avx) {
+                VectorInstr("vpbroadcastq", r0, xmm[0], NULL);
+            }
+            else {
+                VectorInstr("punpcklqdq", r0, r0, NULL);
+            }
+        } break;
+        case IR_VLOAD: {
+            Mov(RAX, Operand(instr->a));
+            VectorMov(lanes, r0, "[rax]");
+        } break;
+        case IR_VSTORE: {
+            Mov(RAX, Operand(instr->a));
+            VectorMov(lanes, r0, Operand(instr->b));
+            VectorMov(lanes, "[rax]", r0);
+        } return;
+        case IR_VCAST: {
+            VectorMov(lanes, r0, Operand(instr->a));
+            GenerateVectorCast(lanes, instr->type);
+        } break;
+        case IR_VADD:
+        case IR_VSUB:
+        case IR_VMIN:
+        case IR_VMAX: {
+            VectorMov(lanes, r0, Operand(instr->a));
+            VectorMov(lanes, r1, Operand(instr->b));
+            if (instr->opcode == IR_VADD || instr->opcode == IR_VSUB) {
+                VectorOp(avx, (instr->opcode == IR_VADD) ? "paddq" : "psubq", r0, r1);
+            }
+            else {
+                GenerateMinMax(instr->opcode == IR_VMAX, r0, r1, VectorReg(2, lanes));
+            }
+        } break;
+        case IR_VREDUCE_ADD:
+        case IR_VREDUCE_MIN:
+        case IR_VREDUCE_MAX: {
+            VectorMov(lanes, r0, Operand(instr->a));
+            GenerateVectorReduction(lanes, instr->opcode);
+            Mov(Operand(instr->dest), RAX);
+        } return;
+    }
+
+    VectorMov(lanes, Operand(instr->dest), r0);
+}
+
+static void GenerateCompare(struct IrInstr *instr, char *set_instr) {
+    // cmp takes a memory operand on the right when the left one is a register.
+    char *a = Operand(instr->a);
+    if (reg_assignment[instr->a] == LINEAR_SCAN_SPILLED) {
+        Mov(RAX, a);
+        a = RAX;
+    }
+
+    Compare(a, Operand(instr->b), set_instr);
+    Movzx(RAX, AL);
+}
+
+static void GenerateLoad(char *source, enum PrimitiveType type) {
+    switch (type) {
+        case PRIMTYPE_CHAR: { Movzx(RAX, source); } break;
+        case PRIMTYPE_INT:  { Movsxd(RAX, source); } break;
+        default:            { Mov(RAX, source); } break;
+    }
+}
+
+// Where an instruction can compute its result: in the machine register of the result,
+// unless late_operand is in the same register and is read after the result is written.
+static char *ResultReg(struct IrInstr *instr, int late_operand) {
+    bool is_overwritten = late_operand != IR_NO_REG && Operand(late_operand) == Operand(instr->dest);
+    return (reg_assignment[instr->dest] == LINEAR_SCAN_SPILLED || is_overwritten) ? RAX : Operand(instr->dest);
+}
+
+static void MovIfDifferent(char *destination, char *source) {
+    if (destination != source) {
+        Mov(destination, source);
+    }
+}
+
+static void GenerateInstr(struct IrInstr *instr, struct IrBlock *next_block) {
+    if (Ir_IsVector(instr->opcode)) {
+        GenerateVectorInstr(instr);
+        return;
+    }
+
+    char *result = RAX;
+    switch (instr->opcode) {
+        case IR_NOP: {
+        } return;
+        case IR_CONST: {
+            result = ResultReg(instr, IR_NO_REG);
+            MovImm(result, instr->imm);
+        } break;
+        case IR_COPY: {
+            int lanes = reg_lanes[instr->dest];
+            if (lanes > 1) {
+                VectorMov(lanes, VectorReg(0, lanes), Operand(instr->a));
+                VectorMov(lanes, Operand(instr->dest), VectorReg(0, lanes));
+                return;
+            }
+
+            result = ResultReg(instr, IR_NO_REG);
+            MovIfDifferent(result, Operand(instr->a));
+        } break;
+        case IR_PARAM: {
+            if (instr->imm >= 4) {
+                ReportInternalError("IrCodeGeneratorX86::GenerateInstr - more than 4 parameters");
+            }
+
+            result = ResultReg(instr, IR_NO_REG);
+            Mov(result, param_regs[instr->imm][PRIMTYPE_PTR]);
+        } break;
+        case IR_CAST: {
+            int index = reg_assignment[instr->dest];
+            char **result_regs = (index == LINEAR_SCAN_SPILLED) ? rax : allocatable_regs[index];
+            result = result_regs[PRIMTYPE_PTR];
+            MovIfDifferent(result, Operand(instr->a));
+            if (instr->type == PRIMTYPE_CHAR) {
+                Movzx(result, result_regs[PRIMTYPE_CHAR]);
+            }
+            else if (instr->type == PRIMTYPE_INT) {
+                Movsxd(result, result_regs[PRIMTYPE_INT]);
+            }
+        } break;
+        case IR_NEG: {
+            result = ResultReg(instr, IR_NO_REG);
+            MovIfDifferent(result, Operand(instr->a));
+            Neg(result);
+        } break;
+        case IR_ADD: {
+            result = ResultReg(instr, instr->b);
+            MovIfDifferent(result, Operand(instr->a));
+            Add(result, Operand(instr->b));
+        } break;
+        case IR_SUB: {
+            result = ResultReg(instr, instr->b);
+            MovIfDifferent(result, Operand(instr->a));
+            Sub(result, Operand(instr->b));
+        } break;
+        case IR_MUL: {
+            // Multiplying by a constant, such as when scaling an index, avoids imul if it can.
+            if (const_defs[instr->a] || const_defs[instr->b]) {
+                struct IrInstr *factor = const_defs[instr->a] ? const_defs[instr->a] : const_defs[instr->b];
+                result = ResultReg(instr, IR_NO_REG);
+                MovIfDifferent(result, Operand(const_defs[instr->a] ? instr->b : instr->a));
+                MulImm(result, factor->imm);
+            }
+            else {
+                Mov(RAX, Operand(instr->a));
+                Mul(RAX, Operand(instr->b));
+            }
+        } break;
+        case IR_DIV: {
+            Mov(RAX, Operand(instr->a));
+            Div(Operand(instr->b));
+        } break;
+        case IR_EQU: { GenerateCompare(instr, "sete"); } break;
+        case IR_NEQ: { GenerateCompare(instr, "setne"); } break;
+        case IR_LT:  { GenerateCompare(instr, "setl"); } break;
+        case IR_GT:  { GenerateCompare(instr, "setg"); } break;
+        case IR_LTE: { GenerateCompare(instr, "setle"); } break;
+        case IR_GTE: { GenerateCompare(instr, "setge"); } break;
+        case IR_SLOT_ADDR: {
+            struct IrSlot *slot = (struct IrSlot *) List_Get(&current_func->slots, instr->imm);
+            result = ResultReg(instr, IR_NO_REG);
+            Lea(result, slot->rbp_offset);
+        } break;
+        case IR_DATA_ADDR: {
+            result = ResultReg(instr, IR_NO_REG);
+            MovDataField(result, instr->imm);
+        } break;
+        case IR_LOAD: {
+            Mov(RAX, Operand(instr->a));
+            switch (instr->type) {
+                case PRIMTYPE_CHAR: { GenerateLoad("byte [rax]", instr->type); } break;
+                case PRIMTYPE_INT:  { GenerateLoad("dword [rax]", instr->type); } break;
+                default:            { GenerateLoad("qword [rax]", instr->type); } break;
+            }
+        } break;
+        case IR_LOAD_SLOT: {
+            GenerateLoad(SlotOperand(instr->imm, instr->type), instr->type);
+        } break;
+        case IR_STORE: {
+            Mov(RDI, Operand(instr->a));
+            Mov(RAX, Operand(instr->b));
+            WriteMemToReg(RDI, rax[instr->type]);
+        } return;
+        case IR_STORE_SLOT: {
+            Mov(RAX, Operand(instr->a));
+            Mov(SlotOperand(instr->imm, instr->type), rax[instr->type]);
+        } return;
+        case IR_CALL: {
+            if (instr->num_args > 4) {
+                ReportInternalError("IrCodeGeneratorX86::GenerateInstr - more than 4 arguments");
+            }
+
+            for (int i = 0; i < instr->num_args; ++i) {
+                Mov(param_regs[i][PRIMTYPE_PTR], Operand(instr->args[i]));
+            }
+
+            Vzeroupper();
+            Call(instr->name);
+        } break;
+        case IR_PHI: {
+            ReportInternalError("IrCodeGeneratorX86::GenerateInstr - phi must be removed before code generation");
+        } return;
+        case IR_JUMP: {
+            if (instr->target != next_block) {
+                JmpToLabelId(block_label, instr->target->id);
+            }
+        } return;
+        case IR_BRANCH: {
+            Mov(RAX, Operand(instr->a));
+            JumpIfZero(block_label, instr->target2->id);
+            if (instr->target != next_block) {
+                JmpToLabelId(block_label, instr->target->id);
+            }
+        } return;
+        case IR_RETURN: {
+            if (instr->a != IR_NO_REG) {
+                Mov(RAX, Operand(instr->a));
+            }
+
+            if (next_block) {
+                JmpToReturn(current_func->name);
+            }
+        } return;
+    }
+
+    if (instr->dest != IR_NO_REG) {
+        MovIfDifferent(Operand(instr->dest), result);
+    }
+}
+
+// A call whose result is returned right away.
+static bool IsTailCall(struct IrInstr *instr, struct IrInstr *next) {
+    return instr->opcode == IR_CALL && next && next->opcode == IR_RETURN && (next->a == IR_NO_REG || next->a == instr->dest);
+}
+
+static void GenerateTailCall(struct IrInstr *call) {
+    if (call->num_args > 4) {
+        ReportInternalError("IrCodeGeneratorX86::GenerateTailCall - more than 4 arguments");
+    }
+
+    for (int i = 0; i < call->num_args; ++i) {
+        Mov(param_regs[i][PRIMTYPE_PTR], Operand(call->args[i]));
+    }
+
+    RestoreRegisters();
+    Vzeroupper();
+    TailCall(call->name);
+}
+
+static void GenerateFunction(struct IrFunction *func) {
+    current_func = func;
+    Ssa_Destruct(func);
+
+    // The operands, register maps and labels below are only needed while the function is
+    // emitted, so their memory is given back to the arena afterwards.
+    struct ArenaMark mark = Arena_Mark(func->arena);
+    block_label = MakeString("%s.bb", func->name, 0);
+    FindConsts();
+    FindVectorRegs();
+    AllocateRegisters();
+
+    // Reserve 32 bytes for the shadow space.
+    const int shadow_space = 32;
+    int stack_size = Align(AssignFrameOffsets() + shadow_space, 16);
+    Label(func->name);
+    SetupStackFrame(stack_size);
+    SaveRegisters();
+
+    struct List *blocks = &func->blocks;
+    for (int i = 0; i < blocks->count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(blocks, i);
+        struct IrBlock *next_block = (i + 1 < blocks->count) ? (struct IrBlock *) List_Get(blocks, i + 1) : NULL;
+        LabelId(block_label, block->id);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            struct IrInstr *next = (j + 1 < block->instrs.count) ? (struct IrInstr *) List_Get(&block->instrs, j + 1) : NULL;
+            if (IsTailCall(instr, next)) {
+                GenerateTailCall(instr);
+                break;
+            }
+
+            GenerateInstr(instr, next_block);
+        }
+    }
+
+    ReturnLabel(func->name);
+    RestoreRegisters();
+    Vzeroupper();
+    RestoreStackFrame();
+    EmitChar('\n');
+    Arena_Release(func->arena, mark);
+    current_func = NULL;
+}
+
+
+//
+// ===
+// == Functions defined in IrCodeGeneratorX86.h
+// ===
+//
+
+
+void IrCodeGeneratorX86_GenerateCode(FILE *asm_file, struct IrProgram *program) {
+    SetOutput(asm_file);
+    SetupAssemblyFile();
+    SetupDataSection(&program->data_fields);
+    SetupTextSection();
+    for (int i = 0; i < program->functions.count; ++i) {
+        GenerateFunction((struct IrFunction *) List_Get(&program->functions, i));
+    }
+
+    FlushOutput();
+}
@@ -0,0 +1,9 @@
+#ifndef MINIC_IR_CODE_GENERATOR_X86_H
+#define MINIC_IR_CODE_GENERATOR_X86_H
+#include "Ir.h"
+#include <stdio.h>
+
+// Selects x86 instructions for the IR. Every virtual register gets its own stack slot.
+void IrCodeGeneratorX86_GenerateCode(FILE *asm_file, struct IrProgram *program);
+
+#endif // MINIC_IR_CODE_GENERATOR_X86_H
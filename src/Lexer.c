@@ -1,21 +1,45 @@
 #include "Lexer.h"
+#include "Intern.h"
 #include "ReportError.h"
-#include <assert.h>
+#include "Scanner.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define NEW_TYPE(type) ((struct type *) malloc(sizeof(struct type)))
+#define NEW_TYPE(type) ARENA_NEW(l->arena, type)
 
 
-typedef bool (*IsAllowedInSequenceFunction)(char *);
+enum CharClass {
+    CHAR_DIGIT              = 1 << 0,
+    CHAR_IDENTIFIER_START   = 1 << 1,
+    CHAR_IDENTIFIER         = 1 << 2,
+};
 
-static bool IsAlphabetic(char c);
-static bool IsDigit(char c);
+#define A (CHAR_IDENTIFIER_START | CHAR_IDENTIFIER)
+#define D (CHAR_DIGIT | CHAR_IDENTIFIER)
+
+static const unsigned char char_classes[256] = {
+    ['0'] = D, ['1'] = D, ['2'] = D, ['3'] = D, ['4'] = D, ['5'] = D, ['6'] = D, ['7'] = D, ['8'] = D, ['9'] = D,
+    ['A'] = A, ['B'] = A, ['C'] = A, ['D'] = A, ['E'] = A, ['F'] = A, ['G'] = A, ['H'] = A, ['I'] = A,
+    ['J'] = A, ['K'] = A, ['L'] = A, ['M'] = A, ['N'] = A, ['O'] = A, ['P'] = A, ['Q'] = A, ['R'] = A,
+    ['S'] = A, ['T'] = A, ['U'] = A, ['V'] = A, ['W'] = A, ['X'] = A, ['Y'] = A, ['Z'] = A,
+    ['a'] = A, ['b'] = A, ['c'] = A, ['d'] = A, ['e'] = A, ['f'] = A, ['g'] = A, ['h'] = A, ['i'] = A,
+    ['j'] = A, ['k'] = A, ['l'] = A, ['m'] = A, ['n'] = A, ['o'] = A, ['p'] = A, ['q'] = A, ['r'] = A,
+    ['s'] = A, ['t'] = A, ['u'] = A, ['v'] = A, ['w'] = A, ['x'] = A, ['y'] = A, ['z'] = A,
+    ['_'] = A,
+};
+
+#undef A
+#undef D
+
+
+static int64_t NumCharsLeft(struct Lexer *l);
 static char PeekChar(struct Lexer *l);
 static struct Token MakeToken(struct Lexer *l);
-static void ReadSequence(struct Lexer *l, char *buffer, IsAllowedInSequenceFunction IsAllowed);
-static enum TokenType TypeOfIdentifier(char *identifier);
+static struct Token LexToken(struct Lexer *l);
+static char *ReadIdentifier(struct Lexer *l, int *length);
+static char *ReadUntil(struct Lexer *l, char c);
+static enum TokenType TypeOfIdentifier(char *identifier, int length);
 
 static void AddToken(struct Lexer *l, struct Token token) {
     token.line = l->line;
@@ -23,83 +47,42 @@ static void AddToken(struct Lexer *l, struct Token token) {
     l->token_index = (l->token_index + 1) % LEXER_TOKEN_CACHE_SIZE;
 }
 
-static void AddTokenWithType(struct Lexer *l, enum TokenType type) {
-    struct Token token = MakeToken(l);
-    token.type = type;
-    AddToken(l, token);
-}
-
 static void EatChar(struct Lexer *l) {
     l->code_index += 1;
 }
 
 static void EatWhitespaceAndComments(struct Lexer *l) {
-    bool is_done = false;
-    while (!is_done) {
-        switch (PeekChar(l)) {
-            case '\n':
-            case '\r': {
-                l->line += 1;
-                EatChar(l);
-            } break;
-            case ' ': {
-                EatChar(l);
-            } break;
-            case '/': {
-                // TODO: This is an unsafe access to code. Might be out of bound.
-                if (l->code[l->code_index + 1] == '/') {
-                    while (PeekChar(l) != '\n') {
-                        EatChar(l);
-                    }
-                }
-                else if (l->code[l->code_index + 1] == '*') {
-                    while (!(PeekChar(l) == '*' && l->code[l->code_index + 1] == '/')) {
-                        EatChar(l);
-                    }
-
-                    EatChar(l);
-                    EatChar(l);
-                }
-                else {
-                    is_done = true;
-                }
-            } break;
-            default: {
-                is_done = true;
-            } break;
+    char *end = l->code + l->code_length;
+    char *p = l->code + l->code_index;
+    while (true) {
+        int num_newlines = 0;
+        p = Scanner_SkipWhitespace(p, end, &num_newlines);
+        l->line += num_newlines;
+
+        // Peeking one past the end is safe because the code ends with a '\0' sentinel.
+        if (p[0] == '/' && p[1] == '/') {
+            // The newline itself is eaten, and counted, as whitespace.
+            p = Scanner_FindNewline(p + 2, end);
         }
-    }
-}
+        else if (p[0] == '/' && p[1] == '*') {
+            char *comment_end = Scanner_FindCommentEnd(p + 2, end, &num_newlines);
+            if (comment_end == end) {
+                ReportErrorAt(l, p, "unterminated comment");
+            }
 
-static struct Directive *FindDirectiveByIdentifier(struct Lexer *l, char *identifier) {
-    for (int i = 0; i < l->directives.count; ++i) {
-        struct Directive *directive = (struct Directive *) List_Get(&l->directives, i);
-        if (strcmp(directive->identifier, identifier) == 0) {
-            return directive;
+            l->line += num_newlines;
+            p = comment_end + 2;
+        }
+        else {
+            break;
         }
     }
 
-    return NULL;
-}
-
-static bool IsAllowedInIdentifier(char *c) {
-    return IsAlphabetic(*c) || IsDigit(*c) || *c == '_';
-}
-
-static bool IsAllowedInStringLiteral(char *c) {
-    return IsAlphabetic(*c) || IsDigit(*c) || *c != '"' || *c == '%';
-}
-
-static bool IsNotNewline(char *c) {
-    return *c != '\n';
+    l->code_index = p - l->code;
 }
 
-static bool IsAlphabetic(char c) {
-    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
-}
-
-static bool IsDigit(char c) {
-    return '0' <= c && c <= '9';
+static bool IsCharClass(char c, enum CharClass char_class) {
+    return (char_classes[(unsigned char) c] & char_class) != 0;
 }
 
 static struct Token MakeToken(struct Lexer *l) {
@@ -109,7 +92,7 @@ static struct Token MakeToken(struct Lexer *l) {
     return token;
 }
 
-static int NumCharsLeft(struct Lexer *l) {
+static int64_t NumCharsLeft(struct Lexer *l) {
     return l->code_length - l->code_index;
 }
 
@@ -117,24 +100,67 @@ static char PeekChar(struct Lexer *l) {
     return l->code[l->code_index];
 }
 
-static void PreprocessDefine(struct Lexer *l) {
-    struct Directive *directive = NEW_TYPE(Directive);
-    directive->type = TOKEN_KEYWORD_DEFINE;
+// Lexes the rest of the line into tokens. If tokens is NULL the tokens are only counted.
+// Macros that are already defined are expanded in place, so a body never has to be rescanned.
+static int TokenizeLine(struct Lexer *l, struct Token *tokens) {
+    int64_t code_length = l->code_length;
+    char *line_end = Scanner_FindNewline(l->code + l->code_index, l->code + code_length);
+    l->code_length = line_end - l->code;
+
+    int num_tokens = 0;
+    struct Token token = LexToken(l);
+    while (token.type != TOKEN_END_OF_FILE) {
+        struct Macro *macro = NULL;
+        if (token.type == TOKEN_IDENTIFIER) {
+            macro = (struct Macro *) HashMap_Get(&l->macros, token.str_value);
+        }
 
-    ReadSequence(l, directive->identifier, IsAllowedInIdentifier);
-    EatWhitespaceAndComments(l);
-    ReadSequence(l, directive->value, IsNotNewline);
-    List_Add(&l->directives, directive);
+        if (macro) {
+            if (tokens) {
+                memcpy(tokens + num_tokens, macro->tokens, macro->num_tokens * sizeof(struct Token));
+            }
+
+            num_tokens += macro->num_tokens;
+        }
+        else {
+            if (tokens) {
+                tokens[num_tokens] = token;
+            }
+
+            num_tokens += 1;
+        }
+
+        token = LexToken(l);
+    }
+
+    l->code_length = code_length;
+    return num_tokens;
+}
+
+static void PreprocessDefine(struct Lexer *l) {
+    struct Macro *macro = NEW_TYPE(Macro);
+    int length;
+    macro->identifier = ReadIdentifier(l, &length);
+
+    // Count the tokens first, so the body can be stored in an array of exactly the right size.
+    int64_t body_index = l->code_index;
+    int line = l->line;
+    macro->num_tokens = TokenizeLine(l, NULL);
+    macro->tokens = (struct Token *) Arena_Alloc(l->arena, macro->num_tokens * sizeof(struct Token));
+    l->code_index = body_index;
+    l->line = line;
+    TokenizeLine(l, macro->tokens);
+    HashMap_Put(&l->macros, macro->identifier, macro);
 }
 
 static void Preprocess(struct Lexer *l) {
     if (PeekChar(l) == '#') {
         EatChar(l);
-        char identifier[TOKEN_MAX_IDENTIFIER_LENGTH];
-        ReadSequence(l, identifier, IsAllowedInIdentifier);
+        int length;
+        char *identifier = ReadIdentifier(l, &length);
         EatWhitespaceAndComments(l);
 
-        enum TokenType keyword = TypeOfIdentifier(identifier);
+        enum TokenType keyword = TypeOfIdentifier(identifier, length);
         switch (keyword) {
             case TOKEN_KEYWORD_DEFINE: { PreprocessDefine(l); } break;
             default: {
@@ -146,99 +172,68 @@ static void Preprocess(struct Lexer *l) {
     }
 }
 
-static void ReadSequence(struct Lexer *l, char *buffer, IsAllowedInSequenceFunction IsAllowed) {
-    int length = 0;
-    while (NumCharsLeft(l) > 0) {
-        char *c = l->code + l->code_index;
-        if (!IsAllowed(c)) {
-            break;
-        }
+// Returns the interned identifier.
+static char *ReadIdentifier(struct Lexer *l, int *length) {
+    char *start = l->code + l->code_index;
+    char *end = Scanner_SkipIdentifier(start, l->code + l->code_length);
+    *length = (int) (end - start);
+    l->code_index += *length;
+    return Intern_String(start, *length);
+}
 
-        buffer[length] = *c;
-        length += 1;
+// Returns the interned sequence of characters up to, but not including, c.
+static char *ReadUntil(struct Lexer *l, char c) {
+    char *start = l->code + l->code_index;
+    while (NumCharsLeft(l) > 0 && PeekChar(l) != c) {
         EatChar(l);
     }
 
-    buffer[length] = '\0';
-}
-
-static enum TokenType TypeOfIdentifier(char *identifier) {
-    if (strcmp(identifier, "char") == 0)    return TOKEN_KEYWORD_CHAR;
-    if (strcmp(identifier, "define") == 0)  return TOKEN_KEYWORD_DEFINE;
-    if (strcmp(identifier, "else") == 0)    return TOKEN_KEYWORD_ELSE;
-    if (strcmp(identifier, "for") == 0)     return TOKEN_KEYWORD_FOR;
-    if (strcmp(identifier, "int") == 0)     return TOKEN_KEYWORD_INT;
-    if (strcmp(identifier, "if") == 0)      return TOKEN_KEYWORD_IF;
-    if (strcmp(identifier, "return") == 0)  return TOKEN_KEYWORD_RETURN;
-    if (strcmp(identifier, "sizeof") == 0)  return TOKEN_KEYWORD_SIZEOF;
-    if (strcmp(identifier, "struct") == 0)  return TOKEN_KEYWORD_STRUCT;
-    if (strcmp(identifier, "while") == 0)   return TOKEN_KEYWORD_WHILE;
-    return TOKEN_IDENTIFIER;
-}
-
-static struct Token *PopTokenQueue(struct Lexer *l) {
-    struct Token *token = (struct Token *) List_Get(&l->token_queue, l->token_queue_tail);
-    l->token_queue_tail += 1;
-    return token;
+    return Intern_String(start, (int) (l->code + l->code_index - start));
 }
 
-static void ParseDirectiveValue(struct Lexer *l, char *value) {
-    struct Lexer temp_l;
-    Lexer_Init(&temp_l, value, (int) strlen(value));
-    while (true) {
-        struct Token token = Lexer_PeekToken(&temp_l);
-        if (token.type == TOKEN_END_OF_FILE) {
-            break;
-        }
-
-        struct Token *t = (struct Token *) malloc(sizeof(struct Token));
-        t->int_value = token.int_value;
-        t->line = token.line;
-        t->location = token.location;
-        strcpy(t->str_value, token.str_value);
-        t->type = token.type;
-        List_Add(&l->token_queue, t);
-        Lexer_EatToken(&temp_l);
-    }
-}
-
-
-//
-// ===
-// == Functions defined in Lexer.h
-// ===
-//
-
-
-void Lexer_EatToken(struct Lexer *l) {
-    char c = PeekChar(l);
-    while (c == '#') {
-        Preprocess(l);
-        EatWhitespaceAndComments(l);
-        c = PeekChar(l);
+static enum TokenType TypeOfIdentifier(char *identifier, int length) {
+#define MATCH(keyword, type) if (memcmp(identifier, keyword, length) == 0) return type; break
+    // Every keyword is identified by its length and first character,
+    // so at most one comparison is made per identifier.
+    switch (length) {
+        case 2: switch (identifier[0]) {
+            case 'i': MATCH("if", TOKEN_KEYWORD_IF);
+        } break;
+        case 3: switch (identifier[0]) {
+            case 'f': MATCH("for", TOKEN_KEYWORD_FOR);
+            case 'i': MATCH("int", TOKEN_KEYWORD_INT);
+        } break;
+        case 4: switch (identifier[0]) {
+            case 'c': MATCH("char", TOKEN_KEYWORD_CHAR);
+            case 'e': MATCH("else", TOKEN_KEYWORD_ELSE);
+        } break;
+        case 5: switch (identifier[0]) {
+            case 'w': MATCH("while", TOKEN_KEYWORD_WHILE);
+        } break;
+        case 6: switch (identifier[0]) {
+            case 'd': MATCH("define", TOKEN_KEYWORD_DEFINE);
+            case 'r': MATCH("return", TOKEN_KEYWORD_RETURN);
+            case 's': switch (identifier[1]) {
+                case 'i': MATCH("sizeof", TOKEN_KEYWORD_SIZEOF);
+                case 't': MATCH("struct", TOKEN_KEYWORD_STRUCT);
+            } break;
+        } break;
     }
+#undef MATCH
 
-    if (l->token_queue_tail < l->token_queue.count) {
-        struct Token *t = PopTokenQueue(l);
-        AddToken(l, *t);
-        return;
-    }
-    else if (l->token_queue_tail == l->token_queue.count) {
-        l->token_queue_tail = 0;
-        l->token_queue.count = 0;
-    }
-    else {
-        assert(false);
-    }
+    return TOKEN_IDENTIFIER;
+}
 
+// Lexes the next token, without expanding macros.
+static struct Token LexToken(struct Lexer *l) {
     EatWhitespaceAndComments(l);
+    struct Token token = MakeToken(l);
     if (NumCharsLeft(l) == 0) {
-        AddTokenWithType(l, TOKEN_END_OF_FILE);
-        return;
+        token.type = TOKEN_END_OF_FILE;
+        return token;
     }
 
-    struct Token token = MakeToken(l);
-    c = PeekChar(l);
+    char c = PeekChar(l);
     switch (c) {
         case ',': { EatChar(l); token.type = TOKEN_COMMA; } break;
         case '.': { EatChar(l); token.type = TOKEN_DOT; } break;
@@ -308,7 +303,7 @@ void Lexer_EatToken(struct Lexer *l) {
         } break;
         case '"': {
             EatChar(l);
-            ReadSequence(l, token.str_value, IsAllowedInStringLiteral);
+            token.str_value = ReadUntil(l, '"');
             token.type = TOKEN_LITERAL_STRING;
             if (PeekChar(l) != '"') {
                 char *location = l->code + l->code_index;
@@ -318,32 +313,18 @@ void Lexer_EatToken(struct Lexer *l) {
             EatChar(l);
         } break;
         default: {
-            if (IsAlphabetic(c) || c == '_') {
-                ReadSequence(l, token.str_value, IsAllowedInIdentifier);
-                struct Directive *directive = FindDirectiveByIdentifier(l, token.str_value);
-                if (directive) {
-                    ParseDirectiveValue(l, directive->value);
-                    if (l->token_queue_tail < l->token_queue.count) {
-                        struct Token *t = PopTokenQueue(l);
-                        AddToken(l, *t);
-                        return;
-                    }
-                    else {
-                        ReportInternalError("error with directive???");
-                    }
-                }
-                else {
-                    token.type = TypeOfIdentifier(token.str_value);
-                }
+            if (IsCharClass(c, CHAR_IDENTIFIER_START)) {
+                int length;
+                token.str_value = ReadIdentifier(l, &length);
+                token.type = TypeOfIdentifier(token.str_value, length);
             }
-            else if (IsDigit(c)) {
+            else if (IsCharClass(c, CHAR_DIGIT)) {
                 char *p = l->code + l->code_index;
                 char *q = p;
                 token.int_value = strtoul(p, &p, 10);
                 token.type = TOKEN_LITERAL_NUMBER;
 
-                int len = (int) (p - q);
-                l->code_index += len;
+                l->code_index += p - q;
             }
             else {
                 char *location = l->code + l->code_index;
@@ -352,28 +333,129 @@ void Lexer_EatToken(struct Lexer *l) {
         } break;
     }
 
+    return token;
+}
+
+
+//
+// ===
+// == Functions defined in Lexer.h
+// ===
+//
+
+
+void Lexer_EatToken(struct Lexer *l) {
+    if (l->is_tokenized) {
+        if (l->token_position < l->num_tokens - 1) {
+            l->token_position += 1;
+        }
+
+        return;
+    }
+
+    if (l->expansion) {
+        AddToken(l, l->expansion->tokens[l->expansion_index]);
+        l->expansion_index += 1;
+        if (l->expansion_index == l->expansion->num_tokens) {
+            l->expansion = NULL;
+        }
+
+        return;
+    }
+
+    EatWhitespaceAndComments(l);
+    while (PeekChar(l) == '#') {
+        Preprocess(l);
+        EatWhitespaceAndComments(l);
+    }
+
+    struct Token token = LexToken(l);
+    if (token.type == TOKEN_IDENTIFIER) {
+        struct Macro *macro = (struct Macro *) HashMap_Get(&l->macros, token.str_value);
+        if (macro) {
+            if (macro->num_tokens > 0) {
+                l->expansion = macro;
+                l->expansion_index = 0;
+            }
+
+            // Either the first token of the expansion, or the token after an empty macro.
+            Lexer_EatToken(l);
+            return;
+        }
+    }
+
     AddToken(l, token);
 }
 
-void Lexer_Init(struct Lexer *l, char *code, int code_len) {
-    List_Init(&l->token_queue);
-    List_Init(&l->directives);
+void Lexer_Init(struct Lexer *l, struct Arena *arena, char *code, int64_t code_len) {
+    Scanner_Init();
+    l->arena = arena;
+    HashMap_Init(&l->macros);
+    l->expansion = NULL;
+    l->expansion_index = 0;
+    l->token_array = NULL;
+    l->num_tokens = 0;
+    l->token_position = 0;
+    l->is_tokenized = false;
     l->code = code;
     l->code_index = 0;
     l->code_length = code_len;
     l->line = 1;
     l->token_index = 0;
-    l->token_queue_tail = 0;
     for (int i = 0; i < LEXER_TOKEN_CACHE_SIZE; ++i) {
         Lexer_EatToken(l);
     }
 }
 
+void Lexer_Free(struct Lexer *l) {
+    HashMap_Free(&l->macros);
+    free(l->token_array);
+    l->token_array = NULL;
+    l->num_tokens = 0;
+}
+
 struct Token Lexer_PeekToken(struct Lexer *l) {
     return Lexer_PeekToken2(l, 0);
 }
 
 struct Token Lexer_PeekToken2(struct Lexer *l, int offset) {
+    if (l->is_tokenized) {
+        // Peeking past the end keeps returning the end of file token.
+        int64_t index = l->token_position + offset;
+        return l->token_array[(index < l->num_tokens) ? index : l->num_tokens - 1];
+    }
+
     int index = (l->token_index + offset) % LEXER_TOKEN_CACHE_SIZE;
     return l->tokens[index];
 }
+
+void Lexer_Tokenize(struct Lexer *l) {
+    // Roughly one token per 4 characters, the array grows if that is not enough.
+    int64_t capacity = l->code_length / 4 + 16;
+    struct Token *token_array = (struct Token *) malloc(capacity * sizeof(struct Token));
+    int64_t num_tokens = 0;
+    while (true) {
+        if (num_tokens == capacity) {
+            capacity *= 2;
+            token_array = (struct Token *) realloc(token_array, capacity * sizeof(struct Token));
+        }
+
+        if (!token_array) {
+            ReportInternalError("out of memory");
+        }
+
+        struct Token token = Lexer_PeekToken(l);
+        token_array[num_tokens] = token;
+        num_tokens += 1;
+        if (token.type == TOKEN_END_OF_FILE) {
+            break;
+        }
+
+        Lexer_EatToken(l);
+    }
+
+    l->token_array = token_array;
+    l->num_tokens = num_tokens;
+    l->token_position = 0;
+    l->is_tokenized = true;
+}
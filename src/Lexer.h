@@ -1,37 +1,54 @@
 #ifndef MINIC_LEXER_H
 #define MINIC_LEXER_H
-#include "List.h"
+#include "Arena.h"
+#include "HashMap.h"
 #include "Token.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 #define LEXER_TOKEN_CACHE_SIZE 2
 
 
-struct Directive {
-    enum TokenType type;
-    char identifier[TOKEN_MAX_IDENTIFIER_LENGTH];
-    // TODO: What should length of value be?
-    char value[128];
+// The body of a #define is tokenized once, when the macro is defined.
+// Expanding the macro hands out its tokens without copying them.
+struct Macro {
+    char *identifier;
+    struct Token *tokens;
+    int num_tokens;
 };
 
 struct Lexer {
+    struct Arena *arena;
+    // Tokens are read from one of two places. By default they are lexed on demand
+    // into a small ring buffer. After Lexer_Tokenize all of them are in token_array.
     struct Token tokens[LEXER_TOKEN_CACHE_SIZE];
-    struct List token_queue;
-    struct List directives;
+    struct Token *token_array;
+    int64_t num_tokens;
+    int64_t token_position;
+    bool is_tokenized;
+    struct HashMap macros; // Interned identifier -> struct Macro *
+    struct Macro *expansion;
+    int expansion_index;
     char *code;
-    int code_index;
-    int code_length;
+    int64_t code_index;
+    int64_t code_length;
     int line;
     int token_index;
-    int token_queue_tail;
 };
 
 void Lexer_EatToken(struct Lexer *l);
 
-void Lexer_Init(struct Lexer *l, char *code, int code_len);
+void Lexer_Free(struct Lexer *l);
+
+// The code must be followed by a '\0' sentinel (code[code_len] == '\0').
+void Lexer_Init(struct Lexer *l, struct Arena *arena, char *code, int64_t code_len);
 
 struct Token Lexer_PeekToken(struct Lexer *l);
 
 struct Token Lexer_PeekToken2(struct Lexer *l, int offset);
 
+// Lexes the rest of the translation unit into a contiguous array. Afterwards
+// Lexer_PeekToken2 accepts any offset.
+void Lexer_Tokenize(struct Lexer *l);
+
 #endif // MINIC_LEXER_H
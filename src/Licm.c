@@ -0,0 +1,152 @@
+#include "Licm.h"
+#include "Dominators.h"
+#include "Loops.h"
+#include "ReportError.h"
+#include <stdlib.h>
+
+
+static struct IrBlock **def_blocks; // Register -> block that defines it
+
+
+static bool IsHoistable(struct IrInstr *instr) {
+    switch (instr->opcode) {
+        case IR_CONST:
+        case IR_COPY:
+        case IR_CAST:
+        case IR_NEG:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_EQU:
+        case IR_NEQ:
+        case IR_LT:
+        case IR_GT:
+        case IR_LTE:
+        case IR_GTE:
+        case IR_SLOT_ADDR:
+        case IR_DATA_ADDR: {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool HasInvariantOperands(struct IrInstr *instr, struct Loop *loop) {
+    int *uses[64];
+    if (2 + instr->num_args > 64) {
+        ReportInternalError("Licm::HasInvariantOperands - too many arguments");
+    }
+
+    int num_uses = Ir_GetUses(instr, uses);
+    for (int i = 0; i < num_uses; ++i) {
+        struct IrBlock *def_block = def_blocks[*uses[i]];
+        if (def_block && Loops_Contains(loop, def_block)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool WritesMemory(struct Loop *loop) {
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->opcode == IR_STORE || instr->opcode == IR_STORE_SLOT || instr->opcode == IR_VSTORE || instr->opcode == IR_CALL) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// A load through a pointer may only run if the loop would have run it anyway.
+static bool DominatesExits(struct IrBlock *block, struct Loop *loop) {
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *exiting = (struct IrBlock *) List_Get(&loop->blocks, i);
+        struct IrBlock *succs[2];
+        int num_succs = Ir_Successors(exiting, succs);
+        for (int j = 0; j < num_succs; ++j) {
+            if (!Loops_Contains(loop, succs[j]) && !Dominators_Dominates(block, exiting)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void HoistFromLoop(struct Loop *loop) {
+    struct IrBlock *preheader = loop->preheader;
+    struct IrInstr *preheader_jump = Ir_Terminator(preheader);
+    bool writes_memory = WritesMemory(loop);
+    preheader->instrs.count -= 1;
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        int count = 0;
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            bool is_hoistable = IsHoistable(instr);
+            if (instr->opcode == IR_LOAD_SLOT) {
+                is_hoistable = !writes_memory;
+            }
+            else if (instr->opcode == IR_LOAD) {
+                is_hoistable = !writes_memory && DominatesExits(block, loop);
+            }
+
+            if (is_hoistable && HasInvariantOperands(instr, loop)) {
+                List_Add(&preheader->instrs, instr);
+                def_blocks[instr->dest] = preheader;
+            }
+            else {
+                block->instrs.data[count] = instr;
+                count += 1;
+            }
+        }
+
+        block->instrs.count = count;
+    }
+
+    List_Add(&preheader->instrs, preheader_jump);
+}
+
+
+//
+// ===
+// == Functions defined in Licm.h
+// ===
+//
+
+
+void Licm_Run(struct IrFunction *func) {
+    if (Loops_InsertPreheaders(func)) {
+        Dominators_Compute(func);
+    }
+
+    struct List loops;
+    List_Init(&loops);
+    Loops_Find(func, &loops);
+    def_blocks = (struct IrBlock **) calloc(func->num_regs, sizeof(struct IrBlock *));
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->dest != IR_NO_REG) {
+                def_blocks[instr->dest] = block;
+            }
+        }
+    }
+
+    for (int i = 0; i < loops.count; ++i) {
+        struct Loop *loop = (struct Loop *) List_Get(&loops, i);
+        if (loop->preheader) {
+            HoistFromLoop(loop);
+        }
+    }
+
+    Loops_Free(&loops);
+    free(def_blocks);
+}
@@ -0,0 +1,13 @@
+#ifndef MINIC_LICM_H
+#define MINIC_LICM_H
+#include "Ir.h"
+
+// Loop-invariant code motion. Gives every loop a preheader and moves the instructions
+// whose operands are all defined outside the loop there, inner loops first, so that an
+// invariant leaves a whole loop nest. Only instructions that cannot trap are moved, since
+// the preheader also runs when the loop body does not. Loads are moved if the loop
+// stores nothing and calls nothing, and, unless they read a stack slot, only if their
+// block runs on every iteration that leaves the loop. Updates the dominator tree.
+void Licm_Run(struct IrFunction *func);
+
+#endif // MINIC_LICM_H
@@ -0,0 +1,365 @@
+#include "LinearScan.h"
+#include "ReportError.h"
+#include <stdlib.h>
+#include <string.h>
+
+// A use in a loop counts as much as this many uses outside it, per level of nesting.
+#define LOOP_WEIGHT 8
+#define MAX_LOOP_DEPTH 4
+
+
+struct Interval {
+    int reg;
+    int start;
+    int end;
+    bool spans_call;
+    double uses; // Weighted by the loop depth of each use
+    int copy_of; // The register a copy defines this one from, if any
+};
+
+// A sparse set of registers, so that liveness takes memory in the number of registers live
+// at each block boundary rather than in blocks times registers.
+struct RegSet {
+    int *regs;
+    int count;
+};
+
+static struct RegSet *live_in; // Block index -> registers live on entry
+static int *block_indices; // Block id -> index in the function's block list
+
+
+static void FreeSets(struct RegSet *sets, int count) {
+    for (int i = 0; i < count; ++i) {
+        free(sets[i].regs);
+    }
+
+    free(sets);
+}
+
+static void CopySet(struct RegSet *set, int *regs, int count) {
+    free(set->regs);
+    set->regs = (int *) malloc(sizeof(int) * (count + 1));
+    memcpy(set->regs, regs, sizeof(int) * count);
+    set->count = count;
+}
+
+static int GetUses(struct IrInstr *instr, int **uses) {
+    if (2 + instr->num_args > 64) {
+        ReportInternalError("LinearScan::GetUses - too many arguments");
+    }
+
+    return Ir_GetUses(instr, uses);
+}
+
+// Backwards dataflow: a register is live on entry to a block if the block reads it before
+// writing it, or if it is live on exit and the block doesn't write it. The sets only grow,
+// so a block's set changed if its size did.
+static void ComputeLiveness(struct IrFunction *func) {
+    int num_blocks = func->blocks.count;
+    struct RegSet *gen = (struct RegSet *) calloc(num_blocks, sizeof(struct RegSet));
+    struct RegSet *kill = (struct RegSet *) calloc(num_blocks, sizeof(struct RegSet));
+    live_in = (struct RegSet *) calloc(num_blocks, sizeof(struct RegSet));
+    // Register -> the last block visit that wrote it or added it to the set being built.
+    int *killed = (int *) calloc(func->num_regs, sizeof(int));
+    int *added = (int *) calloc(func->num_regs, sizeof(int));
+    int *gen_regs = (int *) malloc(sizeof(int) * (func->num_regs + 1));
+    int *kill_regs = (int *) malloc(sizeof(int) * (func->num_regs + 1));
+    int visit = 0;
+    for (int i = 0; i < num_blocks; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        int num_gen = 0;
+        int num_kill = 0;
+        visit += 1;
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            int *uses[64];
+            int num_uses = GetUses(instr, uses);
+            for (int k = 0; k < num_uses; ++k) {
+                int reg = *uses[k];
+                if (killed[reg] != visit && added[reg] != visit) {
+                    added[reg] = visit;
+                    gen_regs[num_gen] = reg;
+                    num_gen += 1;
+                }
+            }
+
+            if (instr->dest != IR_NO_REG && killed[instr->dest] != visit) {
+                killed[instr->dest] = visit;
+                kill_regs[num_kill] = instr->dest;
+                num_kill += 1;
+            }
+        }
+
+        CopySet(&gen[i], gen_regs, num_gen);
+        CopySet(&kill[i], kill_regs, num_kill);
+    }
+
+    int *in = gen_regs; // Free again, it now holds the new set of each block.
+    bool has_changed = true;
+    while (has_changed) {
+        has_changed = false;
+        for (int i = num_blocks - 1; i >= 0; --i) {
+            struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+            struct IrBlock *succs[2];
+            int num_succs = Ir_Successors(block, succs);
+            int num_in = 0;
+            visit += 1;
+            for (int k = 0; k < kill[i].count; ++k) {
+                killed[kill[i].regs[k]] = visit;
+            }
+
+            for (int k = 0; k < gen[i].count; ++k) {
+                added[gen[i].regs[k]] = visit;
+                in[num_in] = gen[i].regs[k];
+                num_in += 1;
+            }
+
+            for (int k = 0; k < num_succs; ++k) {
+                struct RegSet *out = &live_in[block_indices[succs[k]->id]];
+                for (int m = 0; m < out->count; ++m) {
+                    int reg = out->regs[m];
+                    if (killed[reg] != visit && added[reg] != visit) {
+                        added[reg] = visit;
+                        in[num_in] = reg;
+                        num_in += 1;
+                    }
+                }
+            }
+
+            if (num_in != live_in[i].count) {
+                CopySet(&live_in[i], in, num_in);
+                has_changed = true;
+            }
+        }
+    }
+
+    FreeSets(gen, num_blocks);
+    FreeSets(kill, num_blocks);
+    free(killed);
+    free(added);
+    free(gen_regs);
+    free(kill_regs);
+}
+
+// A jump back to an earlier block closes a loop over the blocks in between.
+static int *ComputeLoopDepths(struct IrFunction *func) {
+    int num_blocks = func->blocks.count;
+    int *depths = (int *) calloc(num_blocks, sizeof(int));
+    for (int i = 0; i < num_blocks; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        struct IrBlock *succs[2];
+        int num_succs = Ir_Successors(block, succs);
+        for (int k = 0; k < num_succs; ++k) {
+            for (int j = block_indices[succs[k]->id]; j <= i; ++j) {
+                depths[j] += 1;
+            }
+        }
+    }
+
+    return depths;
+}
+
+static void Extend(struct Interval *interval, int position) {
+    if (interval->start < 0 || position < interval->start) {
+        interval->start = position;
+    }
+
+    if (position > interval->end) {
+        interval->end = position;
+    }
+}
+
+static double UseWeight(int depth) {
+    double weight = 1;
+    for (int i = 0; i < depth && i < MAX_LOOP_DEPTH; ++i) {
+        weight *= LOOP_WEIGHT;
+    }
+
+    return weight;
+}
+
+// Builds an interval per register from the positions of its definitions, uses and the
+// block boundaries it is live across. Returns the positions of the calls.
+static int BuildIntervals(struct IrFunction *func, struct Interval *intervals, int *calls) {
+    for (int reg = 0; reg < func->num_regs; ++reg) {
+        intervals[reg].reg = reg;
+        intervals[reg].start = -1;
+        intervals[reg].end = -1;
+        intervals[reg].spans_call = false;
+        intervals[reg].uses = 0;
+        intervals[reg].copy_of = IR_NO_REG;
+    }
+
+    int *depths = ComputeLoopDepths(func);
+    int num_calls = 0;
+    int position = 0;
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        int first = position;
+        int last = position + block->instrs.count - 1;
+        double weight = UseWeight(depths[i]);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            int *uses[64];
+            int num_uses = GetUses(instr, uses);
+            for (int k = 0; k < num_uses; ++k) {
+                Extend(&intervals[*uses[k]], position);
+                intervals[*uses[k]].uses += weight;
+            }
+
+            if (instr->dest != IR_NO_REG) {
+                Extend(&intervals[instr->dest], position);
+                intervals[instr->dest].uses += weight;
+            }
+
+            if (instr->opcode == IR_COPY) {
+                intervals[instr->dest].copy_of = instr->a;
+            }
+
+            if (instr->opcode == IR_CALL) {
+                calls[num_calls] = position;
+                num_calls += 1;
+            }
+
+            position += 1;
+        }
+
+        // The registers live on exit are the ones live on entry to the successors.
+        struct IrBlock *succs[2];
+        int num_succs = (block->instrs.count > 0) ? Ir_Successors(block, succs) : 0;
+        for (int k = 0; k < live_in[i].count && block->instrs.count > 0; ++k) {
+            Extend(&intervals[live_in[i].regs[k]], first);
+        }
+
+        for (int k = 0; k < num_succs; ++k) {
+            struct RegSet *out = &live_in[block_indices[succs[k]->id]];
+            for (int m = 0; m < out->count; ++m) {
+                Extend(&intervals[out->regs[m]], last);
+            }
+        }
+    }
+
+    free(depths);
+    return num_calls;
+}
+
+// The calls are in increasing order of position, so a binary search finds the first one
+// after the start. An interval that ends at a call only reads its arguments, and one that
+// starts at a call holds its result.
+static bool SpansCall(struct Interval *interval, int *calls, int num_calls) {
+    int low = 0;
+    int high = num_calls;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (calls[middle] <= interval->start) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    return low < num_calls && calls[low] < interval->end;
+}
+
+static int CompareStarts(const void *x, const void *y) {
+    struct Interval *a = *(struct Interval **) x;
+    struct Interval *b = *(struct Interval **) y;
+    return (a->start != b->start) ? a->start - b->start : a->reg - b->reg;
+}
+
+static double SpillCost(struct Interval *interval) {
+    return interval->uses / (interval->end - interval->start + 1);
+}
+
+
+//
+// ===
+// == Functions defined in LinearScan.h
+// ===
+//
+
+
+void LinearScan_Allocate(struct IrFunction *func, bool *is_candidate, int num_regs, int num_caller_saved, int *assignment) {
+    block_indices = (int *) calloc(func->num_block_ids, sizeof(int));
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        block_indices[block->id] = i;
+    }
+
+    ComputeLiveness(func);
+    int num_instrs = 0;
+    for (int i = 0; i < func->blocks.count; ++i) {
+        num_instrs += ((struct IrBlock *) List_Get(&func->blocks, i))->instrs.count;
+    }
+
+    struct Interval *intervals = (struct Interval *) malloc(sizeof(struct Interval) * func->num_regs);
+    int *calls = (int *) malloc(sizeof(int) * (num_instrs + 1));
+    int num_calls = BuildIntervals(func, intervals, calls);
+    struct Interval **order = (struct Interval **) malloc(sizeof(struct Interval *) * func->num_regs);
+    int num_intervals = 0;
+    for (int reg = 0; reg < func->num_regs; ++reg) {
+        assignment[reg] = LINEAR_SCAN_SPILLED;
+        if (is_candidate[reg] && intervals[reg].start >= 0) {
+            intervals[reg].spans_call = SpansCall(&intervals[reg], calls, num_calls);
+            order[num_intervals] = &intervals[reg];
+            num_intervals += 1;
+        }
+    }
+
+    qsort(order, num_intervals, sizeof(struct Interval *), CompareStarts);
+    struct Interval **owners = (struct Interval **) calloc(num_regs, sizeof(struct Interval *));
+    for (int i = 0; i < num_intervals; ++i) {
+        struct Interval *current = order[i];
+        // Every instruction reads its operands before it writes its result, so an interval
+        // that ends where another one starts can hand its register over.
+        for (int r = 0; r < num_regs; ++r) {
+            if (owners[r] && owners[r]->end <= current->start) {
+                owners[r] = NULL;
+            }
+        }
+
+        // A copy from a register that dies at the copy gets the same machine register if
+        // it can, so that the copy disappears.
+        int first_reg = current->spans_call ? num_caller_saved : 0;
+        int free_reg = -1;
+        int source = (current->copy_of != IR_NO_REG) ? assignment[current->copy_of] : LINEAR_SCAN_SPILLED;
+        if (source >= first_reg && !owners[source]) {
+            free_reg = source;
+        }
+
+        for (int r = first_reg; r < num_regs && free_reg < 0; ++r) {
+            free_reg = owners[r] ? -1 : r;
+        }
+
+        // Without a free register, the cheapest of the intervals that hold one of the
+        // registers this one can take and this one itself goes to memory.
+        if (free_reg < 0) {
+            int victim = -1;
+            double victim_cost = SpillCost(current);
+            for (int r = first_reg; r < num_regs; ++r) {
+                if (SpillCost(owners[r]) < victim_cost) {
+                    victim = r;
+                    victim_cost = SpillCost(owners[r]);
+                }
+            }
+
+            if (victim < 0) {
+                continue;
+            }
+
+            assignment[owners[victim]->reg] = LINEAR_SCAN_SPILLED;
+            free_reg = victim;
+        }
+
+        owners[free_reg] = current;
+        assignment[current->reg] = free_reg;
+    }
+
+    free(owners);
+    free(order);
+    free(calls);
+    free(intervals);
+    FreeSets(live_in, func->blocks.count);
+    free(block_indices);
+}
@@ -0,0 +1,19 @@
+#ifndef MINIC_LINEAR_SCAN_H
+#define MINIC_LINEAR_SCAN_H
+#include "Ir.h"
+#include <stdbool.h>
+
+#define LINEAR_SCAN_SPILLED -1
+
+// Linear scan register allocation (Poletto and Sarkar) for a function that is out of SSA
+// form, see Ssa_Destruct. The instructions are numbered in block order, and a virtual
+// register lives from the first to the last position where it is defined, used or live
+// across a block boundary. Each register for which is_candidate is true gets one of
+// num_regs machine registers for its whole interval in assignment, or LINEAR_SCAN_SPILLED.
+// Calls clobber machine registers 0 to num_caller_saved - 1, so intervals that span a
+// call only get the others; the rest prefer those to not make the function save more
+// registers. When the registers run out, the interval with the fewest uses per position
+// it spans is spilled, uses in loops counting more.
+void LinearScan_Allocate(struct IrFunction *func, bool *is_candidate, int num_regs, int num_caller_saved, int *assignment);
+
+#endif // MINIC_LINEAR_SCAN_H
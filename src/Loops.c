@@ -0,0 +1,277 @@
+#include "Loops.h"
+#include "Dominators.h"
+#include <stdlib.h>
+
+
+static int CompareLoopSizes(const void *x, const void *y) {
+    struct Loop *a = *(struct Loop **) x;
+    struct Loop *b = *(struct Loop **) y;
+    return a->blocks.count - b->blocks.count;
+}
+
+static int CompareRpoIndices(const void *x, const void *y) {
+    struct IrBlock *a = *(struct IrBlock **) x;
+    struct IrBlock *b = *(struct IrBlock **) y;
+    return a->rpo_index - b->rpo_index;
+}
+
+static struct Loop *NewLoop(struct IrBlock *header, struct Loop **members) {
+    struct Loop *loop = (struct Loop *) malloc(sizeof(struct Loop));
+    loop->header = header;
+    loop->preheader = NULL;
+    List_Init(&loop->blocks);
+    loop->parent = NULL;
+    loop->depth = 1;
+    members[header->id] = loop;
+    List_Add(&loop->blocks, header);
+    return loop;
+}
+
+// Adds the blocks that reach latch without going through the header. members maps each
+// block id to the last loop that added the block.
+static void AddLoopBody(struct IrFunction *func, struct Loop *loop, struct IrBlock *latch, struct Loop **members) {
+    struct IrBlock **worklist = (struct IrBlock **) malloc(sizeof(struct IrBlock *) * func->blocks.count);
+    int num_worklist = 0;
+    if (members[latch->id] != loop) {
+        members[latch->id] = loop;
+        List_Add(&loop->blocks, latch);
+        worklist[0] = latch;
+        num_worklist = 1;
+    }
+
+    while (num_worklist > 0) {
+        num_worklist -= 1;
+        struct IrBlock *block = worklist[num_worklist];
+        for (int i = 0; i < block->preds.count; ++i) {
+            struct IrBlock *pred = (struct IrBlock *) List_Get(&block->preds, i);
+            if (members[pred->id] != loop && pred->rpo_index != -1) {
+                members[pred->id] = loop;
+                List_Add(&loop->blocks, pred);
+                worklist[num_worklist] = pred;
+                num_worklist += 1;
+            }
+        }
+    }
+
+    free(worklist);
+}
+
+static bool IsBackEdge(struct IrBlock *pred, struct IrBlock *header) {
+    return pred->rpo_index != -1 && Dominators_Dominates(header, pred);
+}
+
+// Loops come smallest first, so a block's innermost loop is the first one to reach it, and
+// each loop becomes the parent of the outermost loop found so far around any of its blocks.
+static void NestLoops(struct List *loops, int first_loop) {
+    for (int i = first_loop; i < loops->count; ++i) {
+        struct Loop *loop = (struct Loop *) List_Get(loops, i);
+        for (int j = 0; j < loop->blocks.count; ++j) {
+            struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, j);
+            struct Loop *inner = block->loop;
+            if (!inner) {
+                block->loop = loop;
+                continue;
+            }
+
+            while (inner->parent) {
+                inner = inner->parent;
+            }
+
+            if (inner != loop) {
+                inner->parent = loop;
+            }
+        }
+    }
+
+    for (int i = loops->count - 1; i >= first_loop; --i) {
+        struct Loop *loop = (struct Loop *) List_Get(loops, i);
+        loop->depth = loop->parent ? loop->parent->depth + 1 : 1;
+    }
+}
+
+
+//
+// ===
+// == Functions defined in Loops.h
+// ===
+//
+
+
+bool Loops_Contains(struct Loop *loop, struct IrBlock *block) {
+    struct Loop *inner = block->loop;
+    while (inner && inner->depth > loop->depth) {
+        inner = inner->parent;
+    }
+
+    return inner == loop;
+}
+
+void Loops_Find(struct IrFunction *func, struct List *loops) {
+    int first_loop = loops->count;
+    struct Loop **members = (struct Loop **) calloc(func->num_block_ids, sizeof(struct Loop *));
+    for (int i = 0; i < func->blocks.count; ++i) {
+        ((struct IrBlock *) List_Get(&func->blocks, i))->loop = NULL;
+    }
+
+    struct List *rpo_blocks = &func->rpo_blocks;
+    for (int i = 0; i < rpo_blocks->count; ++i) {
+        struct IrBlock *header = (struct IrBlock *) List_Get(rpo_blocks, i);
+        struct Loop *loop = NULL;
+        for (int j = 0; j < header->preds.count; ++j) {
+            struct IrBlock *pred = (struct IrBlock *) List_Get(&header->preds, j);
+            if (!IsBackEdge(pred, header)) {
+                continue;
+            }
+
+            if (!loop) {
+                loop = NewLoop(header, members);
+                List_Add(loops, loop);
+            }
+
+            AddLoopBody(func, loop, pred, members);
+        }
+
+        if (!loop) {
+            continue;
+        }
+
+        qsort(loop->blocks.data, loop->blocks.count, sizeof(void *), CompareRpoIndices);
+        int num_outside_preds = 0;
+        for (int j = 0; j < header->preds.count; ++j) {
+            struct IrBlock *pred = (struct IrBlock *) List_Get(&header->preds, j);
+            if (members[pred->id] != loop) {
+                struct IrBlock *succs[2];
+                num_outside_preds += 1;
+                loop->preheader = (Ir_Successors(pred, succs) == 1) ? pred : NULL;
+            }
+        }
+
+        if (num_outside_preds != 1) {
+            loop->preheader = NULL;
+        }
+    }
+
+    free(members);
+    qsort(loops->data + first_loop, loops->count - first_loop, sizeof(void *), CompareLoopSizes);
+    NestLoops(loops, first_loop);
+}
+
+void Loops_Free(struct List *loops) {
+    for (int i = 0; i < loops->count; ++i) {
+        struct Loop *loop = (struct Loop *) List_Get(loops, i);
+        for (int j = 0; j < loop->blocks.count; ++j) {
+            ((struct IrBlock *) List_Get(&loop->blocks, j))->loop = NULL;
+        }
+
+        List_Free(&loop->blocks);
+        free(loop);
+    }
+
+    List_Free(loops);
+}
+
+bool Loops_InsertPreheaders(struct IrFunction *func) {
+    int num_old_block_ids = func->num_block_ids;
+    struct IrBlock **preheaders = (struct IrBlock **) calloc(num_old_block_ids, sizeof(struct IrBlock *));
+    bool has_changed = false;
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *header = (struct IrBlock *) List_Get(&func->blocks, i);
+        struct List outside_preds;
+        struct List back_preds;
+        List_Init(&outside_preds);
+        List_Init(&back_preds);
+        for (int j = 0; j < header->preds.count; ++j) {
+            struct IrBlock *pred = (struct IrBlock *) List_Get(&header->preds, j);
+            List_Add(IsBackEdge(pred, header) ? &back_preds : &outside_preds, pred);
+        }
+
+        struct IrBlock *succs[2];
+        bool has_preheader = outside_preds.count == 1 && Ir_Successors((struct IrBlock *) List_Get(&outside_preds, 0), succs) == 1;
+        if (back_preds.count == 0 || outside_preds.count == 0 || has_preheader) {
+            List_Free(&outside_preds);
+            List_Free(&back_preds);
+            continue;
+        }
+
+        struct IrBlock *preheader = Ir_NewBlock(func);
+        preheader->preds = outside_preds;
+        preheaders[header->id] = preheader;
+        has_changed = true;
+
+        // The header's phis get one argument for the preheader, which merges the values
+        // from outside the loop with phis of its own when there is more than one.
+        for (int j = 0; j < header->instrs.count; ++j) {
+            struct IrInstr *phi = (struct IrInstr *) List_Get(&header->instrs, j);
+            if (phi->opcode != IR_PHI) {
+                break;
+            }
+
+            int *args = ARENA_NEW_ARRAY(func->arena, int, back_preds.count + 1);
+            int num_args = 1;
+            struct IrInstr *outside_phi = NULL;
+            if (outside_preds.count > 1) {
+                outside_phi = Ir_AddInstr(func, preheader, IR_PHI);
+                outside_phi->dest = Ir_NewReg(func);
+                outside_phi->imm = phi->imm;
+                outside_phi->args = ARENA_NEW_ARRAY(func->arena, int, outside_preds.count);
+            }
+
+            for (int k = 0; k < header->preds.count; ++k) {
+                struct IrBlock *pred = (struct IrBlock *) List_Get(&header->preds, k);
+                if (IsBackEdge(pred, header)) {
+                    args[num_args] = phi->args[k];
+                    num_args += 1;
+                }
+                else if (outside_phi) {
+                    outside_phi->args[outside_phi->num_args] = phi->args[k];
+                    outside_phi->num_args += 1;
+                }
+                else {
+                    args[0] = phi->args[k];
+                }
+            }
+
+            if (outside_phi) {
+                args[0] = outside_phi->dest;
+            }
+
+            phi->args = args;
+            phi->num_args = num_args;
+        }
+
+        struct IrInstr *jump = Ir_AddInstr(func, preheader, IR_JUMP);
+        jump->target = header;
+        for (int j = 0; j < outside_preds.count; ++j) {
+            Ir_ReplaceTarget(Ir_Terminator((struct IrBlock *) List_Get(&outside_preds, j)), header, preheader);
+        }
+
+        List_Free(&header->preds);
+        List_Init(&header->preds);
+        List_Add(&header->preds, preheader);
+        for (int j = 0; j < back_preds.count; ++j) {
+            List_Add(&header->preds, List_Get(&back_preds, j));
+        }
+
+        List_Free(&back_preds);
+    }
+
+    // Each preheader is placed right before its header, so that it falls through.
+    if (has_changed) {
+        struct List blocks;
+        List_Init(&blocks);
+        for (int i = 0; i < func->blocks.count; ++i) {
+            struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+            if (block->id < num_old_block_ids && preheaders[block->id]) {
+                List_Add(&blocks, preheaders[block->id]);
+            }
+
+            List_Add(&blocks, block);
+        }
+
+        List_Free(&func->blocks);
+        func->blocks = blocks;
+    }
+
+    free(preheaders);
+    return has_changed;
+}
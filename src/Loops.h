@@ -0,0 +1,35 @@
+#ifndef MINIC_LOOPS_H
+#define MINIC_LOOPS_H
+#include "Ir.h"
+#include "List.h"
+#include <stdbool.h>
+
+// A natural loop: the header and every block that reaches a back edge into it without
+// going through the header. Back edges into the same header form one loop.
+struct Loop {
+    struct IrBlock *header;
+    // The only predecessor of the header outside the loop, if it jumps straight to the
+    // header. NULL otherwise, see Loops_InsertPreheaders.
+    struct IrBlock *preheader;
+    struct List blocks; // In reverse post-order, so the header is first.
+    struct Loop *parent; // The innermost loop around this one, NULL if there is none.
+    int depth; // 1 for a loop that no other loop is around.
+};
+
+// True if the block was in the loop when the loops were found. Blocks added since then are
+// in no loop. Takes time in the number of loops between the block's innermost loop and loop.
+bool Loops_Contains(struct Loop *loop, struct IrBlock *block);
+
+// Finds the natural loops of the function and adds them to loops, inner loops before the
+// loops that contain them. Every block gets the innermost loop it is in. Dominators_Compute
+// must have been run.
+void Loops_Find(struct IrFunction *func, struct List *loops);
+
+void Loops_Free(struct List *loops);
+
+// Gives every loop header a preheader: a block outside the loop whose only successor is
+// the header and which is the header's only predecessor outside the loop. Returns true if
+// blocks were added, in which case the dominator tree is out of date.
+bool Loops_InsertPreheaders(struct IrFunction *func);
+
+#endif // MINIC_LOOPS_H
@@ -1,13 +1,48 @@
+#include "Arena.h"
+#include "Assembly.h"
 #include "CodeGeneratorX86.h"
+#include "ConstantPropagation.h"
 #include "FileIO.h"
+#include "Intern.h"
+#include "IrBuilder.h"
+#include "Inliner.h"
+#include "IrCodeGeneratorX86.h"
 #include "Lexer.h"
+#include "Optimizer.h"
 #include "Parser.h"
 #include "SemanticAnalysis.h"
+#include "TimeReport.h"
+#include "Unroll.h"
+#include "Vectorize.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define MAX_FILENAME_LENGTH 128
+// The nasm and link commands hold two file names besides their own text.
+#define MAX_COMMAND_LENGTH (2 * MAX_FILENAME_LENGTH + 256)
+
+
+struct Options {
+    char *filename;
+    // Where the assembly goes, "-" is stdout.
+    char *asm_filename;
+    bool dump_ast;
+    bool emit_ir;
+    int inline_limit;
+    // 0 generates code straight from the AST, 1 and above go through the IR.
+    int opt_level;
+    // Rewrite the emitted instructions with the peephole rules, at every level.
+    bool peephole;
+    bool prelex;
+    bool time_report;
+    bool time_report_json;
+    int unroll_factor;
+    // Number of 64-bit lanes that loops are vectorized with, 0 turns vectorization off.
+    int vector_width;
+    // Stop after writing the assembly, don't assemble or link.
+    bool stop_after_assembly;
+};
 
 void ChangeFileExtension( char *filename, char *new_filename, char *new_extension) {
     char *dot = strrchr(filename, '.');
@@ -24,13 +59,112 @@ void ChangeFileExtension( char *filename, char *new_filename, char *new_extensio
     strcat(new_filename, new_extension);
 }
 
-int main(int num_args, char **args) {
-    if (num_args < 2) {
+static bool ParseOptions(struct Options *options, int num_args, char **args) {
+    options->filename = NULL;
+    options->asm_filename = "tmp.asm";
+    options->dump_ast = false;
+    options->emit_ir = false;
+    options->inline_limit = INLINER_DEFAULT_LIMIT;
+    options->opt_level = 0;
+    options->peephole = true;
+    options->prelex = false;
+    options->time_report = false;
+    options->time_report_json = false;
+    options->unroll_factor = UNROLL_DEFAULT_FACTOR;
+    options->vector_width = VECTORIZE_SSE2_WIDTH;
+    options->stop_after_assembly = false;
+    for (int i = 1; i < num_args; ++i) {
+        char *arg = args[i];
+        if (strcmp(arg, "--dump-ast") == 0) {
+            options->dump_ast = true;
+        }
+        else if (strcmp(arg, "--emit-ir") == 0) {
+            options->emit_ir = true;
+        }
+        else if (strncmp(arg, "-finline-limit=", strlen("-finline-limit=")) == 0) {
+            char *value = arg + strlen("-finline-limit=");
+            char *end = NULL;
+            long limit = strtol(value, &end, 10);
+            if (*value == '\0' || *end != '\0' || limit < 0 || limit > 100000) {
+                fprintf(stderr, "error: invalid inline limit %s\n", value);
+                return false;
+            }
+
+            options->inline_limit = (int) limit;
+        }
+        else if (strncmp(arg, "-funroll-factor=", strlen("-funroll-factor=")) == 0) {
+            char *value = arg + strlen("-funroll-factor=");
+            char *end = NULL;
+            long factor = strtol(value, &end, 10);
+            if (*value == '\0' || *end != '\0' || factor < 1 || factor > 64) {
+                fprintf(stderr, "error: invalid unroll factor %s\n", value);
+                return false;
+            }
+
+            options->unroll_factor = (int) factor;
+        }
+        else if (strcmp(arg, "-fno-peephole") == 0) {
+            options->peephole = false;
+        }
+        else if (strcmp(arg, "-fno-vectorize") == 0) {
+            options->vector_width = 0;
+        }
+        else if (strcmp(arg, "-mavx2") == 0) {
+            options->vector_width = VECTORIZE_AVX2_WIDTH;
+        }
+        else if (strcmp(arg, "-O0") == 0 || strcmp(arg, "-O1") == 0) {
+            options->opt_level = arg[2] - '0';
+        }
+        else if (strcmp(arg, "--prelex") == 0) {
+            options->prelex = true;
+        }
+        else if (strcmp(arg, "--time-report") == 0) {
+            options->time_report = true;
+        }
+        else if (strcmp(arg, "--time-report=json") == 0) {
+            options->time_report = true;
+            options->time_report_json = true;
+        }
+        else if (strcmp(arg, "-S") == 0) {
+            options->stop_after_assembly = true;
+        }
+        else if (strcmp(arg, "-o") == 0) {
+            if (i + 1 == num_args) {
+                fprintf(stderr, "error: missing filename after -o\n");
+                return false;
+            }
+
+            i += 1;
+            options->asm_filename = args[i];
+            if (strlen(options->asm_filename) + strlen(".exe") >= MAX_FILENAME_LENGTH) {
+                fprintf(stderr, "error: output filename is too long\n");
+                return false;
+            }
+        }
+        else if (arg[0] == '-' && arg[1] != '\0') {
+            fprintf(stderr, "error: unknown option %s\n", arg);
+            return false;
+        }
+        else {
+            options->filename = arg;
+        }
+    }
+
+    if (!options->filename) {
         fprintf(stderr, "error: no input file specified\n");
+        return false;
+    }
+
+    return true;
+}
+
+int main(int num_args, char **args) {
+    struct Options options;
+    if (!ParseOptions(&options, num_args, args)) {
         return 1;
     }
 
-    char *filename = args[1];
+    char *filename = options.filename;
     struct File file;
     enum FileIOStatus status = FileIO_ReadFile(&file, filename);
     if (status == FILE_IO_ERROR_FILE_NOT_FOUND) {
@@ -38,39 +172,127 @@ int main(int num_args, char **args) {
         return false;
     }
 
+    // Everything the front end allocates lives until the program is compiled.
+    struct Arena arena;
+    Arena_Init(&arena);
+    SetAstArena(&arena);
+    Intern_Init(&arena);
+
+    // When the assembly is piped to stdout, nothing else may be written there.
+    bool asm_to_stdout = strcmp(options.asm_filename, "-") == 0;
+    FILE *log = asm_to_stdout ? stderr : stdout;
+
+    if (options.time_report) {
+        TimeReport_Enable();
+    }
+
     struct Lexer lexer;
-    Lexer_Init(&lexer, file.content, file.length);
+    Lexer_Init(&lexer, &arena, file.content, file.length);
+    // Lexing is otherwise interleaved with parsing and could not be measured on its own.
+    if (options.prelex || options.time_report) {
+        TimeReport_BeginPhase(PHASE_LEX, &arena);
+        Lexer_Tokenize(&lexer);
+        TimeReport_EndPhase(PHASE_LEX, &arena);
+    }
 
-    printf("Parsing...\n");
+    fprintf(log, "Parsing...\n");
+    TimeReport_BeginPhase(PHASE_PARSE, &arena);
     struct TranslationUnit *t_unit = Parser_MakeAst(&lexer);
-    printf("Analyzing...\n");
+    TimeReport_EndPhase(PHASE_PARSE, &arena);
+
+    fprintf(log, "Analyzing...\n");
+    TimeReport_BeginPhase(PHASE_ANALYZE, &arena);
     SemanticAnalysis_Analyze(t_unit);
-    PrintS((struct AstNode *) t_unit);
+    TimeReport_EndPhase(PHASE_ANALYZE, &arena);
+
+    // Constant propagation works on the AST, so even -O0 gets immediates for constants.
+    // --emit-ir also works at -O0, where the code is still generated from the AST.
+    TimeReport_BeginPhase(PHASE_OPTIMIZE, &arena);
+    ConstantPropagation_Run(t_unit);
+    struct IrProgram *program = NULL;
+    if (options.opt_level > 0 || options.emit_ir) {
+        program = IrBuilder_Build(&arena, t_unit);
+        Optimizer_Run(program, options.opt_level, options.inline_limit, options.unroll_factor, options.vector_width);
+    }
+
+    TimeReport_EndPhase(PHASE_OPTIMIZE, &arena);
+    if (options.dump_ast) {
+        PrintS((struct AstNode *) t_unit);
+    }
 
-    filename = "tmp";
-    char asm_filename[MAX_FILENAME_LENGTH];
-    ChangeFileExtension(filename, asm_filename, "asm");
-    FILE *asm_file;
-    fopen_s(&asm_file, asm_filename, "w");
+    if (options.emit_ir) {
+        Ir_PrintProgram(log, program);
+    }
+
+    char *asm_filename = options.asm_filename;
+    FILE *asm_file = stdout;
+    if (!asm_to_stdout) {
+        fopen_s(&asm_file, asm_filename, "wb");
+        if (!asm_file) {
+            fprintf(stderr, "error: could not open %s\n", asm_filename);
+            return 1;
+        }
+    }
+
+    fprintf(log, "Compiling...\n");
+    TimeReport_BeginPhase(PHASE_CODEGEN, &arena);
+    SetPeephole(options.peephole);
+    if (options.opt_level > 0) {
+        IrCodeGeneratorX86_GenerateCode(asm_file, program);
+    }
+    else {
+        CodeGeneratorX86_GenerateCode(asm_file, t_unit);
+    }
+    if (!asm_to_stdout) {
+        fclose(asm_file);
+    }
 
-    printf("Compiling...\n");
-    CodeGeneratorX86_GenerateCode(asm_file, t_unit);
-    fclose(asm_file);
+    TimeReport_EndPhase(PHASE_CODEGEN, &arena);
+    Lexer_Free(&lexer);
+    Arena_Free(&arena);
+    FileIO_FreeFile(&file);
+    if (options.stop_after_assembly || asm_to_stdout) {
+        if (options.time_report) {
+            TimeReport_Print(stderr, options.time_report_json);
+        }
+
+        return 0;
+    }
 
     char obj_filename[MAX_FILENAME_LENGTH];
-    ChangeFileExtension(filename, obj_filename, "obj");
+    ChangeFileExtension(asm_filename, obj_filename, "obj");
+    char exe_filename[MAX_FILENAME_LENGTH];
+    ChangeFileExtension(asm_filename, exe_filename, "exe");
+
+    char command[MAX_COMMAND_LENGTH];
+    int command_length = snprintf(command, sizeof(command), "nasm -f win64 %s -o %s", asm_filename, obj_filename);
+    if (command_length < 0 || command_length >= (int) sizeof(command)) {
+        fprintf(stderr, "error: the nasm command is too long\n");
+        return 1;
+    }
 
-    char command[256];
-    sprintf(command, "nasm -f win64 %s -o %s", asm_filename, obj_filename);
     printf("%s\n", command);
+    TimeReport_BeginPhase(PHASE_ASSEMBLE, NULL);
     int nasm_result = system(command);
+    TimeReport_EndPhase(PHASE_ASSEMBLE, NULL);
     if (nasm_result == 1) {
         return 1;
     }
 
-    sprintf(command, "link /nologo /subsystem:console /entry:main %s msvcrt.lib legacy_stdio_definitions.lib kernel32.lib ucrt.lib", obj_filename);
+    command_length = snprintf(command, sizeof(command), "link /nologo /subsystem:console /entry:main /out:%s %s msvcrt.lib legacy_stdio_definitions.lib kernel32.lib ucrt.lib", exe_filename, obj_filename);
+    if (command_length < 0 || command_length >= (int) sizeof(command)) {
+        fprintf(stderr, "error: the link command is too long\n");
+        return 1;
+    }
+
     printf("%s\n", command);
+    TimeReport_BeginPhase(PHASE_LINK, NULL);
     system(command);
-    printf("Compiled successfully.");
+    TimeReport_EndPhase(PHASE_LINK, NULL);
+    printf("Compiled successfully.\n");
+    if (options.time_report) {
+        TimeReport_Print(stderr, options.time_report_json);
+    }
+
     return 0;
 }
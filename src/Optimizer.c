@@ -0,0 +1,89 @@
+#include "Optimizer.h"
+#include "Dce.h"
+#include "Dominators.h"
+#include "Gvn.h"
+#include "Inliner.h"
+#include "Licm.h"
+#include "Sccp.h"
+#include "SimplifyCfg.h"
+#include "Ssa.h"
+#include "StrengthReduction.h"
+#include "TailRecursion.h"
+#include "Unroll.h"
+#include "Vectorize.h"
+
+
+static void OptimizeFunction(struct IrFunction *func, int unroll_factor, int vector_width) {
+    Ir_RemoveUnreachableBlocks(func);
+    Dominators_Compute(func);
+    Ssa_PromoteSlots(func);
+    bool has_changed_cfg = Sccp_Run(func);
+    Dce_Run(func);
+    // Branches that SimplifyCfg turns into jumps leave their conditions dead.
+    if (SimplifyCfg_Run(func)) {
+        Dce_Run(func);
+        has_changed_cfg = true;
+    }
+
+    if (TailRecursion_Run(func)) {
+        has_changed_cfg = true;
+    }
+
+    if (has_changed_cfg) {
+        Dominators_Compute(func);
+    }
+
+    Licm_Run(func);
+    StrengthReduction_Run(func);
+    // Vectorization needs the element pointers of strength reduction. The loops that finish
+    // the iterations of a vectorized loop are not worth unrolling partially.
+    struct List remainders;
+    List_Init(&remainders);
+    if (Vectorize_Run(func, vector_width, &remainders)) {
+        Dominators_Compute(func);
+    }
+
+    // The copies of a fully unrolled loop see constant counters, and they are chained by
+    // jumps that SimplifyCfg merges.
+    if (Unroll_Run(func, unroll_factor, &remainders)) {
+        Sccp_Run(func);
+        SimplifyCfg_Run(func);
+        Dominators_Compute(func);
+    }
+
+    List_Free(&remainders);
+
+    Gvn_Run(func);
+    Dce_Run(func);
+}
+
+
+//
+// ===
+// == Functions defined in Optimizer.h
+// ===
+//
+
+
+void Optimizer_Run(struct IrProgram *program, int opt_level, int inline_limit, int unroll_factor, int vector_width) {
+    if (opt_level < 1) {
+        return;
+    }
+
+    // Callees are optimized before their callers, so that what gets inlined is already
+    // simplified and the caller's passes clean up after the inlining.
+    struct List order;
+    List_Init(&order);
+    Inliner_SortBottomUp(program, &order);
+    struct HashMap optimized;
+    HashMap_Init(&optimized);
+    for (int i = 0; i < order.count; ++i) {
+        struct IrFunction *func = (struct IrFunction *) List_Get(&order, i);
+        Inliner_Run(func, &optimized, inline_limit);
+        OptimizeFunction(func, unroll_factor, vector_width);
+        HashMap_Put(&optimized, func->name, func);
+    }
+
+    HashMap_Free(&optimized);
+    List_Free(&order);
+}
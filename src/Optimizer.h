@@ -0,0 +1,11 @@
+#ifndef MINIC_OPTIMIZER_H
+#define MINIC_OPTIMIZER_H
+#include "Ir.h"
+
+// Runs the IR passes enabled at the given optimization level on every function. Calls
+// are inlined when the callee's cost is at most inline_limit, see Inliner.h, loops are
+// unrolled by unroll_factor, see Unroll.h, and vectorized with vector_width lanes, see
+// Vectorize.h.
+void Optimizer_Run(struct IrProgram *program, int opt_level, int inline_limit, int unroll_factor, int vector_width);
+
+#endif // MINIC_OPTIMIZER_H
@@ -6,7 +6,6 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define NEW_TYPE(type) ((struct type *) malloc(sizeof(struct type)))
 #define UNUSED(x) ((void) x)
 
 static struct CompoundStmt *ParseCompoundStmt();
@@ -184,6 +183,7 @@ static struct AstNode *ParseDecl() {
 
         do {
             struct Declarator *declarator = NewDeclarator();
+            declarator->type = var_declaration->type;
             List_Add(&var_declaration->declarators, declarator);
 
             // Pointer declarator
@@ -194,7 +194,7 @@ static struct AstNode *ParseDecl() {
 
             // Identifier
             token = Lexer_PeekToken(l);
-            strncpy(declarator->identifier, token.str_value, TOKEN_MAX_IDENTIFIER_LENGTH);
+            declarator->identifier = token.str_value;
             if (Lexer_PeekToken2(l, 1).type != TOKEN_EQUALS) {
                 ExpectAndEat(TOKEN_IDENTIFIER);
             }
@@ -347,11 +347,12 @@ struct FunctionDef *ParseFunctionDef() {
         var_declaration->type = ParsePrimitiveType();
 
         struct Declarator *declarator = NewDeclarator();
+        declarator->type = var_declaration->type;
         List_Add(&var_declaration->declarators, declarator);
 
         // Identifier
         struct Token token = Lexer_PeekToken(l);
-        strncpy(declarator->identifier, token.str_value, TOKEN_MAX_IDENTIFIER_LENGTH);
+        declarator->identifier = token.str_value;
         ExpectAndEat(TOKEN_IDENTIFIER);
 
         function->num_params += 1;
@@ -0,0 +1,847 @@
+#include "Peephole.h"
+#include "Arena.h"
+#include "Register.h"
+#include "ReportError.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_WINDOW 3
+#define MAX_REPLACEMENTS 2
+#define MAX_VARS 26
+#define MAX_VAR_LENGTH 128
+// Replacements hold at most 4 variables besides a few characters of their own.
+#define MAX_LINE_LENGTH (8 * MAX_VAR_LENGTH)
+// How many instructions are looked at for the next use of a register before giving up.
+#define MAX_LOOKAHEAD 16
+
+
+// The text of the variables %a to %z that a window of lines was matched with. A variable
+// matches 1 to MAX_VAR_LENGTH - 1 characters, and the same text wherever it appears again.
+struct Match {
+    char *starts[MAX_VARS]; // Where the text is in the line while matching
+    size_t lengths[MAX_VARS];
+    char vars[MAX_VARS][MAX_VAR_LENGTH]; // Copied out of the line when first needed
+    bool is_bound[MAX_VARS];
+    bool is_copied[MAX_VARS];
+    int last; // Index of the window's last line
+};
+
+// The patterns match consecutive lines, without their indentation, and are replaced by
+// fewer lines if the guard, when there is one, holds.
+struct Rule {
+    int num_patterns;
+    char *patterns[MAX_WINDOW];
+    int num_replacements;
+    char *replacements[MAX_REPLACEMENTS];
+    bool (*guard)(struct Match *match);
+};
+
+// What the look-ahead for uses of a register needs to know about a line, found the first
+// time it is needed.
+struct Line {
+    char *text; // NULL once the line is removed
+    char *instr; // The text without its indentation
+    bool is_decoded;
+    bool is_barrier; // A comment or an empty line
+    bool is_label;
+    bool is_call;
+    bool is_explicit;
+    int full_write; // The register the instruction sets without reading it, or -1
+    unsigned int mentions; // Bit set of the registers the instruction names
+};
+
+static struct Arena arena; // The replacement lines
+static struct Line *lines;
+static int num_lines;
+
+// The general purpose registers the code generators use, with the names of their parts.
+static char **families[] = { rax, rcx, rdx, r8, r9, r10, r11, rdi, rbx, rsi, r12, r13, r14, r15 };
+#define NUM_FAMILIES ((int) (sizeof(families) / sizeof(families[0])))
+#define NUM_NAMES (PRIMTYPE_PTR - PRIMTYPE_CHAR + 1)
+// A hash table from the names of the registers, see WordKey, to family * NUM_NAMES + type.
+#define NAME_TABLE_SIZE 128
+static uint32_t name_keys[NAME_TABLE_SIZE]; // 0 for a free slot
+static int name_indices[NAME_TABLE_SIZE];
+static bool word_chars[256]; // The characters of names and numbers
+
+// Instructions that only read and write the operands they name, unlike cqo, idiv, calls,
+// jumps and ret. push and pop also move rsp.
+static char *explicit_mnemonics[] = { "add", "and", "cmp", "lea", "neg", "not", "or", "sar", "shl", "shr", "sub", "test", "xor" };
+static char *explicit_prefixes[] = { "mov", "p", "set", "v" };
+
+
+static char *Var(struct Match *match, char name) {
+    int var = name - 'a';
+    if (!match->is_copied[var]) {
+        memcpy(match->vars[var], match->starts[var], match->lengths[var]);
+        match->vars[var][match->lengths[var]] = '\0';
+        match->is_copied[var] = true;
+    }
+
+    return match->vars[var];
+}
+
+static void Bind(struct Match *match, char name, char *text) {
+    strcpy(match->vars[name - 'a'], text);
+    match->is_bound[name - 'a'] = true;
+    match->is_copied[name - 'a'] = true;
+}
+
+static char *Instruction(char *line) {
+    while (*line == ' ' || *line == '\t') {
+        line += 1;
+    }
+
+    return line;
+}
+
+static bool IsBarrier(char *instr) {
+    return *instr == ';' || *instr == '\0';
+}
+
+static bool IsLabel(char *instr) {
+    size_t length = strlen(instr);
+    return length > 0 && instr[length - 1] == ':';
+}
+
+// The helpers below compare by hand, they run for every line and every rule.
+static char *SkipPrefix(char *text, char *prefix) {
+    while (*prefix != '\0' && *text == *prefix) {
+        text += 1;
+        prefix += 1;
+    }
+
+    return (*prefix == '\0') ? text : NULL;
+}
+
+static bool IsSame(char *a, char *b) {
+    char *rest = SkipPrefix(a, b);
+    return rest && *rest == '\0';
+}
+
+static bool IsMnemonic(char *instr, char *mnemonic) {
+    char *rest = SkipPrefix(instr, mnemonic);
+    return rest && (*rest == ' ' || *rest == '\0');
+}
+
+static bool IsMemory(char *operand) {
+    return strchr(operand, '[') != NULL;
+}
+
+static bool IsDigit(char c) {
+    return '0' <= c && c <= '9';
+}
+
+static bool IsNumber(char *operand) {
+    if (*operand == '-') {
+        operand += 1;
+    }
+
+    if (!IsDigit(*operand)) {
+        return false;
+    }
+
+    while (IsDigit(*operand)) {
+        operand += 1;
+    }
+
+    return *operand == '\0';
+}
+
+// Instructions that write memory take at most a 32-bit immediate, which they sign-extend.
+static bool IsImmediate32(char *operand) {
+    if (!IsNumber(operand)) {
+        return false;
+    }
+
+    long long value = strtoll(operand, NULL, 10);
+    return INT32_MIN <= value && value <= INT32_MAX;
+}
+
+static bool IsWordChar(char c) {
+    return word_chars[(unsigned char) c];
+}
+
+static bool IsWord(char *word, size_t length, char *name) {
+    for (size_t i = 0; i < length; ++i) {
+        if (word[i] != name[i]) {
+            return false;
+        }
+    }
+
+    return name[length] == '\0';
+}
+
+// The characters of a word of at most 4 characters packed into an integer.
+static uint32_t WordKey(char *word, size_t length) {
+    uint32_t key = 0;
+    for (size_t i = 0; i < length; ++i) {
+        key = (key << 8) | (unsigned char) word[i];
+    }
+
+    return key;
+}
+
+static int NameSlot(uint32_t key) {
+    return (int) ((key * 2654435761u) >> 25) % NAME_TABLE_SIZE;
+}
+
+static void InitTables(void) {
+    memset(name_keys, 0, sizeof(name_keys));
+    for (int i = 0; i < NUM_FAMILIES; ++i) {
+        for (int type = 0; type < NUM_NAMES; ++type) {
+            char *name = families[i][PRIMTYPE_CHAR + type];
+            uint32_t key = WordKey(name, strlen(name));
+            int slot = NameSlot(key);
+            while (name_keys[slot] != 0) {
+                slot = (slot + 1) % NAME_TABLE_SIZE;
+            }
+
+            name_keys[slot] = key;
+            name_indices[slot] = i * NUM_NAMES + type;
+        }
+    }
+
+    for (int c = 0; c < 256; ++c) {
+        word_chars[c] = ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || c == '_' || c == '.';
+    }
+}
+
+// family * NUM_NAMES + type, if the word names a register. Register names are 2 to 4
+// characters long and start with a letter.
+static int NameIndex(char *word, size_t length) {
+    if (length < 2 || length > 4 || IsDigit(*word)) {
+        return -1;
+    }
+
+    uint32_t key = WordKey(word, length);
+    for (int slot = NameSlot(key); name_keys[slot] != 0; slot = (slot + 1) % NAME_TABLE_SIZE) {
+        if (name_keys[slot] == key) {
+            return name_indices[slot];
+        }
+    }
+
+    return -1;
+}
+
+// The register that has this name for any of its parts.
+static int WordFamily(char *word, size_t length) {
+    int index = NameIndex(word, length);
+    return (index >= 0) ? index / NUM_NAMES : -1;
+}
+
+// The registers and the other names of the text, one word at a time.
+static unsigned int MentionedFamilies(char *text, char *name, bool *mentions_name) {
+    unsigned int mentions = 0;
+    while (*text != '\0') {
+        if (!IsWordChar(*text)) {
+            text += 1;
+            continue;
+        }
+
+        size_t length = 0;
+        while (IsWordChar(text[length])) {
+            length += 1;
+        }
+
+        int family = WordFamily(text, length);
+        mentions |= (family >= 0) ? 1u << family : 0;
+        if (name && IsWord(text, length, name)) {
+            *mentions_name = true;
+        }
+
+        text += length;
+    }
+
+    return mentions;
+}
+
+static bool MentionsName(char *text, char *name) {
+    bool mentions_name = false;
+    MentionedFamilies(text, name, &mentions_name);
+    return mentions_name;
+}
+
+static bool Mentions(char *text, int family) {
+    return (MentionedFamilies(text, NULL, NULL) >> family) & 1;
+}
+
+// The register whose 64-bit or 32-bit name this is, writing either sets all of it.
+static int Family(char *operand) {
+    int index = NameIndex(operand, strlen(operand));
+    int type = PRIMTYPE_CHAR + index % NUM_NAMES;
+    return (index >= 0 && (type == PRIMTYPE_INT || type == PRIMTYPE_PTR)) ? index / NUM_NAMES : -1;
+}
+
+static bool IsRegister64(char *operand) {
+    int family = Family(operand);
+    return family >= 0 && IsSame(operand, families[family][PRIMTYPE_PTR]);
+}
+
+static void FirstOperand(char *instr, char *operand) {
+    char *start = strchr(instr, ' ');
+    size_t length = 0;
+    if (start) {
+        start += 1;
+        while (start[length] != '\0' && start[length] != ',' && length + 1 < MAX_VAR_LENGTH) {
+            length += 1;
+        }
+
+        memcpy(operand, start, length);
+    }
+
+    operand[length] = '\0';
+}
+
+static int CompareNames(const void *x, const void *y) {
+    return strcmp(*(char **) x, *(char **) y);
+}
+
+static bool IsExplicit(char *instr) {
+    if (IsLabel(instr)) {
+        return false;
+    }
+
+    // The mnemonics are sorted.
+    char mnemonic[8];
+    size_t length = 0;
+    while (instr[length] != ' ' && instr[length] != '\0' && length + 1 < sizeof(mnemonic)) {
+        mnemonic[length] = instr[length];
+        length += 1;
+    }
+
+    mnemonic[length] = '\0';
+    char *key = mnemonic;
+    size_t num_mnemonics = sizeof(explicit_mnemonics) / sizeof(explicit_mnemonics[0]);
+    if (bsearch(&key, explicit_mnemonics, num_mnemonics, sizeof(char *), CompareNames)) {
+        return true;
+    }
+
+    for (int i = 0; i < (int) (sizeof(explicit_prefixes) / sizeof(explicit_prefixes[0])); ++i) {
+        if (SkipPrefix(instr, explicit_prefixes[i])) {
+            return true;
+        }
+    }
+
+    // With one operand, imul multiplies rax into rdx:rax.
+    return IsMnemonic(instr, "imul") && strchr(instr, ',') != NULL;
+}
+
+// An instruction that can change places with the ones around it if they don't share a
+// register.
+static bool IsPlain(char *instr) {
+    return IsExplicit(instr) && !IsMnemonic(instr, "push") && !IsMnemonic(instr, "pop") && !MentionsName(instr, "rsp");
+}
+
+static void SetLine(int index, char *text) {
+    lines[index].text = text;
+    lines[index].instr = text ? Instruction(text) : NULL;
+    lines[index].is_decoded = false;
+}
+
+// One pass over the words of the instruction finds the registers it names, and whether it
+// sets the register of its first operand as a whole without reading it.
+static struct Line *Decode(int index) {
+    struct Line *line = &lines[index];
+    if (line->is_decoded) {
+        return line;
+    }
+
+    char *instr = line->instr;
+    line->is_decoded = true;
+    line->is_barrier = IsBarrier(instr);
+    line->is_label = IsLabel(instr);
+    line->is_call = IsMnemonic(instr, "call");
+    line->is_explicit = IsExplicit(instr);
+    line->mentions = 0;
+    unsigned int source_mentions = 0;
+    char *first_operand = strchr(instr, ' ');
+    char *source = strchr(instr, ',');
+    int written = -1;
+    for (char *c = instr; *c != '\0';) {
+        if (!IsWordChar(*c)) {
+            c += 1;
+            continue;
+        }
+
+        size_t length = 0;
+        while (IsWordChar(c[length])) {
+            length += 1;
+        }
+
+        int name = NameIndex(c, length);
+        if (name >= 0) {
+            line->mentions |= 1u << (name / NUM_NAMES);
+            source_mentions |= (source && c > source) ? 1u << (name / NUM_NAMES) : 0;
+            int type = PRIMTYPE_CHAR + name % NUM_NAMES;
+            bool is_whole = type == PRIMTYPE_INT || type == PRIMTYPE_PTR;
+            if (is_whole && first_operand && c == first_operand + 1 && (c[length] == ',' || c[length] == '\0')) {
+                written = name / NUM_NAMES;
+            }
+        }
+
+        c += length;
+    }
+
+    bool is_pop = IsMnemonic(instr, "pop");
+    bool is_move = IsMnemonic(instr, "mov") || IsMnemonic(instr, "movzx") || IsMnemonic(instr, "movsxd") || IsMnemonic(instr, "lea");
+    bool is_full = is_pop || (is_move && source && written >= 0 && !((source_mentions >> written) & 1));
+    line->full_write = is_full ? written : -1;
+    return line;
+}
+
+static int NextLine(int index) {
+    index += 1;
+    while (index < num_lines && !lines[index].text) {
+        index += 1;
+    }
+
+    return index;
+}
+
+static int PreviousLine(int index, int first) {
+    index -= 1;
+    while (index >= first && !lines[index].text) {
+        index -= 1;
+    }
+
+    return index;
+}
+
+// Whether the register is written before it is read after the line. Labels can be reached
+// from elsewhere, so the register is taken to be used there.
+static bool IsDead(int family, int line) {
+    int num_instrs = 0;
+    for (int i = NextLine(line); i < num_lines && num_instrs < MAX_LOOKAHEAD; i = NextLine(i)) {
+        struct Line *next = Decode(i);
+        if (next->is_barrier) {
+            continue;
+        }
+
+        if (next->is_label) {
+            return false;
+        }
+
+        if ((next->mentions >> family) & 1) {
+            return next->full_write == family;
+        }
+
+        // A call reads its arguments and changes the caller-saved registers.
+        if (next->is_call) {
+            return families[family] == rax || families[family] == r10 || families[family] == r11;
+        }
+
+        if (!next->is_explicit) {
+            return false;
+        }
+
+        num_instrs += 1;
+    }
+
+    return false;
+}
+
+static bool NotBothMemory(struct Match *match) {
+    return !IsMemory(Var(match, 'a')) || !IsMemory(Var(match, 'b'));
+}
+
+// push %a, %i, pop %b
+static bool CanMoveAcross(struct Match *match) {
+    char *i = Var(match, 'i');
+    int b = Family(Var(match, 'b'));
+    return IsRegister64(Var(match, 'b')) && IsPlain(i) && !Mentions(i, b) && !MentionsName(Var(match, 'a'), "rsp");
+}
+
+// lea %r, [%m], %o %d, ... [%r]
+static bool CanFoldLoad(struct Match *match) {
+    char *o = Var(match, 'o');
+    int d = Family(Var(match, 'd'));
+    int r = Family(Var(match, 'r'));
+    bool is_load = strcmp(o, "mov") == 0 || strcmp(o, "movzx") == 0 || strcmp(o, "movsxd") == 0;
+    return is_load && d >= 0 && r >= 0 && (d == r || IsDead(r, match->last));
+}
+
+// lea %r, [%m], mov [%r], %y
+static bool CanFoldStore(struct Match *match) {
+    int r = Family(Var(match, 'r'));
+    return r >= 0 && !Mentions(Var(match, 'y'), r) && IsDead(r, match->last);
+}
+
+// lea %r, [%m], %i, mov [%r], %y
+static bool CanFoldStoreAcross(struct Match *match) {
+    char *i = Var(match, 'i');
+    char *m = Var(match, 'm');
+    int r = Family(Var(match, 'r'));
+    if (r < 0 || !IsPlain(i) || Mentions(i, r) || MentionsName(m, "rsp")) {
+        return false;
+    }
+
+    // The address must not depend on what %i writes.
+    char written[MAX_VAR_LENGTH];
+    FirstOperand(i, written);
+    if (MentionsName(written, "rbp") && MentionsName(m, "rbp")) {
+        return false;
+    }
+
+    if (MentionedFamilies(written, NULL, NULL) & MentionedFamilies(m, NULL, NULL)) {
+        return false;
+    }
+
+    return CanFoldStore(match);
+}
+
+// mov %r, %x, mov [%r], %y
+static bool CanFoldStoreAddress(struct Match *match) {
+    return IsRegister64(Var(match, 'r')) && IsRegister64(Var(match, 'x')) && CanFoldStore(match);
+}
+
+// %o %r, %x, mov %s, %r
+static bool CanForwardMove(struct Match *match) {
+    char *o = Var(match, 'o');
+    char *r = Var(match, 'r');
+    char *s = Var(match, 's');
+    char *x = Var(match, 'x');
+    if (!IsRegister64(r) || strcmp(r, s) == 0 || Mentions(s, Family(r))) {
+        return false;
+    }
+
+    if (strcmp(o, "movzx") == 0 || strcmp(o, "movsxd") == 0 || strcmp(o, "lea") == 0) {
+        return IsRegister64(s) && IsDead(Family(r), match->last);
+    }
+
+    // Without a register, the size of a store must be given.
+    if (strcmp(o, "mov") != 0 || (IsMemory(s) && !IsRegister64(x) && !(IsImmediate32(x) && strncmp(s, QWORD " [", strlen(QWORD " [")) == 0))) {
+        return false;
+    }
+
+    return IsDead(Family(r), match->last);
+}
+
+// mov %r, %x, mov %s, %t with %r the lower half of %t. Binds %u to the lower half of %s,
+// which the load then zero-extends the same way.
+static bool CanForwardZeroExtension(struct Match *match) {
+    int r = Family(Var(match, 'r'));
+    int s = Family(Var(match, 's'));
+    if (r < 0 || s < 0 || r == s || strcmp(Var(match, 'r'), families[r][PRIMTYPE_INT]) != 0) {
+        return false;
+    }
+
+    if (strcmp(Var(match, 't'), families[r][PRIMTYPE_PTR]) != 0 || !IsRegister64(Var(match, 's'))) {
+        return false;
+    }
+
+    Bind(match, 'u', families[s][PRIMTYPE_INT]);
+    return IsDead(r, match->last);
+}
+
+// mov %r, %x, mov [%m], %t with %t all or the lower half of %r. Binds %u to the size.
+static bool CanStoreConstant(struct Match *match) {
+    char *r = Var(match, 'r');
+    char *t = Var(match, 't');
+    if (!IsRegister64(r) || !IsImmediate32(Var(match, 'x')) || Mentions(Var(match, 'm'), Family(r))) {
+        return false;
+    }
+
+    if (strcmp(t, r) == 0) {
+        Bind(match, 'u', QWORD);
+    }
+    else if (strcmp(t, families[Family(r)][PRIMTYPE_INT]) == 0) {
+        Bind(match, 'u', DWORD);
+    }
+    else {
+        return false;
+    }
+
+    return IsDead(Family(r), match->last);
+}
+
+// mov %a, %b, mov %b, %a. When %a is loaded from an address that uses it, the second move
+// stores to a different address.
+static bool IsMoveBack(struct Match *match) {
+    char *a = Var(match, 'a');
+    char *b = Var(match, 'b');
+    if (IsRegister64(a)) {
+        return (IsRegister64(b) || IsMemory(b)) && !Mentions(b, Family(a));
+    }
+
+    return IsMemory(a) && IsRegister64(b);
+}
+
+static bool IsSameRegister(struct Match *match) {
+    return IsRegister64(Var(match, 'a'));
+}
+
+// mov%i, lea %i
+static bool IsDeadWrite(struct Match *match) {
+    struct Line *line = Decode(match->last);
+    return line->full_write >= 0 && IsDead(line->full_write, match->last);
+}
+
+static bool IsUnreachable(struct Match *match) {
+    return !IsLabel(Var(match, 'i'));
+}
+
+static struct Rule rules[] = {
+    // A value pushed and popped right away is moved instead.
+    { 2, { "push %a", "pop %b" }, 1, { "mov %b, %a" }, NotBothMemory },
+    { 3, { "push %a", "%i", "pop %b" }, 2, { "mov %b, %a", "%i" }, CanMoveAcross },
+    // The address of a stack slot is folded into the load or store that uses it.
+    { 2, { "lea %r, [%m]", "%o %d, %s [%r]" }, 1, { "%o %d, %s [%m]" }, CanFoldLoad },
+    { 2, { "lea %r, [%m]", "%o %d, [%r]" }, 1, { "%o %d, [%m]" }, CanFoldLoad },
+    { 2, { "lea %r, [%m]", "mov [%r], %y" }, 1, { "mov [%m], %y" }, CanFoldStore },
+    { 3, { "lea %r, [%m]", "%i", "mov [%r], %y" }, 2, { "%i", "mov [%m], %y" }, CanFoldStoreAcross },
+    { 2, { "mov %r, %x", "mov [%r], %y" }, 1, { "mov [%x], %y" }, CanFoldStoreAddress },
+    // A register that only carries a value to the next instruction is left out.
+    { 2, { "%o %r, %x", "mov %s, %r" }, 1, { "%o %s, %x" }, CanForwardMove },
+    { 2, { "mov %r, %x", "mov %s, %t" }, 1, { "mov %u, %x" }, CanForwardZeroExtension },
+    { 2, { "mov %r, %x", "mov [%m], %t" }, 1, { "mov %u [%m], %x" }, CanStoreConstant },
+    // Moves that change nothing.
+    { 2, { "mov %a, %b", "mov %b, %a" }, 1, { "mov %a, %b" }, IsMoveBack },
+    { 1, { "mov %a, %a" }, 0, { NULL }, IsSameRegister },
+    // Registers that are set again before anything reads them.
+    { 1, { "mov%i" }, 0, { NULL }, IsDeadWrite },
+    { 1, { "lea %i" }, 0, { NULL }, IsDeadWrite },
+    // Jumps to the next label, and code after an unconditional jump up to the next label.
+    { 2, { "j%c %l", "%l:" }, 1, { "%l:" }, NULL },
+    { 3, { "j%c %l", "%k:", "%l:" }, 2, { "%k:", "%l:" }, NULL },
+    { 2, { "jmp %a", "%i" }, 1, { "jmp %a" }, IsUnreachable },
+    { 2, { "ret", "%i" }, 1, { "ret" }, IsUnreachable },
+};
+#define NUM_RULES ((int) (sizeof(rules) / sizeof(rules[0])))
+
+// The rules that can match a line, in table order, by the line's first character.
+static int rules_by_start[256][NUM_RULES];
+static int num_rules_by_start[256];
+
+static void IndexRules(void) {
+    for (int c = 0; c < 256; ++c) {
+        num_rules_by_start[c] = 0;
+        for (int i = 0; i < NUM_RULES; ++i) {
+            char start = rules[i].patterns[0][0];
+            if (start == '%' || (unsigned char) start == c) {
+                rules_by_start[c][num_rules_by_start[c]] = i;
+                num_rules_by_start[c] += 1;
+            }
+        }
+    }
+}
+
+static bool MatchLine(char *pattern, char *text, struct Match *match) {
+    while (*pattern != '%') {
+        if (*pattern != *text) {
+            return false;
+        }
+
+        if (*pattern == '\0') {
+            return true;
+        }
+
+        pattern += 1;
+        text += 1;
+    }
+
+    int var = pattern[1] - 'a';
+    if (match->is_bound[var]) {
+        for (size_t i = 0; i < match->lengths[var]; ++i) {
+            if (text[i] != match->starts[var][i]) {
+                return false;
+            }
+        }
+
+        return MatchLine(pattern + 2, text + match->lengths[var], match);
+    }
+
+    // The shortest text that lets the rest of the line match is taken.
+    match->is_bound[var] = true;
+    match->starts[var] = text;
+    if (pattern[2] == '\0') {
+        char *end = text;
+        while (*end != '\0') {
+            end += 1;
+        }
+
+        match->lengths[var] = end - text;
+        match->is_bound[var] = end > text && end - text < MAX_VAR_LENGTH;
+        return match->is_bound[var];
+    }
+
+    // The variable can only end where the text has the character that follows it.
+    char next = pattern[2];
+    for (char *end = text + 1; *(end - 1) != '\0'; ++end) {
+        while (next != '%' && *end != next && *end != '\0') {
+            end += 1;
+        }
+
+        if ((next != '%' && *end != next) || end - text >= MAX_VAR_LENGTH) {
+            break;
+        }
+
+        match->lengths[var] = end - text;
+        if (MatchLine(pattern + 2, end, match)) {
+            return true;
+        }
+    }
+
+    match->is_bound[var] = false;
+    return false;
+}
+
+static bool MatchesPrefix(char *pattern, char *text) {
+    while (*pattern != '%' && *pattern != '\0') {
+        if (*pattern != *text) {
+            return false;
+        }
+
+        pattern += 1;
+        text += 1;
+    }
+
+    return true;
+}
+
+static char *Substitute(char *replacement, struct Match *match) {
+    char expanded[MAX_LINE_LENGTH];
+    size_t length = 0;
+    for (char *c = replacement; *c != '\0'; ++c) {
+        if (*c == '%') {
+            c += 1;
+            char *value = Var(match, *c);
+            size_t value_length = strlen(value);
+            memcpy(expanded + length, value, value_length);
+            length += value_length;
+        }
+        else {
+            expanded[length] = *c;
+            length += 1;
+        }
+    }
+
+    // Instructions are indented, labels are not.
+    size_t indent = (length > 0 && expanded[length - 1] == ':') ? 0 : 2;
+    char *line = (char *) Arena_Alloc(&arena, indent + length + 1);
+    memset(line, ' ', indent);
+    memcpy(line + indent, expanded, length);
+    line[indent + length] = '\0';
+    return line;
+}
+
+// Tries the rules on the window of lines that starts at the index.
+static bool Apply(int index) {
+    int window[MAX_WINDOW];
+    int window_size = 0;
+    for (int i = index; i < num_lines && window_size < MAX_WINDOW && !IsBarrier(lines[i].instr); i = NextLine(i)) {
+        window[window_size] = i;
+        window_size += 1;
+    }
+
+    struct Match match;
+    unsigned char start = (unsigned char) lines[index].instr[0];
+    for (int i = 0; i < num_rules_by_start[start]; ++i) {
+        struct Rule *rule = &rules[rules_by_start[start][i]];
+        if (rule->num_patterns > window_size) {
+            continue;
+        }
+
+        // The text before the first variable of each line rules out most rules cheaply.
+        bool is_match = true;
+        for (int j = 0; j < rule->num_patterns && is_match; ++j) {
+            is_match = MatchesPrefix(rule->patterns[j], lines[window[j]].instr);
+        }
+
+        if (!is_match) {
+            continue;
+        }
+
+        memset(match.is_bound, 0, sizeof(match.is_bound));
+        memset(match.is_copied, 0, sizeof(match.is_copied));
+        match.last = window[rule->num_patterns - 1];
+        for (int j = 0; j < rule->num_patterns && is_match; ++j) {
+            is_match = MatchLine(rule->patterns[j], lines[window[j]].instr, &match);
+        }
+
+        if (!is_match || (rule->guard && !rule->guard(&match))) {
+            continue;
+        }
+
+        for (int j = 0; j < rule->num_patterns; ++j) {
+            SetLine(window[j], (j < rule->num_replacements) ? Substitute(rule->replacements[j], &match) : NULL);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+
+//
+// ===
+// == Functions defined in Peephole.h
+// ===
+//
+
+
+char *Peephole_Run(char *text, size_t length, size_t *new_length) {
+    Arena_Init(&arena);
+    InitTables();
+    IndexRules();
+    num_lines = 0;
+    for (size_t i = 0; i < length; ++i) {
+        num_lines += (text[i] == '\n');
+    }
+
+    lines = (struct Line *) malloc(sizeof(struct Line) * (num_lines + 1));
+    int first = num_lines;
+    char *start = text;
+    for (int i = 0; i < num_lines; ++i) {
+        char *end = strchr(start, '\n');
+        *end = '\0';
+        SetLine(i, start);
+        if (strcmp(start, "section .text") == 0) {
+            first = i + 1;
+        }
+
+        start = end + 1;
+    }
+
+    // Every rule removes at least one line, so this ends. After a change, the windows that
+    // overlap the new lines are tried again.
+    int index = first;
+    while (index < num_lines) {
+        if (!lines[index].text || !Apply(index)) {
+            index += 1;
+            continue;
+        }
+
+        for (int i = 0; i < MAX_WINDOW - 1 && PreviousLine(index, first) >= first; ++i) {
+            index = PreviousLine(index, first);
+        }
+    }
+
+    size_t output_length = 0;
+    for (int i = 0; i < num_lines; ++i) {
+        output_length += lines[i].text ? strlen(lines[i].text) + 1 : 0;
+    }
+
+    char *output = (char *) malloc(output_length > 0 ? output_length : 1);
+    if (!output) {
+        ReportInternalError("out of memory");
+    }
+
+    size_t position = 0;
+    for (int i = 0; i < num_lines; ++i) {
+        if (lines[i].text) {
+            size_t line_length = strlen(lines[i].text);
+            memcpy(output + position, lines[i].text, line_length);
+            output[position + line_length] = '\n';
+            position += line_length + 1;
+        }
+    }
+
+    free(lines);
+    Arena_Free(&arena);
+    *new_length = output_length;
+    return output;
+}
@@ -0,0 +1,15 @@
+#ifndef MINIC_PEEPHOLE_H
+#define MINIC_PEEPHOLE_H
+#include <stddef.h>
+
+// Rewrites the instructions of the text section through a window of up to 3 lines with a
+// table of rules, for example push rax followed by pop rdi becomes mov rdi, rax, the address
+// from lea rax, [rbp - N] is folded into the load or store that uses it, and a jump to the
+// next label is removed. A rule whose result depends on a register being unused afterwards
+// looks ahead to the next write of that register; labels, jumps and instructions that use
+// registers implicitly count as uses. Comments are left alone and no rule spans them. The
+// lines of text, which must end with a newline, are split in place, and the result is
+// returned in a new buffer of new_length characters.
+char *Peephole_Run(char *text, size_t length, size_t *new_length);
+
+#endif // MINIC_PEEPHOLE_H
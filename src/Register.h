@@ -26,10 +26,44 @@
 #define R9D "r9d"
 #define R9 "r9"
 
+#define R10B "r10b"
+#define R10D "r10d"
+#define R10 "r10"
+
+#define R11B "r11b"
+#define R11D "r11d"
+#define R11 "r11"
+
+#define BL "bl"
+#define EBX "ebx"
+#define RBX "rbx"
+
+#define SIL "sil"
+#define ESI "esi"
+#define RSI "rsi"
+
+#define R12B "r12b"
+#define R12D "r12d"
+#define R12 "r12"
+
+#define R13B "r13b"
+#define R13D "r13d"
+#define R13 "r13"
+
+#define R14B "r14b"
+#define R14D "r14d"
+#define R14 "r14"
+
+#define R15B "r15b"
+#define R15D "r15d"
+#define R15 "r15"
+
 #define BYTE "byte"
 #define WORD "word"
 #define DWORD "dword"
 #define QWORD "qword"
+#define OWORD "oword"
+#define YWORD "yword"
 
 
 static char bytes[PRIMTYPE_COUNT] = {
@@ -89,6 +123,73 @@ static char *r9[PRIMTYPE_COUNT] = {
 };
 
 
+static char *r10[PRIMTYPE_COUNT] = {
+    [PRIMTYPE_INVALID]  = "INVALID(r10)",
+    [PRIMTYPE_CHAR]     = R10B,
+    [PRIMTYPE_INT]      = R10D,
+    [PRIMTYPE_PTR]      = R10,
+};
+
+static char *r11[PRIMTYPE_COUNT] = {
+    [PRIMTYPE_INVALID]  = "INVALID(r11)",
+    [PRIMTYPE_CHAR]     = R11B,
+    [PRIMTYPE_INT]      = R11D,
+    [PRIMTYPE_PTR]      = R11,
+};
+
+static char *rbx[PRIMTYPE_COUNT] = {
+    [PRIMTYPE_INVALID]  = "INVALID(rbx)",
+    [PRIMTYPE_CHAR]     = BL,
+    [PRIMTYPE_INT]      = EBX,
+    [PRIMTYPE_PTR]      = RBX,
+};
+
+static char *rsi[PRIMTYPE_COUNT] = {
+    [PRIMTYPE_INVALID]  = "INVALID(rsi)",
+    [PRIMTYPE_CHAR]     = SIL,
+    [PRIMTYPE_INT]      = ESI,
+    [PRIMTYPE_PTR]      = RSI,
+};
+
+static char *r12[PRIMTYPE_COUNT] = {
+    [PRIMTYPE_INVALID]  = "INVALID(r12)",
+    [PRIMTYPE_CHAR]     = R12B,
+    [PRIMTYPE_INT]      = R12D,
+    [PRIMTYPE_PTR]      = R12,
+};
+
+static char *r13[PRIMTYPE_COUNT] = {
+    [PRIMTYPE_INVALID]  = "INVALID(r13)",
+    [PRIMTYPE_CHAR]     = R13B,
+    [PRIMTYPE_INT]      = R13D,
+    [PRIMTYPE_PTR]      = R13,
+};
+
+static char *r14[PRIMTYPE_COUNT] = {
+    [PRIMTYPE_INVALID]  = "INVALID(r14)",
+    [PRIMTYPE_CHAR]     = R14B,
+    [PRIMTYPE_INT]      = R14D,
+    [PRIMTYPE_PTR]      = R14,
+};
+
+static char *r15[PRIMTYPE_COUNT] = {
+    [PRIMTYPE_INVALID]  = "INVALID(r15)",
+    [PRIMTYPE_CHAR]     = R15B,
+    [PRIMTYPE_INT]      = R15D,
+    [PRIMTYPE_PTR]      = R15,
+};
+
+
+// The registers the IR code generator keeps virtual registers in. Calls clobber the first
+// NUM_CALLER_SAVED_REGS of them, Win64 makes the callee save the others.
+#define NUM_ALLOCATABLE_REGS 8
+#define NUM_CALLER_SAVED_REGS 2
+static char **allocatable_regs[NUM_ALLOCATABLE_REGS] = { r10, r11, rbx, rsi, r12, r13, r14, r15 };
+
+// The vector registers the code generator uses, xmm<n> is the lower half of ymm<n>.
+static char *xmm[3] = { "xmm0", "xmm1", "xmm2" };
+static char *ymm[3] = { "ymm0", "ymm1", "ymm2" };
+
 // The first 4 Win64 function parameters go to these registers.
 // Additional parameters must be pushed to the stack.
 // https://www.cs.uaf.edu/2017/fall/cs301/reference/x86_64.html
@@ -31,6 +31,16 @@ void ReportInternalError(char *format, ...) {
     exit(1);
 }
 
+void ReportSemanticError(char *format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    fprintf(stderr, "error: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
 void ReportErrorAt(struct Lexer *l, char *location, char *format, ...) {
     va_list args;
     va_start(args, format);
@@ -4,6 +4,9 @@
 
 void ReportInternalError(char *format, ...);
 
+// For errors found after parsing, when the source location is no longer known.
+void ReportSemanticError(char *format, ...);
+
 void ReportErrorAt(struct Lexer *l, char *location, char *format, ...);
 
 void ReportErrorAtToken(struct Lexer *l, struct Token token, char *format, ...);
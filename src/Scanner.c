@@ -0,0 +1,349 @@
+#include "Scanner.h"
+#include <stdbool.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SCANNER_X86_64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+
+typedef char *(*FindCommentEndFunction)(char *, char *, int *);
+typedef char *(*FindNewlineFunction)(char *, char *);
+typedef char *(*SkipIdentifierFunction)(char *, char *);
+typedef char *(*SkipWhitespaceFunction)(char *, char *, int *);
+
+static bool is_initialized;
+static FindCommentEndFunction FindCommentEnd;
+static FindNewlineFunction FindNewline;
+static SkipIdentifierFunction SkipIdentifier;
+static SkipWhitespaceFunction SkipWhitespace;
+
+
+//
+// ===
+// == Scalar
+// ===
+//
+
+
+static bool IsIdentifierChar(char c) {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || c == '_';
+}
+
+static bool IsWhitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static char *FindCommentEndScalar(char *p, char *end, int *num_newlines) {
+    while (p < end - 1 && !(p[0] == '*' && p[1] == '/')) {
+        *num_newlines += (*p == '\n');
+        p += 1;
+    }
+
+    return (p < end - 1) ? p : end;
+}
+
+static char *FindNewlineScalar(char *p, char *end) {
+    while (p < end && *p != '\n') {
+        p += 1;
+    }
+
+    return p;
+}
+
+static char *SkipIdentifierScalar(char *p, char *end) {
+    while (p < end && IsIdentifierChar(*p)) {
+        p += 1;
+    }
+
+    return p;
+}
+
+static char *SkipWhitespaceScalar(char *p, char *end, int *num_newlines) {
+    while (p < end && IsWhitespace(*p)) {
+        *num_newlines += (*p == '\n');
+        p += 1;
+    }
+
+    return p;
+}
+
+
+#ifdef SCANNER_X86_64
+
+static int CountBits(unsigned int x) {
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    x = (x + (x >> 4)) & 0x0F0F0F0Fu;
+    return (int) ((x * 0x01010101u) >> 24);
+}
+
+static int CountTrailingZeros(unsigned int x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return (int) index;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+// Counts the bits of mask that come before the first set bit of stop.
+static int CountBitsBefore(unsigned int mask, unsigned int stop) {
+    return CountBits(mask & ((stop & (0u - stop)) - 1));
+}
+
+
+//
+// ===
+// == SSE2 (16 bytes at a time)
+// ===
+//
+
+
+static __m128i InRange128(__m128i chars, char low, char high) {
+    __m128i offset = _mm_sub_epi8(chars, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8((char) (high - low))), offset);
+}
+
+static unsigned int EqualMask128(__m128i chars, char c) {
+    return (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8(c)));
+}
+
+static char *FindCommentEndSSE2(char *p, char *end, int *num_newlines) {
+    // The second load reads one byte further, so one extra byte must be available.
+    while (end - p >= 17) {
+        __m128i chars = _mm_loadu_si128((__m128i *) p);
+        __m128i next_chars = _mm_loadu_si128((__m128i *) (p + 1));
+        unsigned int newlines = EqualMask128(chars, '\n');
+        unsigned int found = EqualMask128(chars, '*') & EqualMask128(next_chars, '/');
+        if (found) {
+            *num_newlines += CountBitsBefore(newlines, found);
+            return p + CountTrailingZeros(found);
+        }
+
+        *num_newlines += CountBits(newlines);
+        p += 16;
+    }
+
+    return FindCommentEndScalar(p, end, num_newlines);
+}
+
+static char *FindNewlineSSE2(char *p, char *end) {
+    while (end - p >= 16) {
+        __m128i chars = _mm_loadu_si128((__m128i *) p);
+        unsigned int found = EqualMask128(chars, '\n');
+        if (found) {
+            return p + CountTrailingZeros(found);
+        }
+
+        p += 16;
+    }
+
+    return FindNewlineScalar(p, end);
+}
+
+static char *SkipIdentifierSSE2(char *p, char *end) {
+    while (end - p >= 16) {
+        __m128i chars = _mm_loadu_si128((__m128i *) p);
+        __m128i letters = InRange128(_mm_or_si128(chars, _mm_set1_epi8(0x20)), 'a', 'z');
+        __m128i digits = InRange128(chars, '0', '9');
+        __m128i underscores = _mm_cmpeq_epi8(chars, _mm_set1_epi8('_'));
+        __m128i allowed = _mm_or_si128(_mm_or_si128(letters, digits), underscores);
+        unsigned int stop = ~(unsigned int) _mm_movemask_epi8(allowed) & 0xFFFFu;
+        if (stop) {
+            return p + CountTrailingZeros(stop);
+        }
+
+        p += 16;
+    }
+
+    return SkipIdentifierScalar(p, end);
+}
+
+static char *SkipWhitespaceSSE2(char *p, char *end, int *num_newlines) {
+    while (end - p >= 16) {
+        __m128i chars = _mm_loadu_si128((__m128i *) p);
+        unsigned int newlines = EqualMask128(chars, '\n');
+        unsigned int whitespace = EqualMask128(chars, ' ') | EqualMask128(chars, '\t') | EqualMask128(chars, '\r') | newlines;
+        unsigned int stop = ~whitespace & 0xFFFFu;
+        if (stop) {
+            *num_newlines += CountBitsBefore(newlines, stop);
+            return p + CountTrailingZeros(stop);
+        }
+
+        *num_newlines += CountBits(newlines);
+        p += 16;
+    }
+
+    return SkipWhitespaceScalar(p, end, num_newlines);
+}
+
+
+//
+// ===
+// == AVX2 (32 bytes at a time)
+// ===
+//
+
+
+TARGET_AVX2 static __m256i InRange256(__m256i chars, char low, char high) {
+    __m256i offset = _mm256_sub_epi8(chars, _mm256_set1_epi8(low));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8((char) (high - low))), offset);
+}
+
+TARGET_AVX2 static unsigned int EqualMask256(__m256i chars, char c) {
+    return (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(c)));
+}
+
+TARGET_AVX2 static char *FindCommentEndAVX2(char *p, char *end, int *num_newlines) {
+    while (end - p >= 33) {
+        __m256i chars = _mm256_loadu_si256((__m256i *) p);
+        __m256i next_chars = _mm256_loadu_si256((__m256i *) (p + 1));
+        unsigned int newlines = EqualMask256(chars, '\n');
+        unsigned int found = EqualMask256(chars, '*') & EqualMask256(next_chars, '/');
+        if (found) {
+            *num_newlines += CountBitsBefore(newlines, found);
+            return p + CountTrailingZeros(found);
+        }
+
+        *num_newlines += CountBits(newlines);
+        p += 32;
+    }
+
+    return FindCommentEndSSE2(p, end, num_newlines);
+}
+
+TARGET_AVX2 static char *FindNewlineAVX2(char *p, char *end) {
+    while (end - p >= 32) {
+        __m256i chars = _mm256_loadu_si256((__m256i *) p);
+        unsigned int found = EqualMask256(chars, '\n');
+        if (found) {
+            return p + CountTrailingZeros(found);
+        }
+
+        p += 32;
+    }
+
+    return FindNewlineSSE2(p, end);
+}
+
+TARGET_AVX2 static char *SkipIdentifierAVX2(char *p, char *end) {
+    while (end - p >= 32) {
+        __m256i chars = _mm256_loadu_si256((__m256i *) p);
+        __m256i letters = InRange256(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), 'a', 'z');
+        __m256i digits = InRange256(chars, '0', '9');
+        __m256i underscores = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('_'));
+        __m256i allowed = _mm256_or_si256(_mm256_or_si256(letters, digits), underscores);
+        unsigned int stop = ~(unsigned int) _mm256_movemask_epi8(allowed);
+        if (stop) {
+            return p + CountTrailingZeros(stop);
+        }
+
+        p += 32;
+    }
+
+    return SkipIdentifierSSE2(p, end);
+}
+
+TARGET_AVX2 static char *SkipWhitespaceAVX2(char *p, char *end, int *num_newlines) {
+    while (end - p >= 32) {
+        __m256i chars = _mm256_loadu_si256((__m256i *) p);
+        unsigned int newlines = EqualMask256(chars, '\n');
+        unsigned int whitespace = EqualMask256(chars, ' ') | EqualMask256(chars, '\t') | EqualMask256(chars, '\r') | newlines;
+        unsigned int stop = ~whitespace;
+        if (stop) {
+            *num_newlines += CountBitsBefore(newlines, stop);
+            return p + CountTrailingZeros(stop);
+        }
+
+        *num_newlines += CountBits(newlines);
+        p += 32;
+    }
+
+    return SkipWhitespaceSSE2(p, end, num_newlines);
+}
+
+static bool CpuSupportsAvx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+
+    // AVX2 also needs the OS to save the upper halves of the ymm registers.
+    __cpuid(info, 1);
+    bool has_osxsave = (info[2] & (1 << 27)) != 0;
+    bool has_avx = (info[2] & (1 << 28)) != 0;
+    if (!has_osxsave || !has_avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // SCANNER_X86_64
+
+
+//
+// ===
+// == Functions defined in Scanner.h
+// ===
+//
+
+
+void Scanner_Init() {
+    if (is_initialized) {
+        return;
+    }
+
+    is_initialized = true;
+    FindCommentEnd = FindCommentEndScalar;
+    FindNewline = FindNewlineScalar;
+    SkipIdentifier = SkipIdentifierScalar;
+    SkipWhitespace = SkipWhitespaceScalar;
+
+#ifdef SCANNER_X86_64
+    // SSE2 is part of x86-64, so only AVX2 has to be checked for.
+    if (CpuSupportsAvx2()) {
+        FindCommentEnd = FindCommentEndAVX2;
+        FindNewline = FindNewlineAVX2;
+        SkipIdentifier = SkipIdentifierAVX2;
+        SkipWhitespace = SkipWhitespaceAVX2;
+    }
+    else {
+        FindCommentEnd = FindCommentEndSSE2;
+        FindNewline = FindNewlineSSE2;
+        SkipIdentifier = SkipIdentifierSSE2;
+        SkipWhitespace = SkipWhitespaceSSE2;
+    }
+#endif
+}
+
+char *Scanner_FindCommentEnd(char *p, char *end, int *num_newlines) {
+    return FindCommentEnd(p, end, num_newlines);
+}
+
+char *Scanner_FindNewline(char *p, char *end) {
+    return FindNewline(p, end);
+}
+
+char *Scanner_SkipIdentifier(char *p, char *end) {
+    return SkipIdentifier(p, end);
+}
+
+char *Scanner_SkipWhitespace(char *p, char *end, int *num_newlines) {
+    return SkipWhitespace(p, end, num_newlines);
+}
@@ -0,0 +1,22 @@
+#ifndef MINIC_SCANNER_H
+#define MINIC_SCANNER_H
+
+// Bulk character scanning for the lexer. Each function scans [p, end) and
+// returns a pointer to the first character that stops the scan, or end.
+// Depending on the CPU the scans run on AVX2, SSE2 or plain C.
+
+// Picks the widest version of the scans the CPU supports. Called by Lexer_Init, only the
+// first call has an effect.
+void Scanner_Init();
+
+// Finds '*/'. Returns a pointer to the '*', or end if there is none.
+char *Scanner_FindCommentEnd(char *p, char *end, int *num_newlines);
+
+char *Scanner_FindNewline(char *p, char *end);
+
+char *Scanner_SkipIdentifier(char *p, char *end);
+
+// Skips ' ', '\t', '\r' and '\n'.
+char *Scanner_SkipWhitespace(char *p, char *end, int *num_newlines);
+
+#endif // MINIC_SCANNER_H
@@ -0,0 +1,408 @@
+#include "Sccp.h"
+#include "ReportError.h"
+#include <limits.h>
+#include <stdlib.h>
+
+
+// Each register starts as TOP (no value seen yet) and can only move down the lattice.
+enum LatticeKind {
+    LATTICE_TOP,
+    LATTICE_CONST,
+    LATTICE_BOTTOM,
+};
+
+struct LatticeValue {
+    enum LatticeKind kind;
+    long long value;
+};
+
+struct Edge {
+    struct IrBlock *from;
+    struct IrBlock *to;
+};
+
+static struct IrFunction *current_func;
+static struct LatticeValue *values; // Register -> lattice value
+static bool *is_visited; // Block id -> has been reached
+static bool **is_edge_executable; // Block id -> one flag per predecessor
+static int *use_offsets; // Register -> index of its first use in use_instrs
+static struct IrInstr **use_instrs;
+static struct IrBlock **use_blocks;
+static struct Edge *edge_worklist;
+static int num_edge_worklist;
+static int *reg_worklist;
+static int num_reg_worklist;
+
+
+static long long Truncate(long long value, enum PrimitiveType type) {
+    switch (type) {
+        case PRIMTYPE_CHAR: { return (unsigned char) value; }
+        case PRIMTYPE_INT:  { return (int) value; }
+    }
+
+    return value;
+}
+
+static int PredIndex(struct IrBlock *block, struct IrBlock *pred) {
+    for (int i = 0; i < block->preds.count; ++i) {
+        if (List_Get(&block->preds, i) == pred) {
+            return i;
+        }
+    }
+
+    ReportInternalError("Sccp::PredIndex - not a predecessor");
+    return -1;
+}
+
+static void AddEdge(struct IrBlock *from, struct IrBlock *to) {
+    edge_worklist[num_edge_worklist].from = from;
+    edge_worklist[num_edge_worklist].to = to;
+    num_edge_worklist += 1;
+}
+
+static void SetValue(int reg, enum LatticeKind kind, long long value) {
+    struct LatticeValue *old = &values[reg];
+    if (old->kind == kind && (kind != LATTICE_CONST || old->value == value)) {
+        return;
+    }
+
+    // Two different constants meet at bottom.
+    if (old->kind == LATTICE_CONST && kind == LATTICE_CONST) {
+        kind = LATTICE_BOTTOM;
+    }
+
+    if (old->kind == LATTICE_BOTTOM) {
+        return;
+    }
+
+    old->kind = kind;
+    old->value = value;
+    reg_worklist[num_reg_worklist] = reg;
+    num_reg_worklist += 1;
+}
+
+static void EvaluatePhi(struct IrInstr *phi, struct IrBlock *block) {
+    enum LatticeKind kind = LATTICE_TOP;
+    long long value = 0;
+    for (int i = 0; i < phi->num_args; ++i) {
+        if (!is_edge_executable[block->id][i]) {
+            continue;
+        }
+
+        struct LatticeValue *arg = &values[phi->args[i]];
+        if (arg->kind == LATTICE_BOTTOM || (arg->kind == LATTICE_CONST && kind == LATTICE_CONST && arg->value != value)) {
+            kind = LATTICE_BOTTOM;
+            break;
+        }
+
+        if (arg->kind == LATTICE_CONST) {
+            kind = LATTICE_CONST;
+            value = arg->value;
+        }
+    }
+
+    if (kind != LATTICE_TOP) {
+        SetValue(phi->dest, kind, value);
+    }
+}
+
+static void EvaluateTerminator(struct IrInstr *instr, struct IrBlock *block) {
+    if (instr->opcode == IR_JUMP) {
+        AddEdge(block, instr->target);
+    }
+    else if (instr->opcode == IR_BRANCH) {
+        struct LatticeValue *condition = &values[instr->a];
+        if (condition->kind == LATTICE_BOTTOM) {
+            AddEdge(block, instr->target);
+            AddEdge(block, instr->target2);
+        }
+        else if (condition->kind == LATTICE_CONST) {
+            AddEdge(block, (condition->value != 0) ? instr->target : instr->target2);
+        }
+    }
+}
+
+static void Evaluate(struct IrInstr *instr, struct IrBlock *block) {
+    if (instr->opcode == IR_PHI) {
+        EvaluatePhi(instr, block);
+        return;
+    }
+
+    if (Ir_IsTerminator(instr)) {
+        EvaluateTerminator(instr, block);
+        return;
+    }
+
+    if (instr->dest == IR_NO_REG) {
+        return;
+    }
+
+    switch (instr->opcode) {
+        case IR_CONST: {
+            SetValue(instr->dest, LATTICE_CONST, instr->imm);
+        } return;
+        case IR_COPY:
+        case IR_CAST:
+        case IR_NEG:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_EQU:
+        case IR_NEQ:
+        case IR_LT:
+        case IR_GT:
+        case IR_LTE:
+        case IR_GTE: {
+        } break;
+        default: {
+            SetValue(instr->dest, LATTICE_BOTTOM, 0);
+        } return;
+    }
+
+    struct LatticeValue *a = &values[instr->a];
+    struct LatticeValue *b = (instr->b != IR_NO_REG) ? &values[instr->b] : a;
+    if (a->kind == LATTICE_BOTTOM || b->kind == LATTICE_BOTTOM) {
+        SetValue(instr->dest, LATTICE_BOTTOM, 0);
+        return;
+    }
+
+    if (a->kind == LATTICE_TOP || b->kind == LATTICE_TOP) {
+        return;
+    }
+
+    // Unsigned arithmetic wraps like the 64-bit registers the values live in.
+    unsigned long long x = (unsigned long long) a->value;
+    unsigned long long y = (unsigned long long) b->value;
+    long long result = 0;
+    switch (instr->opcode) {
+        case IR_COPY: { result = a->value; } break;
+        case IR_CAST: { result = Truncate(a->value, instr->type); } break;
+        case IR_NEG:  { result = (long long) (0 - x); } break;
+        case IR_ADD:  { result = (long long) (x + y); } break;
+        case IR_SUB:  { result = (long long) (x - y); } break;
+        case IR_MUL:  { result = (long long) (x * y); } break;
+        case IR_DIV: {
+            // Left to trap at run time.
+            if (b->value == 0 || (a->value == LLONG_MIN && b->value == -1)) {
+                SetValue(instr->dest, LATTICE_BOTTOM, 0);
+                return;
+            }
+
+            result = a->value / b->value;
+        } break;
+        case IR_EQU: { result = a->value == b->value; } break;
+        case IR_NEQ: { result = a->value != b->value; } break;
+        case IR_LT:  { result = a->value < b->value; } break;
+        case IR_GT:  { result = a->value > b->value; } break;
+        case IR_LTE: { result = a->value <= b->value; } break;
+        case IR_GTE: { result = a->value >= b->value; } break;
+    }
+
+    SetValue(instr->dest, LATTICE_CONST, result);
+}
+
+static void VisitEdge(struct Edge edge) {
+    struct IrBlock *block = edge.to;
+    if (edge.from) {
+        int pred_index = PredIndex(block, edge.from);
+        if (is_edge_executable[block->id][pred_index]) {
+            return;
+        }
+
+        is_edge_executable[block->id][pred_index] = true;
+    }
+
+    // The phis depend on which edges are executable, the rest only has to be seen once.
+    bool is_first_visit = !is_visited[block->id];
+    is_visited[block->id] = true;
+    for (int i = 0; i < block->instrs.count; ++i) {
+        struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, i);
+        if (instr->opcode != IR_PHI && !is_first_visit) {
+            break;
+        }
+
+        Evaluate(instr, block);
+    }
+}
+
+static void BuildUses() {
+    int num_regs = current_func->num_regs;
+    use_offsets = (int *) calloc(num_regs + 1, sizeof(int));
+    int *uses[64];
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < current_func->blocks.count; ++i) {
+            struct IrBlock *block = (struct IrBlock *) List_Get(&current_func->blocks, i);
+            for (int j = 0; j < block->instrs.count; ++j) {
+                struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+                if (2 + instr->num_args > 64) {
+                    ReportInternalError("Sccp::BuildUses - too many arguments");
+                }
+
+                int num_uses = Ir_GetUses(instr, uses);
+                for (int k = 0; k < num_uses; ++k) {
+                    int reg = *uses[k];
+                    if (pass == 0) {
+                        use_offsets[reg + 1] += 1;
+                    }
+                    else {
+                        // use_offsets[reg] is the next free index during the second pass.
+                        use_instrs[use_offsets[reg]] = instr;
+                        use_blocks[use_offsets[reg]] = block;
+                        use_offsets[reg] += 1;
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (int reg = 0; reg < num_regs; ++reg) {
+                use_offsets[reg + 1] += use_offsets[reg];
+            }
+
+            int total = use_offsets[num_regs];
+            use_instrs = (struct IrInstr **) malloc(sizeof(struct IrInstr *) * (total + 1));
+            use_blocks = (struct IrBlock **) malloc(sizeof(struct IrBlock *) * (total + 1));
+        }
+    }
+
+    // The second pass moved every offset to the start of the next register.
+    for (int reg = num_regs; reg > 0; --reg) {
+        use_offsets[reg] = use_offsets[reg - 1];
+    }
+
+    use_offsets[0] = 0;
+}
+
+static void Propagate() {
+    int num_edges = 1;
+    for (int i = 0; i < current_func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&current_func->blocks, i);
+        num_edges += block->preds.count;
+    }
+
+    // Every edge is added at most twice (branches with both targets on the same block) and
+    // every register at most twice (TOP -> CONST -> BOTTOM).
+    edge_worklist = (struct Edge *) malloc(sizeof(struct Edge) * num_edges * 2);
+    reg_worklist = (int *) malloc(sizeof(int) * current_func->num_regs * 2);
+    num_edge_worklist = 0;
+    num_reg_worklist = 0;
+    AddEdge(NULL, (struct IrBlock *) List_Get(&current_func->blocks, 0));
+    while (num_edge_worklist > 0 || num_reg_worklist > 0) {
+        if (num_edge_worklist > 0) {
+            num_edge_worklist -= 1;
+            VisitEdge(edge_worklist[num_edge_worklist]);
+            continue;
+        }
+
+        num_reg_worklist -= 1;
+        int reg = reg_worklist[num_reg_worklist];
+        for (int i = use_offsets[reg]; i < use_offsets[reg + 1]; ++i) {
+            if (is_visited[use_blocks[i]->id]) {
+                Evaluate(use_instrs[i], use_blocks[i]);
+            }
+        }
+    }
+
+    free(edge_worklist);
+    free(reg_worklist);
+}
+
+static bool IsFoldable(struct IrInstr *instr) {
+    if (instr->dest == IR_NO_REG || instr->opcode == IR_CONST) {
+        return false;
+    }
+
+    struct LatticeValue *value = &values[instr->dest];
+    return value->kind == LATTICE_CONST && value->value >= INT_MIN && value->value <= INT_MAX;
+}
+
+// Returns true if a branch was turned into a jump.
+static bool Rewrite() {
+    bool has_changed_cfg = false;
+    for (int i = 0; i < current_func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&current_func->blocks, i);
+        if (!is_visited[block->id]) {
+            continue;
+        }
+
+        // Phis that fold are moved behind the remaining phis, which must stay first.
+        struct List *instrs = &block->instrs;
+        int num_phis = 0;
+        while (num_phis < instrs->count && ((struct IrInstr *) List_Get(instrs, num_phis))->opcode == IR_PHI) {
+            num_phis += 1;
+        }
+
+        int num_kept_phis = 0;
+        for (int j = 0; j < num_phis; ++j) {
+            struct IrInstr *phi = (struct IrInstr *) List_Get(instrs, j);
+            if (!IsFoldable(phi)) {
+                instrs->data[j] = instrs->data[num_kept_phis];
+                instrs->data[num_kept_phis] = phi;
+                num_kept_phis += 1;
+            }
+        }
+
+        for (int j = 0; j < instrs->count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(instrs, j);
+            if (IsFoldable(instr)) {
+                instr->imm = (int) values[instr->dest].value;
+                instr->opcode = IR_CONST;
+                instr->type = PRIMTYPE_PTR;
+                instr->a = IR_NO_REG;
+                instr->b = IR_NO_REG;
+                instr->num_args = 0;
+                instr->args = NULL;
+            }
+            else if (instr->opcode == IR_BRANCH && values[instr->a].kind == LATTICE_CONST) {
+                instr->opcode = IR_JUMP;
+                instr->target = (values[instr->a].value != 0) ? instr->target : instr->target2;
+                instr->target2 = NULL;
+                instr->a = IR_NO_REG;
+                has_changed_cfg = true;
+            }
+        }
+    }
+
+    return has_changed_cfg;
+}
+
+
+//
+// ===
+// == Functions defined in Sccp.h
+// ===
+//
+
+
+bool Sccp_Run(struct IrFunction *func) {
+    current_func = func;
+    values = (struct LatticeValue *) calloc(func->num_regs, sizeof(struct LatticeValue));
+    is_visited = (bool *) calloc(func->num_block_ids, sizeof(bool));
+    is_edge_executable = (bool **) calloc(func->num_block_ids, sizeof(bool *));
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        is_edge_executable[block->id] = (bool *) calloc(block->preds.count + 1, sizeof(bool));
+    }
+
+    BuildUses();
+    Propagate();
+    bool has_changed_cfg = Rewrite();
+    if (has_changed_cfg) {
+        Ir_ComputePredecessors(func);
+        Ir_RemoveUnreachableBlocks(func);
+    }
+
+    for (int i = 0; i < func->num_block_ids; ++i) {
+        free(is_edge_executable[i]);
+    }
+
+    free(values);
+    free(is_visited);
+    free(is_edge_executable);
+    free(use_offsets);
+    free(use_instrs);
+    free(use_blocks);
+    current_func = NULL;
+    return has_changed_cfg;
+}
@@ -0,0 +1,11 @@
+#ifndef MINIC_SCCP_H
+#define MINIC_SCCP_H
+#include "Ir.h"
+
+// Sparse conditional constant propagation (Wegman and Zadeck). Registers that are constant
+// on every executable path become IR_CONST, branches on constants become jumps and the
+// blocks that can no longer be reached are removed. The dominator tree has to be
+// recomputed afterwards if the function returns true.
+bool Sccp_Run(struct IrFunction *func);
+
+#endif // MINIC_SCCP_H
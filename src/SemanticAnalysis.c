@@ -1,6 +1,7 @@
 #include "SemanticAnalysis.h"
 #include "Register.h"
 #include "ReportError.h"
+#include "SymbolTable.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,36 +13,14 @@ static void AnalyzeCompoundStmt(struct CompoundStmt *compound_stmt);
 
 static struct FunctionDef *current_func;
 static struct TranslationUnit *current_t_unit;
+static struct SymbolTable symbols;
+static struct HashMap string_pool; // Interned string -> data field
 
 
-static struct Declarator *FindDeclarator(struct List *var_declarations, char *identifier) {
-    for (int i = 0; i < var_declarations->count; ++i) {
-        struct VarDeclaration *var_declaration = (struct VarDeclaration *) List_Get(var_declarations, i);
-        struct List *declarators = &var_declaration->declarators;
-        for (int j = 0; j < declarators->count; ++j) {
-            struct Declarator *declarator = (struct Declarator *) List_Get(declarators, j);
-            if (strcmp(declarator->identifier, identifier) == 0) {
-                return declarator;
-            }
-        }
+static void Declare(struct Declarator *declarator) {
+    if (!SymbolTable_Declare(&symbols, declarator->identifier, declarator)) {
+        ReportSemanticError("redeclaration of '%s' in function '%s'", declarator->identifier, current_func->identifier);
     }
-
-    return NULL;
-}
-
-static struct VarDeclaration *FindVarDeclaration(struct List *var_declarations, char *identifier) {
-    for (int i = 0; i < var_declarations->count; ++i) {
-        struct VarDeclaration *var_declaration = (struct VarDeclaration *) List_Get(var_declarations, i);
-        struct List *declarators = &var_declaration->declarators;
-        for (int j = 0; j < declarators->count; ++j) {
-            struct Declarator *declarator = (struct Declarator *) List_Get(declarators, j);
-            if (strcmp(declarator->identifier, identifier) == 0) {
-                return var_declaration;
-            }
-        }
-    }
-
-    return NULL;
 }
 
 static void AnalyzeExpr(struct Expr *expr) {
@@ -50,26 +29,25 @@ static void AnalyzeExpr(struct Expr *expr) {
             expr->operand_type = PRIMTYPE_INT;
         } break;
         case EXPR_STR: {
-            bool string_exists = false;
-            struct List *data_fields = &current_t_unit->data_fields;
-            for (int i = 0; i < data_fields->count; ++i) {
-                struct Expr *data_field = (struct Expr *) List_Get(data_fields, i);
-                if (strcmp(expr->str_value, data_field->str_value) == 0) {
-                    string_exists = true;
-                    break;
-                }
+            // Each unique literal is emitted once, as data field fmt_<id>.
+            struct Expr *data_field = (struct Expr *) HashMap_Get(&string_pool, expr->str_value);
+            if (data_field) {
+                expr->id = data_field->id;
             }
-
-            if (!string_exists) {
+            else {
+                struct List *data_fields = &current_t_unit->data_fields;
+                expr->id = data_fields->count;
                 List_Add(data_fields, expr);
+                HashMap_Put(&string_pool, expr->str_value, expr);
             }
         } break;
         case EXPR_VAR: {
-            struct Declarator *decl = FindDeclarator(&current_func->var_decls, expr->str_value);
+            struct Declarator *decl = SymbolTable_Lookup(&symbols, expr->str_value);
             if (!decl) {
-                printf("err: couldnt find decl\n");
+                ReportSemanticError("'%s' undeclared in function '%s'", expr->str_value, current_func->identifier);
             }
 
+            expr->declarator = decl;
             if (decl->array_dimensions > 0 || decl->pointer_inderection > 0) {
                 expr->operand_type = PRIMTYPE_PTR;
                 if (decl->array_dimensions > 1 || decl->pointer_inderection > 1) {
@@ -80,8 +58,7 @@ static void AnalyzeExpr(struct Expr *expr) {
                 }
             }
             else {
-                struct VarDeclaration *var_decl = FindVarDeclaration(&current_func->var_decls, expr->str_value);
-                expr->operand_type = var_decl->type;
+                expr->operand_type = decl->type;
             }
         } break;
         case EXPR_FUNC_CALL: {
@@ -142,6 +119,22 @@ static void AnalyzeExpr(struct Expr *expr) {
             AnalyzeExpr(expr->rhs);
             expr->operand_type = expr->lhs->operand_type;
         } break;
+        case EXPR_PLUS: {
+            AnalyzeExpr(expr->lhs);
+            expr->operand_type = expr->lhs->operand_type;
+        } break;
+        case EXPR_EQU:
+        case EXPR_NEQ:
+        case EXPR_LT:
+        case EXPR_GT:
+        case EXPR_LTE:
+        case EXPR_GTE:
+        case EXPR_MUL:
+        case EXPR_DIV: {
+            AnalyzeExpr(expr->lhs);
+            AnalyzeExpr(expr->rhs);
+            expr->operand_type = PRIMTYPE_INT;
+        } break;
     }
 }
 
@@ -151,6 +144,8 @@ static void AnalyzeVarDecl(struct VarDeclaration *var_declaration) {
     struct List *declarators = &var_declaration->declarators;
     for (int i = 0; i < declarators->count; ++i) {
         struct Declarator *declarator = (struct Declarator *) List_Get(declarators, i);
+        // Declared before its initializer is analyzed, since the initializer assigns to it.
+        Declare(declarator);
         if (declarator->value) {
             AnalyzeExpr(declarator->value);
         }
@@ -162,15 +157,16 @@ static void AnalyzeExpressionStmt(struct ExpressionStmt *expr_stmt) {
 }
 
 static void AnalyzeForStmt(struct ForStmt *for_stmt) {
-    AnalyzeExpr(for_stmt->init_expr);
-    AnalyzeExpr(for_stmt->cond_expr);
-    AnalyzeExpr(for_stmt->loop_expr);
+    if (for_stmt->init_expr) AnalyzeExpr(for_stmt->init_expr);
+    if (for_stmt->cond_expr) AnalyzeExpr(for_stmt->cond_expr);
+    if (for_stmt->loop_expr) AnalyzeExpr(for_stmt->loop_expr);
     AnalyzeStmt(for_stmt->stmt);
 }
 
 static void AnalyzeIfStmt(struct IfStmt *if_stmt) {
     AnalyzeExpr(if_stmt->condition);
     AnalyzeStmt(if_stmt->stmt);
+    if (if_stmt->else_branch) AnalyzeStmt(if_stmt->else_branch);
 }
 
 static void AnalyzeReturnStmt(struct ReturnStmt *return_stmt) {
@@ -202,6 +198,7 @@ static void AnalyzeStmt(struct AstNode *stmt) {
 }
 
 static void AnalyzeCompoundStmt(struct CompoundStmt *compound_stmt) {
+    SymbolTable_PushScope(&symbols);
     struct List *body = &compound_stmt->body;
     for (int i = 0; i < body->count; ++i) {
         struct AstNode *node = (struct AstNode *) List_Get(body, i);
@@ -212,22 +209,35 @@ static void AnalyzeCompoundStmt(struct CompoundStmt *compound_stmt) {
             AnalyzeStmt(node);
         }
     }
+
+    SymbolTable_PopScope(&symbols);
 }
 
 static void AnalyzeFunctionDef(struct FunctionDef *func) {
     current_func = func;
+    SymbolTable_PushScope(&symbols);
+    for (int i = 0; i < func->num_params; ++i) {
+        struct VarDeclaration *param = (struct VarDeclaration *) List_Get(&func->var_decls, i);
+        Declare((struct Declarator *) List_Get(&param->declarators, 0));
+    }
+
     AnalyzeCompoundStmt(func->body);
+    SymbolTable_PopScope(&symbols);
     current_func = 0;
 }
 
 static void AnalyzeTranslationUnit(struct TranslationUnit *t_unit) {
     current_t_unit = t_unit;
+    SymbolTable_Init(&symbols);
+    HashMap_Init(&string_pool);
     struct List *functions = &t_unit->functions;
     for (int i = 0; i < functions->count; ++i) {
         struct FunctionDef *func = (struct FunctionDef *) List_Get(functions, i);
         AnalyzeFunctionDef(func);
     }
 
+    SymbolTable_Free(&symbols);
+    HashMap_Free(&string_pool);
     current_t_unit = 0;
 }
 
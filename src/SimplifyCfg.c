@@ -0,0 +1,203 @@
+#include "SimplifyCfg.h"
+#include <stdlib.h>
+
+
+static bool HasPhis(struct IrBlock *block) {
+    if (block->instrs.count == 0) {
+        return false;
+    }
+
+    return ((struct IrInstr *) List_Get(&block->instrs, 0))->opcode == IR_PHI;
+}
+
+static bool IsPredecessor(struct IrBlock *block, struct IrBlock *pred) {
+    for (int i = 0; i < block->preds.count; ++i) {
+        if (List_Get(&block->preds, i) == pred) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool SimplifyBranches(struct IrFunction *func) {
+    bool has_changed = false;
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        struct IrInstr *terminator = Ir_Terminator(block);
+        if (terminator && terminator->opcode == IR_BRANCH && terminator->target == terminator->target2) {
+            terminator->opcode = IR_JUMP;
+            terminator->a = IR_NO_REG;
+            terminator->target2 = NULL;
+            has_changed = true;
+        }
+    }
+
+    return has_changed;
+}
+
+// A block that holds nothing but a jump is skipped by its predecessors. When the target
+// has phis, an edge can only be moved if the phi arguments stay unambiguous: the block
+// must have a single predecessor that is not already a predecessor of the target.
+static bool ThreadJumps(struct IrFunction *func) {
+    bool has_changed = false;
+    // Blocks that gained predecessors have stale lists until the end of the pass.
+    bool *has_stale_preds = (bool *) calloc(func->num_block_ids, sizeof(bool));
+    struct IrBlock *entry = (struct IrBlock *) List_Get(&func->blocks, 0);
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        struct IrInstr *jump = (struct IrInstr *) ((block->instrs.count == 1) ? List_Get(&block->instrs, 0) : NULL);
+        if (block == entry || !jump || jump->opcode != IR_JUMP || jump->target == block || has_stale_preds[block->id]) {
+            continue;
+        }
+
+        struct IrBlock *target = jump->target;
+        if (HasPhis(target)) {
+            if (block->preds.count != 1) {
+                continue;
+            }
+
+            struct IrBlock *pred = (struct IrBlock *) List_Get(&block->preds, 0);
+            if (IsPredecessor(target, pred)) {
+                continue;
+            }
+
+            Ir_ReplacePredecessor(target, block, pred);
+        }
+        else {
+            has_stale_preds[target->id] = true;
+        }
+
+        for (int j = 0; j < block->preds.count; ++j) {
+            struct IrBlock *pred = (struct IrBlock *) List_Get(&block->preds, j);
+            struct IrInstr *terminator = Ir_Terminator(pred);
+            if (terminator->target == block) {
+                terminator->target = target;
+                has_changed = true;
+            }
+
+            if (terminator->target2 == block) {
+                terminator->target2 = target;
+                has_changed = true;
+            }
+        }
+
+        block->preds.count = 0;
+    }
+
+    // The skipped blocks are unreachable now. They have to go before the predecessors are
+    // recomputed, or their jumps would count as edges.
+    if (has_changed) {
+        Ir_RemoveUnreachableBlocks(func);
+    }
+
+    free(has_stale_preds);
+    return has_changed;
+}
+
+static bool MergeBlocks(struct IrFunction *func, int *replacements) {
+    bool has_changed = false;
+    bool *is_removed = (bool *) calloc(func->num_block_ids, sizeof(bool));
+    struct IrBlock *entry = (struct IrBlock *) List_Get(&func->blocks, 0);
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        if (is_removed[block->id]) {
+            continue;
+        }
+
+        while (true) {
+            struct IrInstr *jump = Ir_Terminator(block);
+            if (!jump || jump->opcode != IR_JUMP) {
+                break;
+            }
+
+            struct IrBlock *succ = jump->target;
+            if (succ == block || succ == entry || succ->preds.count != 1) {
+                break;
+            }
+
+            // The phis of a block with one predecessor have one argument.
+            block->instrs.count -= 1;
+            for (int j = 0; j < succ->instrs.count; ++j) {
+                struct IrInstr *instr = (struct IrInstr *) List_Get(&succ->instrs, j);
+                if (instr->opcode == IR_PHI) {
+                    replacements[instr->dest] = instr->args[0];
+                    continue;
+                }
+
+                List_Add(&block->instrs, instr);
+            }
+
+            struct IrBlock *succs[2];
+            int num_succs = Ir_Successors(succ, succs);
+            for (int j = 0; j < num_succs; ++j) {
+                Ir_ReplacePredecessor(succs[j], succ, block);
+            }
+
+            is_removed[succ->id] = true;
+            has_changed = true;
+        }
+    }
+
+    int count = 0;
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        if (!is_removed[block->id]) {
+            func->blocks.data[count] = block;
+            count += 1;
+        }
+    }
+
+    func->blocks.count = count;
+    free(is_removed);
+    return has_changed;
+}
+
+static void RemoveSingleArgumentPhis(struct IrFunction *func, int *replacements) {
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *phi = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (phi->opcode != IR_PHI) {
+                break;
+            }
+
+            if (phi->num_args == 1) {
+                replacements[phi->dest] = phi->args[0];
+                phi->opcode = IR_NOP;
+                phi->num_args = 0;
+            }
+        }
+    }
+}
+
+
+//
+// ===
+// == Functions defined in SimplifyCfg.h
+// ===
+//
+
+
+bool SimplifyCfg_Run(struct IrFunction *func) {
+    int *replacements = (int *) calloc(func->num_regs, sizeof(int));
+    bool has_changed = false;
+    bool is_changing = true;
+    while (is_changing) {
+        is_changing = SimplifyBranches(func);
+        if (is_changing) {
+            Ir_ComputePredecessors(func);
+        }
+
+        is_changing = ThreadJumps(func) || is_changing;
+        Ir_RemoveUnreachableBlocks(func);
+        is_changing = MergeBlocks(func, replacements) || is_changing;
+        has_changed = has_changed || is_changing;
+    }
+
+    RemoveSingleArgumentPhis(func, replacements);
+    Ir_ReplaceRegs(func, replacements);
+    Ir_RemoveNops(func);
+    free(replacements);
+    return has_changed;
+}
@@ -0,0 +1,13 @@
+#ifndef MINIC_SIMPLIFY_CFG_H
+#define MINIC_SIMPLIFY_CFG_H
+#include "Ir.h"
+
+// Cleans up the control-flow graph until nothing changes: branches with both targets on
+// the same block become jumps, jumps to blocks that only jump on are threaded to the
+// final target, a block is merged into its predecessor when it is that block's only
+// successor and has no other predecessor, and unreachable blocks are removed. Phis in
+// blocks with a single predecessor are replaced by their argument.
+// Returns true if the CFG changed, in which case the dominator tree is out of date.
+bool SimplifyCfg_Run(struct IrFunction *func);
+
+#endif // MINIC_SIMPLIFY_CFG_H
@@ -0,0 +1,502 @@
+#include "Ssa.h"
+#include "ReportError.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+struct ValueStack {
+    int *values;
+    int count;
+    int capacity;
+};
+
+// The state of one Ssa_PromoteSlots run.
+static struct IrFunction *current_func;
+static bool *is_promoted; // Slot id -> promote it
+static int *phi_slots; // Register -> slot id + 1 of the phi that defines it, 0 for other registers
+static struct IrInstr **defs; // Register -> defining instruction
+static int *replacements; // Register -> register that replaces it
+static struct ValueStack *stacks; // Slot id -> current definitions
+static struct ValueStack pushed_slots; // The slot of every definition on stacks, in push order
+static int undef_reg;
+
+
+static void PushValue(struct ValueStack *stack, int value) {
+    if (stack->count == stack->capacity) {
+        stack->capacity = (stack->capacity == 0) ? 16 : stack->capacity * 2;
+        stack->values = (int *) realloc(stack->values, sizeof(int) * stack->capacity);
+    }
+
+    stack->values[stack->count] = value;
+    stack->count += 1;
+}
+
+static void Push(int slot, int value) {
+    PushValue(&stacks[slot], value);
+    PushValue(&pushed_slots, slot);
+}
+
+static int Resolve(int reg) {
+    while (replacements[reg] != IR_NO_REG) {
+        reg = replacements[reg];
+    }
+
+    return reg;
+}
+
+// A read of a slot that was never written gets an undefined value, which is 0 here.
+static int CurrentValue(int slot) {
+    struct ValueStack *stack = &stacks[slot];
+    if (stack->count > 0) {
+        return stack->values[stack->count - 1];
+    }
+
+    if (undef_reg == IR_NO_REG) {
+        undef_reg = Ir_NewReg(current_func);
+    }
+
+    return undef_reg;
+}
+
+// A slot only holds the low bytes of what is stored in it. Casting is unnecessary when the
+// value is already what a load of that type would produce.
+static bool NeedsCast(int value, enum PrimitiveType type) {
+    if (type == PRIMTYPE_PTR) {
+        return false;
+    }
+
+    struct IrInstr *def = defs[value];
+    if (!def) {
+        return true;
+    }
+
+    switch (def->opcode) {
+        case IR_CONST: {
+            return type == PRIMTYPE_CHAR && (def->imm < 0 || def->imm > 255);
+        }
+        case IR_CAST:
+        case IR_LOAD:
+        case IR_LOAD_SLOT: {
+            return def->type != type;
+        }
+        case IR_EQU:
+        case IR_NEQ:
+        case IR_LT:
+        case IR_GT:
+        case IR_LTE:
+        case IR_GTE: {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void ComputeFrontiers(struct List *frontiers) {
+    struct List *rpo_blocks = &current_func->rpo_blocks;
+    for (int i = 0; i < rpo_blocks->count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(rpo_blocks, i);
+        if (block->preds.count < 2) {
+            continue;
+        }
+
+        for (int j = 0; j < block->preds.count; ++j) {
+            struct IrBlock *runner = (struct IrBlock *) List_Get(&block->preds, j);
+            while (runner != block->idom) {
+                struct List *frontier = &frontiers[runner->id];
+                if (frontier->count == 0 || List_Get(frontier, frontier->count - 1) != block) {
+                    List_Add(frontier, block);
+                }
+
+                runner = runner->idom;
+            }
+        }
+    }
+}
+
+static void InsertPhis(struct List *new_phis) {
+    int num_block_ids = current_func->num_block_ids;
+    struct List *frontiers = (struct List *) malloc(sizeof(struct List) * num_block_ids);
+    for (int i = 0; i < num_block_ids; ++i) {
+        List_Init(&frontiers[i]);
+    }
+
+    ComputeFrontiers(frontiers);
+
+    // has_phi and is_queued hold the id of the last slot that marked the block.
+    int *has_phi = (int *) malloc(sizeof(int) * num_block_ids);
+    int *is_queued = (int *) malloc(sizeof(int) * num_block_ids);
+    struct IrBlock **worklist = (struct IrBlock **) malloc(sizeof(struct IrBlock *) * num_block_ids);
+    for (int i = 0; i < num_block_ids; ++i) {
+        has_phi[i] = -1;
+        is_queued[i] = -1;
+    }
+
+    // The blocks that store to each slot, found in one pass.
+    int num_slots = current_func->slots.count;
+    struct List *def_blocks = (struct List *) malloc(sizeof(struct List) * num_slots);
+    for (int slot = 0; slot < num_slots; ++slot) {
+        List_Init(&def_blocks[slot]);
+    }
+
+    struct List *rpo_blocks = &current_func->rpo_blocks;
+    for (int i = 0; i < rpo_blocks->count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(rpo_blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->opcode != IR_STORE_SLOT || !is_promoted[instr->imm]) {
+                continue;
+            }
+
+            struct List *blocks = &def_blocks[instr->imm];
+            if (blocks->count == 0 || List_Get(blocks, blocks->count - 1) != block) {
+                List_Add(blocks, block);
+            }
+        }
+    }
+
+    for (int slot = 0; slot < num_slots; ++slot) {
+        if (!is_promoted[slot]) {
+            continue;
+        }
+
+        int num_worklist = 0;
+        for (int i = 0; i < def_blocks[slot].count; ++i) {
+            struct IrBlock *block = (struct IrBlock *) List_Get(&def_blocks[slot], i);
+            worklist[num_worklist] = block;
+            num_worklist += 1;
+            is_queued[block->id] = slot;
+        }
+
+        while (num_worklist > 0) {
+            num_worklist -= 1;
+            struct List *frontier = &frontiers[worklist[num_worklist]->id];
+            for (int i = 0; i < frontier->count; ++i) {
+                struct IrBlock *block = (struct IrBlock *) List_Get(frontier, i);
+                if (has_phi[block->id] == slot) {
+                    continue;
+                }
+
+                has_phi[block->id] = slot;
+                struct IrInstr *phi = Ir_NewInstr(current_func, IR_PHI);
+                phi->dest = Ir_NewReg(current_func);
+                phi->imm = slot;
+                phi->num_args = block->preds.count;
+                phi->args = ARENA_NEW_ARRAY(current_func->arena, int, phi->num_args);
+                List_Add(&new_phis[block->id], phi);
+                if (is_queued[block->id] != slot) {
+                    is_queued[block->id] = slot;
+                    worklist[num_worklist] = block;
+                    num_worklist += 1;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < num_block_ids; ++i) {
+        List_Free(&frontiers[i]);
+    }
+
+    for (int slot = 0; slot < num_slots; ++slot) {
+        List_Free(&def_blocks[slot]);
+    }
+
+    free(frontiers);
+    free(def_blocks);
+    free(has_phi);
+    free(is_queued);
+    free(worklist);
+}
+
+static void RenameBlock(struct IrBlock *block) {
+    for (int i = 0; i < block->instrs.count; ++i) {
+        struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, i);
+        if (instr->opcode == IR_PHI && phi_slots[instr->dest] != 0) {
+            Push(phi_slots[instr->dest] - 1, instr->dest);
+        }
+        else if (instr->opcode == IR_LOAD_SLOT && is_promoted[instr->imm]) {
+            replacements[instr->dest] = CurrentValue(instr->imm);
+            instr->opcode = IR_NOP;
+        }
+        else if (instr->opcode == IR_STORE_SLOT && is_promoted[instr->imm]) {
+            int slot = instr->imm;
+            int value = Resolve(instr->a);
+            if (NeedsCast(value, instr->type)) {
+                // The store becomes the cast, which is the slot's new value.
+                instr->opcode = IR_CAST;
+                instr->dest = Ir_NewReg(current_func);
+                instr->a = value;
+                instr->imm = 0;
+                defs[instr->dest] = instr;
+                Push(slot, instr->dest);
+            }
+            else {
+                instr->opcode = IR_NOP;
+                Push(slot, value);
+            }
+        }
+    }
+
+    struct IrBlock *succs[2];
+    int num_succs = Ir_Successors(block, succs);
+    for (int i = 0; i < num_succs; ++i) {
+        struct IrBlock *succ = succs[i];
+        int pred_index = 0;
+        while (List_Get(&succ->preds, pred_index) != block) {
+            pred_index += 1;
+        }
+
+        for (int j = 0; j < succ->instrs.count; ++j) {
+            struct IrInstr *phi = (struct IrInstr *) List_Get(&succ->instrs, j);
+            if (phi->opcode != IR_PHI) {
+                break;
+            }
+
+            if (phi_slots[phi->dest] != 0) {
+                phi->args[pred_index] = CurrentValue(phi_slots[phi->dest] - 1);
+            }
+        }
+    }
+}
+
+static void Rename() {
+    struct List *rpo_blocks = &current_func->rpo_blocks;
+    int num_blocks = rpo_blocks->count;
+
+    // Walks the dominator tree depth first without recursion. Each entry on the stack is
+    // visited twice: once to rename the block and once, after its children, to pop the
+    // definitions it pushed, which are the ones above the height of pushed_slots that
+    // was saved in saved_heights on the way in.
+    struct IrBlock **stack = (struct IrBlock **) malloc(sizeof(struct IrBlock *) * num_blocks * 2);
+    bool *is_exit = (bool *) malloc(sizeof(bool) * num_blocks * 2);
+    int *saved_heights = (int *) malloc(sizeof(int) * num_blocks * 2);
+    int stack_size = 1;
+    stack[0] = (struct IrBlock *) List_Get(rpo_blocks, 0);
+    is_exit[0] = false;
+    while (stack_size > 0) {
+        stack_size -= 1;
+        struct IrBlock *block = stack[stack_size];
+        if (is_exit[stack_size]) {
+            while (pushed_slots.count > saved_heights[stack_size]) {
+                pushed_slots.count -= 1;
+                stacks[pushed_slots.values[pushed_slots.count]].count -= 1;
+            }
+
+            continue;
+        }
+
+        saved_heights[stack_size] = pushed_slots.count;
+        RenameBlock(block);
+        is_exit[stack_size] = true;
+        stack_size += 1;
+        for (int i = block->dom_children.count - 1; i >= 0; --i) {
+            stack[stack_size] = (struct IrBlock *) List_Get(&block->dom_children, i);
+            is_exit[stack_size] = false;
+            stack_size += 1;
+        }
+    }
+
+    free(stack);
+    free(is_exit);
+    free(saved_heights);
+}
+
+static void CountRegUses(struct IrFunction *func, int *num_uses) {
+    int *uses[64];
+    memset(num_uses, 0, sizeof(int) * func->num_regs);
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (2 + instr->num_args > 64) {
+                ReportInternalError("Ssa::CountRegUses - too many arguments");
+            }
+
+            int count = Ir_GetUses(instr, uses);
+            for (int k = 0; k < count; ++k) {
+                num_uses[*uses[k]] += 1;
+            }
+        }
+    }
+}
+
+// Minimal SSA places phis that nothing reads, for example for a variable that is dead
+// after a loop. Removing them (and the phis only they read) keeps the IR readable.
+static void RemoveUnusedPhis() {
+    int *num_uses = (int *) malloc(sizeof(int) * current_func->num_regs);
+    CountRegUses(current_func, num_uses);
+    bool has_changed = true;
+    while (has_changed) {
+        has_changed = false;
+        for (int i = 0; i < current_func->blocks.count; ++i) {
+            struct IrBlock *block = (struct IrBlock *) List_Get(&current_func->blocks, i);
+            for (int j = 0; j < block->instrs.count; ++j) {
+                struct IrInstr *phi = (struct IrInstr *) List_Get(&block->instrs, j);
+                if (phi->opcode != IR_PHI) {
+                    continue;
+                }
+
+                // A phi that only feeds itself (a loop variable nobody reads) is unused too.
+                int num_self_uses = 0;
+                for (int k = 0; k < phi->num_args; ++k) {
+                    num_self_uses += (phi->args[k] == phi->dest);
+                }
+
+                if (num_uses[phi->dest] == num_self_uses) {
+                    for (int k = 0; k < phi->num_args; ++k) {
+                        num_uses[phi->args[k]] -= 1;
+                    }
+
+                    phi->opcode = IR_NOP;
+                    phi->num_args = 0;
+                    has_changed = true;
+                }
+            }
+        }
+    }
+
+    free(num_uses);
+}
+
+
+//
+// ===
+// == Functions defined in Ssa.h
+// ===
+//
+
+
+void Ssa_Destruct(struct IrFunction *func) {
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *phi = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (phi->opcode != IR_PHI) {
+                break;
+            }
+
+            int temp = Ir_NewReg(func);
+            for (int k = 0; k < block->preds.count; ++k) {
+                struct IrBlock *pred = (struct IrBlock *) List_Get(&block->preds, k);
+                struct IrInstr *terminator = Ir_Terminator(pred);
+                struct IrInstr *copy = Ir_NewInstr(func, IR_COPY);
+                copy->dest = temp;
+                copy->a = phi->args[k];
+                pred->instrs.count -= 1;
+                List_Add(&pred->instrs, copy);
+                List_Add(&pred->instrs, terminator);
+            }
+
+            phi->opcode = IR_COPY;
+            phi->a = temp;
+            phi->num_args = 0;
+            phi->args = NULL;
+        }
+    }
+}
+
+void Ssa_PromoteSlots(struct IrFunction *func) {
+    current_func = func;
+    int num_slots = func->slots.count;
+    is_promoted = (bool *) malloc(sizeof(bool) * (num_slots + 1));
+    bool has_promotable_slot = false;
+    for (int i = 0; i < num_slots; ++i) {
+        struct IrSlot *slot = (struct IrSlot *) List_Get(&func->slots, i);
+        is_promoted[i] = !slot->is_address_taken && !slot->is_promoted;
+        has_promotable_slot = has_promotable_slot || is_promoted[i];
+    }
+
+    if (!has_promotable_slot) {
+        free(is_promoted);
+        return;
+    }
+
+    int num_block_ids = func->num_block_ids;
+    struct List *new_phis = (struct List *) malloc(sizeof(struct List) * num_block_ids);
+    for (int i = 0; i < num_block_ids; ++i) {
+        List_Init(&new_phis[i]);
+    }
+
+    InsertPhis(new_phis);
+
+    // Every promoted store may become a cast with a new register, and one register is
+    // needed for undefined values.
+    int num_stores = 0;
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        num_stores += block->instrs.count;
+    }
+
+    int max_regs = func->num_regs + num_stores + 1;
+    phi_slots = (int *) calloc(max_regs, sizeof(int));
+    defs = (struct IrInstr **) calloc(max_regs, sizeof(struct IrInstr *));
+    replacements = (int *) calloc(max_regs, sizeof(int));
+    stacks = (struct ValueStack *) calloc(num_slots, sizeof(struct ValueStack));
+    memset(&pushed_slots, 0, sizeof(pushed_slots));
+    undef_reg = IR_NO_REG;
+
+    // Prepend the new phis to their blocks.
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        struct List *phis = &new_phis[block->id];
+        for (int j = 0; j < phis->count; ++j) {
+            struct IrInstr *phi = (struct IrInstr *) List_Get(phis, j);
+            phi_slots[phi->dest] = phi->imm + 1;
+        }
+
+        for (int j = 0; j < block->instrs.count; ++j) {
+            List_Add(phis, List_Get(&block->instrs, j));
+        }
+
+        List_Free(&block->instrs);
+        block->instrs = *phis;
+        List_Init(&new_phis[block->id]);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->dest != IR_NO_REG) {
+                defs[instr->dest] = instr;
+            }
+        }
+    }
+
+    Rename();
+
+    if (undef_reg != IR_NO_REG) {
+        struct IrBlock *entry = (struct IrBlock *) List_Get(&func->blocks, 0);
+        struct IrInstr *undef = Ir_NewInstr(func, IR_CONST);
+        undef->dest = undef_reg;
+        undef->imm = 0;
+        List_Add(&entry->instrs, NULL);
+        memmove(entry->instrs.data + 1, entry->instrs.data, sizeof(void *) * (entry->instrs.count - 1));
+        entry->instrs.data[0] = undef;
+    }
+
+    Ir_ReplaceRegs(func, replacements);
+    Ir_RemoveNops(func);
+    RemoveUnusedPhis();
+    Ir_RemoveNops(func);
+
+    for (int i = 0; i < num_slots; ++i) {
+        if (is_promoted[i]) {
+            struct IrSlot *slot = (struct IrSlot *) List_Get(&func->slots, i);
+            slot->is_promoted = true;
+        }
+    }
+
+    for (int i = 0; i < num_slots; ++i) {
+        free(stacks[i].values);
+    }
+
+    for (int i = 0; i < num_block_ids; ++i) {
+        List_Free(&new_phis[i]);
+    }
+
+    free(new_phis);
+    free(is_promoted);
+    free(phi_slots);
+    free(defs);
+    free(replacements);
+    free(stacks);
+    free(pushed_slots.values);
+    current_func = NULL;
+}
@@ -0,0 +1,13 @@
+#ifndef MINIC_SSA_H
+#define MINIC_SSA_H
+#include "Ir.h"
+
+// Leaves SSA form: every phi becomes copies at the end of its predecessors.
+// Each phi gets its own temporary, so phis that read each other's results stay correct.
+void Ssa_Destruct(struct IrFunction *func);
+
+// mem2reg: turns the slots whose address is never taken into SSA registers, inserting
+// phis on the dominance frontiers (Cytron et al.). Dominators_Compute must have been run.
+void Ssa_PromoteSlots(struct IrFunction *func);
+
+#endif // MINIC_SSA_H
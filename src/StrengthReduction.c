@@ -0,0 +1,436 @@
+#include "StrengthReduction.h"
+#include "Loops.h"
+#include "ReportError.h"
+#include <limits.h>
+#include <stdlib.h>
+
+
+// A header phi that the loop adds step to: phi = phi + step, possibly cast back to int.
+struct BasicIv {
+    struct IrInstr *phi;
+    struct IrInstr *increment;
+    struct IrInstr *cast; // NULL if the increment is not cast.
+    int step;
+    // The first derived induction variable with a positive scale that got a phi of its own.
+    struct IrInstr *reduced;
+    int reduced_scale;
+    int reduced_offset;
+};
+
+// scale * basic + offset, offset is IR_NO_REG if there is none.
+struct DerivedIv {
+    int basic; // -1 if the register is not a derived induction variable.
+    int scale;
+    int offset;
+};
+
+static struct IrDefs defs; // num_uses leaves out the loop being reduced and its preheader.
+static int *num_loop_uses; // Register -> number of uses in the current loop
+static int *num_derived_uses; // Register -> number of uses by derived induction variables
+static struct DerivedIv *derived;
+static int capacity; // Registers the three arrays above have room for.
+static struct BasicIv *basic_ivs;
+static int num_basic_ivs;
+
+
+static bool IsInvariant(int reg, struct Loop *loop) {
+    return !Loops_Contains(loop, defs.blocks[reg]);
+}
+
+static int CountUses(int reg) {
+    return defs.num_uses[reg] + num_loop_uses[reg];
+}
+
+static bool FitsInInt(long long value) {
+    return INT_MIN <= value && value <= INT_MAX;
+}
+
+static int FindBasicIv(int reg) {
+    for (int i = 0; i < num_basic_ivs; ++i) {
+        if (basic_ivs[i].phi->dest == reg) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void FindBasicIvs(struct Loop *loop, int latch_index) {
+    struct IrBlock *header = loop->header;
+    num_basic_ivs = 0;
+    for (int i = 0; i < header->instrs.count; ++i) {
+        struct IrInstr *phi = (struct IrInstr *) List_Get(&header->instrs, i);
+        if (phi->opcode != IR_PHI) {
+            break;
+        }
+
+        // A signed int that overflows is undefined, so the cast can be ignored.
+        struct IrInstr *increment = defs.instrs[phi->args[latch_index]];
+        struct IrInstr *cast = NULL;
+        if (increment && increment->opcode == IR_CAST && increment->type != PRIMTYPE_CHAR) {
+            cast = increment;
+            increment = defs.instrs[cast->a];
+        }
+
+        if (!increment || !Loops_Contains(loop, defs.blocks[increment->dest])) {
+            continue;
+        }
+
+        int step = 0;
+        if (increment->opcode == IR_ADD && increment->a == phi->dest && Ir_IsConst(&defs, increment->b)) {
+            step = defs.instrs[increment->b]->imm;
+        }
+        else if (increment->opcode == IR_ADD && increment->b == phi->dest && Ir_IsConst(&defs, increment->a)) {
+            step = defs.instrs[increment->a]->imm;
+        }
+        else if (increment->opcode == IR_SUB && increment->a == phi->dest && Ir_IsConst(&defs, increment->b) && defs.instrs[increment->b]->imm != INT_MIN) {
+            step = -defs.instrs[increment->b]->imm;
+        }
+        else {
+            continue;
+        }
+
+        struct BasicIv *iv = &basic_ivs[num_basic_ivs];
+        iv->phi = phi;
+        iv->increment = increment;
+        iv->cast = cast;
+        iv->step = step;
+        iv->reduced = NULL;
+        num_basic_ivs += 1;
+    }
+}
+
+// Records c * i and base + c * i, where i is a basic induction variable, c a constant
+// and base invariant. The loop's blocks are in reverse post-order, so operands are seen
+// before the instructions that use them.
+static void FindDerivedIvs(struct Loop *loop) {
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->opcode == IR_MUL) {
+                int scaled = Ir_IsConst(&defs, instr->a) ? instr->b : instr->a;
+                int factor = Ir_IsConst(&defs, instr->a) ? instr->a : instr->b;
+                int basic = FindBasicIv(scaled);
+                int scale = defs.instrs[factor]->imm;
+                if (basic != -1 && Ir_IsConst(&defs, factor) && scale != 0 && scale != 1) {
+                    derived[instr->dest].basic = basic;
+                    derived[instr->dest].scale = scale;
+                    derived[instr->dest].offset = IR_NO_REG;
+                }
+            }
+            else if (instr->opcode == IR_ADD) {
+                int scaled = (derived[instr->a].basic != -1) ? instr->a : instr->b;
+                int offset = (scaled == instr->a) ? instr->b : instr->a;
+                struct DerivedIv *iv = &derived[scaled];
+                if (iv->basic != -1 && iv->offset == IR_NO_REG && IsInvariant(offset, loop)) {
+                    derived[instr->dest].basic = iv->basic;
+                    derived[instr->dest].scale = iv->scale;
+                    derived[instr->dest].offset = offset;
+                }
+            }
+        }
+    }
+}
+
+static void CountLoopUses(struct Loop *loop) {
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            int *uses[64];
+            int num_instr_uses = Ir_GetUses(instr, uses);
+            for (int k = 0; k < num_instr_uses; ++k) {
+                num_loop_uses[*uses[k]] += 1;
+                if (instr->dest != IR_NO_REG && derived[instr->dest].basic != -1) {
+                    num_derived_uses[*uses[k]] += 1;
+                }
+            }
+        }
+    }
+}
+
+static int AddConst(struct IrFunction *func, struct IrBlock *block, int value) {
+    struct IrInstr *instr = Ir_AddBeforeTerminator(func, block, IR_CONST);
+    instr->imm = value;
+    return instr->dest;
+}
+
+// Adds scale * reg + offset to the end of the block, offset can be IR_NO_REG.
+static int AddScaled(struct IrFunction *func, struct IrBlock *block, int scale, int reg, int offset) {
+    long long folded = (long long) scale * (Ir_IsConst(&defs, reg) ? defs.instrs[reg]->imm : 0);
+    int scaled;
+    if (Ir_IsConst(&defs, reg) && folded == 0 && offset != IR_NO_REG) {
+        return offset;
+    }
+    else if (Ir_IsConst(&defs, reg) && FitsInInt(folded)) {
+        scaled = AddConst(func, block, (int) folded);
+    }
+    else {
+        int scale_reg = AddConst(func, block, scale);
+        struct IrInstr *mul = Ir_AddBeforeTerminator(func, block, IR_MUL);
+        mul->a = scale_reg;
+        mul->b = reg;
+        scaled = mul->dest;
+    }
+
+    if (offset == IR_NO_REG) {
+        return scaled;
+    }
+
+    struct IrInstr *add = Ir_AddBeforeTerminator(func, block, IR_ADD);
+    add->a = offset;
+    add->b = scaled;
+    return add->dest;
+}
+
+static void ReplaceUses(struct Loop *loop, int old_reg, int new_reg) {
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            int *uses[64];
+            int num_instr_uses = Ir_GetUses(instr, uses);
+            for (int k = 0; k < num_instr_uses; ++k) {
+                if (*uses[k] == old_reg) {
+                    *uses[k] = new_reg;
+                }
+            }
+        }
+    }
+}
+
+// Gives the derived induction variable a phi that starts at its value for the initial
+// counter and is incremented by scale * step in the latch.
+static struct IrInstr *Reduce(struct IrFunction *func, struct Loop *loop, struct IrInstr *instr, int latch_index) {
+    struct DerivedIv *iv = &derived[instr->dest];
+    struct BasicIv *basic = &basic_ivs[iv->basic];
+    long long step = (long long) iv->scale * basic->step;
+    if (!FitsInInt(step)) {
+        return NULL;
+    }
+
+    struct IrBlock *header = loop->header;
+    struct IrBlock *latch = (struct IrBlock *) List_Get(&header->preds, latch_index);
+    struct IrInstr *phi = Ir_NewInstr(func, IR_PHI);
+    phi->dest = Ir_NewReg(func);
+    phi->num_args = 2;
+    phi->args = ARENA_NEW_ARRAY(func->arena, int, 2);
+    phi->args[1 - latch_index] = AddScaled(func, loop->preheader, iv->scale, basic->phi->args[1 - latch_index], iv->offset);
+    List_Add(&header->instrs, phi);
+    for (int i = header->instrs.count - 1; i > 0; --i) {
+        header->instrs.data[i] = header->instrs.data[i - 1];
+    }
+
+    header->instrs.data[0] = phi;
+    int step_reg = AddConst(func, latch, (int) step);
+    struct IrInstr *increment = Ir_AddBeforeTerminator(func, latch, IR_ADD);
+    increment->a = phi->dest;
+    increment->b = step_reg;
+    phi->args[latch_index] = increment->dest;
+    ReplaceUses(loop, instr->dest, phi->dest);
+    return phi;
+}
+
+// Marks the derived induction variables that are left without uses as dead, so that
+// they no longer count as uses of their operands. Operands come before their users in
+// the loop, so one backwards pass is enough.
+static void RemoveDeadDerivedUses(struct Loop *loop, int num_regs) {
+    for (int i = loop->blocks.count - 1; i >= 0; --i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        for (int j = block->instrs.count - 1; j >= 0; --j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->dest == IR_NO_REG || instr->dest >= num_regs || derived[instr->dest].basic == -1 || CountUses(instr->dest) != 0) {
+                continue;
+            }
+
+            // Operands that were replaced by reduced induction variables are new registers.
+            if (instr->a < num_regs) {
+                num_loop_uses[instr->a] -= 1;
+            }
+
+            if (instr->b < num_regs) {
+                num_loop_uses[instr->b] -= 1;
+            }
+
+            instr->opcode = IR_NOP;
+        }
+    }
+}
+
+// Linear function test replacement: if the counter is only used to increment itself and in
+// one comparison with an invariant limit, the comparison is made on a reduced induction
+// variable instead. scale > 0, so scale * i + offset keeps the order of i.
+static void ReplaceTest(struct IrFunction *func, struct Loop *loop, struct BasicIv *iv) {
+    int counter = iv->phi->dest;
+    bool is_increment_dead = CountUses(iv->increment->dest) == 1 && (!iv->cast || CountUses(iv->cast->dest) == 1);
+    if (!iv->reduced || CountUses(counter) != 2 || !is_increment_dead) {
+        return;
+    }
+
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (!Ir_IsComparison(instr->opcode) || (instr->a == counter) == (instr->b == counter)) {
+                continue;
+            }
+
+            int *limit = (instr->a == counter) ? &instr->b : &instr->a;
+            if (!IsInvariant(*limit, loop)) {
+                return;
+            }
+
+            *limit = AddScaled(func, loop->preheader, iv->reduced_scale, *limit, iv->reduced_offset);
+            if (instr->a == counter) {
+                instr->a = iv->reduced->dest;
+            }
+            else {
+                instr->b = iv->reduced->dest;
+            }
+
+            return;
+        }
+    }
+}
+
+static void ResetEntry(int reg) {
+    derived[reg].basic = -1;
+    num_loop_uses[reg] = 0;
+    num_derived_uses[reg] = 0;
+}
+
+// The arrays are kept for the whole pass, so only the entries of the registers the loop
+// defines or reads are reset.
+static void ResetLoopEntries(struct Loop *loop, int num_regs) {
+    if (capacity < num_regs) {
+        capacity = 2 * num_regs;
+        derived = (struct DerivedIv *) realloc(derived, sizeof(struct DerivedIv) * capacity);
+        num_loop_uses = (int *) realloc(num_loop_uses, sizeof(int) * capacity);
+        num_derived_uses = (int *) realloc(num_derived_uses, sizeof(int) * capacity);
+    }
+
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            int *uses[64];
+            if (2 + instr->num_args > 64) {
+                ReportInternalError("StrengthReduction::ResetLoopEntries - too many arguments");
+            }
+
+            int num_instr_uses = Ir_GetUses(instr, uses);
+            for (int k = 0; k < num_instr_uses; ++k) {
+                ResetEntry(*uses[k]);
+            }
+
+            if (instr->dest != IR_NO_REG) {
+                ResetEntry(instr->dest);
+            }
+        }
+    }
+}
+
+static void ReduceLoop(struct IrFunction *func, struct Loop *loop) {
+    struct IrBlock *header = loop->header;
+    if (header->preds.count != 2) {
+        return;
+    }
+
+    int latch_index = (List_Get(&header->preds, 0) == loop->preheader) ? 1 : 0;
+    basic_ivs = (struct BasicIv *) malloc(sizeof(struct BasicIv) * header->instrs.count);
+    FindBasicIvs(loop, latch_index);
+    if (num_basic_ivs == 0) {
+        free(basic_ivs);
+        return;
+    }
+
+    int num_regs = func->num_regs;
+    ResetLoopEntries(loop, num_regs);
+    FindDerivedIvs(loop);
+    CountLoopUses(loop);
+
+    // Derived induction variables used outside the loop are left alone, the phi would
+    // have moved on by one step when the loop exits.
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->opcode == IR_PHI || instr->dest == IR_NO_REG || instr->dest >= num_regs) {
+                continue;
+            }
+
+            int reg = instr->dest;
+            if (derived[reg].basic == -1 || defs.num_uses[reg] != 0 || num_derived_uses[reg] == num_loop_uses[reg]) {
+                continue;
+            }
+
+            struct IrInstr *phi = Reduce(func, loop, instr, latch_index);
+            if (!phi) {
+                continue;
+            }
+
+            num_loop_uses[reg] = 0;
+            struct BasicIv *basic = &basic_ivs[derived[reg].basic];
+            if (!basic->reduced && derived[reg].scale > 0) {
+                basic->reduced = phi;
+                basic->reduced_scale = derived[reg].scale;
+                basic->reduced_offset = derived[reg].offset;
+            }
+        }
+    }
+
+    RemoveDeadDerivedUses(loop, num_regs);
+    for (int i = 0; i < num_basic_ivs; ++i) {
+        ReplaceTest(func, loop, &basic_ivs[i]);
+    }
+
+    free(basic_ivs);
+}
+
+
+//
+// ===
+// == Functions defined in StrengthReduction.h
+// ===
+//
+
+
+void StrengthReduction_Run(struct IrFunction *func) {
+    struct List loops;
+    List_Init(&loops);
+    Loops_Find(func, &loops);
+    Ir_ComputeDefs(func, &defs);
+    derived = NULL;
+    num_loop_uses = NULL;
+    num_derived_uses = NULL;
+    capacity = 0;
+    for (int i = 0; i < loops.count; ++i) {
+        struct Loop *loop = (struct Loop *) List_Get(&loops, i);
+        if (!loop->preheader) {
+            continue;
+        }
+
+        // The loop's uses are counted apart while it is reduced. Reducing an inner loop
+        // adds registers that the outer loop has to know about, so its blocks and the
+        // preheader are recorded again afterwards.
+        for (int j = 0; j < loop->blocks.count; ++j) {
+            Ir_RemoveUses(&defs, (struct IrBlock *) List_Get(&loop->blocks, j));
+        }
+
+        Ir_RemoveUses(&defs, loop->preheader);
+        ReduceLoop(func, loop);
+        for (int j = 0; j < loop->blocks.count; ++j) {
+            Ir_AddDefs(func, &defs, (struct IrBlock *) List_Get(&loop->blocks, j));
+        }
+
+        Ir_AddDefs(func, &defs, loop->preheader);
+    }
+
+    free(derived);
+    free(num_loop_uses);
+    free(num_derived_uses);
+    Ir_FreeDefs(&defs);
+    Ir_RemoveNops(func);
+    Loops_Free(&loops);
+}
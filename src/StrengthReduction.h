@@ -0,0 +1,15 @@
+#ifndef MINIC_STRENGTH_REDUCTION_H
+#define MINIC_STRENGTH_REDUCTION_H
+#include "Ir.h"
+
+// Induction variable strength reduction. A basic induction variable is a header phi that
+// the loop increments by a constant; a derived one is c * i or base + c * i, with c a
+// constant other than 1 and base invariant, which is what indexing an array in a loop
+// lowers to. Each derived induction variable that is used by anything but another one gets
+// a phi of its own that the latch increments by c * step, so the multiply leaves the loop.
+// If the counter is then only used by the loop test, the test is rewritten to compare
+// the new variable against c * limit + base, and the counter dies.
+// Every loop must have a preheader, see Loops_InsertPreheaders.
+void StrengthReduction_Run(struct IrFunction *func);
+
+#endif // MINIC_STRENGTH_REDUCTION_H
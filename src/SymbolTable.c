@@ -0,0 +1,69 @@
+#include "SymbolTable.h"
+#include "ReportError.h"
+#include <stdlib.h>
+
+#define SYMBOL_TABLE_INITIAL_CAPACITY 16
+
+
+//
+// ===
+// == Functions defined in SymbolTable.h
+// ===
+//
+
+
+bool SymbolTable_Declare(struct SymbolTable *t, char *identifier, struct Declarator *declarator) {
+    struct HashMap *scope = &t->scopes[t->num_scopes - 1];
+    if (HashMap_Get(scope, identifier)) {
+        return false;
+    }
+
+    HashMap_Put(scope, identifier, declarator);
+    return true;
+}
+
+void SymbolTable_Free(struct SymbolTable *t) {
+    while (t->num_scopes > 0) {
+        SymbolTable_PopScope(t);
+    }
+
+    free(t->scopes);
+    t->scopes = NULL;
+    t->capacity = 0;
+}
+
+void SymbolTable_Init(struct SymbolTable *t) {
+    t->scopes = NULL;
+    t->num_scopes = 0;
+    t->capacity = 0;
+}
+
+struct Declarator *SymbolTable_Lookup(struct SymbolTable *t, char *identifier) {
+    for (int i = t->num_scopes - 1; i >= 0; --i) {
+        struct Declarator *declarator = (struct Declarator *) HashMap_Get(&t->scopes[i], identifier);
+        if (declarator) {
+            return declarator;
+        }
+    }
+
+    return NULL;
+}
+
+void SymbolTable_PopScope(struct SymbolTable *t) {
+    t->num_scopes -= 1;
+    HashMap_Free(&t->scopes[t->num_scopes]);
+}
+
+void SymbolTable_PushScope(struct SymbolTable *t) {
+    if (t->num_scopes == t->capacity) {
+        t->capacity = t->capacity ? t->capacity * 2 : SYMBOL_TABLE_INITIAL_CAPACITY;
+        t->scopes = (struct HashMap *) realloc(t->scopes, t->capacity * sizeof(struct HashMap));
+        if (!t->scopes) {
+            ReportInternalError("out of memory");
+        }
+    }
+
+    // Maps allocate lazily, so scopes without declarations cost nothing.
+    HashMap_Init(&t->scopes[t->num_scopes]);
+    t->num_scopes += 1;
+}
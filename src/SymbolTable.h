@@ -0,0 +1,28 @@
+#ifndef MINIC_SYMBOL_TABLE_H
+#define MINIC_SYMBOL_TABLE_H
+#include "AstNode.h"
+#include "HashMap.h"
+
+// A stack of block scopes, each with its own hash map from interned identifier
+// to declarator. Declarations in inner scopes shadow those in outer scopes.
+struct SymbolTable {
+    struct HashMap *scopes;
+    int num_scopes;
+    int capacity;
+};
+
+// Returns false if the identifier is already declared in the innermost scope.
+bool SymbolTable_Declare(struct SymbolTable *t, char *identifier, struct Declarator *declarator);
+
+void SymbolTable_Free(struct SymbolTable *t);
+
+void SymbolTable_Init(struct SymbolTable *t);
+
+// Returns NULL if the identifier is not declared in any enclosing scope.
+struct Declarator *SymbolTable_Lookup(struct SymbolTable *t, char *identifier);
+
+void SymbolTable_PopScope(struct SymbolTable *t);
+
+void SymbolTable_PushScope(struct SymbolTable *t);
+
+#endif // MINIC_SYMBOL_TABLE_H
@@ -0,0 +1,344 @@
+#include "TailRecursion.h"
+#include "ReportError.h"
+#include <stdlib.h>
+
+
+// A block that ends with a call of the function to itself, which returns either the
+// result or result op value.
+struct TailCall {
+    struct IrBlock *block;
+    struct IrInstr *call;
+    struct IrInstr *accumulate; // NULL if the result is returned as it is.
+};
+
+static int *num_uses; // Register -> number of uses
+
+
+static void CountUses(struct IrFunction *func) {
+    num_uses = (int *) calloc(func->num_regs, sizeof(int));
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            int *uses[64];
+            if (2 + instr->num_args > 64) {
+                ReportInternalError("TailRecursion::CountUses - too many arguments");
+            }
+
+            int num_instr_uses = Ir_GetUses(instr, uses);
+            for (int k = 0; k < num_instr_uses; ++k) {
+                num_uses[*uses[k]] += 1;
+            }
+        }
+    }
+}
+
+// Everything after the call runs before the recursion once it is a jump, so nothing there
+// may observe or change memory.
+static bool IsMovable(struct IrInstr *instr) {
+    return !Ir_HasSideEffects(instr) && instr->opcode != IR_LOAD && instr->opcode != IR_LOAD_SLOT && instr->opcode != IR_VLOAD;
+}
+
+static bool FindTailCall(struct IrFunction *func, struct IrBlock *block, struct TailCall *tail_call) {
+    struct IrInstr *ret = Ir_Terminator(block);
+    if (!ret || ret->opcode != IR_RETURN || block->instrs.count < 2) {
+        return false;
+    }
+
+    struct IrInstr *last = (struct IrInstr *) List_Get(&block->instrs, block->instrs.count - 2);
+    bool is_self_call = last->opcode == IR_CALL && last->name == func->name && last->num_args == func->num_params;
+    if (is_self_call && (ret->a == IR_NO_REG || ret->a == last->dest)) {
+        tail_call->block = block;
+        tail_call->call = last;
+        tail_call->accumulate = NULL;
+        return true;
+    }
+
+    if ((last->opcode != IR_ADD && last->opcode != IR_MUL) || ret->a != last->dest || num_uses[last->dest] != 1) {
+        return false;
+    }
+
+    for (int i = block->instrs.count - 3; i >= 0; --i) {
+        struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, i);
+        if (instr->opcode == IR_CALL && instr->name == func->name && instr->num_args == func->num_params) {
+            bool is_operand = (last->a == instr->dest) != (last->b == instr->dest);
+            if (!is_operand || num_uses[instr->dest] != 1) {
+                return false;
+            }
+
+            tail_call->block = block;
+            tail_call->call = instr;
+            tail_call->accumulate = last;
+            return true;
+        }
+
+        if (!IsMovable(instr) || instr->opcode == IR_PHI) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+static struct IrInstr *NewPhi(struct IrFunction *func, int num_args) {
+    struct IrInstr *phi = Ir_NewInstr(func, IR_PHI);
+    phi->dest = Ir_NewReg(func);
+    phi->num_args = num_args;
+    phi->args = ARENA_NEW_ARRAY(func->arena, int, num_args);
+    return phi;
+}
+
+// A block that only returns, possibly a phi, is copied into the predecessors that jump to
+// it, so that calls in front of the jumps end up in tail position.
+static bool DuplicateReturns(struct IrFunction *func) {
+    bool has_changed = false;
+    for (int i = 1; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        struct IrInstr *ret = Ir_Terminator(block);
+        struct IrInstr *phi = (struct IrInstr *) List_Get(&block->instrs, 0);
+        bool is_return = block->instrs.count == 1 && ret->opcode == IR_RETURN;
+        bool is_phi_return = block->instrs.count == 2 && phi->opcode == IR_PHI && ret->opcode == IR_RETURN && ret->a == phi->dest;
+        if (!is_return && !is_phi_return) {
+            continue;
+        }
+
+        int count = 0;
+        for (int j = 0; j < block->preds.count; ++j) {
+            struct IrBlock *pred = (struct IrBlock *) List_Get(&block->preds, j);
+            struct IrInstr *jump = Ir_Terminator(pred);
+            if (jump->opcode == IR_JUMP) {
+                jump->opcode = IR_RETURN;
+                jump->target = NULL;
+                jump->a = is_phi_return ? phi->args[j] : ret->a;
+                has_changed = true;
+                continue;
+            }
+
+            block->preds.data[count] = pred;
+            if (is_phi_return) {
+                phi->args[count] = phi->args[j];
+            }
+
+            count += 1;
+        }
+
+        block->preds.count = count;
+        if (is_phi_return) {
+            phi->num_args = count;
+        }
+    }
+
+    if (has_changed) {
+        Ir_RemoveUnreachableBlocks(func);
+    }
+
+    return has_changed;
+}
+
+// Moves everything but the parameters from the entry into a new block, the loop header.
+static struct IrBlock *SplitEntry(struct IrFunction *func, struct IrBlock *entry) {
+    struct IrBlock *header = Ir_NewBlock(func);
+    int count = 0;
+    for (int i = 0; i < entry->instrs.count; ++i) {
+        struct IrInstr *instr = (struct IrInstr *) List_Get(&entry->instrs, i);
+        if (instr->opcode == IR_PARAM) {
+            entry->instrs.data[count] = instr;
+            count += 1;
+        }
+        else {
+            List_Add(&header->instrs, instr);
+        }
+    }
+
+    entry->instrs.count = count;
+    struct IrInstr *jump = Ir_AddInstr(func, entry, IR_JUMP);
+    jump->target = header;
+    List_Add(&header->preds, entry);
+
+    struct IrBlock *succs[2];
+    int num_succs = Ir_Successors(header, succs);
+    for (int i = 0; i < num_succs; ++i) {
+        Ir_ReplacePredecessor(succs[i], entry, header);
+    }
+
+    struct List blocks;
+    List_Init(&blocks);
+    List_Add(&blocks, entry);
+    List_Add(&blocks, header);
+    for (int i = 1; i < func->blocks.count; ++i) {
+        List_Add(&blocks, List_Get(&func->blocks, i));
+    }
+
+    List_Free(&func->blocks);
+    func->blocks = blocks;
+    return header;
+}
+
+
+//
+// ===
+// == Functions defined in TailRecursion.h
+// ===
+//
+
+
+bool TailRecursion_Run(struct IrFunction *func) {
+    struct IrBlock *entry = (struct IrBlock *) List_Get(&func->blocks, 0);
+    if (entry->preds.count != 0) {
+        return false;
+    }
+
+    bool has_changed = DuplicateReturns(func);
+    CountUses(func);
+    struct TailCall *tail_calls = (struct TailCall *) malloc(sizeof(struct TailCall) * func->blocks.count);
+    int num_tail_calls = 0;
+    enum IrOpcode accumulate_opcode = IR_NOP;
+    for (int i = 0; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        struct TailCall *tail_call = &tail_calls[num_tail_calls];
+        if (!FindTailCall(func, block, tail_call)) {
+            continue;
+        }
+
+        // The accumulator is either a sum or a product.
+        if (tail_call->accumulate && accumulate_opcode == IR_NOP) {
+            accumulate_opcode = tail_call->accumulate->opcode;
+        }
+        else if (tail_call->accumulate && tail_call->accumulate->opcode != accumulate_opcode) {
+            continue;
+        }
+
+        num_tail_calls += 1;
+    }
+
+    free(num_uses);
+    if (num_tail_calls == 0) {
+        free(tail_calls);
+        return has_changed;
+    }
+
+    int *params = (int *) calloc(func->num_params, sizeof(int));
+    for (int i = 0; i < entry->instrs.count; ++i) {
+        struct IrInstr *instr = (struct IrInstr *) List_Get(&entry->instrs, i);
+        if (instr->opcode == IR_PARAM) {
+            params[instr->imm] = instr->dest;
+        }
+    }
+
+    struct IrBlock *header = SplitEntry(func, entry);
+    for (int i = 0; i < num_tail_calls; ++i) {
+        if (tail_calls[i].block == entry) {
+            tail_calls[i].block = header;
+        }
+    }
+
+    // Header phis: the parameters and the accumulator, with the entry as first predecessor.
+    int num_phi_args = 1 + num_tail_calls;
+    struct IrInstr **phis = (struct IrInstr **) malloc(sizeof(struct IrInstr *) * (func->num_params + 1));
+    struct List instrs;
+    List_Init(&instrs);
+    for (int i = 0; i < func->num_params; ++i) {
+        // The parameter may have been unused so far.
+        if (params[i] == IR_NO_REG) {
+            struct IrInstr *param = Ir_AddBeforeTerminator(func, entry, IR_PARAM);
+            param->imm = i;
+            params[i] = param->dest;
+        }
+
+        phis[i] = NewPhi(func, num_phi_args);
+        phis[i]->args[0] = params[i];
+        List_Add(&instrs, phis[i]);
+    }
+
+    struct IrInstr *accumulator = NULL;
+    if (accumulate_opcode != IR_NOP) {
+        struct IrInstr *identity = Ir_AddBeforeTerminator(func, entry, IR_CONST);
+        identity->imm = (accumulate_opcode == IR_MUL) ? 1 : 0;
+        accumulator = NewPhi(func, num_phi_args);
+        accumulator->args[0] = identity->dest;
+        List_Add(&instrs, accumulator);
+    }
+
+    // Uses of the parameters now read the phis.
+    int *replacements = (int *) calloc(func->num_regs, sizeof(int));
+    for (int i = 0; i < func->num_params; ++i) {
+        replacements[params[i]] = phis[i]->dest;
+    }
+
+    for (int i = 1; i < func->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            int *uses[64];
+            int num_instr_uses = Ir_GetUses(instr, uses);
+            for (int k = 0; k < num_instr_uses; ++k) {
+                if (replacements[*uses[k]] != IR_NO_REG) {
+                    *uses[k] = replacements[*uses[k]];
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < header->instrs.count; ++i) {
+        List_Add(&instrs, List_Get(&header->instrs, i));
+    }
+
+    List_Free(&header->instrs);
+    header->instrs = instrs;
+
+    // The other returns combine their value with the accumulator.
+    bool *is_tail_call_block = (bool *) calloc(func->num_block_ids, sizeof(bool));
+    for (int i = 0; i < num_tail_calls; ++i) {
+        is_tail_call_block[tail_calls[i].block->id] = true;
+    }
+
+    for (int i = 0; i < func->blocks.count && accumulator; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&func->blocks, i);
+        struct IrInstr *ret = Ir_Terminator(block);
+        if (is_tail_call_block[block->id] || !ret || ret->opcode != IR_RETURN || ret->a == IR_NO_REG) {
+            continue;
+        }
+
+        struct IrInstr *combine = Ir_AddBeforeTerminator(func, block, accumulate_opcode);
+        combine->a = accumulator->dest;
+        combine->b = ret->a;
+        ret->a = combine->dest;
+    }
+
+    // The tail calls jump to the header with their arguments.
+    for (int i = 0; i < num_tail_calls; ++i) {
+        struct TailCall *tail_call = &tail_calls[i];
+        struct IrInstr *call = tail_call->call;
+        for (int j = 0; j < func->num_params; ++j) {
+            phis[j]->args[1 + i] = call->args[j];
+        }
+
+        if (tail_call->accumulate) {
+            struct IrInstr *accumulate = tail_call->accumulate;
+            int value = (accumulate->a == call->dest) ? accumulate->b : accumulate->a;
+            accumulate->a = accumulator->dest;
+            accumulate->b = value;
+            accumulator->args[1 + i] = accumulate->dest;
+        }
+        else if (accumulator) {
+            accumulator->args[1 + i] = accumulator->dest;
+        }
+
+        call->opcode = IR_NOP;
+        call->dest = IR_NO_REG;
+        call->num_args = 0;
+        struct IrInstr *jump = Ir_Terminator(tail_call->block);
+        jump->opcode = IR_JUMP;
+        jump->a = IR_NO_REG;
+        jump->target = header;
+        List_Add(&header->preds, tail_call->block);
+    }
+
+    Ir_RemoveNops(func);
+    free(is_tail_call_block);
+    free(replacements);
+    free(phis);
+    free(params);
+    free(tail_calls);
+    return true;
+}
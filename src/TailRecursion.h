@@ -0,0 +1,15 @@
+#ifndef MINIC_TAIL_RECURSION_H
+#define MINIC_TAIL_RECURSION_H
+#include "Ir.h"
+#include <stdbool.h>
+
+// Turns calls of the function to itself in tail position into jumps back to the start of
+// its body, where phis pick the new arguments. A call whose result is only added to, or
+// multiplied by, another value before it is returned is turned into a jump too: the value
+// goes into an accumulator that the other returns add or multiply their result with.
+// Blocks that only return are copied into the blocks that jump to them first, so that more
+// calls end up in tail position, which also serves the backend's tail calls. Returns true
+// if the function changed, in which case the dominator tree is out of date.
+bool TailRecursion_Run(struct IrFunction *func);
+
+#endif // MINIC_TAIL_RECURSION_H
@@ -0,0 +1,221 @@
+#include "TimeReport.h"
+#include <stdint.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+
+struct PhaseReport {
+    bool has_run;
+    double wall_ms;
+    double cpu_ms;
+    size_t num_allocations;
+    size_t bytes_allocated;
+    size_t peak_rss_kb;
+};
+
+struct Sample {
+    double wall_ms;
+    double cpu_ms;
+    size_t num_allocations;
+    size_t bytes_allocated;
+};
+
+static char *phase_names[PHASE_COUNT] = {
+    [PHASE_LEX]         = "lex",
+    [PHASE_PARSE]       = "parse",
+    [PHASE_ANALYZE]     = "analyze",
+    [PHASE_OPTIMIZE]    = "optimize",
+    [PHASE_CODEGEN]     = "codegen",
+    [PHASE_ASSEMBLE]    = "assemble",
+    [PHASE_LINK]        = "link",
+};
+
+static bool is_enabled;
+static struct PhaseReport reports[PHASE_COUNT];
+static struct Sample phase_start[PHASE_COUNT];
+
+#ifdef _WIN32
+static double FileTimeToMs(FILETIME time) {
+    uint64_t ticks = ((uint64_t) time.dwHighDateTime << 32) | time.dwLowDateTime;
+    // FILETIME counts 100 nanosecond intervals.
+    return (double) ticks / 10000.0;
+}
+#else
+static double TimevalToMs(struct timeval time) {
+    return (double) time.tv_sec * 1000.0 + (double) time.tv_usec / 1000.0;
+}
+#endif
+
+static double WallTimeMs() {
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart * 1000.0 / (double) frequency.QuadPart;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec * 1000.0 + (double) time.tv_nsec / 1000000.0;
+#endif
+}
+
+static double CpuTimeMs() {
+#ifdef _WIN32
+    FILETIME creation_time;
+    FILETIME exit_time;
+    FILETIME kernel_time;
+    FILETIME user_time;
+    GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time);
+    return FileTimeToMs(kernel_time) + FileTimeToMs(user_time);
+#else
+    struct rusage self;
+    struct rusage children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    return TimevalToMs(self.ru_utime) + TimevalToMs(self.ru_stime) +
+           TimevalToMs(children.ru_utime) + TimevalToMs(children.ru_stime);
+#endif
+}
+
+static size_t PeakRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+
+    return counters.PeakWorkingSetSize / 1024;
+#else
+#ifdef __linux__
+    // ru_maxrss survives exec, so a child of a large process would report its parent's peak.
+    // VmHWM belongs to the current address space only.
+    FILE *status = fopen("/proc/self/status", "r");
+    if (status) {
+        char line[128];
+        size_t peak_kb = 0;
+        while (fgets(line, sizeof(line), status)) {
+            if (sscanf(line, "VmHWM: %zu kB", &peak_kb) == 1) {
+                break;
+            }
+        }
+
+        fclose(status);
+        if (peak_kb > 0) {
+            return peak_kb;
+        }
+    }
+#endif
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    // macOS reports bytes, Linux reports kilobytes.
+    return (size_t) usage.ru_maxrss / 1024;
+#else
+    return (size_t) usage.ru_maxrss;
+#endif
+#endif
+}
+
+static struct Sample TakeSample(struct Arena *arena) {
+    struct Sample sample;
+    sample.wall_ms = WallTimeMs();
+    sample.cpu_ms = CpuTimeMs();
+    sample.num_allocations = arena ? arena->num_allocations : 0;
+    sample.bytes_allocated = arena ? arena->bytes_allocated : 0;
+    return sample;
+}
+
+
+//
+// ===
+// == Functions defined in TimeReport.h
+// ===
+//
+
+
+void TimeReport_BeginPhase(enum CompilePhase phase, struct Arena *arena) {
+    if (is_enabled) {
+        phase_start[phase] = TakeSample(arena);
+    }
+}
+
+void TimeReport_Enable() {
+    is_enabled = true;
+}
+
+void TimeReport_EndPhase(enum CompilePhase phase, struct Arena *arena) {
+    if (!is_enabled) {
+        return;
+    }
+
+    struct Sample end = TakeSample(arena);
+    struct Sample start = phase_start[phase];
+    struct PhaseReport *report = &reports[phase];
+    report->has_run = true;
+    report->wall_ms += end.wall_ms - start.wall_ms;
+    report->cpu_ms += end.cpu_ms - start.cpu_ms;
+    report->num_allocations += end.num_allocations - start.num_allocations;
+    report->bytes_allocated += end.bytes_allocated - start.bytes_allocated;
+    report->peak_rss_kb = PeakRssKb();
+}
+
+void TimeReport_Print(FILE *file, bool as_json) {
+    struct PhaseReport total = {0};
+    if (as_json) {
+        fprintf(file, "{\n  \"phases\": [\n");
+    }
+    else {
+        fprintf(file, "%-10s %12s %12s %12s %14s %14s\n", "phase", "wall (ms)", "cpu (ms)", "arena allocs", "arena bytes", "peak rss (kb)");
+    }
+
+    bool is_first = true;
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        struct PhaseReport *report = &reports[i];
+        if (!report->has_run) {
+            continue;
+        }
+
+        total.wall_ms += report->wall_ms;
+        total.cpu_ms += report->cpu_ms;
+        total.num_allocations += report->num_allocations;
+        total.bytes_allocated += report->bytes_allocated;
+        total.peak_rss_kb = report->peak_rss_kb;
+        if (as_json) {
+            fprintf(file,
+                "%s    {\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"arena_allocations\": %zu, \"arena_bytes\": %zu, \"peak_rss_kb\": %zu}",
+                is_first ? "" : ",\n",
+                phase_names[i], report->wall_ms, report->cpu_ms, report->num_allocations, report->bytes_allocated, report->peak_rss_kb
+            );
+        }
+        else {
+            fprintf(file, "%-10s %12.3f %12.3f %12zu %14zu %14zu\n",
+                phase_names[i], report->wall_ms, report->cpu_ms, report->num_allocations, report->bytes_allocated, report->peak_rss_kb
+            );
+        }
+
+        is_first = false;
+    }
+
+    if (as_json) {
+        fprintf(file,
+            "\n  ],\n"
+            "  \"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"arena_allocations\": %zu, \"arena_bytes\": %zu, \"peak_rss_kb\": %zu}\n"
+            "}\n",
+            total.wall_ms, total.cpu_ms, total.num_allocations, total.bytes_allocated, total.peak_rss_kb
+        );
+    }
+    else {
+        fprintf(file, "%-10s %12.3f %12.3f %12zu %14zu %14zu\n",
+            "total", total.wall_ms, total.cpu_ms, total.num_allocations, total.bytes_allocated, total.peak_rss_kb
+        );
+    }
+}
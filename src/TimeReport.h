@@ -0,0 +1,32 @@
+#ifndef MINIC_TIME_REPORT_H
+#define MINIC_TIME_REPORT_H
+#include "Arena.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+enum CompilePhase {
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_ANALYZE,
+    PHASE_OPTIMIZE, // Lowering to IR and the optimization passes.
+    PHASE_CODEGEN,
+    PHASE_ASSEMBLE,
+    PHASE_LINK,
+    PHASE_COUNT,
+};
+
+// Measures wall time, CPU time, arena allocations and peak RSS for each phase of
+// the compilation. Phases that never ran are left out of the report.
+// CPU time includes child processes where the platform reports it (nasm and link).
+// Only the arena is counted: memory from malloc shows up in the peak RSS alone.
+void TimeReport_BeginPhase(enum CompilePhase phase, struct Arena *arena);
+
+// Phases are only measured after this is called, so that compiling without a report
+// does not pay for the samples.
+void TimeReport_Enable();
+
+void TimeReport_EndPhase(enum CompilePhase phase, struct Arena *arena);
+
+void TimeReport_Print(FILE *file, bool as_json);
+
+#endif // MINIC_TIME_REPORT_H
@@ -47,10 +47,16 @@ char *TokenTypeToStr(enum TokenType type) {
 
 void PrintToken(struct Token token) {
     printf("<Token\n");
-    printf("  int_value=\"%d\"\n", token.int_value);
+    if (token.type == TOKEN_LITERAL_NUMBER) {
+        printf("  int_value=\"%d\"\n", token.int_value);
+    }
+
     printf("  line=\"%d\"\n", token.line);
 //    printf("  location=\"%s\"\n", token.location);
-    printf("  str_value=\"%s\"\n", token.str_value);
+    if (token.type == TOKEN_IDENTIFIER || token.type == TOKEN_LITERAL_STRING) {
+        printf("  str_value=\"%s\"\n", token.str_value);
+    }
+
     printf("  type=\"%s\"\n", TokenTypeToStr(token.type));
     printf(">\n");
 }
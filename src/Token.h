@@ -1,8 +1,6 @@
 #ifndef MINIC_TOKEN_H
 #define MINIC_TOKEN_H
 
-#define TOKEN_MAX_IDENTIFIER_LENGTH 64
-
 enum TokenType {
     // Others
     TOKEN_END_OF_FILE,
@@ -61,13 +59,13 @@ enum TokenType {
 };
 
 struct Token {
-    int line;
-    char *location;
     enum TokenType type;
+    int line;
     union {
         int int_value;
-        char str_value[TOKEN_MAX_IDENTIFIER_LENGTH];
+        char *str_value; // Interned, see Intern.h.
     };
+    char *location;
 };
 
 
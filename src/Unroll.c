@@ -0,0 +1,527 @@
+#include "Unroll.h"
+#include "Dominators.h"
+#include "Loops.h"
+#include <limits.h>
+#include <stdlib.h>
+
+// How many instructions the copies of a loop may add up to.
+#define UNROLL_BUDGET 128
+#define MAX_TRIP_COUNT 64
+
+
+struct CountedLoop {
+    struct Loop *loop;
+    int latch_index;
+    struct IrBlock *latch;
+    struct IrBlock *body; // The header's successor in the loop.
+    struct IrBlock *exit;
+    struct IrInstr *phi; // The induction variable.
+    int step;
+    bool is_int; // The increment is cast back to int.
+    enum IrOpcode opcode; // The loop runs while phi opcode limit holds.
+    int limit;
+    int size; // Instructions in the loop, phis excluded.
+};
+
+// One copy of the loop. The maps are shared by all copies and cleared after each one.
+struct Iteration {
+    struct IrBlock **blocks; // Loop block id -> copy
+    int *regs; // Loop register -> copy
+};
+
+// Definitions of the registers, the use counts are not kept up to date.
+static struct IrDefs defs;
+static struct IrBlock **block_copies; // Block id -> copy in the current iteration
+static int *reg_copies; // Register -> copy in the current iteration
+static int num_old_regs; // Registers that existed when the loops were found.
+// The new blocks, each to be placed before the block at the same index of next_blocks.
+static struct List new_blocks;
+static struct List next_blocks;
+
+
+static bool IsInLoop(struct Loop *loop, struct IrBlock *block) {
+    return Loops_Contains(loop, block);
+}
+
+// Returns the header phi that reg is, or is cast from, NULL if there is none.
+static struct IrInstr *FindHeaderPhi(struct IrBlock *header, int reg, bool *is_cast) {
+    struct IrInstr *def = defs.instrs[reg];
+    *is_cast = def && def->opcode == IR_CAST && def->type == PRIMTYPE_INT;
+    if (*is_cast) {
+        reg = def->a;
+        def = defs.instrs[reg];
+    }
+
+    return (def && def->opcode == IR_PHI && defs.blocks[reg] == header) ? def : NULL;
+}
+
+static bool FindInductionStep(struct CountedLoop *counted) {
+    struct IrInstr *phi = counted->phi;
+    struct IrInstr *increment = defs.instrs[phi->args[counted->latch_index]];
+    counted->is_int = false;
+    if (increment && increment->opcode == IR_CAST && increment->type != PRIMTYPE_CHAR) {
+        counted->is_int = increment->type == PRIMTYPE_INT;
+        increment = defs.instrs[increment->a];
+    }
+
+    if (!increment || !IsInLoop(counted->loop, defs.blocks[increment->dest])) {
+        return false;
+    }
+
+    if (increment->opcode == IR_ADD && increment->a == phi->dest && Ir_IsConst(&defs, increment->b)) {
+        counted->step = defs.instrs[increment->b]->imm;
+    }
+    else if (increment->opcode == IR_ADD && increment->b == phi->dest && Ir_IsConst(&defs, increment->a)) {
+        counted->step = defs.instrs[increment->a]->imm;
+    }
+    else if (increment->opcode == IR_SUB && increment->a == phi->dest && Ir_IsConst(&defs, increment->b) && defs.instrs[increment->b]->imm != INT_MIN) {
+        counted->step = -defs.instrs[increment->b]->imm;
+    }
+    else {
+        return false;
+    }
+
+    return counted->step != 0;
+}
+
+static bool FindCountedLoop(struct Loop *loop, struct CountedLoop *counted) {
+    struct IrBlock *header = loop->header;
+    if (!loop->preheader || header->preds.count != 2) {
+        return false;
+    }
+
+    counted->loop = loop;
+    counted->latch_index = (List_Get(&header->preds, 0) == loop->preheader) ? 1 : 0;
+    counted->latch = (struct IrBlock *) List_Get(&header->preds, counted->latch_index);
+    counted->size = 0;
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        struct IrBlock *succs[2];
+        int num_succs = Ir_Successors(block, succs);
+        for (int j = 0; j < num_succs; ++j) {
+            if (block != header && !IsInLoop(loop, succs[j])) {
+                return false;
+            }
+        }
+
+        // Only innermost loops are unrolled.
+        for (int j = 0; j < block->preds.count && block != header; ++j) {
+            struct IrBlock *pred = (struct IrBlock *) List_Get(&block->preds, j);
+            if (IsInLoop(loop, pred) && Dominators_Dominates(block, pred)) {
+                return false;
+            }
+        }
+
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            counted->size += (instr->opcode != IR_PHI) ? 1 : 0;
+        }
+    }
+
+    struct IrInstr *branch = Ir_Terminator(header);
+    if (branch->opcode != IR_BRANCH || IsInLoop(loop, branch->target) == IsInLoop(loop, branch->target2)) {
+        return false;
+    }
+
+    bool runs_if_true = IsInLoop(loop, branch->target);
+    counted->body = runs_if_true ? branch->target : branch->target2;
+    counted->exit = runs_if_true ? branch->target2 : branch->target;
+    struct IrInstr *condition = defs.instrs[branch->a];
+    if (!condition || Ir_NegateComparison(condition->opcode) == IR_NOP || defs.blocks[condition->dest] != header) {
+        return false;
+    }
+
+    bool is_cast;
+    counted->opcode = runs_if_true ? condition->opcode : Ir_NegateComparison(condition->opcode);
+    counted->phi = FindHeaderPhi(header, condition->a, &is_cast);
+    counted->limit = condition->b;
+    if (!counted->phi) {
+        counted->phi = FindHeaderPhi(header, condition->b, &is_cast);
+        counted->limit = condition->a;
+        counted->opcode = Ir_SwapComparison(counted->opcode);
+    }
+
+    struct IrBlock *limit_block = defs.blocks[counted->limit];
+    if (!counted->phi || !limit_block || IsInLoop(loop, limit_block) || !FindInductionStep(counted)) {
+        return false;
+    }
+
+    // Through a cast, the comparison only sees the same values if the counter is an int.
+    return !is_cast || counted->is_int;
+}
+
+// Splits reg into base + offset, where base is IR_NO_REG for constants.
+static void Decompose(int reg, int *base, int *offset) {
+    struct IrInstr *def = defs.instrs[reg];
+    *base = reg;
+    *offset = 0;
+    if (Ir_IsConst(&defs, reg)) {
+        *base = IR_NO_REG;
+        *offset = def->imm;
+    }
+    else if (def && def->opcode == IR_ADD && Ir_IsConst(&defs, def->b)) {
+        *base = def->a;
+        *offset = defs.instrs[def->b]->imm;
+    }
+    else if (def && def->opcode == IR_ADD && Ir_IsConst(&defs, def->a)) {
+        *base = def->b;
+        *offset = defs.instrs[def->a]->imm;
+    }
+}
+
+// Returns the number of iterations if it is a constant of at most MAX_TRIP_COUNT, -1
+// otherwise. The counter and the limit may be offsets from the same base.
+static int TripCount(struct CountedLoop *counted) {
+    int init_base;
+    int init_offset;
+    int limit_base;
+    int limit_offset;
+    Decompose(counted->phi->args[1 - counted->latch_index], &init_base, &init_offset);
+    Decompose(counted->limit, &limit_base, &limit_offset);
+    if (init_base != limit_base || (init_base != IR_NO_REG && counted->is_int)) {
+        return -1;
+    }
+
+    long long value = init_offset;
+    for (int count = 0; count <= MAX_TRIP_COUNT; ++count) {
+        if (!Ir_Compare(counted->opcode, value, limit_offset)) {
+            return count;
+        }
+
+        value += counted->step;
+        if (counted->is_int) {
+            value = (int) value;
+        }
+    }
+
+    return -1;
+}
+
+static int MapReg(struct Iteration *iteration, int reg) {
+    if (reg != IR_NO_REG && reg < num_old_regs && iteration->regs[reg] != IR_NO_REG) {
+        return iteration->regs[reg];
+    }
+
+    return reg;
+}
+
+static void MakeJump(struct IrInstr *terminator, struct IrBlock *target) {
+    terminator->opcode = IR_JUMP;
+    terminator->a = IR_NO_REG;
+    terminator->target = target;
+    terminator->target2 = NULL;
+}
+
+// Copies the blocks of the loop and adds them to new_blocks, in front of the header. The
+// header's phis become copies of incoming, in the order of the phis. The copy of the header
+// keeps its branch and has no predecessors, the copy of the latch jumps to it. If keeps_regs
+// is set, the copy defines the loop's own registers, for when the loop itself goes away.
+static void CopyIteration(struct IrFunction *func, struct CountedLoop *counted, int *incoming, bool keeps_regs, struct Iteration *iteration) {
+    struct Loop *loop = counted->loop;
+    iteration->blocks = block_copies;
+    iteration->regs = reg_copies;
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        iteration->blocks[block->id] = Ir_NewBlock(func);
+        List_Add(&new_blocks, iteration->blocks[block->id]);
+        List_Add(&next_blocks, loop->header);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->dest != IR_NO_REG) {
+                iteration->regs[instr->dest] = keeps_regs ? instr->dest : Ir_NewReg(func);
+            }
+        }
+    }
+
+    int num_phis = 0;
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        struct IrBlock *copy = iteration->blocks[block->id];
+        for (int j = 0; j < block->preds.count && block != loop->header; ++j) {
+            struct IrBlock *pred = (struct IrBlock *) List_Get(&block->preds, j);
+            List_Add(&copy->preds, iteration->blocks[pred->id]);
+        }
+
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            struct IrInstr *new_instr = Ir_AddInstr(func, copy, instr->opcode);
+            *new_instr = *instr;
+            new_instr->dest = MapReg(iteration, instr->dest);
+            if (block == loop->header && instr->opcode == IR_PHI) {
+                new_instr->opcode = IR_COPY;
+                new_instr->a = incoming[num_phis];
+                new_instr->num_args = 0;
+                new_instr->args = NULL;
+                num_phis += 1;
+                continue;
+            }
+
+            new_instr->a = MapReg(iteration, instr->a);
+            new_instr->b = MapReg(iteration, instr->b);
+            if (instr->num_args > 0) {
+                new_instr->args = ARENA_NEW_ARRAY(func->arena, int, instr->num_args);
+                for (int k = 0; k < instr->num_args; ++k) {
+                    new_instr->args[k] = MapReg(iteration, instr->args[k]);
+                }
+            }
+
+            if (instr->target && IsInLoop(loop, instr->target)) {
+                new_instr->target = iteration->blocks[instr->target->id];
+            }
+
+            if (instr->target2 && IsInLoop(loop, instr->target2)) {
+                new_instr->target2 = iteration->blocks[instr->target2->id];
+            }
+        }
+    }
+}
+
+// Records the copies in defs and clears the maps for the next iteration.
+static void FinishIteration(struct IrFunction *func, struct Loop *loop, struct Iteration *iteration) {
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        Ir_AddDefs(func, &defs, iteration->blocks[block->id]);
+        iteration->blocks[block->id] = NULL;
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (instr->dest != IR_NO_REG) {
+                iteration->regs[instr->dest] = IR_NO_REG;
+            }
+        }
+    }
+}
+
+// The values the header's phis get from the latch of the iteration.
+static void FindLatchValues(struct CountedLoop *counted, struct Iteration *iteration, int *values) {
+    struct IrBlock *header = counted->loop->header;
+    for (int i = 0; i < header->instrs.count; ++i) {
+        struct IrInstr *phi = (struct IrInstr *) List_Get(&header->instrs, i);
+        if (phi->opcode != IR_PHI) {
+            break;
+        }
+
+        values[i] = MapReg(iteration, phi->args[counted->latch_index]);
+    }
+}
+
+static int CountPhis(struct IrBlock *block) {
+    int count = 0;
+    while (count < block->instrs.count && ((struct IrInstr *) List_Get(&block->instrs, count))->opcode == IR_PHI) {
+        count += 1;
+    }
+
+    return count;
+}
+
+// Chains trip_count copies of the loop, and one more of the header that leaves the loop.
+static void UnrollFully(struct IrFunction *func, struct CountedLoop *counted, int trip_count) {
+    struct Loop *loop = counted->loop;
+    struct IrBlock *header = loop->header;
+    int num_phis = CountPhis(header);
+    int *incoming = (int *) malloc(sizeof(int) * (num_phis + 1));
+    for (int i = 0; i < num_phis; ++i) {
+        incoming[i] = ((struct IrInstr *) List_Get(&header->instrs, i))->args[1 - counted->latch_index];
+    }
+
+    // The last copy takes over the loop's registers, so the values used after the loop
+    // come from it without rewriting their uses.
+    struct Iteration iteration;
+    struct IrBlock *pred = loop->preheader;
+    struct IrBlock *pred_target = header;
+    for (int i = 0; i <= trip_count; ++i) {
+        CopyIteration(func, counted, incoming, i == trip_count, &iteration);
+        struct IrBlock *header_copy = iteration.blocks[header->id];
+        List_Add(&header_copy->preds, pred);
+        Ir_ReplaceTarget(Ir_Terminator(pred), pred_target, header_copy);
+        if (i < trip_count) {
+            MakeJump(Ir_Terminator(header_copy), iteration.blocks[counted->body->id]);
+            FindLatchValues(counted, &iteration, incoming);
+            pred = iteration.blocks[counted->latch->id];
+            pred_target = header_copy;
+        }
+        else {
+            MakeJump(Ir_Terminator(header_copy), counted->exit);
+            Ir_ReplacePredecessor(counted->exit, header, header_copy);
+        }
+
+        FinishIteration(func, loop, &iteration);
+    }
+
+    free(incoming);
+}
+
+// Puts a loop in front of the original one that runs factor copies of the body while
+// factor more iterations remain, the original loop runs the remaining ones.
+static void UnrollPartially(struct IrFunction *func, struct CountedLoop *counted, int factor) {
+    struct Loop *loop = counted->loop;
+    struct IrBlock *header = loop->header;
+    int pre_index = 1 - counted->latch_index;
+    int num_phis = CountPhis(header);
+    int *incoming = (int *) malloc(sizeof(int) * (num_phis + 1));
+    struct IrInstr **phis = (struct IrInstr **) malloc(sizeof(struct IrInstr *) * (num_phis + 1));
+
+    // The new header: phis for the values of the original one, then the test.
+    struct IrBlock *unrolled_header = Ir_NewBlock(func);
+    List_Add(&new_blocks, unrolled_header);
+    List_Add(&next_blocks, header);
+    int iv_reg = IR_NO_REG;
+    for (int i = 0; i < num_phis; ++i) {
+        struct IrInstr *phi = (struct IrInstr *) List_Get(&header->instrs, i);
+        phis[i] = Ir_AddInstr(func, unrolled_header, IR_PHI);
+        phis[i]->dest = Ir_NewReg(func);
+        phis[i]->num_args = 2;
+        phis[i]->args = ARENA_NEW_ARRAY(func->arena, int, 2);
+        phis[i]->args[0] = phi->args[pre_index];
+        incoming[i] = phis[i]->dest;
+        if (phi == counted->phi) {
+            iv_reg = phis[i]->dest;
+        }
+    }
+
+    struct IrInstr *distance = Ir_AddInstr(func, unrolled_header, IR_CONST);
+    distance->dest = Ir_NewReg(func);
+    distance->imm = (factor - 1) * counted->step;
+    struct IrInstr *last_iv = Ir_AddInstr(func, unrolled_header, IR_ADD);
+    last_iv->dest = Ir_NewReg(func);
+    last_iv->a = iv_reg;
+    last_iv->b = distance->dest;
+    struct IrInstr *test = Ir_AddInstr(func, unrolled_header, counted->opcode);
+    test->dest = Ir_NewReg(func);
+    test->a = last_iv->dest;
+    test->b = counted->limit;
+    struct IrInstr *branch = Ir_AddInstr(func, unrolled_header, IR_BRANCH);
+    branch->a = test->dest;
+    branch->target2 = header;
+
+    // The copies skip the test, which the new header did for all of them.
+    struct Iteration iteration;
+    struct IrBlock *pred = unrolled_header;
+    struct IrBlock *pred_target = NULL;
+    for (int i = 0; i < factor; ++i) {
+        CopyIteration(func, counted, incoming, false, &iteration);
+        struct IrBlock *header_copy = iteration.blocks[header->id];
+        List_Add(&header_copy->preds, pred);
+        if (pred_target) {
+            Ir_ReplaceTarget(Ir_Terminator(pred), pred_target, header_copy);
+        }
+        else {
+            branch->target = header_copy;
+        }
+
+        MakeJump(Ir_Terminator(header_copy), iteration.blocks[counted->body->id]);
+        FindLatchValues(counted, &iteration, incoming);
+        pred = iteration.blocks[counted->latch->id];
+        pred_target = header_copy;
+        FinishIteration(func, loop, &iteration);
+    }
+
+    Ir_ReplaceTarget(Ir_Terminator(pred), pred_target, unrolled_header);
+    for (int i = 0; i < num_phis; ++i) {
+        phis[i]->args[1] = incoming[i];
+    }
+
+    List_Add(&unrolled_header->preds, loop->preheader);
+    List_Add(&unrolled_header->preds, pred);
+    Ir_ReplaceTarget(Ir_Terminator(loop->preheader), header, unrolled_header);
+
+    // The original loop continues with the values the unrolled one stopped at.
+    Ir_ReplacePredecessor(header, loop->preheader, unrolled_header);
+    for (int i = 0; i < num_phis; ++i) {
+        struct IrInstr *phi = (struct IrInstr *) List_Get(&header->instrs, i);
+        phi->args[pre_index] = phis[i]->dest;
+    }
+
+    Ir_AddDefs(func, &defs, unrolled_header);
+    free(phis);
+    free(incoming);
+}
+
+static bool UnrollLoop(struct IrFunction *func, struct Loop *loop, int factor, bool is_remainder) {
+    struct CountedLoop counted;
+    if (!FindCountedLoop(loop, &counted)) {
+        return false;
+    }
+
+    int trip_count = TripCount(&counted);
+    if (trip_count >= 0 && (trip_count + 1) * counted.size <= UNROLL_BUDGET) {
+        UnrollFully(func, &counted, trip_count);
+        return true;
+    }
+
+    // The test of the unrolled loop checks the value of the counter in the last copy.
+    bool is_increasing = counted.opcode == IR_LT || counted.opcode == IR_LTE;
+    bool is_decreasing = counted.opcode == IR_GT || counted.opcode == IR_GTE;
+    long long distance = (long long) (factor - 1) * counted.step;
+    bool has_room = factor * counted.size <= UNROLL_BUDGET && INT_MIN <= distance && distance <= INT_MAX;
+    if (factor > 1 && has_room && !is_remainder && ((is_increasing && counted.step > 0) || (is_decreasing && counted.step < 0))) {
+        UnrollPartially(func, &counted, factor);
+        return true;
+    }
+
+    return false;
+}
+
+
+//
+// ===
+// == Functions defined in Unroll.h
+// ===
+//
+
+
+bool Unroll_Run(struct IrFunction *func, int factor, struct List *remainders) {
+    struct List loops;
+    List_Init(&loops);
+    Loops_Find(func, &loops);
+    Ir_ComputeDefs(func, &defs);
+    num_old_regs = func->num_regs;
+    block_copies = (struct IrBlock **) calloc(func->num_block_ids, sizeof(struct IrBlock *));
+    reg_copies = (int *) calloc(func->num_regs, sizeof(int));
+    List_Init(&new_blocks);
+    List_Init(&next_blocks);
+
+    // Block id -> the block is the header of a remainder loop, or of a loop around an
+    // unrolled one.
+    bool *is_remainder = (bool *) calloc(func->num_block_ids, sizeof(bool));
+    bool *is_outer = (bool *) calloc(func->num_block_ids, sizeof(bool));
+    for (int i = 0; i < remainders->count; ++i) {
+        is_remainder[((struct IrBlock *) List_Get(remainders, i))->id] = true;
+    }
+
+    bool has_changed = false;
+    for (int i = 0; i < loops.count; ++i) {
+        // The blocks of loops around an unrolled loop are out of date, and they are not
+        // innermost anyway.
+        struct Loop *loop = (struct Loop *) List_Get(&loops, i);
+        if (is_outer[loop->header->id]) {
+            continue;
+        }
+
+        if (!UnrollLoop(func, loop, factor, is_remainder[loop->header->id])) {
+            continue;
+        }
+
+        // A loop that was marked has its own loops around it marked already.
+        for (struct Loop *outer = loop->parent; outer && !is_outer[outer->header->id]; outer = outer->parent) {
+            is_outer[outer->header->id] = true;
+        }
+
+        has_changed = true;
+    }
+
+    // Fully unrolled loops leave their original blocks unreachable.
+    if (has_changed) {
+        Ir_InsertBlocks(func, &new_blocks, &next_blocks);
+        Ir_RemoveUnreachableBlocks(func);
+    }
+
+    List_Free(&new_blocks);
+    List_Free(&next_blocks);
+    free(is_remainder);
+    free(is_outer);
+    free(block_copies);
+    free(reg_copies);
+    Ir_FreeDefs(&defs);
+    Loops_Free(&loops);
+    return has_changed;
+}
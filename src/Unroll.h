@@ -0,0 +1,21 @@
+#ifndef MINIC_UNROLL_H
+#define MINIC_UNROLL_H
+#include "Ir.h"
+#include "List.h"
+#include <stdbool.h>
+
+#define UNROLL_DEFAULT_FACTOR 4
+
+// Unrolls innermost counted loops: loops that only exit from the header, when an induction
+// variable with a constant step fails a comparison with an invariant limit. for and while
+// loops both lower to this shape. A loop whose trip count is constant, including pointer
+// loops that run from base + a to base + b, is replaced by that many copies of its body
+// if they fit the size budget. Other counted loops get a copy that runs factor iterations
+// per test of whether factor more iterations remain, and the original loop runs the rest.
+// A factor of 1 turns partial unrolling off, and so do the headers in remainders for their
+// loops, which run few iterations. Every loop must have a preheader, see
+// Loops_InsertPreheaders. Returns true if a loop was unrolled, in which case the dominator
+// tree is out of date.
+bool Unroll_Run(struct IrFunction *func, int factor, struct List *remainders);
+
+#endif // MINIC_UNROLL_H
@@ -0,0 +1,855 @@
+#include "Vectorize.h"
+#include "Loops.h"
+#include "ReportError.h"
+#include <limits.h>
+#include <stdlib.h>
+
+// Bytes between consecutive array elements.
+#define ELEMENT_SIZE 8
+// How far FindSlot looks through additions.
+#define MAX_SLOT_SEARCH_DEPTH 16
+
+
+enum ValueKind {
+    KIND_OUTSIDE, // Not defined in the loop, so the same in every iteration.
+    KIND_CONST,
+    KIND_INDUCTION,
+    KIND_STEP, // Part of the increment of an induction variable.
+    KIND_TEST, // Part of the test in the header.
+    KIND_VECTOR, // Becomes one lane of a vector.
+    KIND_REDUCTION,
+    KIND_REDUCTION_STEP, // Part of the update of a reduction.
+};
+
+struct Induction {
+    struct IrInstr *phi;
+    int step;
+    enum PrimitiveType cast_type; // PRIMTYPE_INVALID if the increment is not cast.
+};
+
+struct Reduction {
+    struct IrInstr *phi;
+    enum IrOpcode opcode; // The vector instruction that updates the lanes.
+    int value; // What is added, subtracted or compared in each iteration.
+    enum PrimitiveType cast_type; // PRIMTYPE_INVALID if the sum is not cast.
+};
+
+struct VectorLoop {
+    struct Loop *loop;
+    int latch_index;
+    struct IrBlock *exit;
+    struct List body; // The loads, stores and arithmetic that become vector instructions.
+    struct Induction *inductions;
+    int num_inductions;
+    struct Reduction *reductions;
+    int num_reductions;
+    struct Induction *test_induction; // The loop runs while its phi opcode limit holds.
+    enum IrOpcode opcode;
+    int limit;
+};
+
+static struct IrDefs defs;
+static enum ValueKind *kinds; // Register -> what it is to the loop being vectorized
+static int num_old_regs; // Registers that existed when the loops were found.
+// Register -> its counterpart in the vector loop: the phi of an induction, the vector of
+// a lane value, the broadcast of an outside value.
+static int *scalars;
+static int *vectors;
+static int *broadcasts;
+
+
+// The arrays are kept for the whole pass, so only the entries of the registers the loop
+// defines or reads are reset.
+static void ResetLoopEntries(struct Loop *loop) {
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            int *uses[64];
+            if (2 + instr->num_args > 64) {
+                ReportInternalError("Vectorize::ResetLoopEntries - too many arguments");
+            }
+
+            int num_instr_uses = Ir_GetUses(instr, uses);
+            for (int k = 0; k <= num_instr_uses; ++k) {
+                int reg = (k < num_instr_uses) ? *uses[k] : instr->dest;
+                if (reg != IR_NO_REG && reg < num_old_regs) {
+                    kinds[reg] = KIND_OUTSIDE;
+                    scalars[reg] = IR_NO_REG;
+                    vectors[reg] = IR_NO_REG;
+                    broadcasts[reg] = IR_NO_REG;
+                }
+            }
+        }
+    }
+}
+
+static bool IsInLoop(struct Loop *loop, struct IrBlock *block) {
+    return block && Loops_Contains(loop, block);
+}
+
+static bool IsDefinedInLoop(struct Loop *loop, int reg) {
+    return IsInLoop(loop, defs.blocks[reg]);
+}
+
+static int CountUsesInLoop(struct Loop *loop, int reg) {
+    int count = 0;
+    for (int i = 0; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            int *uses[64];
+            int num_instr_uses = Ir_GetUses(instr, uses);
+            for (int k = 0; k < num_instr_uses; ++k) {
+                count += (*uses[k] == reg) ? 1 : 0;
+            }
+        }
+    }
+
+    return count;
+}
+
+static int IndexOfBlock(struct List *blocks, struct IrBlock *block) {
+    for (int i = 0; i < blocks->count; ++i) {
+        if (List_Get(blocks, i) == block) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// A value the vector instructions can use: a lane of a vector, or the same value in every
+// lane.
+static bool IsVectorOperand(struct Loop *loop, int reg) {
+    return kinds[reg] == KIND_VECTOR || kinds[reg] == KIND_CONST || !IsDefinedInLoop(loop, reg);
+}
+
+// The body is either one block, or a block that branches around empty blocks to one that
+// starts with a phi picking the new minimum or maximum. The blocks that run in every
+// iteration are added to body, and the block with the phi is returned in join.
+static bool FindBody(struct VectorLoop *v, struct List *body, struct IrBlock **join) {
+    struct Loop *loop = v->loop;
+    struct IrBlock *header = loop->header;
+    struct IrBlock *latch = (struct IrBlock *) List_Get(&header->preds, v->latch_index);
+    struct IrBlock *first = (struct IrBlock *) List_Get(&loop->blocks, 1);
+    *join = NULL;
+    if (first->preds.count != 1) {
+        return false;
+    }
+
+    if (loop->blocks.count == 2) {
+        List_Add(body, first);
+        return first == latch && Ir_Terminator(first)->opcode == IR_JUMP;
+    }
+
+    struct IrInstr *branch = Ir_Terminator(first);
+    if (loop->blocks.count > 5 || branch->opcode != IR_BRANCH || Ir_Terminator(latch)->opcode != IR_JUMP) {
+        return false;
+    }
+
+    for (int i = 2; i < loop->blocks.count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(&loop->blocks, i);
+        struct IrInstr *terminator = Ir_Terminator(block);
+        bool is_empty = block->instrs.count == 1 && terminator->opcode == IR_JUMP && terminator->target == latch;
+        if (block != latch && !is_empty) {
+            return false;
+        }
+    }
+
+    struct IrInstr *phi = (struct IrInstr *) List_Get(&latch->instrs, 0);
+    bool targets_body = IsInLoop(loop, branch->target) && IsInLoop(loop, branch->target2)
+        && (branch->target == latch || branch->target->instrs.count == 1)
+        && (branch->target2 == latch || branch->target2->instrs.count == 1);
+    if (!targets_body || branch->target == branch->target2 || latch->preds.count != 2 || phi->opcode != IR_PHI) {
+        return false;
+    }
+
+    List_Add(body, first);
+    List_Add(body, latch);
+    *join = latch;
+    return true;
+}
+
+static bool FindInduction(struct VectorLoop *v, struct IrInstr *phi, struct Induction *induction) {
+    int latch_value = phi->args[v->latch_index];
+    struct IrInstr *increment = defs.instrs[latch_value];
+    struct IrInstr *cast = NULL;
+    induction->phi = phi;
+    induction->cast_type = PRIMTYPE_INVALID;
+    if (increment && increment->opcode == IR_CAST && increment->type != PRIMTYPE_CHAR) {
+        cast = increment;
+        induction->cast_type = increment->type;
+        increment = defs.instrs[increment->a];
+    }
+
+    if (!increment || !IsDefinedInLoop(v->loop, increment->dest)) {
+        return false;
+    }
+
+    if (increment->opcode == IR_ADD && increment->a == phi->dest && Ir_IsConst(&defs, increment->b)) {
+        induction->step = defs.instrs[increment->b]->imm;
+    }
+    else if (increment->opcode == IR_ADD && increment->b == phi->dest && Ir_IsConst(&defs, increment->a)) {
+        induction->step = defs.instrs[increment->a]->imm;
+    }
+    else if (increment->opcode == IR_SUB && increment->a == phi->dest && Ir_IsConst(&defs, increment->b) && defs.instrs[increment->b]->imm != INT_MIN) {
+        induction->step = -defs.instrs[increment->b]->imm;
+    }
+    else {
+        return false;
+    }
+
+    if (induction->step == 0) {
+        return false;
+    }
+
+    kinds[phi->dest] = KIND_INDUCTION;
+    kinds[increment->dest] = KIND_STEP;
+    if (cast) {
+        kinds[cast->dest] = KIND_STEP;
+    }
+
+    return true;
+}
+
+// t = t + x, t = x + t or t = t - x, maybe cast back to int or char, which wraps the same
+// way whether it is done in each iteration or once at the end.
+static bool FindSum(struct VectorLoop *v, struct IrInstr *phi, struct Reduction *reduction) {
+    struct IrInstr *update = defs.instrs[phi->args[v->latch_index]];
+    struct IrInstr *cast = NULL;
+    reduction->phi = phi;
+    reduction->cast_type = PRIMTYPE_INVALID;
+    if (update && update->opcode == IR_CAST && update->type != PRIMTYPE_PTR && defs.num_uses[update->dest] == 1) {
+        cast = update;
+        reduction->cast_type = update->type;
+        update = defs.instrs[update->a];
+    }
+
+    if (!update || !IsDefinedInLoop(v->loop, update->dest) || defs.num_uses[update->dest] != 1) {
+        return false;
+    }
+
+    if (update->opcode == IR_ADD && update->a == phi->dest) {
+        reduction->opcode = IR_VADD;
+        reduction->value = update->b;
+    }
+    else if (update->opcode == IR_ADD && update->b == phi->dest) {
+        reduction->opcode = IR_VADD;
+        reduction->value = update->a;
+    }
+    else if (update->opcode == IR_SUB && update->a == phi->dest) {
+        reduction->opcode = IR_VSUB;
+        reduction->value = update->b;
+    }
+    else {
+        return false;
+    }
+
+    if (reduction->value == phi->dest || CountUsesInLoop(v->loop, phi->dest) != 1) {
+        return false;
+    }
+
+    kinds[phi->dest] = KIND_REDUCTION;
+    kinds[update->dest] = KIND_REDUCTION_STEP;
+    if (cast) {
+        kinds[cast->dest] = KIND_REDUCTION_STEP;
+    }
+
+    return true;
+}
+
+// if (x > m) m = x, or any other comparison of the two that keeps the smaller or larger.
+static bool FindMinMax(struct VectorLoop *v, struct IrInstr *phi, struct IrBlock *join, struct Reduction *reduction) {
+    struct IrBlock *branching = (struct IrBlock *) List_Get(&v->loop->blocks, 1);
+    struct IrInstr *branch = Ir_Terminator(branching);
+    struct IrInstr *select = (struct IrInstr *) List_Get(&join->instrs, 0);
+    struct IrInstr *condition = defs.instrs[branch->a];
+    bool is_ordering = condition && condition->opcode != IR_EQU && condition->opcode != IR_NEQ && Ir_IsComparison(condition->opcode);
+    if (phi->args[v->latch_index] != select->dest || !is_ordering || defs.blocks[condition->dest] != branching) {
+        return false;
+    }
+
+    int value = (condition->a == phi->dest) ? condition->b : condition->a;
+    bool compares_phi = condition->a == phi->dest || condition->b == phi->dest;
+    bool selects_phi = (select->args[0] == phi->dest && select->args[1] == value)
+        || (select->args[1] == phi->dest && select->args[0] == value);
+    if (!compares_phi || !selects_phi || value == phi->dest || defs.num_uses[condition->dest] != 1 || defs.num_uses[select->dest] != 1 || CountUsesInLoop(v->loop, phi->dest) != 2) {
+        return false;
+    }
+
+    // The value the phi picks when the condition holds.
+    struct IrBlock *true_pred = (branch->target == join) ? branching : branch->target;
+    int picked = select->args[IndexOfBlock(&join->preds, true_pred)];
+    bool is_greater = condition->opcode == IR_GT || condition->opcode == IR_GTE;
+    reduction->phi = phi;
+    reduction->opcode = (is_greater == (picked == condition->a)) ? IR_VMAX : IR_VMIN;
+    reduction->value = value;
+    reduction->cast_type = PRIMTYPE_INVALID;
+    kinds[phi->dest] = KIND_REDUCTION;
+    kinds[condition->dest] = KIND_REDUCTION_STEP;
+    kinds[select->dest] = KIND_REDUCTION_STEP;
+    return true;
+}
+
+// Returns the induction that reg is, or is cast from, NULL if there is none.
+static struct Induction *FindTestInduction(struct VectorLoop *v, int reg, bool *is_cast) {
+    struct IrInstr *def = defs.instrs[reg];
+    *is_cast = def && def->opcode == IR_CAST && def->type == PRIMTYPE_INT && defs.blocks[reg] == v->loop->header;
+    if (*is_cast) {
+        kinds[reg] = KIND_TEST;
+        reg = def->a;
+    }
+
+    for (int i = 0; i < v->num_inductions; ++i) {
+        if (v->inductions[i].phi->dest == reg) {
+            return &v->inductions[i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool FindTest(struct VectorLoop *v, int width) {
+    struct Loop *loop = v->loop;
+    struct IrInstr *branch = Ir_Terminator(loop->header);
+    if (branch->opcode != IR_BRANCH || IsInLoop(loop, branch->target) == IsInLoop(loop, branch->target2)) {
+        return false;
+    }
+
+    bool runs_if_true = IsInLoop(loop, branch->target);
+    v->exit = runs_if_true ? branch->target2 : branch->target;
+    struct IrInstr *condition = defs.instrs[branch->a];
+    if (!condition || !Ir_IsComparison(condition->opcode) || defs.blocks[condition->dest] != loop->header) {
+        return false;
+    }
+
+    bool is_cast;
+    kinds[condition->dest] = KIND_TEST;
+    v->opcode = runs_if_true ? condition->opcode : Ir_NegateComparison(condition->opcode);
+    v->test_induction = FindTestInduction(v, condition->a, &is_cast);
+    v->limit = condition->b;
+    if (!v->test_induction) {
+        v->test_induction = FindTestInduction(v, condition->b, &is_cast);
+        v->limit = condition->a;
+        v->opcode = Ir_SwapComparison(v->opcode);
+    }
+
+    struct Induction *induction = v->test_induction;
+    if (!induction || IsDefinedInLoop(loop, v->limit) || (is_cast && induction->cast_type != PRIMTYPE_INT)) {
+        return false;
+    }
+
+    // The vector loop tests the value of the counter in its last lane.
+    bool is_increasing = v->opcode == IR_LT || v->opcode == IR_LTE;
+    bool is_decreasing = v->opcode == IR_GT || v->opcode == IR_GTE;
+    long long distance = (long long) (width - 1) * induction->step;
+    if (!(is_increasing && induction->step > 0) && !(is_decreasing && induction->step < 0)) {
+        return false;
+    }
+
+    if (distance < INT_MIN || distance > INT_MAX) {
+        return false;
+    }
+
+    // A loop that is known to stop before width iterations is left alone.
+    int init = induction->phi->args[1 - v->latch_index];
+    if (Ir_IsConst(&defs, init) && Ir_IsConst(&defs, v->limit)) {
+        long long value = defs.instrs[init]->imm;
+        return Ir_Compare(v->opcode, value + distance, defs.instrs[v->limit]->imm);
+    }
+
+    return true;
+}
+
+// An element of an array that the loop walks through, one element per iteration.
+static bool IsElementPointer(struct VectorLoop *v, int reg) {
+    if (kinds[reg] != KIND_INDUCTION) {
+        return false;
+    }
+
+    for (int i = 0; i < v->num_inductions; ++i) {
+        struct Induction *induction = &v->inductions[i];
+        if (induction->phi->dest == reg) {
+            return induction->step == ELEMENT_SIZE && induction->cast_type == PRIMTYPE_INVALID;
+        }
+    }
+
+    return false;
+}
+
+static bool ClassifyBody(struct VectorLoop *v, struct List *blocks) {
+    struct Loop *loop = v->loop;
+    for (int i = 0; i < blocks->count; ++i) {
+        struct IrBlock *block = (struct IrBlock *) List_Get(blocks, i);
+        for (int j = 0; j < block->instrs.count; ++j) {
+            struct IrInstr *instr = (struct IrInstr *) List_Get(&block->instrs, j);
+            if (Ir_IsTerminator(instr) || (instr->dest != IR_NO_REG && kinds[instr->dest] != KIND_OUTSIDE)) {
+                continue;
+            }
+
+            switch (instr->opcode) {
+                case IR_CONST: {
+                    kinds[instr->dest] = KIND_CONST;
+                } continue;
+                case IR_LOAD: {
+                    if (instr->type != PRIMTYPE_PTR || !IsElementPointer(v, instr->a)) {
+                        return false;
+                    }
+                } break;
+                case IR_STORE: {
+                    if (instr->type != PRIMTYPE_PTR || !IsElementPointer(v, instr->a) || !IsVectorOperand(loop, instr->b)) {
+                        return false;
+                    }
+                } break;
+                case IR_ADD:
+                case IR_SUB: {
+                    if (!IsVectorOperand(loop, instr->a) || !IsVectorOperand(loop, instr->b)) {
+                        return false;
+                    }
+                } break;
+                case IR_CAST: {
+                    if (!IsVectorOperand(loop, instr->a)) {
+                        return false;
+                    }
+                } break;
+                default: {
+                    return false;
+                }
+            }
+
+            if (instr->dest != IR_NO_REG) {
+                kinds[instr->dest] = KIND_VECTOR;
+            }
+
+            List_Add(&v->body, instr);
+        }
+    }
+
+    return true;
+}
+
+static void FindBase(int reg, int *base, long long *offset) {
+    *offset = 0;
+    for (struct IrInstr *def = defs.instrs[reg]; def && def->opcode == IR_ADD; def = defs.instrs[reg]) {
+        if (Ir_IsConst(&defs, def->b)) {
+            *offset += defs.instrs[def->b]->imm;
+            reg = def->a;
+        }
+        else if (Ir_IsConst(&defs, def->a)) {
+            *offset += defs.instrs[def->a]->imm;
+            reg = def->b;
+        }
+        else {
+            break;
+        }
+    }
+
+    *base = reg;
+}
+
+// Returns the slot whose address reg is computed from, -1 if there is none.
+static int FindSlot(int reg, int depth) {
+    struct IrInstr *def = defs.instrs[reg];
+    if (!def || depth > MAX_SLOT_SEARCH_DEPTH) {
+        return -1;
+    }
+
+    if (def->opcode == IR_SLOT_ADDR) {
+        return def->imm;
+    }
+
+    if (def->opcode == IR_ADD) {
+        int a = FindSlot(def->a, depth + 1);
+        int b = FindSlot(def->b, depth + 1);
+        return (a >= 0 && b >= 0) ? -1 : ((a >= 0) ? a : b);
+    }
+
+    return -1;
+}
+
+// Whether a store through one element pointer and an access through another happen in
+// the same order when width iterations run at once. The pointers step together, so they
+// must either be the same or be width elements apart, or point into different arrays.
+static bool AreIndependent(struct VectorLoop *v, int store_pointer, int other_pointer, int width) {
+    if (store_pointer == other_pointer) {
+        return true;
+    }
+
+    int pre_index = 1 - v->latch_index;
+    int store_base;
+    int other_base;
+    long long store_offset;
+    long long other_offset;
+    FindBase(defs.instrs[store_pointer]->args[pre_index], &store_base, &store_offset);
+    FindBase(defs.instrs[other_pointer]->args[pre_index], &other_base, &other_offset);
+    // Value numbering has not run yet, so the same slot can have several addresses.
+    struct IrInstr *store_def = defs.instrs[store_base];
+    struct IrInstr *other_def = defs.instrs[other_base];
+    bool is_same_slot = store_def && other_def && store_def->opcode == IR_SLOT_ADDR && other_def->opcode == IR_SLOT_ADDR && store_def->imm == other_def->imm;
+    if (store_base == other_base || is_same_slot) {
+        long long distance = llabs(store_offset - other_offset);
+        return distance == 0 || distance >= (long long) width * ELEMENT_SIZE;
+    }
+
+    int store_slot = FindSlot(store_base, 0);
+    int other_slot = FindSlot(other_base, 0);
+    return store_slot >= 0 && other_slot >= 0 && store_slot != other_slot;
+}
+
+static bool HasNoDependences(struct VectorLoop *v, int width) {
+    for (int i = 0; i < v->body.count; ++i) {
+        struct IrInstr *store = (struct IrInstr *) List_Get(&v->body, i);
+        if (store->opcode != IR_STORE) {
+            continue;
+        }
+
+        for (int j = 0; j < v->body.count; ++j) {
+            struct IrInstr *other = (struct IrInstr *) List_Get(&v->body, j);
+            bool is_access = other->opcode == IR_LOAD || other->opcode == IR_STORE;
+            if (i != j && is_access && !AreIndependent(v, store->a, other->a, width)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool FindVectorLoop(struct VectorLoop *v, struct Loop *loop, int width) {
+    struct IrBlock *header = loop->header;
+    v->inductions = NULL;
+    v->reductions = NULL;
+    List_Init(&v->body);
+    if (!loop->preheader || header->preds.count != 2 || loop->blocks.count < 2) {
+        return false;
+    }
+
+    v->loop = loop;
+    v->latch_index = (List_Get(&header->preds, 0) == loop->preheader) ? 1 : 0;
+    struct List blocks;
+    List_Init(&blocks);
+    struct IrBlock *join;
+    bool has_body = FindBody(v, &blocks, &join);
+    int num_phis = 0;
+    while (num_phis < header->instrs.count && ((struct IrInstr *) List_Get(&header->instrs, num_phis))->opcode == IR_PHI) {
+        num_phis += 1;
+    }
+
+    // Every phi in the header is an induction variable or a reduction.
+    v->inductions = (struct Induction *) malloc(sizeof(struct Induction) * (num_phis + 1));
+    v->reductions = (struct Reduction *) malloc(sizeof(struct Reduction) * (num_phis + 1));
+    v->num_inductions = 0;
+    v->num_reductions = 0;
+    bool has_min_max = false;
+    for (int i = 0; i < num_phis && has_body; ++i) {
+        struct IrInstr *phi = (struct IrInstr *) List_Get(&header->instrs, i);
+        if (FindInduction(v, phi, &v->inductions[v->num_inductions])) {
+            v->num_inductions += 1;
+        }
+        else if (FindSum(v, phi, &v->reductions[v->num_reductions])) {
+            v->num_reductions += 1;
+        }
+        else if (join && !has_min_max && width >= VECTORIZE_AVX2_WIDTH && FindMinMax(v, phi, join, &v->reductions[v->num_reductions])) {
+            v->num_reductions += 1;
+            has_min_max = true;
+        }
+        else {
+            has_body = false;
+        }
+    }
+
+    bool is_found = has_body && (!join || has_min_max) && FindTest(v, width);
+    for (int i = num_phis; i < header->instrs.count - 1 && is_found; ++i) {
+        struct IrInstr *instr = (struct IrInstr *) List_Get(&header->instrs, i);
+        if (instr->opcode == IR_CONST) {
+            kinds[instr->dest] = KIND_CONST;
+        }
+        else if (kinds[instr->dest] != KIND_TEST) {
+            is_found = false;
+        }
+    }
+
+    is_found = is_found && ClassifyBody(v, &blocks);
+    for (int i = 0; i < v->num_reductions && is_found; ++i) {
+        is_found = IsVectorOperand(loop, v->reductions[i].value);
+    }
+
+    is_found = is_found && v->body.count > 0 && HasNoDependences(v, width);
+    List_Free(&blocks);
+    return is_found;
+}
+
+static void FreeVectorLoop(struct VectorLoop *v) {
+    free(v->inductions);
+    free(v->reductions);
+    List_Free(&v->body);
+}
+
+static struct IrInstr *AddInstr(struct IrFunction *func, struct IrBlock *block, enum IrOpcode opcode, int a, int b) {
+    struct IrInstr *instr = Ir_AddInstr(func, block, opcode);
+    instr->dest = Ir_NewReg(func);
+    instr->a = a;
+    instr->b = b;
+    return instr;
+}
+
+static struct IrInstr *AddPhi(struct IrFunction *func, struct IrBlock *block, int first) {
+    struct IrInstr *phi = AddInstr(func, block, IR_PHI, IR_NO_REG, IR_NO_REG);
+    phi->num_args = 2;
+    phi->args = ARENA_NEW_ARRAY(func->arena, int, 2);
+    phi->args[0] = first;
+    return phi;
+}
+
+// Puts the value in every lane, once, in the preheader.
+static int Broadcast(struct IrFunction *func, struct Loop *loop, int reg, int width) {
+    if (reg < num_old_regs && broadcasts[reg] != IR_NO_REG) {
+        return broadcasts[reg];
+    }
+
+    int value = reg;
+    if (reg < num_old_regs && kinds[reg] == KIND_CONST) {
+        struct IrInstr *instr = Ir_AddBeforeTerminator(func, loop->preheader, IR_CONST);
+        instr->imm = defs.instrs[reg]->imm;
+        value = instr->dest;
+    }
+
+    struct IrInstr *broadcast = Ir_AddBeforeTerminator(func, loop->preheader, IR_VBROADCAST);
+    broadcast->a = value;
+    broadcast->imm = width;
+    if (reg < num_old_regs) {
+        broadcasts[reg] = broadcast->dest;
+    }
+
+    return broadcast->dest;
+}
+
+static int VectorOperand(struct IrFunction *func, struct Loop *loop, int reg, int width) {
+    return (kinds[reg] == KIND_VECTOR) ? vectors[reg] : Broadcast(func, loop, reg, width);
+}
+
+static void GenerateBody(struct IrFunction *func, struct VectorLoop *v, struct IrBlock *block, int width) {
+    struct Loop *loop = v->loop;
+    for (int i = 0; i < v->body.count; ++i) {
+        struct IrInstr *instr = (struct IrInstr *) List_Get(&v->body, i);
+        struct IrInstr *vector = NULL;
+        switch (instr->opcode) {
+            case IR_LOAD: {
+                vector = AddInstr(func, block, IR_VLOAD, scalars[instr->a], IR_NO_REG);
+            } break;
+            case IR_STORE: {
+                int value = VectorOperand(func, loop, instr->b, width);
+                vector = Ir_AddInstr(func, block, IR_VSTORE);
+                vector->a = scalars[instr->a];
+                vector->b = value;
+            } break;
+            case IR_ADD:
+            case IR_SUB: {
+                int a = VectorOperand(func, loop, instr->a, width);
+                int b = VectorOperand(func, loop, instr->b, width);
+                vector = AddInstr(func, block, (instr->opcode == IR_ADD) ? IR_VADD : IR_VSUB, a, b);
+            } break;
+            case IR_CAST: {
+                int a = VectorOperand(func, loop, instr->a, width);
+                vector = AddInstr(func, block, IR_VCAST, a, IR_NO_REG);
+                vector->type = instr->type;
+            } break;
+        }
+
+        vector->imm = width;
+        if (instr->dest != IR_NO_REG) {
+            vectors[instr->dest] = vector->dest;
+        }
+    }
+}
+
+// Puts a loop in front of the original one that runs width iterations at once, while
+// width more remain, then combines the lanes of the reductions.
+// Adds the vector loop's blocks to new_blocks, to be placed before the block at the same
+// index of next_blocks.
+static void Vectorize(struct IrFunction *func, struct VectorLoop *v, int width, struct List *new_blocks, struct List *next_blocks) {
+    struct Loop *loop = v->loop;
+    struct IrBlock *header = loop->header;
+    struct IrBlock *preheader = loop->preheader;
+    int pre_index = 1 - v->latch_index;
+    struct IrInstr **induction_phis = (struct IrInstr **) malloc(sizeof(struct IrInstr *) * (v->num_inductions + 1));
+    struct IrInstr **accumulators = (struct IrInstr **) malloc(sizeof(struct IrInstr *) * (v->num_reductions + 1));
+    struct IrBlock *vector_header = Ir_NewBlock(func);
+    struct IrBlock *vector_body = Ir_NewBlock(func);
+    struct IrBlock *vector_exit = Ir_NewBlock(func);
+
+    // The sums start at 0 in every lane, minimums and maximums at the initial value.
+    for (int i = 0; i < v->num_inductions; ++i) {
+        struct IrInstr *phi = v->inductions[i].phi;
+        induction_phis[i] = AddPhi(func, vector_header, phi->args[pre_index]);
+        scalars[phi->dest] = induction_phis[i]->dest;
+    }
+
+    for (int i = 0; i < v->num_reductions; ++i) {
+        struct Reduction *reduction = &v->reductions[i];
+        int init = reduction->phi->args[pre_index];
+        if (reduction->opcode == IR_VADD || reduction->opcode == IR_VSUB) {
+            struct IrInstr *zero = Ir_AddBeforeTerminator(func, preheader, IR_CONST);
+            init = zero->dest;
+        }
+
+        accumulators[i] = AddPhi(func, vector_header, Broadcast(func, loop, init, width));
+    }
+
+    // The counter of the first lane is tested against a limit moved back by the other lanes,
+    // so that the vector loop stays a counted loop that Unroll_Run can unroll.
+    struct IrInstr *distance = Ir_AddBeforeTerminator(func, preheader, IR_CONST);
+    distance->imm = (width - 1) * v->test_induction->step;
+    struct IrInstr *limit = Ir_AddBeforeTerminator(func, preheader, IR_SUB);
+    limit->a = v->limit;
+    limit->b = distance->dest;
+    struct IrInstr *test = AddInstr(func, vector_header, v->opcode, scalars[v->test_induction->phi->dest], limit->dest);
+    struct IrInstr *branch = Ir_AddInstr(func, vector_header, IR_BRANCH);
+    branch->a = test->dest;
+    branch->target = vector_body;
+    branch->target2 = vector_exit;
+
+    GenerateBody(func, v, vector_body, width);
+    for (int i = 0; i < v->num_reductions; ++i) {
+        struct Reduction *reduction = &v->reductions[i];
+        int value = VectorOperand(func, loop, reduction->value, width);
+        struct IrInstr *update = AddInstr(func, vector_body, reduction->opcode, accumulators[i]->dest, value);
+        update->imm = width;
+        accumulators[i]->args[1] = update->dest;
+    }
+
+    for (int i = 0; i < v->num_inductions; ++i) {
+        struct Induction *induction = &v->inductions[i];
+        struct IrInstr *step = AddInstr(func, vector_body, IR_CONST, IR_NO_REG, IR_NO_REG);
+        step->imm = width * induction->step;
+        struct IrInstr *increment = AddInstr(func, vector_body, IR_ADD, induction_phis[i]->dest, step->dest);
+        if (induction->cast_type != PRIMTYPE_INVALID) {
+            increment = AddInstr(func, vector_body, IR_CAST, increment->dest, IR_NO_REG);
+            increment->type = induction->cast_type;
+        }
+
+        induction_phis[i]->args[1] = increment->dest;
+        induction->phi->args[pre_index] = induction_phis[i]->dest;
+    }
+
+    struct IrInstr *jump = Ir_AddInstr(func, vector_body, IR_JUMP);
+    jump->target = vector_header;
+
+    // The original loop continues from where the vector loop stopped.
+    for (int i = 0; i < v->num_reductions; ++i) {
+        struct Reduction *reduction = &v->reductions[i];
+        enum IrOpcode opcode = IR_VREDUCE_ADD;
+        opcode = (reduction->opcode == IR_VMIN) ? IR_VREDUCE_MIN : opcode;
+        opcode = (reduction->opcode == IR_VMAX) ? IR_VREDUCE_MAX : opcode;
+        struct IrInstr *result = AddInstr(func, vector_exit, opcode, accumulators[i]->dest, IR_NO_REG);
+        result->type = PRIMTYPE_PTR;
+        result->imm = width;
+        if (opcode == IR_VREDUCE_ADD) {
+            result = AddInstr(func, vector_exit, IR_ADD, reduction->phi->args[pre_index], result->dest);
+        }
+
+        if (reduction->cast_type != PRIMTYPE_INVALID) {
+            result = AddInstr(func, vector_exit, IR_CAST, result->dest, IR_NO_REG);
+            result->type = reduction->cast_type;
+        }
+
+        reduction->phi->args[pre_index] = result->dest;
+    }
+
+    jump = Ir_AddInstr(func, vector_exit, IR_JUMP);
+    jump->target = header;
+
+    List_Add(&vector_header->preds, preheader);
+    List_Add(&vector_header->preds, vector_body);
+    List_Add(&vector_body->preds, vector_header);
+    List_Add(&vector_exit->preds, vector_header);
+    Ir_ReplacePredecessor(header, preheader, vector_exit);
+    Ir_ReplaceTarget(Ir_Terminator(preheader), header, vector_header);
+    List_Add(new_blocks, vector_header);
+    List_Add(new_blocks, vector_body);
+    List_Add(new_blocks, vector_exit);
+    for (int i = 0; i < 3; ++i) {
+        List_Add(next_blocks, header);
+    }
+
+    free(induction_phis);
+    free(accumulators);
+}
+
+
+//
+// ===
+// == Functions defined in Vectorize.h
+// ===
+//
+
+
+bool Vectorize_Run(struct IrFunction *func, int width, struct List *remainders) {
+    if (width < VECTORIZE_SSE2_WIDTH) {
+        return false;
+    }
+
+    struct List loops;
+    List_Init(&loops);
+    Loops_Find(func, &loops);
+    Ir_ComputeDefs(func, &defs);
+    num_old_regs = func->num_regs;
+    kinds = (enum ValueKind *) calloc(num_old_regs, sizeof(enum ValueKind));
+    scalars = (int *) calloc(num_old_regs, sizeof(int));
+    vectors = (int *) calloc(num_old_regs, sizeof(int));
+    broadcasts = (int *) calloc(num_old_regs, sizeof(int));
+    bool *is_outer = (bool *) calloc(func->num_block_ids, sizeof(bool)); // Header block id -> is around a vectorized loop
+    struct List new_blocks;
+    struct List next_blocks;
+    List_Init(&new_blocks);
+    List_Init(&next_blocks);
+    bool has_changed = false;
+    for (int i = 0; i < loops.count; ++i) {
+        // The blocks of loops around a vectorized loop are out of date, and they are not
+        // innermost anyway.
+        struct Loop *loop = (struct Loop *) List_Get(&loops, i);
+        if (is_outer[loop->header->id]) {
+            continue;
+        }
+
+        struct VectorLoop v;
+        ResetLoopEntries(loop);
+        if (FindVectorLoop(&v, loop, width)) {
+            // The preheader gets new instructions and the header's phis new arguments.
+            int num_new_blocks = new_blocks.count;
+            Ir_RemoveUses(&defs, loop->preheader);
+            Ir_RemoveUses(&defs, loop->header);
+            Vectorize(func, &v, width, &new_blocks, &next_blocks);
+            Ir_AddDefs(func, &defs, loop->preheader);
+            Ir_AddDefs(func, &defs, loop->header);
+            for (int j = num_new_blocks; j < new_blocks.count; ++j) {
+                Ir_AddDefs(func, &defs, (struct IrBlock *) List_Get(&new_blocks, j));
+            }
+
+            for (struct Loop *outer = loop->parent; outer && !is_outer[outer->header->id]; outer = outer->parent) {
+                is_outer[outer->header->id] = true;
+            }
+
+            List_Add(remainders, loop->header);
+            has_changed = true;
+        }
+
+        FreeVectorLoop(&v);
+    }
+
+    if (has_changed) {
+        Ir_InsertBlocks(func, &new_blocks, &next_blocks);
+    }
+
+    List_Free(&new_blocks);
+    List_Free(&next_blocks);
+    free(is_outer);
+    free(kinds);
+    free(scalars);
+    free(vectors);
+    free(broadcasts);
+    Ir_FreeDefs(&defs);
+    Loops_Free(&loops);
+    return has_changed;
+}
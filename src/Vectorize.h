@@ -0,0 +1,23 @@
+#ifndef MINIC_VECTORIZE_H
+#define MINIC_VECTORIZE_H
+#include "Ir.h"
+#include "List.h"
+#include <stdbool.h>
+
+// Array elements are 8 bytes, so an SSE2 register holds 2 of them and an AVX2 register 4.
+#define VECTORIZE_SSE2_WIDTH 2
+#define VECTORIZE_AVX2_WIDTH 4
+
+// Vectorizes innermost counted loops whose body loads and stores consecutive elements
+// through pointers that step by one element, combines them with additions, subtractions
+// and casts, and sums them or keeps their minimum or maximum. The body must be straight
+// line code, except for an if that only picks a new minimum or maximum. Minimum and
+// maximum need AVX2, SSE2 cannot compare 64-bit lanes. A loop is only vectorized if its
+// stores cannot change what a later iteration reads. A copy of the loop that runs width
+// iterations at a time goes in front of it, while width more iterations remain, and the
+// original loop runs the rest; its header is added to remainders. Every loop must have a
+// preheader, see Loops_InsertPreheaders. Returns true if a loop was vectorized, in which
+// case the dominator tree is out of date.
+bool Vectorize_Run(struct IrFunction *func, int width, struct List *remainders);
+
+#endif // MINIC_VECTORIZE_H
@@ -0,0 +1,26 @@
+int main() {
+    int a[4];
+    int b[4];
+    int i;
+    for (i = 0; i < 4; i = i + 1) {
+        a[i] = i;
+        b[i] = i * 10;
+    }
+
+    for (i = 0; i < 4; i = i + 1) {
+        a[i] = a[i] + b[i];
+        b[i] = a[i] + b[i];
+    }
+
+    printf("%d %d %d\n", a[1], a[3], b[3]);
+
+    int x = 6;
+    int y = 7;
+    int *p = &x;
+    int v = *p;
+    int before = v + y;
+    *p = 1;
+    v = *p;
+    int after = v + y;
+    printf("%d %d %d\n", before, after, y * x + x * y);
+}
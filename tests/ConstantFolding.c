@@ -0,0 +1,57 @@
+#define WIDTH 4
+#define HEIGHT 3
+#define DEBUG 0
+
+int area() {
+    return WIDTH * HEIGHT + 2 + 2 - 2;
+}
+
+int pick(int x) {
+    int n = 10;
+    if (n > 5) {
+        return x + n;
+    }
+
+    return 0 - 1;
+}
+
+int main() {
+    int n = 10;
+    int m = n * 2;
+    char c = 300;
+    int i;
+    int s = 0;
+    if (DEBUG) {
+        printf("debug\n");
+    }
+
+    for (i = 0; i < n; i = i + 1) {
+        s = s + m;
+    }
+
+    int k = 1;
+    while (k < 100) {
+        k = k * 3;
+    }
+
+    int flag = 7;
+    int j = 0;
+    while (j < 5) {
+        if (flag == 7) {
+            j = j + 1;
+        }
+        else {
+            flag = 0;
+        }
+    }
+
+    printf("%d %d %d\n", area(), pick(5), m);
+    printf("%d %d %d\n", c, s, k);
+    printf("%d\n", flag);
+    while (0) {
+        printf("never\n");
+    }
+
+    return 0;
+    printf("dead\n");
+}
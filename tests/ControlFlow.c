@@ -0,0 +1,43 @@
+int first_multiple(int n, int k) {
+    int i;
+    for (i = 1; i <= n; i = i + 1) {
+        if (i / k * k == i) {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+int sign(int x) {
+    if (x < 0) return 0 - 1;
+    else if (x == 0) return 0;
+    else return 1;
+}
+
+int main() {
+    int total = 0;
+    int i;
+    int j;
+    for (i = 0; i < 4; i = i + 1) {
+        j = 0;
+        while (j < i) {
+            total = total + i * j;
+            j = j + 1;
+        }
+    }
+
+    printf("%d\n", total);
+    printf("%d %d\n", first_multiple(20, 7), first_multiple(5, 9));
+    printf("%d %d %d\n", sign(0 - 5), sign(0), sign(8));
+
+    int x = 10;
+    if (x > 5) {
+        x = x - 5;
+    }
+    else {
+        x = x + 5;
+    }
+
+    printf("%d\n", x);
+}
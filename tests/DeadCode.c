@@ -0,0 +1,44 @@
+int classify(int x) {
+    int result = 0;
+    if (x < 0) {
+        result = 0 - 1;
+    }
+    else {
+        if (x == 0) {
+        }
+        else {
+            result = 1;
+        }
+    }
+
+    x * 2;
+    return result;
+    printf("unreachable\n");
+}
+
+int count_down(int n) {
+    int steps = 0;
+    while (n > 0) {
+        if (n > 100) {
+        }
+
+        n = n - 1;
+        steps = steps + 1;
+    }
+
+    return steps;
+}
+
+int main() {
+    int unused = 5 * 7;
+    if (0) {
+        printf("never\n");
+    }
+    else {
+    }
+
+    printf("%d %d %d\n", classify(0 - 3), classify(0), classify(9));
+    printf("%d\n", count_down(6));
+    return 0;
+    printf("after return\n");
+}
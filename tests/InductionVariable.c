@@ -0,0 +1,37 @@
+int sum_strided(int n) {
+    int total = 0;
+    int i;
+    for (i = 0; i < n; i = i + 1) {
+        total = total + i * 3 + i * 5 + i * 6;
+    }
+
+    return total;
+}
+
+int main() {
+    int squares[10];
+    int copy[10];
+    int i;
+    for (i = 0; i < 10; i = i + 1) {
+        squares[i] = i * i;
+    }
+
+    for (i = 10; i > 0; i = i - 1) {
+        int square = squares[i - 1];
+        copy[10 - i] = square;
+    }
+
+    int sum = 0;
+    for (i = 2; i < 10; i = i + 2) {
+        int value = copy[i];
+        sum = sum + value;
+    }
+
+    int last = 0;
+    for (i = 0; i < 5; i = i + 1) {
+        last = squares[i];
+    }
+
+    printf("%d %d %d\n", sum, last, i);
+    printf("%d\n", sum_strided(4));
+}
@@ -0,0 +1,63 @@
+int distance(int x, int y) {
+    if (x < y) {
+        return y - x;
+    }
+
+    return x - y;
+}
+
+int clamp(int x, int low, int high) {
+    if (x < low) {
+        return low;
+    }
+
+    if (x > high) {
+        return high;
+    }
+
+    return x;
+}
+
+int sum_first(int n) {
+    int values[4];
+    values[0] = 4;
+    values[1] = 5;
+    values[2] = 6;
+    values[3] = 7;
+    int total = 0;
+    int i;
+    for (i = 0; i < n; i = i + 1) {
+        int value = values[i];
+        total = total + value;
+    }
+
+    return total;
+}
+
+int is_odd(int n) {
+    if (n == 0) {
+        return 0;
+    }
+
+    return is_even(n - 1);
+}
+
+int is_even(int n) {
+    if (n == 0) {
+        return 1;
+    }
+
+    return is_odd(n - 1);
+}
+
+int main() {
+    int i;
+    int total = 0;
+    for (i = 0; i < 5; i = i + 1) {
+        total = total + clamp(i * 3, 2, 9);
+    }
+
+    printf("%d %d\n", distance(3, 10), total);
+    printf("%d %d\n", sum_first(3), sum_first(4));
+    printf("%d %d\n", is_even(10), is_odd(7));
+}
@@ -0,0 +1,19 @@
+// The lexer scans whitespace, comments and identifiers 16 or 32 bytes at a time, so
+// these cross those boundaries: tabs between tokens, block comments over several lines
+// with stars in them, and identifiers longer than a vector.
+/* A block comment that starts before a directive
+ * and spans a few lines, with * and / on their own: * / ** //
+ ***********************************************************************/
+#define	TABBED	(4	+	5)
+
+int main() {
+    int this_identifier_is_longer_than_thirty_two_bytes_and_sixty_four_bytes_as_well = 7;
+	int	a	=	1;		// Tabs only
+    int b = /* inline */ 2; /**/
+	/*
+	 * Indented with a tab.
+	 */	int c = a + b;
+    printf("%d %d\n", TABBED, c);
+    printf("%d\n", this_identifier_is_longer_than_thirty_two_bytes_and_sixty_four_bytes_as_well);
+    printf("/* not a comment */ %d\n", a);
+}
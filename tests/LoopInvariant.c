@@ -0,0 +1,42 @@
+int sum_grid(int n, int m) {
+    int total = 0;
+    int i;
+    int j;
+    for (i = 0; i < n * m; i = i + 1) {
+        total = total + n * m;
+    }
+
+    for (i = 0; i < n; i = i + 1) {
+        j = 0;
+        while (j < m) {
+            total = total + i * m + n * 2;
+            j = j + 1;
+        }
+    }
+
+    return total;
+}
+
+int main() {
+    int values[4];
+    values[0] = 1;
+    values[1] = 5;
+    values[2] = 9;
+    values[3] = 2;
+    int *p = values;
+    int limit = 4;
+    int i = 0;
+    int found = 0 - 1;
+    while (i < 4) {
+        int v = *(p + i);
+        if (v > limit * 2) {
+            found = i;
+            i = 4;
+        }
+
+        i = i + 1;
+    }
+
+    printf("%d\n", sum_grid(3, 4));
+    printf("%d\n", found);
+}
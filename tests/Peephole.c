@@ -0,0 +1,51 @@
+// The peephole rules fold the pushes, pops and addresses of the generated code, so these
+// cover values that have to survive them: nested expressions, loads and stores through
+// pointers, branches that fall through to the next label and calls with arguments.
+int mix(int a, int b, int c) {
+    return a * b - c;
+}
+
+int pick(int a, int b) {
+    if (a > b) {
+        return a;
+    }
+    else {
+        return b;
+    }
+}
+
+int nested(int x, int y) {
+    return (x + y) * (x - y) + x / y;
+}
+
+int through_pointers() {
+    int x = 7;
+    int y = 3;
+    int *p = &x;
+    int *q = &y;
+    int t = *p;
+    int u = *q;
+    *q = t;
+    *p = u + 5;
+    return x * 10 + y;
+}
+
+int partial_sum() {
+    int i = 0;
+    int sum = 0;
+    while (i < 10) {
+        if (i < 5) {
+            sum = sum + i;
+        }
+
+        i = i + 1;
+    }
+
+    return sum;
+}
+
+int main() {
+    printf("%d %d\n", nested(7, 3), through_pointers());
+    printf("%d %d\n", partial_sum(), pick(mix(3, 12, 1), mix(12, 3, 2)));
+    printf("%d\n", mix(pick(1, 2), pick(4, 3), mix(1, 1, 1)));
+}
@@ -0,0 +1,51 @@
+int add3(int a, int b, int c) {
+    return a + b + c;
+}
+
+// More values are live at once than there are registers to keep them in.
+int many_live(int x) {
+    int a = x + 1;
+    int b = x + 2;
+    int c = x + 3;
+    int d = x + 4;
+    int e = x + 5;
+    int f = x + 6;
+    int g = x + 7;
+    int h = x + 8;
+    int i = x + 9;
+    int j = x + 10;
+    int k = x + 11;
+    return a * b + c * d + e * f + g * h + i * j + k * a + b * c + d * e + f * g + h * i + j * k;
+}
+
+// The values that are live across the calls must survive them.
+int across_calls(int n) {
+    int total = 0;
+    int i;
+    for (i = 0; i < n; i = i + 1) {
+        int before = i * 7;
+        int after = add3(i, before, total) / 3;
+        total = total + after - before / 7 + (i - i / 4 * 4);
+    }
+
+    return total;
+}
+
+int nested(int n) {
+    int sum = 0;
+    int i;
+    int j;
+    for (i = 0; i < n; i = i + 1) {
+        for (j = 0; j < i; j = j + 1) {
+            sum = sum + i * j - (i + j) / 3;
+        }
+    }
+
+    return sum;
+}
+
+int main() {
+    printf("%d %d\n", many_live(1), many_live(20));
+    printf("%d %d\n", across_calls(10), across_calls(25));
+    printf("%d %d\n", nested(6), nested(30));
+}
@@ -0,0 +1,56 @@
+// Constants go on the left of the comparisons, so that they also hold for large values
+// at -O0.
+int sum_to(int n) {
+    if (0 == n) {
+        return 0;
+    }
+
+    return n + sum_to(n - 1);
+}
+
+int factorial(int n) {
+    if (1 >= n) {
+        return 1;
+    }
+
+    return n * factorial(n - 1);
+}
+
+int gcd(int a, int b) {
+    if (0 == b) {
+        return a;
+    }
+
+    return gcd(b, a - a / b * b);
+}
+
+// Too deep for the stack unless the calls reuse the frame.
+int count_down(int n, int steps) {
+    if (0 == n) {
+        return steps;
+    }
+
+    return count_down(n - 1, steps + 1);
+}
+
+int is_odd(int n) {
+    if (0 == n) {
+        return 0;
+    }
+
+    return is_even(n - 1);
+}
+
+int is_even(int n) {
+    if (0 == n) {
+        return 1;
+    }
+
+    return is_odd(n - 1);
+}
+
+int main() {
+    printf("%d %d %d\n", sum_to(100), factorial(10), gcd(1071, 462));
+    printf("%d\n", count_down(3000000, 0));
+    printf("%d %d\n", is_even(3000001), is_odd(3000001));
+}
@@ -0,0 +1,52 @@
+int sum_below(int n) {
+    int total = 0;
+    int i;
+    for (i = 0; i < n; i = i + 1) {
+        total = total + i;
+    }
+
+    return total;
+}
+
+int count_even(int n) {
+    int count = 0;
+    int i = 0;
+    while (i <= n) {
+        if (i == i / 2 * 2) {
+            count = count + 1;
+        }
+
+        i = i + 1;
+    }
+
+    return count;
+}
+
+int count_down(int n) {
+    int steps = 0;
+    while (n > 2) {
+        steps = steps + 1;
+        n = n - 3;
+    }
+
+    return steps;
+}
+
+int main() {
+    int values[8];
+    int i;
+    for (i = 0; i < 8; i = i + 1) {
+        values[i] = i * 3;
+    }
+
+    int sum = 0;
+    for (i = 7; i > 1; i = i - 2) {
+        int value = values[i];
+        sum = sum + value;
+    }
+
+    printf("%d %d\n", sum, i);
+    printf("%d %d %d\n", sum_below(0), sum_below(7), sum_below(13));
+    printf("%d %d %d\n", count_even(0), count_even(9), count_even(10));
+    printf("%d %d %d\n", count_down(0), count_down(10), count_down(12));
+}
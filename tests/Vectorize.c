@@ -0,0 +1,91 @@
+int add_and_sum(int n) {
+    int a[64];
+    int b[64];
+    int i;
+    for (i = 0; i < n; i = i + 1) {
+        a[i] = i * 37 + 11 - (i * 37 + 11) / 50 * 50;
+    }
+
+    for (i = 0; i < n; i = i + 1) {
+        b[i] = a[i] + 1000;
+    }
+
+    int sum = 0;
+    for (i = 0; i < n; i = i + 1) {
+        int value = b[i];
+        sum = sum + value;
+    }
+
+    return sum;
+}
+
+int max_minus_min(int n) {
+    int a[64];
+    int i;
+    for (i = 0; i < n; i = i + 1) {
+        a[i] = i * 37 + 11 - (i * 37 + 11) / 50 * 50;
+    }
+
+    int largest = a[0];
+    int smallest = a[0];
+    for (i = 1; i < n; i = i + 1) {
+        int value = a[i];
+        if (value > largest) {
+            largest = value;
+        }
+    }
+
+    for (i = 1; i < n; i = i + 1) {
+        int value = a[i];
+        if (smallest > value) {
+            smallest = value;
+        }
+    }
+
+    return largest - smallest;
+}
+
+int fill_and_subtract(int n) {
+    int a[64];
+    int b[64];
+    int i;
+    for (i = 0; i < n; i = i + 1) {
+        a[i] = 9;
+    }
+
+    for (i = 0; i < n; i = i + 1) {
+        b[i] = i * i;
+    }
+
+    for (i = 0; i < n; i = i + 1) {
+        a[i] = b[i] - a[i];
+    }
+
+    int sum = 0;
+    for (i = 0; i < n; i = i + 1) {
+        int value = a[i];
+        sum = sum + value;
+    }
+
+    return sum;
+}
+
+int main() {
+    printf("%d %d %d\n", add_and_sum(1), add_and_sum(7), add_and_sum(64));
+    printf("%d %d %d\n", max_minus_min(2), max_minus_min(9), max_minus_min(50));
+    printf("%d %d %d\n", fill_and_subtract(0), fill_and_subtract(5), fill_and_subtract(63));
+
+    int values[20];
+    int i;
+    for (i = 0; i < 20; i = i + 1) {
+        values[i] = i;
+    }
+
+    int total = 0;
+    for (i = 0; i < 20; i = i + 1) {
+        int value = values[i];
+        total = total + value;
+    }
+
+    printf("%d\n", total);
+}
@@ -0,0 +1,299 @@
+import argparse
+import json
+import math
+import os
+import subprocess
+import sys
+import tempfile
+
+
+COLOR_RED = "\033[91m"
+COLOR_GREEN = "\033[92m"
+COLOR_END = "\033[0m"
+
+PHASES = ["lex", "parse", "analyze", "optimize", "codegen"]
+
+# The optimizer only runs the IR passes at -O1, so both levels are measured.
+OPT_LEVELS = ["-O0", "-O1"]
+
+# A log-log slope above this means the phase grows faster than linearly with the input size.
+MAX_SLOPE = 1.3
+
+# Timings below this are mostly noise and are left out of the slope.
+MIN_WALL_MS = 20.0
+
+# The slope is only judged when the timings that are left span at least this factor of sizes,
+# a fit over two neighbouring sizes says little about the growth.
+MIN_SIZE_RATIO = 4
+
+
+#
+# Generators. Each one returns the source of a program that scales with n.
+#
+
+
+def generate_functions(n):
+    lines = []
+    for i in range(n):
+        lines.append(f"int f{i}(int x) {{")
+        lines.append(f"    return x + {i};")
+        lines.append("}")
+        lines.append("")
+
+    lines.append("int main() {")
+    lines.append("    int sum = 0;")
+    for i in range(0, n, max(1, n // 100)):
+        lines.append(f"    sum = sum + f{i}({i});")
+
+    lines.append('    printf("%d\\n", sum);')
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def generate_locals(n):
+    lines = ["int main() {"]
+    for i in range(n):
+        lines.append(f"    int x{i} = {i % 100};")
+
+    lines.append("    int sum = 0;")
+    for i in range(n):
+        lines.append(f"    sum = sum + x{i};")
+
+    lines.append('    printf("%d\\n", sum);')
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def generate_branchy_locals(n):
+    # Each local is assigned in its own branch, so -O1 has to place a phi for every one. The
+    # conditions depend on a parameter, so constant propagation cannot fold the branches away.
+    # The kernel grows with n, so it is too large to be inlined into main.
+    lines = ["int kernel(int seed) {", "    int sum = seed;"]
+    for i in range(n):
+        lines.append(f"    int x{i} = {i % 100};")
+        lines.append(f"    if (sum > {i % 50}) {{")
+        lines.append(f"        x{i} = x{i} + 1;")
+        lines.append("    }")
+        lines.append(f"    sum = sum + x{i};")
+
+    lines.append("    return sum;")
+    lines.append("}")
+    lines.append("")
+    lines.append("int main() {")
+    lines.append('    printf("%d\\n", kernel(3));')
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def generate_sequential_loops(n):
+    # Many loops one after another in a single function, so the loop passes see n loops at once.
+    # The trip count is a parameter, so the loops are neither folded nor fully unrolled.
+    lines = ["int kernel(int p) {", "    int sum = 0;", "    int i;"]
+    for i in range(n):
+        lines.append(f"    for (i = 0; i < p; i = i + 1) {{ sum = sum + i + {i % 7}; }}")
+
+    lines.append("    return sum;")
+    lines.append("}")
+    lines.append("")
+    lines.append("int main() {")
+    lines.append('    printf("%d\\n", kernel(10));')
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def generate_nested_expressions(n):
+    # Many statements with moderately deep nesting, so the parser's recursion stays bounded.
+    depth = 50
+    lines = ["int main() {", "    int x = 1;"]
+    for i in range(n // depth):
+        expr = "x"
+        for j in range(depth):
+            expr = f"({expr} + {j % 7})" if j % 2 == 0 else f"({expr} - {j % 5})"
+
+        lines.append(f"    x = {expr};")
+
+    lines.append('    printf("%d\\n", x);')
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def generate_defines(n):
+    lines = []
+    for i in range(n):
+        lines.append(f"#define VALUE{i} {i}")
+
+    lines.append("")
+    lines.append("int main() {")
+    lines.append("    int sum = 0;")
+    for i in range(n):
+        lines.append(f"    sum = sum + VALUE{i};")
+
+    lines.append('    printf("%d\\n", sum);')
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def generate_string_literals(n):
+    lines = ["int main() {"]
+    for i in range(n):
+        # Every fourth literal repeats an earlier one, so pooling is exercised as well.
+        literal_id = i if i % 4 != 3 else i // 2
+        lines.append(f'    printf("literal {literal_id}: %d\\n", {i});')
+
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+GENERATORS = {
+    "functions": (generate_functions, 1250),
+    "locals": (generate_locals, 12500),
+    "branchy_locals": (generate_branchy_locals, 2500),
+    "nested_expressions": (generate_nested_expressions, 2500),
+    "defines": (generate_defines, 1250),
+    "string_literals": (generate_string_literals, 1250),
+    "sequential_loops": (generate_sequential_loops, 500),
+}
+
+
+#
+# Measuring
+#
+
+
+def run_minic(minic, c_file, asm_file, opt_level):
+    compile_cmd = [minic, opt_level, "--time-report=json", "-S", "-o", asm_file, c_file]
+    result = subprocess.run(compile_cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stderr)
+        return None
+
+    # The report is the last thing written to stderr.
+    report_start = result.stderr.find("{")
+    return json.loads(result.stderr[report_start:])
+
+
+def measure(minic, source, opt_level, num_runs):
+    with tempfile.TemporaryDirectory() as directory:
+        c_file = os.path.join(directory, "bench.c")
+        asm_file = os.path.join(directory, "bench.asm")
+        with open(c_file, "w") as f:
+            f.write(source)
+
+        # Keep the fastest run of each phase, it has the least noise.
+        best = None
+        for _ in range(num_runs):
+            report = run_minic(minic, c_file, asm_file, opt_level)
+            if report is None:
+                return None
+
+            phases = {phase["name"]: phase for phase in report["phases"]}
+            if best is None:
+                best = phases
+                continue
+
+            for name, phase in phases.items():
+                if phase["wall_ms"] < best[name]["wall_ms"]:
+                    best[name] = phase
+
+        return best
+
+
+def slope(sizes, times):
+    # Least squares fit of log(time) = slope * log(size) + c.
+    points = [(math.log(s), math.log(t)) for s, t in zip(sizes, times) if t >= MIN_WALL_MS]
+    if len(points) < 3 or points[-1][0] - points[0][0] < math.log(MIN_SIZE_RATIO):
+        return None
+
+    mean_x = sum(x for x, _ in points) / len(points)
+    mean_y = sum(y for _, y in points) / len(points)
+    numerator = sum((x - mean_x) * (y - mean_y) for x, y in points)
+    denominator = sum((x - mean_x) ** 2 for x, _ in points)
+    return numerator / denominator
+
+
+def run_benchmark(minic, name, opt_level, scales, num_runs, json_results):
+    generate, base_size = GENERATORS[name]
+    print(f"{name} {opt_level}")
+    print(f"  {'n':>8} {'lines':>8} {'lines/sec':>12} {'peak rss (kb)':>14}  " + " ".join(f"{p + ' (ms)':>13}" for p in PHASES))
+
+    sizes = []
+    phase_times = {phase: [] for phase in PHASES}
+    for scale in scales:
+        n = base_size * scale
+        source = generate(n)
+        num_lines = source.count("\n")
+        phases = measure(minic, source, opt_level, num_runs)
+        if phases is None:
+            print(f"  {COLOR_RED}minic failed for n={n}{COLOR_END}")
+            return False
+
+        wall_ms = sum(phases[p]["wall_ms"] for p in PHASES)
+        lines_per_sec = num_lines / (wall_ms / 1000) if wall_ms > 0 else 0
+        peak_rss_kb = max(phase["peak_rss_kb"] for phase in phases.values())
+        times = " ".join(f"{phases[p]['wall_ms']:>13.3f}" for p in PHASES)
+        print(f"  {n:>8} {num_lines:>8} {lines_per_sec:>12.0f} {peak_rss_kb:>14}  {times}")
+
+        sizes.append(num_lines)
+        for p in PHASES:
+            phase_times[p].append(phases[p]["wall_ms"])
+
+        json_results.append({
+            "benchmark": name,
+            "opt_level": opt_level,
+            "n": n,
+            "lines": num_lines,
+            "lines_per_sec": lines_per_sec,
+            "peak_rss_kb": peak_rss_kb,
+            "phases": {p: phases[p]["wall_ms"] for p in PHASES},
+        })
+
+    is_linear = True
+    for p in PHASES:
+        phase_slope = slope(sizes, phase_times[p])
+        if phase_slope is not None and phase_slope > MAX_SLOPE:
+            print(f"  {COLOR_RED}super-linear: {p} grows as n^{phase_slope:.2f}{COLOR_END}")
+            is_linear = False
+
+    if is_linear:
+        print(f"  {COLOR_GREEN}linear{COLOR_END}")
+
+    print()
+    return is_linear
+
+
+def main():
+    default_minic = os.path.join("bin", "minic")
+    parser = argparse.ArgumentParser(description="Measures minic's throughput on large synthetic inputs.")
+    parser.add_argument("--minic", default=default_minic, help="path to the minic executable")
+    parser.add_argument("--bench", choices=GENERATORS.keys(), action="append", help="only run this benchmark (repeatable)")
+    parser.add_argument("--scales", default="1,2,4,8,16", help="comma separated multiples of each benchmark's base size")
+    parser.add_argument("--runs", type=int, default=3, help="runs per size, the fastest one is reported")
+    parser.add_argument("--json", help="also write the results to this file")
+    parser.add_argument("--generate", nargs=2, metavar=("BENCH", "N"), help="print the generated program and exit")
+    args = parser.parse_args()
+
+    if args.generate:
+        name, n = args.generate
+        generate, _ = GENERATORS[name]
+        sys.stdout.write(generate(int(n)))
+        return 0
+
+    scales = [int(s) for s in args.scales.split(",")]
+    names = args.bench or list(GENERATORS.keys())
+    json_results = []
+    num_super_linear = 0
+    for name in names:
+        for opt_level in OPT_LEVELS:
+            if not run_benchmark(args.minic, name, opt_level, scales, args.runs, json_results):
+                num_super_linear += 1
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(json_results, f, indent=2)
+
+    print("Scaling is linear" if num_super_linear == 0 else f"Super-linear benchmarks: {num_super_linear}")
+    return 0 if num_super_linear == 0 else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,3 +1,4 @@
+import argparse
 import glob
 import os
 import subprocess
@@ -7,10 +8,13 @@ COLOR_RED = "\033[91m"
 COLOR_GREEN = "\033[92m"
 COLOR_END = "\033[0m"
 
+# Every test is compiled once per optimization level.
+OPT_LEVELS = ["-O0", "-O1"]
 
-def run_test(c_file, verbose):
+
+def run_test(c_file, opt_level, verbose):
     # Compile with minic
-    compile_cmd = [".\\bin\\minic", c_file]
+    compile_cmd = [".\\bin\\minic", opt_level, c_file]
     try:
         compile_result = subprocess.run(compile_cmd, capture_output=True)
     except subprocess.CalledProcessError:
@@ -21,7 +25,7 @@ def run_test(c_file, verbose):
     if compile_result.returncode != 0:
         test_passed = False
         status = f"{COLOR_GREEN}PASS{COLOR_END}" if test_passed else f"{COLOR_RED}FAIL{COLOR_END}"
-        print(f"{c_file + ' ':.<40} {status}")
+        print(f"{c_file + ' ' + opt_level + ' ':.<40} {status}")
 
         if verbose:
             print("Failed to compile")
@@ -50,7 +54,7 @@ def run_test(c_file, verbose):
 
     test_passed = actual_result == expected_output
     status = f"{COLOR_GREEN}PASS{COLOR_END}" if test_passed else f"{COLOR_RED}FAIL{COLOR_END}"
-    print(f"{c_file + ' ':.<40} {status}")
+    print(f"{c_file + ' ' + opt_level + ' ':.<40} {status}")
 
     if not test_passed and verbose:
         print("Differences (expected vs actual)")
@@ -70,12 +74,17 @@ def run_test(c_file, verbose):
 
 
 def main():
-    c_files = glob.glob(os.path.join(".\\tests", "*.c"))
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--file", help="only run this test")
+    args = parser.parse_args()
+
+    c_files = [args.file] if args.file else glob.glob(os.path.join(".\\tests", "*.c"))
     num_failed = 0
     for c_file in c_files:
-        test_passed = run_test(c_file, verbose=True)
-        if not test_passed:
-            num_failed += 1
+        for opt_level in OPT_LEVELS:
+            test_passed = run_test(c_file, opt_level, verbose=True)
+            if not test_passed:
+                num_failed += 1
 
     minic_size_bytes = os.path.getsize("bin\minic.exe")
     minic_size_kbytes = minic_size_bytes / 1024